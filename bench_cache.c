@@ -0,0 +1,177 @@
+/*
+ * BENCH_CACHE.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * Thundering-herd benchmark: many threads find the same files expired at
+ * once, round after round. Compares every thread reading the source itself
+ * against fetch_file_cache(), where one read per file is shared.
+ *
+ * usage: ./bench [threads] [files] [rounds] [KB per file]
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "cache.h"
+
+#define BENCH_NAME_LEN 32
+
+typedef struct bench_t {
+    C_T cache; // NULL: every thread reads the sources itself
+    int files;
+    int rounds;
+    char (*names)[BENCH_NAME_LEN];
+    pthread_barrier_t start, done; // bracket each round
+    uint64_t naive_reads; // reads by every thread, without a cache
+    pthread_mutex_t lock; // guards naive_reads
+} bench_t;
+
+
+/* bench_worker()
+ * @brief   thread body: in each round, fetches every file once, starting
+ *          at a different file than its neighbours
+ */
+static void *bench_worker(void *arg)
+{
+    bench_t *b = (bench_t *)arg;
+    static int next_id = 0;
+    int id = __sync_fetch_and_add(&next_id, 1);
+    int r, i;
+
+    for (r = 0; r < b->rounds; r++) {
+        pthread_barrier_wait(&b->start);
+
+        for (i = 0; i < b->files; i++) {
+            char *name = b->names[(i + id) % b->files];
+
+            if (b->cache != NULL) {
+                fetch_file_cache(b->cache, name, 600, -1);
+                continue;
+            }
+
+            unsigned char *buffer = NULL;
+            file_meta_t meta;
+            read_file_with_meta(name, &buffer, &meta);
+            free(buffer);
+
+            pthread_mutex_lock(&b->lock);
+            b->naive_reads++;
+            pthread_mutex_unlock(&b->lock);
+        }
+
+        pthread_barrier_wait(&b->done);
+    }
+
+    return NULL;
+}
+
+
+/* run_bench()
+ * @brief   runs every round with the given number of threads: before each
+ *          round, rewrites every file and (with a cache) expires it
+ * @returns number of source reads made
+ */
+static uint64_t run_bench(bench_t *b, int threads, int kb, double *secs)
+{
+    pthread_t *tids = malloc(threads * sizeof(pthread_t));
+    unsigned char *data = malloc(kb * 1024);
+    struct timespec t0, t1;
+    int r, i;
+
+    pthread_barrier_init(&b->start, NULL, threads + 1);
+    pthread_barrier_init(&b->done, NULL, threads + 1);
+    b->naive_reads = 0;
+
+    for (i = 0; i < threads; i++)
+        pthread_create(&tids[i], NULL, bench_worker, b);
+
+    double elapsed = 0;
+    for (r = 0; r < b->rounds; r++) {
+        for (i = 0; i < b->files; i++) {
+            memset(data, 'a' + (r % 26), kb * 1024);
+            write_buf_into_file(b->names[i], data, kb * 1024 - (r % 2));
+            if (b->cache != NULL) {
+                lock_cache(b->cache);
+                expire_item_cache(b->cache, b->names[i]);
+                unlock_cache(b->cache);
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        pthread_barrier_wait(&b->start);
+        pthread_barrier_wait(&b->done);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+
+        elapsed += (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    }
+
+    for (i = 0; i < threads; i++)
+        pthread_join(tids[i], NULL);
+
+    pthread_barrier_destroy(&b->start);
+    pthread_barrier_destroy(&b->done);
+    free(data);
+    free(tids);
+
+    *secs = elapsed;
+    if (b->cache != NULL)
+        return stats_of_cache(b->cache)->fetch_loads;
+    return b->naive_reads;
+}
+
+
+int main(int argc, char **argv)
+{
+    int threads = (argc > 1) ? atoi(argv[1]) : 16;
+    int files = (argc > 2) ? atoi(argv[2]) : 8;
+    int rounds = (argc > 3) ? atoi(argv[3]) : 20;
+    int kb = (argc > 4) ? atoi(argv[4]) : 256;
+
+    if (threads < 1 || files < 1 || rounds < 1 || kb < 1) {
+        fprintf(stderr, "usage: %s [threads] [files] [rounds] [KB]\n",
+                argv[0]);
+        return 1;
+    }
+
+    bench_t b;
+    b.files = files;
+    b.rounds = rounds;
+    b.names = malloc(files * BENCH_NAME_LEN);
+    pthread_mutex_init(&b.lock, NULL);
+
+    int i;
+    for (i = 0; i < files; i++)
+        snprintf(b.names[i], BENCH_NAME_LEN, "bench_%d.dat", i);
+
+    double naive_secs, flight_secs;
+
+    b.cache = NULL;
+    uint64_t naive = run_bench(&b, threads, kb, &naive_secs);
+
+    b.cache = (C_T)create_cache(files);
+    uint64_t loads = run_bench(&b, threads, kb, &flight_secs);
+
+    double per = (double)(files * rounds);
+    printf("%d threads, %d files x %d KB, %d rounds\n", threads, files, kb,
+           rounds);
+    printf("naive:         %8lu source reads (%.2f per file per round), "
+           "%.3fs\n", naive, naive / per, naive_secs);
+    printf("single-flight: %8lu source reads (%.2f per file per round), "
+           "%.3fs, %lu shared\n", loads, loads / per, flight_secs,
+           stats_of_cache(b.cache)->fetch_shared);
+
+    free_cache(b.cache);
+    for (i = 0; i < files; i++)
+        delete_file(b.names[i]);
+    free(b.names);
+    pthread_mutex_destroy(&b.lock);
+
+    return 0;
+}
@@ -0,0 +1,189 @@
+/*
+ * BENCH_DIO.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * Read-path benchmark for big files: reads a file whole (as a PUT does),
+ * then in 64 KB ranges (as chunked GETs do), first through the page cache
+ * and then with O_DIRECT (see enable_direct_file_sys), each from a cold
+ * start. For each, it reports throughput, how much the process's RSS grew
+ * while the data was held, and how much of the file the page cache kept
+ * afterwards: with buffered reads, that's a second copy of the data.
+ *
+ * usage: ./bench_dio <file> [rounds]
+ *
+ */
+
+#define _GNU_SOURCE // mincore()
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "file_sys.h"
+
+#define BENCH_RANGE (64 * 1024) // bytes per range read
+
+
+/* now_sec()
+ * @brief   returns a monotonic time, in seconds
+ */
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/* rss_bytes()
+ * @brief   returns the process's resident set size, from /proc/self/statm
+ */
+static long rss_bytes(void)
+{
+    long pages = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp != NULL) {
+        if (fscanf(fp, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(fp);
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+
+/* drop_cached()
+ * @brief   asks the kernel to drop the file's pages from the page cache,
+ *          so the next read starts cold
+ */
+static void drop_cached(char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+
+/* cached_bytes()
+ * @brief   returns how many bytes of the file are in the page cache, by
+ *          mapping it and asking mincore()
+ */
+static long cached_bytes(char *path, long len)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    long pages = (len + page - 1) / page;
+    int fd = open(path, O_RDONLY);
+    if (fd == -1 || len == 0) {
+        if (fd != -1)
+            close(fd);
+        return 0;
+    }
+
+    void *map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return 0;
+
+    unsigned char *vec = malloc(pages);
+    long resident = 0, i;
+    if (mincore(map, len, vec) == 0)
+        for (i = 0; i < pages; i++)
+            resident += vec[i] & 1;
+
+    free(vec);
+    munmap(map, len);
+    return resident * page;
+}
+
+
+/* run_mode()
+ * @brief   reads path whole, then in ranges, rounds times each from a cold
+ *          page cache, and prints one line for each
+ * @param   label: "buffered" or "direct"
+ */
+static void run_mode(char *path, int rounds, char *label)
+{
+    file_meta_t meta;
+    double whole_secs = 0, range_secs = 0;
+    long grown = 0, cached = 0, range_cached = 0;
+    long len = 0;
+    int r;
+
+    for (r = 0; r < rounds; r++) {
+        drop_cached(path);
+        long before = rss_bytes();
+
+        unsigned char *data = NULL;
+        double start = now_sec();
+        len = read_file_with_meta(path, &data, &meta);
+        whole_secs += now_sec() - start;
+
+        grown = rss_bytes() - before;
+        cached = cached_bytes(path, len);
+        free(data);
+        if (len < 0) {
+            fprintf(stderr, "can't read %s\n", path);
+            return;
+        }
+    }
+
+    unsigned char *buf = malloc(BENCH_RANGE);
+    for (r = 0; r < rounds; r++) {
+        drop_cached(path);
+
+        double start = now_sec();
+        long off;
+        for (off = 0; off < len; off += BENCH_RANGE)
+            read_file_range(path, off, buf, BENCH_RANGE, &meta);
+        range_secs += now_sec() - start;
+
+        range_cached = cached_bytes(path, len);
+    }
+    free(buf);
+
+    double mb = (double)len * rounds / (1024 * 1024);
+    printf("%-9s whole: %7.0f MB/s, RSS +%6.1f MB, page cache %6.1f MB | "
+           "%d KB ranges: %7.0f MB/s, page cache %6.1f MB\n", label,
+           mb / whole_secs, grown / 1048576.0, cached / 1048576.0,
+           BENCH_RANGE / 1024, mb / range_secs, range_cached / 1048576.0);
+}
+
+
+int main(int argc, char **argv)
+{
+    int rounds = (argc > 2) ? atoi(argv[2]) : 3;
+
+    if (argc < 2 || rounds < 1) {
+        fprintf(stderr, "usage: %s <file> [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    file_meta_t meta;
+    if (stat_file_meta(argv[1], &meta) == -1) {
+        fprintf(stderr, "can't stat %s\n", argv[1]);
+        return 1;
+    }
+    printf("%s: %.1f MB, %d rounds, cold page cache each round\n", argv[1],
+           meta.size / 1048576.0, rounds);
+
+    run_mode(argv[1], rounds, "buffered");
+
+    enable_direct_file_sys(1);
+    run_mode(argv[1], rounds, "direct");
+
+    direct_stats_t st;
+    stats_direct_file_sys(&st);
+    printf("direct: %lu reads (%lu bytes), %lu fell back to the page cache, "
+           "%lu waited for a bounce buffer\n", st.reads, st.bytes,
+           st.fallbacks, st.pool_waits);
+    return 0;
+}
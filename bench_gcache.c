@@ -0,0 +1,112 @@
+/*
+ * BENCH_GCACHE.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * Eviction policy benchmark (see gcache.h). Times full victim scans over
+ * the same entries, none expired, as a full cache runs on every miss: with
+ * gcache_a0 and gcache_lru called by name, and with gcache_a0's visit()
+ * called through a function pointer, as a policy chosen at run time would
+ * be.
+ *
+ * usage: ./bench_gcache [entries] [scans]
+ *
+ */
+
+#define _POSIX_C_SOURCE 199309L // clock_gettime()
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "gcache.h"
+
+#define BENCH_MAX_AGE 3600
+
+// an entry's stamps, as a policy sees them
+typedef struct bench_stamps_t {
+    clock_t created, expiration, last_retrieved;
+} bench_stamps_t;
+
+// gcache_a0, with visit() called through a pointer the compiler can't see
+// through
+typedef gcache_a0_t bench_ptr_t;
+static int (*volatile bench_visit_fn)(gcache_a0_t *, void *, clock_t,
+                                      clock_t, clock_t) = gcache_a0_visit;
+#define bench_ptr_start gcache_a0_start
+#define bench_ptr_visit(s, item, created, expiration, last_retrieved) \
+    (bench_visit_fn((s), (item), (created), (expiration), (last_retrieved)))
+#define bench_ptr_pick gcache_a0_pick
+
+
+/* now_sec()
+ * @brief   returns a monotonic time, in seconds
+ */
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+/* SCAN()
+ * @brief   times scans (full scans) of entries[0..n) by policy, and prints
+ *          one line for them
+ */
+#define SCAN(policy, label, entries, n, scans)                                \
+    do {                                                                      \
+        long picked = 0;                                                      \
+        int s, e;                                                             \
+        double start = now_sec();                                             \
+        for (s = 0; s < (scans); s++) {                                       \
+            policy##_t scan;                                                  \
+            policy##_start(&scan, 2 * (clock_t)(n) + 2);                      \
+            for (e = 0; e < (n); e++)                                         \
+                if (policy##_visit(&scan, &(entries)[e],                      \
+                                   (entries)[e].created,                      \
+                                   (entries)[e].expiration,                   \
+                                   (entries)[e].last_retrieved))              \
+                    break;                                                    \
+            picked += (bench_stamps_t *)policy##_pick(&scan, (entries))       \
+                      - (entries);                                            \
+        }                                                                     \
+        double secs = now_sec() - start;                                      \
+        printf("%-24s %8.1f ns/entry (victims sum %ld)\n", label,             \
+               secs * 1e9 / ((double)(scans) * (n)), picked);                 \
+    } while (0)
+
+
+int main(int argc, char **argv)
+{
+    int entries = (argc > 1) ? atoi(argv[1]) : 256;
+    int scans = (argc > 2) ? atoi(argv[2]) : 100000;
+    int i;
+
+    if (entries < 1 || scans < 1) {
+        fprintf(stderr, "usage: %s [entries] [scans]\n", argv[0]);
+        return 1;
+    }
+
+    // put in order, none expired by the scans' 'now'; a third never
+    // retrieved, the rest retrieved at random times
+    bench_stamps_t *stamps = malloc(entries * sizeof(bench_stamps_t));
+    srand(112);
+    for (i = 0; i < entries; i++) {
+        stamps[i].created = i + 1;
+        stamps[i].expiration = gcache_expires(stamps[i].created,
+                                              BENCH_MAX_AGE);
+        stamps[i].last_retrieved = (i % 3 == 0) ? 0
+                                   : entries + 1 + rand() % entries;
+    }
+
+    printf("%d entries, %d scans\n", entries, scans);
+    SCAN(gcache_a0, "scan, gcache_a0:", stamps, entries, scans);
+    SCAN(gcache_lru, "scan, gcache_lru:", stamps, entries, scans);
+    SCAN(bench_ptr, "scan, visit by pointer:", stamps, entries, scans);
+
+    free(stamps);
+    return 0;
+}
@@ -0,0 +1,349 @@
+/*
+ * BENCH_HTTP.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * Loopback benchmark for the cache server's HTTP proxy mode: starts a stub
+ * origin (see stub_origin.h) and a proxy in front of it, both on Unix
+ * sockets, then runs the same pipelined GETs straight at the origin, and
+ * through the (warmed) proxy, and reports throughput and latency for each.
+ *
+ * usage: ./bench_http [connections] [GETs per connection] [depth]
+ *        [KB per object] [objects] [origin delay, us]
+ *
+ */
+
+#define _GNU_SOURCE // memmem()
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "stub_origin.h"
+
+#define BENCH_ORIGIN "bench_origin.sock"
+#define BENCH_PROXY "bench_proxy.sock"
+#define BENCH_READ_BUF (256 * 1024)
+#define BENCH_REQ_MAX 64 // longest request the bench sends
+
+typedef struct bench_t {
+    char *target; // Unix socket to send GETs to
+    int gets; // GETs per connection
+    int depth; // GETs sent before reading their responses
+    int objects;
+} bench_t;
+
+// one connection's results
+typedef struct bench_conn_t {
+    bench_t *b;
+    int id;
+    double *latency; // per GET, in microseconds
+    uint64_t bytes; // bytes of body received
+    int errors; // GETs not answered with a 200
+} bench_conn_t;
+
+// the proxy, run on its own thread
+typedef struct proxy_t {
+    sim_opts_t opts;
+    int size; // cache size
+} proxy_t;
+
+// a buffered reader over a socket
+typedef struct reader_t {
+    int fd;
+    char buf[BENCH_READ_BUF];
+    size_t pos, len;
+} reader_t;
+
+
+/* now_us()
+ * @brief   returns a monotonic time, in microseconds
+ */
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+
+/* connect_to()
+ * @brief   connects to the Unix socket at path, waiting up to 2 sec for it
+ *          to start listening
+ * @returns the connected socket, or -1
+ */
+static int connect_to(char *path)
+{
+    struct sockaddr_un addr = { 0 };
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    int tries;
+    for (tries = 0; tries < 200; tries++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            return fd;
+        close(fd);
+        usleep(10000);
+    }
+    return -1;
+}
+
+
+/* read_response()
+ * @brief   reads one response: its head, then the Content-Length bytes of
+ *          body that follow (which are skipped)
+ * @param   r: the connection's reader
+ * @param   len: set to the body's length, or -1 if the status isn't 200
+ * @returns 0, or -1 if the connection closed
+ */
+static int read_response(reader_t *r, int *len)
+{
+    char *end;
+
+    // the head, which is assumed to fit in the buffer
+    while ((end = memmem(r->buf + r->pos, r->len - r->pos, "\r\n\r\n", 4))
+            == NULL) {
+        memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+        r->len -= r->pos;
+        r->pos = 0;
+
+        ssize_t n = read(r->fd, r->buf + r->len, BENCH_READ_BUF - r->len);
+        if (n <= 0)
+            return -1;
+        r->len += n;
+    }
+
+    char *head = r->buf + r->pos;
+    *end = '\0';
+    int status = atoi(head + 9);
+    int body = 0;
+
+    char *line;
+    for (line = strstr(head, "\r\n"); line != NULL;
+            line = strstr(line + 2, "\r\n"))
+        if (strncasecmp(line + 2, "Content-Length:", 15) == 0)
+            body = atoi(line + 17);
+    r->pos = end + 4 - r->buf;
+    *len = (status == 200) ? body : -1;
+
+    // skip the body
+    size_t left = body;
+    while (left > 0) {
+        if (r->pos == r->len) {
+            ssize_t n = read(r->fd, r->buf, BENCH_READ_BUF);
+            if (n <= 0)
+                return -1;
+            r->pos = 0;
+            r->len = n;
+        }
+
+        size_t take = r->len - r->pos;
+        if (take > left)
+            take = left;
+        r->pos += take;
+        left -= take;
+    }
+
+    return 0;
+}
+
+
+/* bench_conn()
+ * @brief   thread body: one connection, sending its GETs depth at a time;
+ *          each GET's latency runs from when its group was sent until its
+ *          response has been read in full
+ */
+static void *bench_conn(void *arg)
+{
+    bench_conn_t *c = (bench_conn_t *)arg;
+    bench_t *b = c->b;
+    reader_t *r = malloc(sizeof(reader_t));
+    char *req = malloc(b->depth * BENCH_REQ_MAX);
+    int sent = 0;
+
+    r->fd = connect_to(b->target);
+    r->pos = r->len = 0;
+    if (r->fd == -1) {
+        fprintf(stderr, "connection %d: can't connect to %s\n", c->id,
+                b->target);
+        c->errors = b->gets;
+        free(req);
+        free(r);
+        return NULL;
+    }
+
+    while (sent < b->gets) {
+        int group = (b->gets - sent < b->depth) ? b->gets - sent : b->depth;
+        size_t req_len = 0;
+        int i;
+
+        for (i = 0; i < group; i++) {
+            int obj = (c->id * 7919 + sent + i) % b->objects;
+            req_len += sprintf(req + req_len, "GET /obj/%d HTTP/1.1\r\n"
+                               "Host: bench\r\n\r\n", obj);
+        }
+
+        double start = now_us();
+        if (write(r->fd, req, req_len) != (ssize_t)req_len)
+            break;
+
+        for (i = 0; i < group; i++) {
+            int len;
+            if (read_response(r, &len) == -1)
+                break;
+            c->latency[sent + i] = now_us() - start;
+            if (len == -1)
+                c->errors++;
+            else
+                c->bytes += len;
+        }
+        if (i < group)
+            break;
+        sent += group;
+    }
+
+    if (sent < b->gets) {
+        fprintf(stderr, "connection %d: server hung up\n", c->id);
+        c->errors += b->gets - sent;
+    }
+
+    close(r->fd);
+    free(req);
+    free(r);
+    return NULL;
+}
+
+
+/* cmp_double()
+ * @brief   qsort comparator for doubles
+ */
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+
+/* run_pass()
+ * @brief   runs conns connections' GETs against target, and prints the
+ *          results under label
+ */
+static void run_pass(bench_t *b, int conns, char *label)
+{
+    pthread_t *threads = malloc(conns * sizeof(pthread_t));
+    bench_conn_t *args = calloc(conns, sizeof(bench_conn_t));
+    double *latency = malloc((size_t)conns * b->gets * sizeof(double));
+    int i;
+
+    double start = now_us();
+    for (i = 0; i < conns; i++) {
+        args[i].b = b;
+        args[i].id = i;
+        args[i].latency = latency + (size_t)i * b->gets;
+        pthread_create(&threads[i], NULL, bench_conn, &args[i]);
+    }
+
+    uint64_t bytes = 0;
+    int errors = 0;
+    for (i = 0; i < conns; i++) {
+        pthread_join(threads[i], NULL);
+        bytes += args[i].bytes;
+        errors += args[i].errors;
+    }
+    double secs = (now_us() - start) / 1e6;
+
+    size_t total = (size_t)conns * b->gets;
+    qsort(latency, total, sizeof(double), cmp_double);
+
+    printf("%-7s %.0lf GETs/s, %.1lf MB/s, %d errors; latency (us): "
+           "p50 %.1lf, p99 %.1lf, max %.1lf\n", label, total / secs,
+           bytes / secs / (1024 * 1024), errors, latency[total / 2],
+           latency[total * 99 / 100], latency[total - 1]);
+
+    free(latency);
+    free(args);
+    free(threads);
+}
+
+
+/* serve_proxy()
+ * @brief   thread body: runs the proxy until stop_cache_server()
+ */
+static void *serve_proxy(void *arg)
+{
+    proxy_t *p = (proxy_t *)arg;
+    run_cache_server(p->size, &p->opts);
+    return NULL;
+}
+
+
+int main(int argc, char **argv)
+{
+    bench_t b;
+    int conns = (argc > 1) ? atoi(argv[1]) : 4;
+    b.gets = (argc > 2) ? atoi(argv[2]) : 50000;
+    b.depth = (argc > 3) ? atoi(argv[3]) : 16;
+    int kb = (argc > 4) ? atoi(argv[4]) : 4;
+    b.objects = (argc > 5) ? atoi(argv[5]) : 64;
+    int delay_us = (argc > 6) ? atoi(argv[6]) : 0;
+    uint64_t before, after;
+
+    if (conns < 1 || b.gets < 1 || b.depth < 1 || kb < 0 || b.objects < 1
+            || delay_us < 0) {
+        fprintf(stderr, "usage: %s [connections] [GETs per connection] "
+                "[depth] [KB per object] [objects] [origin delay, us]\n",
+                argv[0]);
+        return 1;
+    }
+
+    STUB_T stub = start_stub_origin(BENCH_ORIGIN, b.objects, kb * 1024,
+                                    3600, delay_us);
+    if (stub == NULL) {
+        fprintf(stderr, "can't start the stub origin\n");
+        return 1;
+    }
+
+    // a proxy with room for every object; its stdout is left alone
+    proxy_t p = { { 0 }, b.objects };
+    p.opts.unix_path = BENCH_PROXY;
+    p.opts.origin = BENCH_ORIGIN;
+    p.opts.verbose = 1;
+    pthread_t proxy;
+    pthread_create(&proxy, NULL, serve_proxy, &p);
+
+    printf("%d connections x %d GETs (depth %d) of %d objects x %d KB, "
+           "origin delay %d us\n", conns, b.gets, b.depth, b.objects, kb,
+           delay_us);
+
+    b.target = BENCH_ORIGIN;
+    run_pass(&b, conns, "origin:");
+
+    // warm the proxy with one GET per object, then measure it
+    bench_t warm = { BENCH_PROXY, b.objects, b.depth, b.objects };
+    bench_conn_t warm_conn = { &warm, 0, NULL, 0, 0 };
+    warm_conn.latency = malloc(b.objects * sizeof(double));
+    bench_conn(&warm_conn);
+    free(warm_conn.latency);
+
+    before = served_stub_origin(stub, NULL);
+    b.target = BENCH_PROXY;
+    run_pass(&b, conns, "proxy:");
+    after = served_stub_origin(stub, NULL);
+    printf("        %lu requests reached the origin through the proxy\n",
+           after - before);
+
+    stop_cache_server();
+    pthread_join(proxy, NULL);
+    stop_stub_origin(stub);
+    return 0;
+}
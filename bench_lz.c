@@ -0,0 +1,108 @@
+/*
+ * BENCH_LZ.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * Compression benchmark (see lz.h): for each file, how much the cache's
+ * codec shrinks it, and how fast it packs and unpacks, both in one go
+ * (unpack_lz) and a block at a time into a null sink, as a GET of a
+ * compressed file is written. The total shows how many more files of the
+ * same mix fit in the same memory, with the cache's default -Z cutoff.
+ *
+ * usage: ./bench_lz [rounds] <file>...
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "lz.h"
+#include "sink.h"
+#include "file_sys.h"
+
+#define BENCH_RATIO 1.5 // least ratio worth keeping compressed, as -Z
+
+
+/* now_sec()
+ * @brief   returns a monotonic time, in seconds
+ */
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+int main(int argc, char **argv)
+{
+    int rounds = (argc > 1) ? atoi(argv[1]) : 0;
+
+    if (argc < 3 || rounds < 1) {
+        fprintf(stderr, "usage: %s [rounds] <file>...\n", argv[0]);
+        return 1;
+    }
+
+    S_T sink = open_sink("null");
+    uint64_t raw_total = 0, kept_total = 0;
+    int i, r;
+
+    printf("%-16s %10s %10s %6s %10s %10s %10s\n", "file", "bytes",
+           "packed", "ratio", "pack MB/s", "unpack", "to sink");
+
+    for (i = 2; i < argc; i++) {
+        unsigned char *data = NULL;
+        int len = read_file_into_buf(argv[i], &data);
+        if (len <= 0) {
+            fprintf(stderr, "can't read %s\n", argv[i]);
+            free(data);
+            continue;
+        }
+
+        unsigned char *packed = malloc(bound_lz(len));
+        unsigned char *out = malloc(len);
+        int size = 0;
+
+        double start = now_sec();
+        for (r = 0; r < rounds; r++)
+            size = pack_lz(data, len, packed);
+        double pack = now_sec() - start;
+
+        start = now_sec();
+        for (r = 0; r < rounds; r++)
+            unpack_lz(packed, size, out, len);
+        double unpack = now_sec() - start;
+
+        start = now_sec();
+        for (r = 0; r < rounds; r++)
+            write_packed_sink(sink, argv[i], packed, size, len);
+        double streamed = now_sec() - start;
+
+        if (memcmp(out, data, len) != 0)
+            fprintf(stderr, "%s didn't unpack intact\n", argv[i]);
+
+        double mb = (double)len * rounds / (1024 * 1024);
+        printf("%-16s %10d %10d %5.2fx %10.0f %10.0f %10.0f\n", argv[i],
+               len, size, (double)len / size, mb / pack, mb / unpack,
+               mb / streamed);
+
+        raw_total += len;
+        kept_total += (size * BENCH_RATIO <= len) ? (uint64_t)size : len;
+
+        free(out);
+        free(packed);
+        free(data);
+    }
+
+    if (kept_total > 0)
+        printf("kept in memory: %lu of %lu bytes, room for %.2fx the files "
+               "(-Z %.1f)\n", kept_total, raw_total,
+               (double)raw_total / kept_total, BENCH_RATIO);
+
+    close_sink(sink);
+    return 0;
+}
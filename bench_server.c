@@ -0,0 +1,353 @@
+/*
+ * BENCH_SERVER.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * Loopback benchmark for the cache server (./a.out --serve): writes a set
+ * of files, PUTs them, then has each connection send GETs for them, depth
+ * at a time (pipelined), and reports throughput and GET latency. Run it
+ * from the server's directory, so the server can read the files, with a
+ * cache of at least [files] (evictions delete their files).
+ *
+ * usage: ./bench_server <port | unix socket path> [connections] [GETs per
+ *        connection] [depth] [KB per file] [files]
+ *
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "file_sys.h"
+
+#define BENCH_NAME_LEN 32
+#define BENCH_READ_BUF (256 * 1024)
+
+typedef struct bench_t {
+    char *target; // port number, or Unix socket path
+    int gets; // GETs per connection
+    int depth; // GETs sent before reading their answers
+    int files;
+    char (*names)[BENCH_NAME_LEN];
+} bench_t;
+
+// one connection's results
+typedef struct bench_conn_t {
+    bench_t *b;
+    int id;
+    double *latency; // per GET, in microseconds
+    uint64_t bytes; // bytes of data received
+    int misses; // GETs answered MISS (or otherwise not OK)
+} bench_conn_t;
+
+// a buffered reader over a socket
+typedef struct reader_t {
+    int fd;
+    char buf[BENCH_READ_BUF];
+    size_t pos, len;
+} reader_t;
+
+
+/* now_us()
+ * @brief   returns a monotonic time, in microseconds
+ */
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+
+/* connect_to()
+ * @brief   connects to the server: over TCP on 127.0.0.1 if target is a
+ *          port number, otherwise to the Unix socket at target
+ * @returns the connected socket, or -1
+ */
+static int connect_to(char *target)
+{
+    int fd;
+
+    if (strspn(target, "0123456789") == strlen(target)) {
+        struct sockaddr_in addr = { 0 };
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(target));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    struct sockaddr_un addr = { 0 };
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, target, sizeof(addr.sun_path) - 1);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+/* write_all()
+ * @brief   writes len bytes, however many write() calls it takes
+ * @returns 0, or -1 on error
+ */
+static int write_all(int fd, char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+
+/* read_answer()
+ * @brief   reads one answer: its first line, and for "OK <len>", the len
+ *          bytes of data that follow (which are skipped)
+ * @param   r: the connection's reader
+ * @param   len: set to the data's length, or -1 if the answer isn't "OK"
+ * @returns 0, or -1 if the connection closed
+ */
+static int read_answer(reader_t *r, int *len)
+{
+    char line[64];
+    size_t line_len = 0;
+
+    // the answer's first line
+    while (1) {
+        if (r->pos == r->len) {
+            ssize_t n = read(r->fd, r->buf, BENCH_READ_BUF);
+            if (n <= 0)
+                return -1;
+            r->pos = 0;
+            r->len = n;
+        }
+
+        char c = r->buf[r->pos++];
+        if (c == '\n')
+            break;
+        if (line_len < sizeof(line) - 1)
+            line[line_len++] = c;
+    }
+    line[line_len] = '\0';
+
+    *len = -1;
+    if (strncmp(line, "OK ", 3) != 0)
+        return 0;
+    *len = atoi(line + 3);
+
+    // skip the data
+    size_t left = *len;
+    while (left > 0) {
+        if (r->pos == r->len) {
+            ssize_t n = read(r->fd, r->buf, BENCH_READ_BUF);
+            if (n <= 0)
+                return -1;
+            r->pos = 0;
+            r->len = n;
+        }
+
+        size_t take = r->len - r->pos;
+        if (take > left)
+            take = left;
+        r->pos += take;
+        left -= take;
+    }
+
+    return 0;
+}
+
+
+/* bench_conn()
+ * @brief   thread body: one connection, sending its GETs depth at a time;
+ *          each GET's latency runs from when its group was sent until its
+ *          answer has been read in full
+ */
+static void *bench_conn(void *arg)
+{
+    bench_conn_t *c = (bench_conn_t *)arg;
+    bench_t *b = c->b;
+    reader_t *r = malloc(sizeof(reader_t));
+    char *req = malloc(b->depth * (BENCH_NAME_LEN + 8));
+    int sent = 0;
+
+    r->fd = connect_to(b->target);
+    r->pos = r->len = 0;
+    if (r->fd == -1) {
+        fprintf(stderr, "connection %d: can't connect to %s\n", c->id,
+                b->target);
+        c->misses = b->gets;
+        free(req);
+        free(r);
+        return NULL;
+    }
+
+    while (sent < b->gets) {
+        int group = (b->gets - sent < b->depth) ? b->gets - sent : b->depth;
+        size_t req_len = 0;
+        int i;
+
+        for (i = 0; i < group; i++) {
+            int f = (c->id * 7919 + sent + i) % b->files;
+            req_len += sprintf(req + req_len, "GET: %s\n", b->names[f]);
+        }
+
+        double start = now_us();
+        if (write_all(r->fd, req, req_len) == -1)
+            break;
+
+        for (i = 0; i < group; i++) {
+            int len;
+            if (read_answer(r, &len) == -1)
+                break;
+            c->latency[sent + i] = now_us() - start;
+            if (len == -1)
+                c->misses++;
+            else
+                c->bytes += len;
+        }
+        if (i < group)
+            break;
+        sent += group;
+    }
+
+    if (sent < b->gets) {
+        fprintf(stderr, "connection %d: server hung up\n", c->id);
+        c->misses += b->gets - sent;
+    }
+
+    close(r->fd);
+    free(req);
+    free(r);
+    return NULL;
+}
+
+
+/* cmp_double()
+ * @brief   qsort comparator for doubles
+ */
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <port | unix socket path> [connections] "
+                "[GETs per connection] [depth] [KB per file] [files]\n",
+                argv[0]);
+        return 1;
+    }
+
+    bench_t b;
+    b.target = argv[1];
+    int conns = (argc > 2) ? atoi(argv[2]) : 4;
+    b.gets = (argc > 3) ? atoi(argv[3]) : 100000;
+    b.depth = (argc > 4) ? atoi(argv[4]) : 16;
+    int kb = (argc > 5) ? atoi(argv[5]) : 4;
+    b.files = (argc > 6) ? atoi(argv[6]) : 64;
+    int i;
+
+    if (conns < 1 || b.gets < 1 || b.depth < 1 || kb < 0 || b.files < 1) {
+        fprintf(stderr, "bad arguments\n");
+        return 1;
+    }
+
+    // the files, and one connection to PUT them all
+    b.names = malloc(b.files * BENCH_NAME_LEN);
+    unsigned char *data = malloc(kb * 1024 + 1);
+    memset(data, 'x', kb * 1024);
+
+    int fd = connect_to(b.target);
+    if (fd == -1) {
+        fprintf(stderr, "can't connect to %s\n", b.target);
+        return 1;
+    }
+
+    reader_t *r = malloc(sizeof(reader_t));
+    r->fd = fd;
+    r->pos = r->len = 0;
+    for (i = 0; i < b.files; i++) {
+        char req[BENCH_NAME_LEN + 32];
+        int len;
+
+        snprintf(b.names[i], BENCH_NAME_LEN, "bench_srv_%d.dat", i);
+        write_buf_into_file(b.names[i], data, kb * 1024);
+        sprintf(req, "PUT: %s\\MAX-AGE: 3600\n", b.names[i]);
+        if (write_all(fd, req, strlen(req)) == -1
+                || read_answer(r, &len) == -1) {
+            fprintf(stderr, "server hung up during PUTs\n");
+            return 1;
+        }
+    }
+    close(fd);
+    free(r);
+
+    pthread_t *threads = malloc(conns * sizeof(pthread_t));
+    bench_conn_t *args = calloc(conns, sizeof(bench_conn_t));
+    double *latency = malloc((size_t)conns * b.gets * sizeof(double));
+
+    double start = now_us();
+    for (i = 0; i < conns; i++) {
+        args[i].b = &b;
+        args[i].id = i;
+        args[i].latency = latency + (size_t)i * b.gets;
+        pthread_create(&threads[i], NULL, bench_conn, &args[i]);
+    }
+
+    uint64_t bytes = 0;
+    int misses = 0;
+    for (i = 0; i < conns; i++) {
+        pthread_join(threads[i], NULL);
+        bytes += args[i].bytes;
+        misses += args[i].misses;
+    }
+    double secs = (now_us() - start) / 1e6;
+
+    size_t total = (size_t)conns * b.gets;
+    qsort(latency, total, sizeof(double), cmp_double);
+
+    printf("%d connections x %d GETs (depth %d) of %d files x %d KB: "
+           "%.3lf s\n", conns, b.gets, b.depth, b.files, kb, secs);
+    printf("  %.0lf GETs/s, %.1lf MB/s of data, %d misses\n", total / secs,
+           bytes / secs / (1024 * 1024), misses);
+    printf("  latency (us): p50 %.1lf, p99 %.1lf, max %.1lf\n",
+           latency[total / 2], latency[total * 99 / 100],
+           latency[total - 1]);
+
+    for (i = 0; i < b.files; i++)
+        delete_file(b.names[i]);
+
+    free(latency);
+    free(args);
+    free(threads);
+    free(data);
+    free(b.names);
+    return 0;
+}
@@ -0,0 +1,210 @@
+/*
+ * BLOOM.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ */
+
+#include <math.h>
+
+#include "bloom.h"
+#include "hash.h"
+
+#define BLOOM_MAX_COUNT 255 // saturated counters are never decremented
+#define BLOOM_MIN_SAMPLE 64 // lookups seen before judging the fp rate
+
+struct bloom_t {
+    uint8_t *counters;
+    uint32_t m; // number of counters
+    int k; // counters touched per key
+
+    int expected; // number of keys the filter was sized for
+    int keys; // keys currently in the filter
+    int saturated; // counters stuck at BLOOM_MAX_COUNT
+    double fp_rate; // target false-positive rate
+
+    uint64_t negatives; // lookups answered "definitely absent"
+    uint64_t false_pos; // "maybe" answers for absent keys
+};
+
+
+/* create_bloom()
+ * @brief   initializes a new counting bloom filter
+ * @param   expected    number of keys the filter should hold
+ * @param   fp_rate     target false-positive rate, in (0, 1)
+ * @returns a struct bloom_t pointer, or NULL if arguments are invalid
+ * @note    uses the usual sizing: m = -n ln(p) / ln(2)^2, k = (m / n) ln(2)
+ */
+B_T create_bloom(int expected, double fp_rate)
+{
+    if (expected < 1 || fp_rate <= 0 || fp_rate >= 1)
+        return NULL;
+
+    double ln2 = log(2.0);
+    double m = ceil(-(double)expected * log(fp_rate) / (ln2 * ln2));
+    int k = (int)round((m / expected) * ln2);
+
+    if (m < 64)
+        m = 64;
+    if (k < 1)
+        k = 1;
+
+    B_T bloom = malloc(sizeof(struct bloom_t));
+    bloom->m = (uint32_t)m;
+    bloom->k = k;
+    bloom->counters = calloc(bloom->m, sizeof(uint8_t));
+    bloom->expected = expected;
+    bloom->keys = 0;
+    bloom->saturated = 0;
+    bloom->fp_rate = fp_rate;
+    bloom->negatives = 0;
+    bloom->false_pos = 0;
+
+    return bloom;
+}
+
+
+/* free_bloom()
+ * @brief   frees memory associated with a filter
+ * @param   bloom: a struct bloom_t pointer
+ */
+void free_bloom(B_T bloom)
+{
+    if (bloom == NULL)
+        return;
+
+    free(bloom->counters);
+    free(bloom);
+}
+
+
+/* add_bloom()
+ * @brief   adds key to the filter
+ * @param   bloom: a struct bloom_t pointer
+ * @param   key: key to add
+ */
+void add_bloom(B_T bloom, char *key)
+{
+    if (bloom == NULL || key == NULL)
+        return;
+
+    uint64_t h = hash_str(key);
+
+    int i;
+    for (i = 0; i < bloom->k; i++) {
+        uint8_t *c = &bloom->counters[hash_nth(h, i) % bloom->m];
+        if (*c < BLOOM_MAX_COUNT) {
+            (*c)++;
+            if (*c == BLOOM_MAX_COUNT)
+                bloom->saturated++;
+        }
+    }
+
+    bloom->keys++;
+}
+
+
+/* remove_bloom()
+ * @brief   removes a key that was previously added to the filter
+ * @param   bloom: a struct bloom_t pointer
+ * @param   key: key to remove
+ * @note    saturated counters are left alone, since their true count is
+ *          unknown; they only cost false positives until the next rebuild
+ */
+void remove_bloom(B_T bloom, char *key)
+{
+    if (bloom == NULL || key == NULL)
+        return;
+
+    uint64_t h = hash_str(key);
+
+    int i;
+    for (i = 0; i < bloom->k; i++) {
+        uint8_t *c = &bloom->counters[hash_nth(h, i) % bloom->m];
+        if (*c > 0 && *c < BLOOM_MAX_COUNT)
+            (*c)--;
+    }
+
+    bloom->keys--;
+}
+
+
+/* maybe_bloom()
+ * @brief   checks whether key may be in the filter
+ * @param   bloom: a struct bloom_t pointer
+ * @param   key: key to look for
+ * @returns 0 if key is definitely absent; 1 if it may be present
+ * @note    a NULL filter answers "maybe" for every key
+ */
+int maybe_bloom(B_T bloom, char *key)
+{
+    if (bloom == NULL || key == NULL)
+        return 1;
+
+    return maybe_hashed_bloom(bloom, hash_str(key));
+}
+
+
+/* maybe_hashed_bloom()
+ * @brief   like maybe_bloom(), for a key whose hash_str() the caller has
+ *          already computed
+ * @param   bloom: a struct bloom_t pointer
+ * @param   h: hash_str() of the key to look for
+ * @returns 0 if key is definitely absent; 1 if it may be present
+ */
+int maybe_hashed_bloom(B_T bloom, uint64_t h)
+{
+    if (bloom == NULL)
+        return 1;
+
+    int i;
+    for (i = 0; i < bloom->k; i++) {
+        if (bloom->counters[hash_nth(h, i) % bloom->m] == 0) {
+            bloom->negatives++;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+
+/* note_result_bloom()
+ * @brief   tells the filter what a "maybe" answer turned out to be
+ * @param   bloom: a struct bloom_t pointer
+ * @param   false_positive: 1 if the key wasn't actually present
+ */
+void note_result_bloom(B_T bloom, int false_positive)
+{
+    if (bloom == NULL)
+        return;
+
+    if (false_positive)
+        bloom->false_pos++;
+}
+
+
+/* degraded_bloom()
+ * @brief   checks whether the filter should be rebuilt
+ * @param   bloom: a struct bloom_t pointer
+ * @returns 1 if it holds more keys than it was sized for, has saturated
+ *          counters, or its observed false-positive rate among absent keys
+ *          is more than twice the target; otherwise 0
+ */
+int degraded_bloom(B_T bloom)
+{
+    if (bloom == NULL)
+        return 0;
+
+    if (bloom->keys > bloom->expected || bloom->saturated > 0)
+        return 1;
+
+    uint64_t absent = bloom->negatives + bloom->false_pos;
+    if (absent < BLOOM_MIN_SAMPLE)
+        return 0;
+
+    double observed = (double)bloom->false_pos / (double)absent;
+    return observed > 2 * bloom->fp_rate;
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+/*
+ * BLOOM.H
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * Counting bloom filter over cache membership. A "no" answer is exact, so
+ * lookups of absent files can skip the cache list entirely; counters
+ * (rather than bits) let files be removed again on eviction.
+ *
+ */
+
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct bloom_t *B_T;
+
+// creates a filter sized for expected keys at the given false-positive rate
+B_T create_bloom(int expected, double fp_rate);
+
+// frees memory associated with a filter
+void free_bloom(B_T bloom);
+
+// adds key to the filter
+void add_bloom(B_T bloom, char *key);
+
+// removes a key that was previously added
+void remove_bloom(B_T bloom, char *key);
+
+// returns 0 if key is definitely absent, 1 if it may be present
+int maybe_bloom(B_T bloom, char *key);
+
+// as maybe_bloom, given the key's hash_str() instead of the key
+int maybe_hashed_bloom(B_T bloom, uint64_t h);
+
+// records whether a "maybe" answer turned out to be a false positive
+void note_result_bloom(B_T bloom, int false_positive);
+
+// returns 1 if the filter no longer meets its false-positive target
+int degraded_bloom(B_T bloom);
+
+#endif
\ No newline at end of file
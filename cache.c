@@ -7,7 +7,14 @@
  * 
  */ 
 
+#include <stdarg.h>
+
 #include "cache.h"
+#include "hash.h"
+#include "gcache.h"
+
+#define INDEX_MIN 16 // fewest buckets in the name index
+#define PREFETCH_AHEAD 4 // keys ahead of use to prefetch index buckets for
 
 /*** CACHE FILE STRUCT PTR: defined in header ***/
 
@@ -15,15 +22,113 @@
 typedef struct cache_item_t {
     cache_file_t file;
     struct cache_item_t *next; // pointer to next cache_item_t 
+    struct cache_item_t *prev; // pointer to previous cache_item_t
+
+    uint64_t hash; // hash_str() of file's name
+    struct cache_item_t *chain; // next item in the same index bucket
 } *cache_item_t;
 
 
+/*** NEGATIVE ENTRY LIST-ITEM STRUCT PTR ***/
+// records a file that couldn't be read, so that requests for it can be
+// answered without another open(); kept apart from the cache list
+typedef struct neg_item_t {
+    char *name; // name of unreadable file
+    clock_t expiration; // time at which the entry must be re-checked
+    struct neg_item_t *next;
+} *neg_item_t;
+
+
+/*** BATCHED PUT READ ***/
+// a new file's data, read ahead of the batch that stores it
+typedef struct batch_read_t {
+    int read; // 1 if the file was read ahead of the batch
+    unsigned char *data; // malloc'd data; NULL if unreadable
+    int len; // length of data; -1 if unreadable
+    file_meta_t meta;
+    int spilled; // 1 if the data was taken from L2, not read from the source
+    clock_t expiration; // if spilled: when L2's copy expires
+} batch_read_t;
+
+
+/*** CHUNKS ***/
+// one chunk of a chunked file, and its place in the cache's chunk LRU
+// while it's loaded
+typedef struct chunk_t {
+    payload_t *payload; // its data; NULL until a GET touches it, or evicted
+    struct chunk_t *prev; // LRU neighbours: less recently used...
+    struct chunk_t *next; // ...and more recently used
+} chunk_t;
+
+
+/*** DEDUP STORE ***/
+#define DEDUP_BUCKETS 1024 // starting size of the store's table
+
+// a payload that files with the same data can share
+typedef struct dedup_entry_t {
+    payload_t *payload; // not a reference: the entry goes when it's freed
+    struct dedup_entry_t *next; // next in its bucket
+} dedup_entry_t;
+
+// cached payloads, by hash of their (uncompressed) data
+typedef struct dedup_t {
+    pthread_mutex_t lock; // guards the table: payloads are freed (and
+                          // forgotten) outside the cache's lock
+    dedup_entry_t **buckets;
+    uint64_t mask; // buckets - 1, a power of 2 less one
+    uint64_t entries;
+} dedup_t;
+
+
 /*** CACHE STRUCT ***/
 struct cache_t {
     cache_item_t head; // linked list representing cache items
     cache_item_t tail; // last item in linked list
     int cap; // number of filled spots (items) in cache
     int size;
+
+    cache_item_t *index; // hash buckets of items, chained by name hash
+    uint64_t index_mask; // number of buckets - 1 (a power of 2)
+
+    LFU_T admit; // TinyLFU admission sketch; NULL if admission is off
+    B_T filter; // bloom filter of cached names; NULL if filter is off
+    double filter_fp; // target false-positive rate of the filter
+
+    neg_item_t neg_head; // negative entries, oldest first
+    int neg_size; // number of negative entries
+    int neg_cap; // max negative entries; separate from cap
+    int neg_ttl; // lifetime of a negative entry (sec); 0 if off
+
+    int lazy; // 1 if PUTs defer reading file data until the first GET
+
+    R_T refresher; // background refresh worker; NULL until first needed
+    double ahead_fraction; // refresh-ahead at this fraction of max_age
+    double ahead_rate; // ...for files with at least this many GETs / sec
+
+    W_T watcher; // inotify watcher on cached sources; NULL if off
+    int watch_reload; // 1: re-read changed files; 0: just drop them
+
+    pthread_mutex_t lock; // held by whichever thread is using the cache
+    F_T flights; // loads in progress, so concurrent misses share one read
+    D_T spill; // on-disk L2 that evicted files spill to; NULL if off
+    int pack_min; // files of at least this many bytes are compressed; 0 if
+                  // compression is off
+    double pack_ratio; // ...if it shrinks them by at least this factor
+
+    int chunk_len; // files bigger than this are stored in chunks of this
+                   // many bytes; 0 if chunking is off
+    uint64_t chunk_budget; // most bytes of chunks kept loaded at once
+    uint64_t chunk_bytes; // bytes of chunks loaded now
+    chunk_t *chunk_head; // chunk LRU, least recently used first
+    chunk_t *chunk_tail;
+
+    dedup_t *dedup; // payloads by content, to share; NULL if dedup is off
+    atomic_uint_fast64_t epoch; // bumped whenever a file's data changes or
+                                // a file leaves (see epoch_of_cache)
+    cache_stats_t stats; // running hit / miss / eviction counters
+    FILE *log; // where messages about what it's doing go; NULL if off
+    clock_t (*now)(void); // its clock: every stamp and expiry check reads
+                          // it (see set_clock_cache)
 };
 // as defined in header, (struct cache_t *) is type-def'd to C_T
 
@@ -34,70 +139,157 @@ struct cache_t {
 static int find_in_cache(C_T cache, char *file_name, 
                                  cache_item_t *item_add);
 
+// as find_in_cache, given file_name's hash_str()
+static int find_hashed(C_T cache, char *file_name, uint64_t hash,
+                       cache_item_t *item_add);
+
 // creates a new cache_item_t pointer with memory for the file's buffer
-static cache_item_t new_cache_item(char *file_name, int max_age);
+static cache_item_t new_cache_item(char *file_name, int max_age, int lazy,
+                                   int chunk_len, clock_t now);
+
+// creates a new cache_item_t pointer around data that's already been read
+static cache_item_t build_cache_item(char *file_name, int max_age,
+                                     unsigned char *data, int len,
+                                     file_meta_t *meta, int loaded,
+                                     clock_t now);
+
+// appends a new item to the back of the cache list, and counts it
+static void link_item(C_T cache, cache_item_t item);
+
+// swaps a file's data for new data, dropping its reference to the old, and
+// bumps the cache's epoch (if cache isn't NULL)
+static void set_data(C_T cache, cache_file_t *file, unsigned char *data,
+                     int len);
+
+// applies a finished fetch to the cache; returns a FETCH_* outcome
+static int apply_fetch(C_T cache, refresh_result_t *job, int max_age,
+                       int lazy);
 
 // given a malloc'd cache_item_t, frees its associated memory
 static void free_cache_item(cache_item_t item);
 
-// removes item at index "index" in the cache's linked list
-static void *remove_at_cache(C_T cache, int index);
+// unlinks item from the cache's linked list and index, and frees it
+static void unlink_item(C_T cache, cache_item_t item);
+
+// hashes every name in a batch, and prefetches the first few buckets
+static uint64_t *hash_batch(C_T cache, char **file_names, int n);
+
+// prefetches the index bucket (and its first item) for a batch's key i
+static void prefetch_batch(C_T cache, uint64_t *hashes, int n, int i);
+
+// returns 1 if file_name has a live negative entry, without counting a hit
+static int peek_negative(C_T cache, char *file_name);
+
+// picks the item evict_one would evict, without removing it
+static cache_item_t pick_victim(C_T cache, int *expired);
+
+// replaces the bloom filter with a fresh one built from the cache list
+static void rebuild_filter(C_T cache);
+
+// records file_name as unreadable, taking ownership of the name
+static void add_negative(C_T cache, char *file_name);
+
+// unlinks and frees the negative entry following prev (head if NULL)
+static void remove_negative(C_T cache, neg_item_t prev);
+
+// handles an item whose source file has disappeared
+static void *source_gone(C_T cache, cache_item_t item);
+
+// frees an item that's been unlinked from the cache list, and forgets it
+// in the filter and watcher
+static void drop_item(C_T cache, cache_item_t item);
+
+// compresses a file's newly read data, if it's big enough and shrinks enough
+static void pack_data(C_T cache, cache_file_t *file);
+
+// returns a file's data uncompressed: data itself, or a malloc'd copy
+static unsigned char *raw_data(cache_file_t *file);
+
+// settles a file's newly read data: shares a cached payload with the same
+// bytes, if dedup is on and there is one; else compresses it, if it should
+static void keep_data(C_T cache, cache_file_t *file);
+
+// pins a payload in the store with this hash and length; NULL if none
+static payload_t *find_dedup(dedup_t *store, uint64_t hash, int len);
+
+// adds a payload to the store, under the hash of its data
+static void add_dedup(dedup_t *store, payload_t *payload, uint64_t hash);
+
+// removes a payload that's being freed from its store
+static void forget_dedup(payload_t *payload);
+
+// frees a store, and cuts any payloads still in it loose
+static void free_dedup(dedup_t *store);
+
+// returns 1 if a payload holds (maybe compressed) len bytes equal to data
+static int same_data(payload_t *payload, unsigned char *data, int len);
+
+// sums the data of the cache's files: returns the bytes held, with shared
+// payloads counted once; logical is set to the bytes of every file
+static uint64_t held_bytes(C_T cache, uint64_t *logical);
+
+// makes a new item's file a chunked one, keeping what data it has
+static void chunk_file(C_T cache, cache_file_t *file);
+
+// drops a file's chunks, and gives it an empty chunk table for len bytes
+// (none, if len is -1)
+static void set_chunks(C_T cache, cache_file_t *file, int len);
+
+// pins chunk i of a chunked file, reading it if it isn't loaded
+static payload_t *load_chunk(C_T cache, cache_file_t *file, int i);
+
+// appends a newly loaded chunk to the LRU, evicting others over budget
+static void add_chunk(C_T cache, chunk_t *chunk);
+
+// unlinks a chunk from the LRU, and drops the cache's reference to it
+static void drop_chunk(C_T cache, chunk_t *chunk);
+
+// wraps n pinned parts in a view of len bytes, starting skip into the first
+static payload_t *create_view(payload_t **parts, int n, int skip, int off,
+                              int len);
 
 
 /*
  * @note    eviction policy: if all files have been accessed before, evict the
  *          least-recently accessed file; otherwise, evict the oldest file
+ * @note    with an L2 (see enable_spill_cache), an unexpired victim's data is
+ *          spilled to it first, so a later miss can be served from disk
+ * @note    a proxied response (see store_http_cache) has no source file to
+ *          delete, and isn't spilled: it's fetched again on its next miss
  */
 void *evict_one(C_T cache)
 {
-    cache_item_t curr = cache->head;
-    int num_not_retrieved = 0;
-    char *few_retrieved = NULL;
-    char *many_retrieved = NULL;
+    int expired = 0;
+    cache_item_t victim = pick_victim(cache, &expired);
 
-    clock_t now = clock();
-    clock_t least_recent = now;
-
-    while (curr != NULL)
-    {
-        char *name = (curr->file).name;
-        // printf("currently, name is: %s\n", name);
-
-        if ((curr->file).expiration <= now) {
-            remove_file_cache(cache, name);
-            delete_file(name);
-            return (void *)cache;
-        }
+    if (victim == NULL)
+        return (void *)cache;
 
-        if ((curr->file).last_retrieved == 0) {
-            num_not_retrieved++;
-            printf("%s has never been retrieved\n", name);
-            if (few_retrieved == NULL)
-                few_retrieved = name; // record oldest never-retrieved
-        }
-        
-        if ( (curr->file).last_retrieved != 0
-                && (curr->file).last_retrieved < least_recent) {
-            least_recent = (curr->file).last_retrieved;
-            many_retrieved = name; // update least-recently retrieved
-            printf("we found a file that has been retrieved older: \n");
+    char *name = (victim->file).name;
 
-        }
-        curr = curr->next;
-    }
-    
-    if (num_not_retrieved < 2) { // if 0 or 1 have never been retreived...
-        printf("deleting if many retrieved\n");
-        // printf("retrieved name: %s", retrieved);
-        delete_file(many_retrieved);
-        remove_file_cache(cache, many_retrieved);
-    }
-    else {
-        printf("deleting if few retrieved\n");
-        delete_file(few_retrieved);
-        remove_file_cache(cache, few_retrieved);
+    if (expired)
+        log_cache(cache, "deleting expired %s\n", name);
+    else if ((victim->file).last_retrieved != 0)
+        log_cache(cache, "deleting if many retrieved\n");
+    else
+        log_cache(cache, "deleting if few retrieved\n");
+
+    cache_file_t *file = &victim->file;
+    if (cache->spill != NULL && !expired && file->loaded
+            && file->data != NULL && file->http == NULL) {
+        spill_entry_t entry = { raw_data(file), file->len, file->max_age,
+                                file->expiration, file->meta };
+        put_spill(cache->spill, name, &entry);
+        if (entry.data != file->data)
+            free(entry.data);
     }
 
+    // delete before removing: removal frees the item's name
+    if (file->http == NULL)
+        delete_file(name);
+    unlink_item(cache, victim);
+    cache->stats.evictions++;
+
     return (void *)cache;
 }
 
@@ -121,6 +313,44 @@ void *create_cache(int cap)
     new_cache->cap = cap;
     new_cache->size = 0;
 
+    // about two buckets per item, so that chains stay short
+    uint64_t buckets = INDEX_MIN;
+    while (cap > 0 && buckets < 2 * (uint64_t)cap)
+        buckets <<= 1;
+    new_cache->index = calloc(buckets, sizeof(cache_item_t));
+    new_cache->index_mask = buckets - 1;
+
+    new_cache->admit = NULL;
+    new_cache->filter = NULL;
+    new_cache->filter_fp = 0;
+
+    new_cache->neg_head = NULL;
+    new_cache->neg_size = 0;
+    new_cache->neg_cap = 0;
+    new_cache->neg_ttl = 0;
+
+    new_cache->lazy = 0;
+    new_cache->log = stdout;
+    new_cache->now = gcache_clock_cpu;
+    new_cache->refresher = NULL;
+    new_cache->ahead_fraction = 0;
+    new_cache->ahead_rate = 0;
+    new_cache->watcher = NULL;
+    new_cache->watch_reload = 0;
+    pthread_mutex_init(&new_cache->lock, NULL);
+    new_cache->flights = create_flight();
+    new_cache->spill = NULL;
+    new_cache->pack_min = 0;
+    new_cache->pack_ratio = 0;
+    new_cache->chunk_len = 0;
+    new_cache->chunk_budget = 0;
+    new_cache->chunk_bytes = 0;
+    new_cache->chunk_head = NULL;
+    new_cache->chunk_tail = NULL;
+    new_cache->dedup = NULL;
+    atomic_init(&new_cache->epoch, 0);
+    memset(&new_cache->stats, 0, sizeof(cache_stats_t));
+
     return (void *)new_cache;
 }
 
@@ -135,6 +365,7 @@ void free_cache(C_T cache)
     if (cache == NULL)
         return;  
 
+    free_refresher(cache->refresher); // joins the worker first
     cache_item_t curr = cache->head;
 
     // free the linked list of cache items
@@ -144,6 +375,18 @@ void free_cache(C_T cache)
         free_cache_item(to_free); // frees to_free as well
     }
 
+    while (cache->neg_head != NULL)
+        remove_negative(cache, NULL);
+
+    free_dedup(cache->dedup); // after the items, which forget their data
+
+    free_tinylfu(cache->admit);
+    free_bloom(cache->filter);
+    free_watcher(cache->watcher);
+    free_flight(cache->flights);
+    free_spill(cache->spill);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->index);
     free(cache);
     return;
 }
@@ -186,77 +429,31 @@ int cap_of_cache(C_T cache)
  * @returns modified struct cache_t pointer, cast to void pointer
  * @note    files that haven't been retreived are init'd with a last_retr.
  *          value of exactly 0.
+ * @note    if negative caching is on and the file can't be read, it's
+ *          recorded as a negative entry instead, and the cache list is
+ *          left unchanged.
  */  
 void *push_back_cache(C_T cache, char *file_name, int max_age)
 {
     if (cache == NULL)
         return NULL; 
 
-    cache->size = cache->size + 1; // update size of cache
-
-    cache_item_t new_item = new_cache_item(file_name, max_age);
-
-    if (cache->head == NULL && cache->tail == NULL) {
-        cache->head = new_item;
-        cache->tail = new_item;
-        return (void *)cache;   
-    }
-    
-    // otherwise, append new cache_file_t to back of cache list
-    (cache->tail)->next = new_item;
-    cache->tail = new_item; // back of list points to new item 
-
-    return (void *)cache;
-}
-
-
-/* remove_at_cache() 
- * @brief   removes a file from the given index in the cache
- * @param   cache: a struct cache_t pointer
- * @param   index: index of file to remove, in cache's linked list
- * @returns modified struct cache_t pointer, cast to void pointer
- * @note    if cache is empty, return cache unchanged
- */
-static void *remove_at_cache(C_T cache, int index)
-{
-    if (cache == NULL)
-        return NULL; 
-
-    else if (cache->head == NULL || index < 0 || index >= cache->size)
-        return (void *)cache; // if cache list is empty, or bad index
-
-    cache_item_t curr = cache->head;
-
-    if (cache->tail == cache->head) { // if list has one item, repoint tail
-        cache->head = NULL;
-        cache->tail = NULL;
-        free_cache_item(curr);
-    }
-    else if (index == 0) { // if item is at front of list, you're there!
-        cache->head = (cache->head)->next;
-        free_cache_item(curr);
-    }
-    else { // traverse to node BEFORE target (at end, i = index - 1)
-        int i;
-        for (i = 0; i < index - 1; i++)
-            curr = curr->next; 
+    cache_item_t new_item = new_cache_item(file_name, max_age, cache->lazy,
+                                           cache->chunk_len, cache->now());
 
-        cache_item_t target = curr->next;
-        if (target->next == NULL) { // if we're at the end of the list
-            cache->tail = NULL;
-        }
-        else {
-            curr->next = target->next;
-        }
-        free_cache_item(target);
+    if (cache->neg_ttl > 0 && (new_item->file).len == -1) {
+        (new_item->file).name = NULL; // negative entry owns the name now
+        free_cache_item(new_item);
+        add_negative(cache, file_name);
+        return (void *)cache;
     }
 
-    cache->size = cache->size - 1; // update num of items in cache
+    link_item(cache, new_item);
     return (void *)cache;
 }
 
 
-/* remove_at_cache() 
+/* remove_file_cache() 
  * @brief   removes a given file from the cache
  * @param   cache: a struct cache_t pointer
  * @param   file_name: name of file to remove
@@ -265,10 +462,10 @@ static void *remove_at_cache(C_T cache, int index)
  */
 void *remove_file_cache(C_T cache, char *file_name)
 {
-    int ind = find_in_cache(cache, file_name, NULL);
+    cache_item_t item = NULL;
     
-    if (ind != -1) // if file exists in the cache
-        cache = (C_T)remove_at_cache(cache, ind);
+    if (find_in_cache(cache, file_name, &item) != -1) // if file is cached
+        unlink_item(cache, item);
 
     return (void *)cache;
 }
@@ -324,143 +521,2897 @@ void print_file_struct(cache_file_t file)
  * @brief   updates a given item in the cache with new cache info (after
  *          a retrieval).
  * @param   cache
- * 
+ * @note    the cache's epoch is bumped only if our_file carries other data
+ *          than the item's; a re-PUT, which just renews it, keeps every
+ *          thread's L0 (see epoch_of_cache)
  */ 
 void *update_item_cache(C_T cache, char *file_name, cache_file_t our_file)
 {
     cache_item_t to_update = NULL;
-    clock_t now = clock();
+    clock_t now = cache->now();
     find_in_cache(cache, file_name, &to_update);
 
     if (to_update != NULL) {
         our_file.last_retrieved = now;
-        our_file.expiration = now + (our_file.max_age * CLOCKS_PER_SEC);
+        our_file.expiration = gcache_expires(now, our_file.max_age);
+        our_file.hits = 0;
 
+        if (our_file.data != (to_update->file).data)
+            atomic_fetch_add(&cache->epoch, 1);
         to_update->file = our_file;
     }
     return (void *)cache;
 }
 
 
-/* print_cache()
- * @brief   prints out the contents of the cache
- * @param   cache   cache instance to print
- * @returns none
+/* revalidate_item_cache()
+ * @brief   renews an expired item, like an HTTP conditional GET: if the
+ *          source's size, mtime and inode still match the ones recorded
+ *          when it was cached, only its expiration is pushed back (no data
+ *          is read); otherwise the file is re-read into the item in place
+ * @param   cache: a struct cache_t pointer
+ * @param   file_name: name of file to revalidate
+ * @returns modified struct cache_t pointer, cast to void pointer
+ * @note    if the source has disappeared, the item is dropped and recorded
+ *          as a negative entry when negative caching is on; otherwise it's
+ *          kept with NULL data and len -1, like any unreadable PUT.
+ * @note    a lazily PUT item that changed is just re-stat'd, and its data
+ *          is still read on its first GET.
  */
-void print_cache(C_T cache)
+void *revalidate_item_cache(C_T cache, char *file_name)
 {
-    if (cache == NULL)
-        return;
+    cache_item_t item = NULL;
+    find_in_cache(cache, file_name, &item);
+
+    if (item == NULL)
+        return (void *)cache;
+
+    cache_file_t *file = &item->file;
+    file_meta_t meta;
+    int found = (stat_file_meta(file->name, &meta) == 0);
+
+    file->expiration = gcache_expires(cache->now(), file->max_age);
+    file->hits = 0;
+
+    if (found && file->len != -1
+            && meta.size == file->meta.size
+            && meta.mtime == file->meta.mtime
+            && meta.mtime_nsec == file->meta.mtime_nsec
+            && meta.ino == file->meta.ino) {
+        cache->stats.revalidated++;
+        if (file->loaded)
+            cache->stats.revalidated_bytes += file->len;
+        return (void *)cache;
+    }
 
-    cache_item_t curr = cache->head;
-    int ind = 1;
+    if (!found && cache->neg_ttl > 0)
+        return source_gone(cache, item);
 
-    while (curr != NULL) {
-        printf("\t%i: ", ind);
-        print_file_struct(curr->file);
-        ind++;
+    if (file->chunks != NULL) { // changed chunks are re-read as GETs need
+        set_chunks(cache, file, found ? (int)meta.size : -1);
+        if (found)
+            file->meta = meta;
+        cache->stats.reloaded++;
+        return (void *)cache;
+    }
 
-        curr = curr->next;
+    set_data(cache, file, NULL, -1);
+
+    if (found && !file->loaded) { // still lazy: just track the new size
+        file->len = (int)meta.size;
+        file->meta = meta;
+        return (void *)cache;
     }
 
-    int i; 
-    for (i = ind; i <= cache->cap; i++)
-        printf("\t%i: NO FILE\n", i);
+    file->loaded = 1;
+    if (found) {
+        unsigned char *buffer = NULL;
+        int len = read_file_with_meta(file->name, &buffer, &file->meta);
+
+        if (len != -1) {
+            set_data(cache, file, buffer, len);
+            keep_data(cache, file);
+            cache->stats.reloaded_bytes += len;
+        }
+        else {
+            free(buffer);
+        }
+    }
+    cache->stats.reloaded++;
+
+    return (void *)cache;
 }
 
 
-/*** STATIC HELPER FUNCTIONS ***/
+/* set_stale_cache()
+ * @brief   sets how long past its expiration a file may still be served
+ *          (stale-while-revalidate), while it's refreshed in the background
+ * @param   cache: a struct cache_t pointer
+ * @param   file_name: name of cached file
+ * @param   stale: grace period, in seconds; 0 turns it off for the file
+ * @returns modified struct cache_t pointer, cast to void pointer
+ * @note    starts the cache's background refresher the first time a file
+ *          is given a grace period
+ */
+void *set_stale_cache(C_T cache, char *file_name, int stale)
+{
+    cache_item_t item = NULL;
+    find_in_cache(cache, file_name, &item);
 
+    if (item == NULL)
+        return (void *)cache;
 
-/* find_in_cache()
- * @brief   traverses to and returns the cache_item_t pointer in the cache
- *          list with the given file_name.
- * @param   file_name: name of file;
+    (item->file).stale = (stale > 0) ? stale : 0;
+
+    if (stale > 0 && cache->refresher == NULL)
+        cache->refresher = create_refresher();
+
+    return (void *)cache;
+}
+
+
+/* serve_stale_cache()
+ * @brief   decides whether an expired file can be served as-is: it can if
+ *          it's still inside its grace period, in which case a background
+ *          refresh is queued for it (at most one at a time per file)
  * @param   cache: a struct cache_t pointer
- * @param   item_add: pointer to store retrieved item in.
- * @returns index of the retrieved item
- * @note    if file is not found, cache_item is set to NULL, and
- *          -1 is returned. 
- * 
- * @note    caller can pass item_add as NULL, if just retrieving int index
- */ 
-static int find_in_cache(C_T cache, char *file_name, 
-                                  cache_item_t *item_add)
+ * @param   file_name: name of expired file
+ * @returns 1 if the stale copy may be served; 0 if the caller has to
+ *          revalidate it now
+ */
+int serve_stale_cache(C_T cache, char *file_name)
+{
+    cache_item_t item = NULL;
+    find_in_cache(cache, file_name, &item);
+
+    if (item == NULL || cache->refresher == NULL)
+        return 0;
+
+    cache_file_t *file = &item->file;
+    clock_t now = cache->now();
+
+    if (file->stale <= 0 || !file->loaded || file->len == -1
+            || file->chunks != NULL
+            || gcache_expired(gcache_expires(file->expiration, file->stale),
+                              now))
+        return 0;
+
+    if (!file->refreshing) {
+        if (submit_refresher(cache->refresher, file->name, &file->meta) != 0)
+            return 0;
+        file->refreshing = 1;
+    }
+
+    cache->stats.stale_served++;
+    return 1;
+}
+
+
+/* enable_refresh_ahead_cache()
+ * @brief   turns on refresh-ahead: a hot file is refreshed in the background
+ *          once it's used up a given fraction of its max_age, so that it's
+ *          renewed before it can expire on a GET
+ * @param   cache: a struct cache_t pointer
+ * @param   fraction: fraction of max_age, in (0, 1), to refresh at
+ * @param   min_rate: GETs per second (since the file's data was last read
+ *          or revalidated) that make a file hot
+ * @returns modified struct cache_t pointer, cast to void pointer
+ */
+void *enable_refresh_ahead_cache(C_T cache, double fraction, double min_rate)
 {
-    int ind = 0;
     if (cache == NULL)
-        return -1; 
+        return NULL;
 
-    cache_item_t curr = cache->head; // struct cache_item_t * --> cache_item_t
-    while (curr != NULL) {
-        if (strncmp((curr->file).name, 
-        file_name, 
-        strlen(file_name)) == 0){
-            // if caller is using item_add; otherwise, don't update
-            
-            if (item_add != NULL) {
-                *item_add = curr;
+    if (fraction <= 0 || fraction >= 1)
+        return (void *)cache;
+
+    cache->ahead_fraction = fraction;
+    cache->ahead_rate = min_rate;
+
+    if (cache->refresher == NULL)
+        cache->refresher = create_refresher();
+
+    return (void *)cache;
+}
+
+
+/* refresh_ahead_cache()
+ * @brief   counts a GET on a fresh file, and queues a background refresh
+ *          if the file is hot and past the refresh-ahead point of its age
+ * @param   cache: a struct cache_t pointer
+ * @param   file_name: name of file that was just retrieved
+ * @returns 1 if a refresh-ahead was issued; otherwise 0
+ * @note    a refresh-ahead counts as wasted if no GET follows it before the
+ *          file is refreshed again or leaves the cache
+ */
+int refresh_ahead_cache(C_T cache, char *file_name)
+{
+    cache_item_t item = NULL;
+    find_in_cache(cache, file_name, &item);
+
+    if (item == NULL)
+        return 0;
+
+    cache_file_t *file = &item->file;
+    file->hits++;
+    if (file->ahead == 2)
+        file->ahead = 0; // the last refresh-ahead paid off
+
+    if (cache->ahead_fraction <= 0 || file->refreshing || file->max_age <= 0
+            || !file->loaded || file->len == -1 || file->chunks != NULL)
+        return 0;
+
+    clock_t now = cache->now();
+    clock_t life = (clock_t)file->max_age * CLOCKS_PER_SEC;
+    clock_t age = now - (file->expiration - life);
+
+    if (age < (clock_t)(cache->ahead_fraction * life))
+        return 0;
+
+    double secs = (double)age / CLOCKS_PER_SEC;
+    if (secs > 0 && file->hits / secs < cache->ahead_rate)
+        return 0;
+
+    if (submit_refresher(cache->refresher, file->name, &file->meta) != 0)
+        return 0;
+
+    file->refreshing = 1;
+    file->ahead = 1;
+    cache->stats.ahead_issued++;
+    return 1;
+}
+
+
+/* apply_refreshes_cache()
+ * @brief   applies every background refresh that has finished: unchanged
+ *          files have their expiration renewed, changed files get their new
+ *          data swapped in, and vanished files are handled as in
+ *          revalidate_item_cache()
+ * @param   cache: a struct cache_t pointer
+ * @returns modified struct cache_t pointer, cast to void pointer
+ * @note    called from the thread that owns the cache, so that buffers are
+ *          never swapped out from under a caller mid-request
+ */
+void *apply_refreshes_cache(C_T cache)
+{
+    if (cache == NULL || cache->refresher == NULL)
+        return (void *)cache;
+
+    refresh_result_t res;
+    while (poll_refresher(cache->refresher, &res)) {
+        cache_item_t item = NULL;
+        find_in_cache(cache, res.name, &item);
+
+        if (item == NULL) { // evicted while refreshing
+            free(res.data);
+            free(res.name);
+            continue;
+        }
+
+        cache_file_t *file = &item->file;
+        file->refreshing = 0;
+        file->expiration = gcache_expires(cache->now(), file->max_age);
+        file->hits = 0;
+        cache->stats.bg_refreshes++;
+
+        if (file->ahead == 1)
+            file->ahead = 2; // wasted, unless a GET comes before the next
+
+        if (res.gone) {
+            if (cache->neg_ttl > 0) {
+                source_gone(cache, item);
+            }
+            else {
+                set_data(cache, file, NULL, -1);
             }
+        }
+        else if (res.changed) {
+            set_data(cache, file, res.data, res.len);
+            keep_data(cache, file);
+            file->meta = res.meta;
+            file->loaded = 1;
+            cache->stats.bg_changed++;
+        }
+
+        free(res.name);
+    }
+
+    return (void *)cache;
+}
+
+
+/* enable_watch_cache()
+ * @brief   turns on an inotify watcher for every cached source file (and
+ *          every negative entry), so that changes are picked up as they
+ *          happen rather than when max_age runs out
+ * @param   cache: a struct cache_t pointer
+ * @param   reload: if 1, changed files are revalidated (re-read if their
+ *          size / mtime / inode changed); if 0, they're dropped
+ * @returns modified struct cache_t pointer, cast to void pointer
+ * @note    events are picked up by apply_watch_cache(); if inotify isn't
+ *          available, the cache carries on without a watcher
+ */
+void *enable_watch_cache(C_T cache, int reload)
+{
+    if (cache == NULL)
+        return NULL;
 
-            return ind;
+    if (cache->watcher == NULL) {
+        cache->watcher = create_watcher();
+        if (cache->watcher == NULL) {
+            fprintf(stderr, "inotify unavailable; not watching files\n");
+            return (void *)cache;
         }
 
-        curr = curr->next;
-        ind++;
+        cache_item_t curr;
+        for (curr = cache->head; curr != NULL; curr = curr->next)
+            add_watcher(cache->watcher, (curr->file).name);
+
+        neg_item_t neg;
+        for (neg = cache->neg_head; neg != NULL; neg = neg->next)
+            add_watcher(cache->watcher, neg->name);
     }
-    // file with file_name was not found.
-    if (item_add != NULL)
-        *item_add = NULL;
 
-    return -1; 
+    cache->watch_reload = reload;
+    return (void *)cache;
 }
 
 
-/* new_cache_item()
- * @brief   creates a new cache_item_t pointer that stores a new
- *          cache_file_t struct (with a malloc'd buffer for the file data)
- * @param   file_name   name of file to store in item's cache_file_t
- * @param   max_age     time before item expires in the cache
- * @returns a cache_item_t pointer
- */ 
-static cache_item_t new_cache_item(char *file_name, int max_age)
+/* apply_watch_cache()
+ * @brief   handles every pending change reported by the watcher: changed
+ *          files are reloaded or dropped, deleted files are dropped (or made
+ *          negative entries), and files that appear clear their negative
+ *          entries
+ * @param   cache: a struct cache_t pointer
+ * @returns modified struct cache_t pointer, cast to void pointer
+ * @note    if inotify dropped events, every file is marked expired, so that
+ *          its next GET revalidates it
+ */
+void *apply_watch_cache(C_T cache)
 {
-    unsigned char *file_buffer = NULL;
-    int file_len = read_file_into_buf(file_name, &file_buffer);
+    if (cache == NULL || cache->watcher == NULL)
+        return (void *)cache;
+
+    char *path = NULL;
+    int kind;
+
+    while ((kind = poll_watcher(cache->watcher, &path)) != 0) {
+        cache->stats.watch_events++;
+
+        if (kind == WATCH_OVERFLOW) {
+            cache_item_t curr;
+            for (curr = cache->head; curr != NULL; curr = curr->next)
+                (curr->file).expiration = 0;
+            atomic_fetch_add(&cache->epoch, 1);
+            while (cache->neg_head != NULL)
+                remove_negative(cache, NULL);
+            continue;
+        }
 
-    // this file expires at time = current_time + max_age (in clock ticks)
-    clock_t exp_time = clock() + (CLOCKS_PER_SEC * max_age);
+        cache_item_t item = NULL;
+        find_in_cache(cache, path, &item);
 
-    cache_file_t new_file= { file_buffer, file_name, file_len, 
-                              max_age, exp_time, 0 };
+        if (item == NULL) {
+            if (kind == WATCH_CHANGED)
+                invalidate_negative_cache(cache, path);
+            continue;
+        }
 
-    cache_item_t new_item = malloc(sizeof(struct cache_item_t));
-    new_item->file = new_file;
-    new_item->next = NULL;
+        if (kind == WATCH_GONE && cache->neg_ttl > 0) {
+            source_gone(cache, item);
+            cache->stats.watch_invalidations++;
+        }
+        else if (kind == WATCH_GONE || !cache->watch_reload) {
+            remove_file_cache(cache, path);
+            cache->stats.watch_invalidations++;
+        }
+        else {
+            revalidate_item_cache(cache, path);
+            cache->stats.watch_reloads++;
+        }
+    }
 
-    return new_item;
+    return (void *)cache;
 }
 
 
-/* free_cache_item()
- * @brief   given a malloc'd cache_item_t, frees it and all memory
- *          associated with its cache_file_t content.
- * @param   address of cache_item_t, a pointer, to free
- * @returns none
- * @note    if item is NULL, does nothing; assumes item was malloc'd
- */ 
-static void free_cache_item(cache_item_t item)
+/* touch_item_cache()
+ * @brief   records a GET on a file: stamps its last retrieval time, without
+ *          renewing its expiration
+ * @param   cache: a struct cache_t pointer
+ * @param   file_name: name of retrieved file
+ * @returns modified struct cache_t pointer, cast to void pointer
+ * @note    a file's freshness runs from when its data was read or last
+ *          revalidated, like HTTP max-age, not from when it was last read
+ */
+void *touch_item_cache(C_T cache, char *file_name)
 {
-        if (item == NULL)
-            return;
+    cache_item_t item = NULL;
+    find_in_cache(cache, file_name, &item);
 
-        // free data from file buffer
-        if ((item->file).data != NULL)
-            free((item->file).data);
-        
-        if ((item->file).name != NULL)
-            free((item->file).name);
+    if (item != NULL)
+        (item->file).last_retrieved = cache->now();
 
-        free(item);
-        item = NULL;
-}
\ No newline at end of file
+    return (void *)cache;
+}
+
+
+/* get_many_cache()
+ * @brief   looks up a batch of files at once: every name is hashed up front,
+ *          index buckets are prefetched a few keys ahead of use, and every
+ *          file found is stamped as retrieved with one clock reading
+ * @param   cache: a struct cache_t pointer
+ * @param   file_names: names of the n files to look up
+ * @param   n: number of files
+ * @param   files: array of n structs, each filled in as by
+ *          retrieve_file_struct() (NULL_FILE if not cached)
+ * @returns number of files found
+ * @note    like retrieve_file_struct(), the structs' data pointers are only
+ *          valid while the cache is unchanged; acquire_file_cache() pins it
+ */
+int get_many_cache(C_T cache, char **file_names, int n, cache_file_t *files)
+{
+    if (cache == NULL || n <= 0)
+        return 0;
+
+    uint64_t *hashes = hash_batch(cache, file_names, n);
+    clock_t now = cache->now();
+    int found = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        prefetch_batch(cache, hashes, n, i + PREFETCH_AHEAD);
+
+        cache_item_t item = NULL;
+        find_hashed(cache, file_names[i], hashes[i], &item);
+
+        if (item == NULL) {
+            files[i] = NULL_FILE;
+            continue;
+        }
+
+        (item->file).last_retrieved = now;
+        files[i] = item->file;
+        found++;
+    }
+
+    free(hashes);
+    return found;
+}
+
+
+/* put_many_cache()
+ * @brief   stores (or updates) a batch of files at once. the data of every
+ *          file that isn't cached yet is read together, outside the cache's
+ *          lock; the batch is then applied in order under one acquisition
+ *          of it, as a run of PUTs would be: known-unreadable files are
+ *          skipped, cached files have their MAX-AGE updated and renewed,
+ *          and new files are admitted (evicting to make room) and stored
+ * @param   cache: a struct cache_t pointer
+ * @param   file_names: names of the n files; copied, not kept
+ * @param   max_ages: MAX-AGE of each file, in seconds
+ * @param   n: number of files
+ * @param   results: filled in with each file's PUT_* outcome
+ * @returns number of files newly stored
+ * @note    must be called without the cache's lock held. a file read ahead
+ *          may still be turned away by admission, once the files before it
+ *          in the batch have been stored; its read is then wasted.
+ * @note    in lazy mode new files are only stat'd, under the lock, as in
+ *          push_back_cache()
+ */
+int put_many_cache(C_T cache, char **file_names, int *max_ages, int n,
+                   int *results)
+{
+    if (cache == NULL || n <= 0)
+        return 0;
+
+    batch_read_t *reads = calloc(n, sizeof(batch_read_t));
+    int stored = 0;
+    int i, j;
+
+    // pick out the files that will need reading: not cached, not known to
+    // be unreadable, and not already picked earlier in the batch
+    lock_cache(cache);
+    uint64_t *hashes = hash_batch(cache, file_names, n);
+
+    for (i = 0; i < n && !cache->lazy; i++) {
+        prefetch_batch(cache, hashes, n, i + PREFETCH_AHEAD);
+
+        if (find_hashed(cache, file_names[i], hashes[i], NULL) == 0
+                || peek_negative(cache, file_names[i]))
+            continue;
+
+        for (j = 0; j < i; j++)
+            if (reads[j].read && hashes[j] == hashes[i]
+                    && strcmp(file_names[j], file_names[i]) == 0)
+                break;
+        reads[i].read = (j == i);
+
+        // a file evicted to L2 is taken from there, not from its source
+        spill_entry_t entry;
+        if (reads[i].read && take_spill(cache->spill, file_names[i], &entry)) {
+            reads[i].data = entry.data;
+            reads[i].len = entry.len;
+            reads[i].meta = entry.meta;
+            reads[i].spilled = 1;
+            reads[i].expiration = entry.expiration;
+        }
+    }
+    unlock_cache(cache);
+
+    for (i = 0; i < n; i++) {
+        if (!reads[i].read || reads[i].spilled)
+            continue;
+
+        // a file that will be chunked isn't read: GETs read its chunks
+        if (cache->chunk_len > 0
+                && stat_file_meta(file_names[i], &reads[i].meta) == 0
+                && reads[i].meta.size > cache->chunk_len) {
+            reads[i].read = 0;
+            continue;
+        }
+
+        reads[i].len = read_file_with_meta(file_names[i], &reads[i].data,
+                                           &reads[i].meta);
+        if (reads[i].len == -1) {
+            free(reads[i].data);
+            reads[i].data = NULL;
+        }
+    }
+
+    lock_cache(cache);
+    for (i = 0; i < n; i++) {
+        char *file_name = file_names[i];
+        cache_item_t item = NULL;
+        results[i] = PUT_REJECTED;
+
+        // known-unreadable files are answered from memory
+        if (is_negative_cache(cache, file_name)) {
+            results[i] = PUT_NEGATIVE;
+            free(reads[i].data);
+            continue;
+        }
+
+        find_hashed(cache, file_name, hashes[i], &item);
+
+        if (item != NULL) { // update content for an existing file
+            clock_t now = cache->now();
+            (item->file).max_age = max_ages[i];
+            (item->file).last_retrieved = now;
+            (item->file).expiration = gcache_expires(now, max_ages[i]);
+            (item->file).hits = 0;
+
+            results[i] = PUT_UPDATED;
+            free(reads[i].data);
+            continue;
+        }
+
+        // a file evicted earlier in the batch (or any file, if lazy) is
+        // only in L2 by now
+        spill_entry_t entry;
+        if (!reads[i].read && take_spill(cache->spill, file_name, &entry)) {
+            reads[i] = (batch_read_t){ 1, entry.data, entry.len, entry.meta,
+                                       1, entry.expiration };
+        }
+
+        if (cache->size >= cache->cap) {
+            if (!admit_file_cache(cache, file_name)) {
+                // L2 may hold the only copy: put it back as it was, still
+                // as fresh as when it was taken out
+                if (reads[i].spilled) {
+                    spill_entry_t entry = { reads[i].data, reads[i].len,
+                                            max_ages[i], reads[i].expiration,
+                                            reads[i].meta };
+                    put_spill(cache->spill, file_name, &entry);
+                }
+                free(reads[i].data);
+                continue;
+            }
+            evict_one(cache);
+        }
+
+        cache->stats.l2_put_hits += reads[i].spilled;
+
+        if (!reads[i].read) { // lazy, or read ahead under another entry
+            push_back_cache(cache, strdup(file_name), max_ages[i]);
+        }
+        else if (reads[i].len == -1 && cache->neg_ttl > 0) {
+            add_negative(cache, strdup(file_name));
+        }
+        else {
+            item = build_cache_item(strdup(file_name), max_ages[i],
+                                    reads[i].data, reads[i].len,
+                                    &reads[i].meta, 1, cache->now());
+            link_item(cache, item);
+        }
+
+        results[i] = PUT_STORED;
+        stored++;
+    }
+    unlock_cache(cache);
+
+    free(hashes);
+    free(reads);
+    return stored;
+}
+
+
+/* lock_cache()
+ * @brief   takes the cache's lock, for a thread to run a command on it
+ * @param   cache: a struct cache_t pointer
+ * @note    every cache function other than fetch_file_cache() assumes the
+ *          caller holds the lock, if more than one thread uses the cache
+ */
+void lock_cache(C_T cache)
+{
+    if (cache != NULL)
+        pthread_mutex_lock(&cache->lock);
+}
+
+
+/* unlock_cache()
+ * @brief   releases the cache's lock
+ * @param   cache: a struct cache_t pointer
+ */
+void unlock_cache(C_T cache)
+{
+    if (cache != NULL)
+        pthread_mutex_unlock(&cache->lock);
+}
+
+
+/* fetch_file_cache()
+ * @brief   makes sure a file's cached data is fresh and loaded, reading its
+ *          source at most once no matter how many threads ask at once: the
+ *          first caller to find it missing, expired or not yet loaded reads
+ *          (or revalidates) it, and callers arriving meanwhile wait for that
+ *          load and share its outcome
+ * @param   cache: a struct cache_t pointer
+ * @param   file_name: name of file to fetch; copied if it's inserted
+ * @param   max_age: MAX-AGE for the file if it isn't cached yet; < 0 to only
+ *          fetch a file that's already cached
+ * @param   timeout_ms: how long to wait on another caller's load; < 0 to
+ *          wait for as long as it takes
+ * @returns FETCH_HIT if the file was already fresh; FETCH_LOADED if this
+ *          caller loaded it; FETCH_SHARED if another caller did;
+ *          FETCH_TIMEOUT if that load took too long; FETCH_MISS if it isn't
+ *          cached (and max_age < 0); FETCH_ERROR if the source couldn't be
+ *          read, whichever caller tried
+ * @note    must be called without the cache's lock held: the source is read
+ *          outside of it, so requests for other files aren't held up
+ * @note    an unreadable source is handled as revalidate_item_cache() and
+ *          push_back_cache() would: dropped or kept as a negative entry
+ */
+int fetch_file_cache(C_T cache, char *file_name, int max_age, int timeout_ms)
+{
+    if (cache == NULL || file_name == NULL)
+        return FETCH_ERROR;
+
+    cache_item_t item = NULL;
+    clock_t now = cache->now();
+
+    lock_cache(cache);
+    find_in_cache(cache, file_name, &item);
+    if (item != NULL && (item->file).loaded
+            && !gcache_expired((item->file).expiration, now)) {
+        unlock_cache(cache);
+        return FETCH_HIT;
+    }
+    unlock_cache(cache);
+
+    int result = FETCH_ERROR;
+    int outcome = join_flight(cache->flights, file_name, timeout_ms, &result);
+
+    if (outcome != FLIGHT_LEADER) {
+        lock_cache(cache);
+        if (outcome == FLIGHT_TIMEOUT)
+            cache->stats.fetch_timeouts++;
+        else
+            cache->stats.fetch_shared++;
+        unlock_cache(cache);
+
+        if (outcome == FLIGHT_TIMEOUT)
+            return FETCH_TIMEOUT;
+        if (result == FETCH_LOADED || result == FETCH_HIT)
+            return FETCH_SHARED;
+        return result; // the leader's FETCH_ERROR / FETCH_MISS
+    }
+
+    // leading: another leader may have landed just before this one took
+    // off, so look again before going to the source
+    refresh_result_t job = { 0 };
+    int lazy = 0;
+
+    lock_cache(cache);
+    item = NULL;
+    find_in_cache(cache, file_name, &item);
+    now = cache->now();
+
+    if (item != NULL && (item->file).loaded
+            && !gcache_expired((item->file).expiration, now))
+        result = FETCH_HIT;
+    else if (item == NULL && max_age < 0)
+        result = FETCH_MISS;
+    else
+        result = 0;
+
+    if (item != NULL && (item->file).loaded && (item->file).len != -1)
+        job.meta = (item->file).meta; // revalidate: read only if changed
+    lazy = (item == NULL && cache->lazy);
+    unlock_cache(cache);
+
+    if (result == 0) {
+        job.name = file_name;
+
+        if (lazy) { // a lazy PUT only stats, as in push_back_cache()
+            job.gone = (stat_file_meta(file_name, &job.meta) == -1);
+            job.len = job.gone ? -1 : (int)job.meta.size;
+        }
+        else {
+            run_refresh(&job); // a zeroed meta never matches: always reads
+        }
+
+        lock_cache(cache);
+        result = apply_fetch(cache, &job, max_age, lazy);
+        unlock_cache(cache);
+    }
+
+    land_flight(cache->flights, file_name, result);
+    return result;
+}
+
+
+/* expire_item_cache()
+ * @brief   marks a cached file as expired, so its next GET revalidates it
+ * @param   cache: a struct cache_t pointer
+ * @param   file_name: name of file to expire
+ * @returns modified struct cache_t pointer, cast to void pointer
+ */
+void *expire_item_cache(C_T cache, char *file_name)
+{
+    cache_item_t item = NULL;
+    find_in_cache(cache, file_name, &item);
+
+    if (item != NULL) {
+        (item->file).expiration = 0;
+        atomic_fetch_add(&cache->epoch, 1);
+    }
+
+    return (void *)cache;
+}
+
+
+/* acquire_file_cache()
+ * @brief   looks up a file and pins its current data, so it can be read
+ *          without the cache's lock: the data stays valid (and unchanged)
+ *          until the handle is released, even if the file is evicted,
+ *          reloaded or dropped in the meantime
+ * @param   cache: a struct cache_t pointer
+ * @param   file_name: name of file to look up
+ * @returns a handle on the file's data, to be passed to release_file_cache;
+ *          NULL if file_name isn't cached, or has no data (unreadable, or
+ *          not loaded yet)
+ * @note    doesn't count as a GET; pair with touch_item_cache() for that
+ */
+payload_t *acquire_file_cache(C_T cache, char *file_name)
+{
+    cache_item_t item = NULL;
+    find_in_cache(cache, file_name, &item);
+
+    if (item == NULL || (item->file).payload == NULL)
+        return NULL;
+
+    payload_t *handle = (item->file).payload;
+    atomic_fetch_add(&handle->refs, 1);
+    return handle;
+}
+
+
+/* release_file_cache()
+ * @brief   drops a reference to a file's data; the last reference (the
+ *          cache's, or a handle's) frees it
+ * @param   handle: a handle from acquire_file_cache(); NULL does nothing
+ * @note    may be called without the cache's lock
+ */
+void release_file_cache(payload_t *handle)
+{
+    if (handle == NULL)
+        return;
+
+    if (atomic_fetch_sub(&handle->refs, 1) == 1) {
+        if (handle->store != NULL)
+            forget_dedup(handle);
+
+        int i;
+        for (i = 0; i < handle->n_parts; i++)
+            release_file_cache(handle->parts[i]);
+        free(handle->parts);
+        free(handle->data);
+        free(handle);
+    }
+}
+
+
+/* create_payload()
+ * @brief   wraps data in a new payload, for data that didn't come from the
+ *          cache (e.g. a response fetched by the proxy), so it can be sent
+ *          and shared like a cached file's
+ * @param   data: malloc'd data; the payload takes ownership of it
+ * @param   len: length of data
+ * @returns a payload with one reference, the caller's, to be dropped with
+ *          release_file_cache()
+ */
+payload_t *create_payload(unsigned char *data, int len)
+{
+    payload_t *payload = malloc(sizeof(payload_t));
+    payload->data = data;
+    payload->len = len;
+    payload->packed = 0;
+    atomic_init(&payload->refs, 1);
+    payload->parts = NULL;
+    payload->n_parts = 0;
+    payload->skip = 0;
+    payload->off = 0;
+    payload->store = NULL;
+    payload->hash = 0;
+
+    return payload;
+}
+
+
+/* unpack_file_cache()
+ * @brief   for a caller that needs a file's data in one piece, as it is
+ *          (e.g. to send it with writev()), swaps a handle on compressed
+ *          data, or a view of chunks, for a handle on a plain copy
+ * @param   handle: a handle from acquire_file_cache() (or
+ *          acquire_range_cache()); it's released if it's replaced
+ * @returns handle itself, if its data is already plain; otherwise a new
+ *          payload with one reference, the caller's, and handle's offset;
+ *          NULL if the data couldn't be decompressed
+ * @note    may be called without the cache's lock; a caller that can take
+ *          the data a piece at a time should use stream_lz(), or the
+ *          view's parts, instead, which don't need a copy
+ */
+payload_t *unpack_file_cache(payload_t *handle)
+{
+    if (handle == NULL || (handle->packed == 0 && handle->parts == NULL))
+        return handle;
+
+    unsigned char *data = malloc(handle->len > 0 ? handle->len : 1);
+    payload_t *raw = NULL;
+
+    if (handle->parts != NULL) {
+        int skip = handle->skip, done = 0, i;
+        for (i = 0; i < handle->n_parts; i++) {
+            int take = handle->parts[i]->len - skip;
+            if (take > handle->len - done)
+                take = handle->len - done;
+            memcpy(data + done, handle->parts[i]->data + skip, take);
+            done += take;
+            skip = 0;
+        }
+        raw = create_payload(data, handle->len);
+        raw->off = handle->off;
+    }
+    else if (unpack_lz(handle->data, handle->packed, data,
+                       handle->len) == 0) {
+        raw = create_payload(data, handle->len);
+    }
+    else {
+        free(data);
+    }
+
+    release_file_cache(handle);
+    return raw;
+}
+
+
+/* acquire_range_cache()
+ * @brief   pins the bytes of a range of a cached file, as
+ *          acquire_file_cache() does the whole of it: a chunked file's
+ *          chunks in the range are read if they aren't loaded, and pinned
+ *          together in a view; its other chunks are left as they are
+ * @param   cache: a struct cache_t pointer
+ * @param   file_name: name of the file
+ * @param   range: the bytes wanted; cut short at the end of the file
+ * @returns a handle to release with release_file_cache(): the file's own
+ *          payload, for all of a file that isn't chunked; otherwise a view
+ *          (see payload_t). NULL if file_name isn't cached or has no data,
+ *          or a chunk couldn't be read
+ * @note    chunks are read with the cache's lock held. a source that's
+ *          changed since the file was cached is revalidated, and the read
+ *          tried again, so a view never mixes two versions of a file
+ */
+payload_t *acquire_range_cache(C_T cache, char *file_name, range_t range)
+{
+    int tries;
+
+    for (tries = 0; tries < 2; tries++) {
+        cache_item_t item = NULL;
+        find_in_cache(cache, file_name, &item);
+        if (item == NULL || (item->file).len == -1)
+            return NULL;
+
+        cache_file_t *file = &item->file;
+        int off = (range.off < file->len) ? range.off : file->len;
+        int len = file->len - off;
+        if (range.len >= 0 && range.len < len)
+            len = range.len;
+
+        if (file->chunks == NULL) {
+            payload_t *whole = acquire_file_cache(cache, file_name);
+            if (whole == NULL || (off == 0 && len == file->len))
+                return whole;
+
+            whole = unpack_file_cache(whole);
+            if (whole == NULL)
+                return NULL;
+            payload_t **parts = malloc(sizeof(payload_t *));
+            parts[0] = whole;
+            return create_view(parts, 1, off, off, len);
+        }
+
+        int first = off / cache->chunk_len;
+        int n = (len == 0) ? 0 : (off + len - 1) / cache->chunk_len - first + 1;
+        payload_t **parts = malloc((n > 0 ? n : 1) * sizeof(payload_t *));
+        int i;
+
+        for (i = 0; i < n; i++)
+            if ((parts[i] = load_chunk(cache, file, first + i)) == NULL)
+                break;
+
+        if (i == n)
+            return create_view(parts, n, off - first * cache->chunk_len,
+                               off, len);
+
+        // the source changed (or went away) under the file
+        while (i-- > 0)
+            release_file_cache(parts[i]);
+        free(parts);
+        revalidate_item_cache(cache, file_name);
+    }
+
+    return NULL;
+}
+
+
+/* store_http_cache()
+ * @brief   stores a response fetched from an HTTP origin, keyed by its
+ *          request target, as a PUT stores a file: a cached target gets
+ *          the new body, validators and lifetime; a new one is admitted
+ *          (evicting to make room) and stored
+ * @param   cache: a struct cache_t pointer
+ * @param   target: the request target; copied
+ * @param   body: the response's body, which the cache shares (taking its
+ *          own reference) rather than copies; the caller keeps its own
+ * @param   max_age: lifetime, in seconds; 0 to revalidate on every use
+ * @param   http: the origin's validators; copied
+ * @returns a PUT_* outcome: PUT_STORED, PUT_UPDATED or PUT_REJECTED
+ * @note    the stored response has no source file: it's never spilled or
+ *          snapshotted, and eviction doesn't delete anything
+ */
+int store_http_cache(C_T cache, char *target, payload_t *body, int max_age,
+                     http_meta_t *http)
+{
+    if (cache == NULL || target == NULL || body == NULL)
+        return PUT_REJECTED;
+
+    cache_item_t item = NULL;
+    find_in_cache(cache, target, &item);
+
+    if (item == NULL) {
+        if (cache->size >= cache->cap) {
+            if (!admit_file_cache(cache, target))
+                return PUT_REJECTED;
+            evict_one(cache);
+        }
+
+        file_meta_t meta = { 0 };
+        item = build_cache_item(strdup(target), max_age, NULL, -1, &meta, 1,
+                                cache->now());
+        (item->file).http = malloc(sizeof(http_meta_t));
+        link_item(cache, item);
+    }
+
+    cache_file_t *file = &item->file;
+    int stored = (file->payload == NULL) ? PUT_STORED : PUT_UPDATED;
+
+    release_file_cache(file->payload);
+    atomic_fetch_add(&body->refs, 1);
+    atomic_fetch_add(&cache->epoch, 1);
+    file->payload = body;
+    file->data = body->data;
+    file->len = body->len;
+
+    *(file->http) = *http;
+    file->max_age = max_age;
+    file->expiration = gcache_expires(cache->now(), max_age);
+    file->hits = 0;
+
+    return stored;
+}
+
+
+/* renew_http_cache()
+ * @brief   renews a cached response that the origin has just confirmed is
+ *          unchanged (a 304), like revalidate_item_cache() does for a file
+ *          whose source is unchanged: its body is kept, and only its
+ *          lifetime (and any validators the 304 updates) are replaced
+ * @param   cache: a struct cache_t pointer
+ * @param   target: the request target
+ * @param   max_age: new lifetime, in seconds
+ * @param   http: the 304's validators; an empty ETag, or a Last-Modified
+ *          of 0, leaves the cached one as it was
+ * @returns modified struct cache_t pointer, cast to void pointer
+ */
+void *renew_http_cache(C_T cache, char *target, int max_age,
+                       http_meta_t *http)
+{
+    cache_item_t item = NULL;
+    find_in_cache(cache, target, &item);
+
+    if (item == NULL || (item->file).http == NULL)
+        return (void *)cache;
+
+    cache_file_t *file = &item->file;
+    if (http->etag[0] != '\0')
+        strcpy(file->http->etag, http->etag);
+    if (http->last_modified != 0)
+        file->http->last_modified = http->last_modified;
+
+    file->max_age = max_age;
+    file->expiration = gcache_expires(cache->now(), max_age);
+    file->hits = 0;
+
+    cache->stats.revalidated++;
+    cache->stats.revalidated_bytes += file->len;
+
+    return (void *)cache;
+}
+
+
+/* enable_spill_cache()
+ * @brief   turns on a second, on-disk tier: evicted files are spilled to a
+ *          log-structured store (see spill.h), and a miss checks it before
+ *          giving up (GETs) or going back to the source (PUTs)
+ * @param   cache: a struct cache_t pointer
+ * @param   dir: directory to keep the store in; a private subdirectory is
+ *          made there, and removed by free_cache()
+ * @param   budget: max bytes of the store
+ * @returns modified struct cache_t pointer, cast to void pointer; the cache
+ *          is left without an L2 if the store can't be made
+ */
+void *enable_spill_cache(C_T cache, char *dir, uint64_t budget)
+{
+    if (cache == NULL)
+        return NULL;
+
+    free_spill(cache->spill);
+    cache->spill = create_spill(dir, budget);
+    return (void *)cache;
+}
+
+
+/* promote_spill_cache()
+ * @brief   moves a file that isn't cached back in from L2, with the data,
+ *          MAX-AGE and expiration it was evicted with
+ * @param   cache: a struct cache_t pointer
+ * @param   file_name: name of file to promote; copied
+ * @returns 1 if it was promoted; 0 if it's already cached, or not in L2
+ * @note    makes room by evicting, as a PUT would (the victim may spill in
+ *          turn), but skips admission: the file was just asked for
+ */
+int promote_spill_cache(C_T cache, char *file_name)
+{
+    if (cache == NULL || cache->spill == NULL
+            || find_in_cache(cache, file_name, NULL) == 0)
+        return 0;
+
+    spill_entry_t entry;
+    if (!take_spill(cache->spill, file_name, &entry))
+        return 0;
+
+    if (cache->size >= cache->cap)
+        evict_one(cache);
+
+    cache_item_t item = build_cache_item(strdup(file_name), entry.max_age,
+                                         entry.data, entry.len, &entry.meta,
+                                         1, cache->now());
+    (item->file).expiration = entry.expiration;
+    link_item(cache, item);
+    cache->stats.l2_hits++;
+
+    return 1;
+}
+
+
+/* save_snapshot_cache()
+ * @brief   writes a snapshot of the cache to path: every file's name, data
+ *          and metadata, in cache order, and the admission sketch
+ * @param   cache: a struct cache_t pointer
+ * @param   path: file to write; replaced only once the snapshot is whole
+ * @returns number of files saved, or -1 if the snapshot couldn't be written
+ * @note    times are saved relative to now (time left before expiration,
+ *          time since the last GET), since the cache's clock restarts with
+ *          the process. unreadable files aren't saved; lazily PUT files that
+ *          were never loaded are saved without data.
+ */
+int save_snapshot_cache(C_T cache, char *path)
+{
+    if (cache == NULL)
+        return -1;
+
+    size_t policy_len = size_of_tinylfu(cache->admit);
+    unsigned char *policy = NULL;
+    if (policy_len > 0) {
+        policy = malloc(policy_len);
+        dump_tinylfu(cache->admit, policy);
+    }
+
+    SNAP_T snap = create_snapshot(path, policy, policy_len);
+    free(policy);
+    if (snap == NULL)
+        return -1;
+
+    clock_t now = cache->now();
+    int saved = 0;
+    cache_item_t curr;
+
+    for (curr = cache->head; curr != NULL; curr = curr->next) {
+        cache_file_t *file = &curr->file;
+        if (file->len == -1 || file->http != NULL)
+            continue;
+
+        snapshot_entry_t entry = {
+            file->loaded ? raw_data(file) : NULL, file->len, file->max_age,
+            file->stale, file->expiration - now,
+            (file->last_retrieved == 0) ? -1 : now - file->last_retrieved,
+            file->meta
+        };
+        int added = add_snapshot(snap, file->name, &entry);
+        if (entry.data != file->data)
+            free(entry.data);
+        if (added == -1)
+            break;
+        saved++;
+    }
+
+    return (commit_snapshot(snap) == 0) ? saved : -1;
+}
+
+
+/* load_snapshot_cache()
+ * @brief   warms the cache from a snapshot written by save_snapshot_cache()
+ * @param   cache: a struct cache_t pointer
+ * @param   path: the snapshot
+ * @returns number of files restored, or -1 if path isn't a snapshot
+ * @note    a file is only restored if its source's size, mtime and inode
+ *          still match the snapshot's; files already cached, and any past
+ *          the cache's capacity, are skipped (nothing is evicted). a
+ *          snapshot that was cut short is restored up to its last whole
+ *          record.
+ * @note    the admission sketch is restored too, if the cache has one of
+ *          the same width
+ */
+int load_snapshot_cache(C_T cache, char *path)
+{
+    if (cache == NULL)
+        return -1;
+
+    SNAP_T snap = open_snapshot(path);
+    if (snap == NULL)
+        return -1;
+
+    uint32_t policy_len;
+    unsigned char *policy = policy_of_snapshot(snap, &policy_len);
+    if (policy != NULL)
+        restore_tinylfu(cache->admit, policy, policy_len);
+
+    clock_t now = cache->now();
+    int restored = 0;
+    char *file_name;
+    snapshot_entry_t entry;
+
+    while (next_snapshot(snap, &file_name, &entry)) {
+        if (cache->size >= cache->cap
+                || find_in_cache(cache, file_name, NULL) == 0) {
+            cache->stats.snap_skipped++;
+            continue;
+        }
+
+        file_meta_t meta;
+        if (stat_file_meta(file_name, &meta) == -1
+                || meta.size != entry.meta.size
+                || meta.mtime != entry.meta.mtime
+                || meta.mtime_nsec != entry.meta.mtime_nsec
+                || meta.ino != entry.meta.ino) {
+            cache->stats.snap_changed++;
+            continue;
+        }
+
+        int loaded = (entry.data != NULL);
+        unsigned char *data = NULL;
+        if (loaded) {
+            data = malloc(entry.len > 0 ? entry.len : 1);
+            memcpy(data, entry.data, entry.len);
+            cache->stats.snap_restored_bytes += entry.len;
+        }
+
+        cache_item_t item = build_cache_item(strdup(file_name), entry.max_age,
+                                             data, loaded ? entry.len
+                                                          : (int)meta.size,
+                                             &meta, loaded, now);
+        cache_file_t *file = &item->file;
+        file->expiration = now + entry.expires_in;
+        if (entry.idle >= 0) // 0 means never retrieved, so keep clear of it
+            file->last_retrieved = (now - entry.idle != 0) ? now - entry.idle
+                                                           : -1;
+        link_item(cache, item);
+        set_stale_cache(cache, file->name, entry.stale);
+
+        cache->stats.snap_restored++;
+        restored++;
+    }
+
+    cache->stats.snap_truncated += truncated_snapshot(snap);
+    close_snapshot(snap);
+
+    return restored;
+}
+
+
+/* print_cache()
+ * @brief   prints out the contents of the cache
+ * @param   cache   cache instance to print
+ * @returns none
+ */
+void print_cache(C_T cache)
+{
+    if (cache == NULL)
+        return;
+
+    cache_item_t curr = cache->head;
+    int ind = 1;
+
+    while (curr != NULL) {
+        printf("\t%i: ", ind);
+        print_file_struct(curr->file);
+        ind++;
+
+        curr = curr->next;
+    }
+
+    int i; 
+    for (i = ind; i <= cache->cap; i++)
+        printf("\t%i: NO FILE\n", i);
+}
+
+
+/* enable_admission_cache()
+ * @brief   turns on TinyLFU admission: new files only displace the next
+ *          eviction victim if they've been accessed more often than it
+ * @param   cache: a struct cache_t pointer
+ * @param   width: minimum counters per row in the frequency sketch
+ * @returns modified struct cache_t pointer, cast to void pointer
+ * @note    if admission is already on, its sketch is reset
+ */
+void *enable_admission_cache(C_T cache, int width)
+{
+    if (cache == NULL)
+        return NULL;
+
+    free_tinylfu(cache->admit);
+    cache->admit = create_tinylfu(width);
+
+    return (void *)cache;
+}
+
+
+/* enable_filter_cache()
+ * @brief   turns on a counting bloom filter over the cache's file names, so
+ *          that lookups of files that aren't cached skip the list walk
+ * @param   cache: a struct cache_t pointer
+ * @param   fp_rate: target false-positive rate, in (0, 1)
+ * @returns modified struct cache_t pointer, cast to void pointer
+ * @note    the filter is rebuilt from the cache list whenever it degrades
+ *          past its target (see degraded_bloom())
+ */
+void *enable_filter_cache(C_T cache, double fp_rate)
+{
+    if (cache == NULL)
+        return NULL;
+
+    cache->filter_fp = fp_rate;
+    rebuild_filter(cache);
+    cache->stats.filter_rebuilds = 0;
+
+    return (void *)cache;
+}
+
+
+/* enable_negative_cache()
+ * @brief   turns on negative caching: files that can't be read are kept in
+ *          a separate list, so repeated requests for them don't re-open()
+ * @param   cache: a struct cache_t pointer
+ * @param   ttl: seconds before a negative entry is re-checked at the source
+ * @param   cap: max negative entries; these don't count against the cache's
+ *          own capacity. when full, the oldest negative entry is dropped.
+ * @returns modified struct cache_t pointer, cast to void pointer
+ */
+void *enable_negative_cache(C_T cache, int ttl, int cap)
+{
+    if (cache == NULL)
+        return NULL;
+
+    if (ttl < 1 || cap < 1) {
+        ttl = 0;
+        cap = 0;
+    }
+
+    cache->neg_ttl = ttl;
+    cache->neg_cap = cap;
+
+    while (cache->neg_size > cache->neg_cap)
+        remove_negative(cache, NULL);
+
+    return (void *)cache;
+}
+
+
+/* is_negative_cache()
+ * @brief   checks whether file_name is known to be unreadable
+ * @param   cache: a struct cache_t pointer
+ * @param   file_name: name of file to check
+ * @returns 1 if file_name has a live negative entry; otherwise 0
+ * @note    an expired negative entry is dropped, so the next request goes
+ *          back to the source. hits are counted in the cache's stats.
+ */
+int is_negative_cache(C_T cache, char *file_name)
+{
+    if (cache == NULL || cache->neg_head == NULL)
+        return 0;
+
+    neg_item_t prev = NULL;
+    neg_item_t curr = cache->neg_head;
+
+    while (curr != NULL) {
+        if (strcmp(curr->name, file_name) == 0) {
+            if (gcache_expired(curr->expiration, cache->now())) {
+                remove_negative(cache, prev);
+                return 0;
+            }
+
+            cache->stats.neg_hits++;
+            return 1;
+        }
+
+        prev = curr;
+        curr = curr->next;
+    }
+
+    return 0;
+}
+
+
+/* invalidate_negative_cache()
+ * @brief   drops file_name's negative entry, if it has one
+ * @param   cache: a struct cache_t pointer
+ * @param   file_name: name of file that has (re)appeared
+ * @returns modified struct cache_t pointer, cast to void pointer
+ */
+void *invalidate_negative_cache(C_T cache, char *file_name)
+{
+    if (cache == NULL)
+        return NULL;
+
+    neg_item_t prev = NULL;
+    neg_item_t curr = cache->neg_head;
+
+    while (curr != NULL) {
+        if (strcmp(curr->name, file_name) == 0) {
+            remove_negative(cache, prev);
+            break;
+        }
+
+        prev = curr;
+        curr = curr->next;
+    }
+
+    return (void *)cache;
+}
+
+
+/* enable_lazy_cache()
+ * @brief   turns on lazy PUTs: new files are only stat'd, and their data is
+ *          read in by load_item_cache() on their first GET
+ * @param   cache: a struct cache_t pointer
+ * @returns modified struct cache_t pointer, cast to void pointer
+ */
+void *enable_lazy_cache(C_T cache)
+{
+    if (cache == NULL)
+        return NULL;
+
+    cache->lazy = 1;
+    return (void *)cache;
+}
+
+
+/* enable_compress_cache()
+ * @brief   turns on in-memory compression: a file of at least min_len
+ *          bytes is kept compressed (see lz.h) once it's read, if that
+ *          makes it at least min_ratio times smaller; other files, and
+ *          proxied responses, are kept as they are
+ * @param   cache: a struct cache_t pointer
+ * @param   min_len: smallest file to compress, in bytes
+ * @param   min_ratio: least original / compressed size worth keeping
+ * @returns modified struct cache_t pointer, cast to void pointer
+ * @note    files are compressed as they're stored, with the cache's lock
+ *          held; handles on them get the compressed data (see payload_t)
+ */
+void *enable_compress_cache(C_T cache, int min_len, double min_ratio)
+{
+    if (cache == NULL)
+        return NULL;
+
+    cache->pack_min = (min_len > 0) ? min_len : 1;
+    cache->pack_ratio = (min_ratio > 1) ? min_ratio : 1;
+    return (void *)cache;
+}
+
+
+/* enable_dedup_cache()
+ * @brief   turns on content-addressed dedup: whenever a file's data is read
+ *          (or restored), it's hashed, and if a cached payload holds the
+ *          same bytes, the file shares that payload and its own copy is
+ *          freed; shared data is held (and compressed) once
+ * @param   cache: a struct cache_t pointer
+ * @returns modified struct cache_t pointer, cast to void pointer
+ * @note    the hash (see hash_data) only finds candidates: data is compared
+ *          in full before it's shared. hashing, like compression, is done
+ *          with the cache's lock held
+ * @note    chunks and proxied responses aren't deduplicated
+ */
+void *enable_dedup_cache(C_T cache)
+{
+    if (cache == NULL)
+        return NULL;
+
+    if (cache->dedup == NULL) {
+        dedup_t *store = malloc(sizeof(dedup_t));
+        pthread_mutex_init(&store->lock, NULL);
+        store->buckets = calloc(DEDUP_BUCKETS, sizeof(dedup_entry_t *));
+        store->mask = DEDUP_BUCKETS - 1;
+        store->entries = 0;
+        cache->dedup = store;
+    }
+    return (void *)cache;
+}
+
+
+/* enable_chunks_cache()
+ * @brief   turns on chunked storage: a file bigger than chunk_len is only
+ *          stat'd when it's PUT, and its data is kept in chunks of
+ *          chunk_len bytes, each read when a GET first touches it (see
+ *          acquire_range_cache) and evicted on its own, least recently
+ *          used first, to keep the chunks of every file within budget
+ * @param   cache: a struct cache_t pointer
+ * @param   chunk_len: bytes per chunk
+ * @param   budget: most bytes of chunks loaded at once
+ * @returns modified struct cache_t pointer, cast to void pointer
+ * @note    chunks are never compressed, spilled to L2 or snapshotted: a
+ *          chunked file is saved without data, like a lazy PUT
+ */
+void *enable_chunks_cache(C_T cache, int chunk_len, uint64_t budget)
+{
+    if (cache == NULL || chunk_len <= 0)
+        return NULL;
+
+    cache->chunk_len = chunk_len;
+    cache->chunk_budget = budget;
+    return (void *)cache;
+}
+
+
+/* load_item_cache()
+ * @brief   reads a lazily PUT file's data into its cache item
+ * @param   cache: a struct cache_t pointer
+ * @param   file_name: name of file to load
+ * @returns 1 if the item's data is (now) loaded; 0 if file_name isn't cached
+ *          or couldn't be read
+ * @note    an item is loaded at most once: every later GET shares the same
+ *          buffer. if the read fails, the item is left as an eager PUT of an
+ *          unreadable file would be (NULL data, len -1).
+ */
+int load_item_cache(C_T cache, char *file_name)
+{
+    cache_item_t item = NULL;
+    find_in_cache(cache, file_name, &item);
+
+    if (item == NULL)
+        return 0;
+
+    cache_file_t *file = &item->file;
+    if (file->loaded)
+        return file->data != NULL;
+
+    unsigned char *buffer = NULL;
+    file_meta_t meta;
+    int len = read_file_with_meta(file->name, &buffer, &meta);
+
+    file->loaded = 1;
+    if (len == -1) {
+        free(buffer);
+        set_data(cache, file, NULL, -1);
+        return 0;
+    }
+
+    set_data(cache, file, buffer, len);
+    keep_data(cache, file);
+    file->meta = meta;
+    cache->stats.lazy_loaded += len;
+
+    return 1;
+}
+
+
+/* record_access_cache()
+ * @brief   records an access to file_name in the admission sketch
+ * @param   cache: a struct cache_t pointer
+ * @param   file_name: name of file that was requested (GET or PUT)
+ * @note    does nothing if admission is off
+ */
+void record_access_cache(C_T cache, char *file_name)
+{
+    if (cache == NULL || cache->admit == NULL)
+        return;
+
+    increment_tinylfu(cache->admit, file_name);
+}
+
+
+/* admit_file_cache()
+ * @brief   decides whether a new file may take the place of the file that
+ *          evict_one would evict next
+ * @param   cache: a struct cache_t pointer
+ * @param   file_name: name of the candidate file
+ * @returns 1 if the candidate should be admitted, 0 if it should be dropped
+ * @note    always admits if admission is off, or if the victim is expired;
+ *          otherwise the candidate must be strictly more frequent. rejected
+ *          candidates are counted in the cache's stats.
+ */
+int admit_file_cache(C_T cache, char *file_name)
+{
+    if (cache == NULL || cache->admit == NULL)
+        return 1;
+
+    int expired = 0;
+    cache_item_t victim = pick_victim(cache, &expired);
+
+    if (victim == NULL || expired)
+        return 1;
+
+    int cand_freq = estimate_tinylfu(cache->admit, file_name);
+    int victim_freq = estimate_tinylfu(cache->admit, (victim->file).name);
+
+    if (cand_freq > victim_freq)
+        return 1;
+
+    cache->stats.rejected++;
+    return 0;
+}
+
+
+/* stats_of_cache()
+ * @brief   returns the cache's running counters
+ * @param   cache: a struct cache_t pointer
+ * @returns pointer to the counters, owned by the cache; NULL if invalid
+ */
+cache_stats_t *stats_of_cache(C_T cache)
+{
+    if (cache == NULL)
+        return NULL;
+
+    return &cache->stats;
+}
+
+
+/* epoch_of_cache()
+ * @brief   returns the cache's epoch: a counter bumped (under the cache's
+ *          lock) whenever a cached file's data is replaced, its file is
+ *          expired by hand, or it leaves the cache
+ * @param   cache: a struct cache_t pointer
+ * @returns the epoch; 0 if cache is NULL
+ * @note    may be called without the cache's lock. data looked up after
+ *          reading epoch e is unchanged for as long as the epoch is still e,
+ *          which is what lets a thread's L0 (see l0.h) skip the lock
+ * @note    renewing a file's expiration (revalidating it unchanged, or
+ *          PUTting it again) doesn't bump it
+ */
+uint64_t epoch_of_cache(C_T cache)
+{
+    if (cache == NULL)
+        return 0;
+
+    return atomic_load(&cache->epoch);
+}
+
+
+/* set_log_cache()
+ * @brief   chooses where the cache's messages (evictions, and the sim's
+ *          per-command lines) and its stats go
+ * @param   cache: a struct cache_t pointer
+ * @param   out: stream to print them to (stdout by default); NULL turns
+ *          the messages off, and stats go to stdout
+ * @returns modified struct cache_t pointer, cast to void pointer
+ */
+void *set_log_cache(C_T cache, FILE *out)
+{
+    if (cache == NULL)
+        return NULL;
+
+    cache->log = out;
+    return (void *)cache;
+}
+
+
+/* set_clock_cache()
+ * @brief   chooses the clock the cache stamps its items by and checks their
+ *          expirations against
+ * @param   cache: a struct cache_t pointer
+ * @param   now: returns the time now, in clock_t ticks: gcache_clock_cpu
+ *          (the default, as the sim replays by) or gcache_clock_mono, for a
+ *          cache whose max-ages are wall time (see gcache.h)
+ * @returns modified struct cache_t pointer, cast to void pointer
+ * @note    set it before anything is put: stamps already taken are on the
+ *          old clock
+ */
+void *set_clock_cache(C_T cache, clock_t (*now)(void))
+{
+    if (cache == NULL || now == NULL)
+        return NULL;
+
+    cache->now = now;
+    return (void *)cache;
+}
+
+
+/* now_cache()
+ * @brief   returns the time now, by the cache's clock
+ * @param   cache: a struct cache_t pointer
+ */
+clock_t now_cache(C_T cache)
+{
+    return cache->now();
+}
+
+
+/* log_of_cache()
+ * @brief   returns where the cache's messages go; NULL if they're off
+ * @param   cache: a struct cache_t pointer
+ */
+FILE *log_of_cache(C_T cache)
+{
+    return (cache != NULL) ? cache->log : NULL;
+}
+
+
+/* log_cache()
+ * @brief   prints a message about what the cache is doing to its log
+ * @param   cache: a struct cache_t pointer
+ * @param   format: printf() format, and its arguments
+ * @returns none
+ * @note    with the log off, nothing is formatted
+ */
+void log_cache(C_T cache, const char *format, ...)
+{
+    if (cache == NULL || cache->log == NULL)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(cache->log, format, args);
+    va_end(args);
+}
+
+
+/* print_stats_cache()
+ * @brief   prints out the cache's running counters, to its log
+ * @param   cache: a struct cache_t pointer
+ * @returns none
+ */
+void print_stats_cache(C_T cache)
+{
+    if (cache == NULL)
+        return;
+
+    // stats were asked for, so they're printed even with messages off
+    FILE *out = (cache->log != NULL) ? cache->log : stdout;
+    cache_stats_t *st = &cache->stats;
+    double ratio = 0;
+    if (st->gets > 0)
+        ratio = 100.0 * (double)st->hits / (double)st->gets;
+
+    fprintf(out, "STATS: %lu GETs, %lu hits, %lu misses (hit ratio "
+            "%0.2lf%%)\n", st->gets, st->hits, st->misses, ratio);
+    fprintf(out, "STATS: %lu PUTs, %lu evictions, %lu rejected by admission\n",
+            st->puts, st->evictions, st->rejected);
+
+    if (cache->filter != NULL)
+        fprintf(out, "STATS: filter skipped %lu lookups, %lu false "
+                "positives, %lu rebuilds\n", st->filter_skips,
+                st->filter_false_pos, st->filter_rebuilds);
+
+    if (cache->neg_ttl > 0)
+        fprintf(out, "STATS: %lu negative entries recorded, %lu negative "
+                "hits\n", st->neg_inserts, st->neg_hits);
+
+    if (st->revalidated + st->reloaded > 0)
+        fprintf(out, "STATS: %lu expired files revalidated unchanged (%lu "
+                "bytes not re-read), %lu reloaded (%lu bytes read)\n",
+                st->revalidated, st->revalidated_bytes, st->reloaded,
+                st->reloaded_bytes);
+
+    if (cache->refresher != NULL)
+        fprintf(out, "STATS: %lu GETs served stale, %lu background refreshes "
+                "(%lu found new data)\n", st->stale_served, st->bg_refreshes,
+                st->bg_changed);
+
+    if (cache->ahead_fraction > 0) {
+        // files whose last refresh-ahead is still unused count as wasted
+        uint64_t wasted = st->ahead_wasted;
+        cache_item_t curr;
+        for (curr = cache->head; curr != NULL; curr = curr->next)
+            wasted += ((curr->file).ahead == 2);
+
+        fprintf(out, "STATS: %lu refresh-aheads issued, %lu wasted\n",
+                st->ahead_issued, wasted);
+    }
+
+    if (cache->watcher != NULL)
+        fprintf(out, "STATS: %lu watch events, %lu files dropped, %lu "
+                "revalidated\n", st->watch_events, st->watch_invalidations,
+                st->watch_reloads);
+
+    if (st->fetch_shared + st->fetch_timeouts > 0)
+        fprintf(out, "STATS: %lu source reads by fetches, %lu fetches shared "
+                "a concurrent read (%lu timed out), %lu failed\n",
+                st->fetch_loads, st->fetch_shared, st->fetch_timeouts,
+                st->fetch_errors);
+
+    if (cache->spill != NULL) {
+        spill_stats_t *l2 = stats_of_spill(cache->spill);
+        uint64_t l1_misses = st->misses + st->l2_hits;
+        double l1 = 0, l2_ratio = 0;
+        if (st->gets > 0)
+            l1 = 100.0 * (double)(st->hits - st->l2_hits) / (double)st->gets;
+        if (l1_misses > 0)
+            l2_ratio = 100.0 * (double)st->l2_hits / (double)l1_misses;
+
+        fprintf(out, "STATS: L1 hit ratio %0.2lf%% (%lu of %lu GETs), L2 hit "
+                "ratio %0.2lf%% (%lu of %lu L1 misses), %lu PUTs taken from "
+                "L2\n", l1, st->hits - st->l2_hits, st->gets, l2_ratio,
+                st->l2_hits, l1_misses, st->l2_put_hits);
+        fprintf(out, "STATS: L2 spilled %lu files (%lu bytes), %lu lost to "
+                "its budget, %lu too big; %lu bytes on disk\n", l2->spilled,
+                l2->spilled_bytes, l2->lost, l2->too_big,
+                bytes_of_spill(cache->spill));
+    }
+
+    if (st->snap_restored + st->snap_changed + st->snap_skipped > 0)
+        fprintf(out, "STATS: snapshot restored %lu files (%lu bytes), %lu "
+                "dropped as changed, %lu skipped%s\n", st->snap_restored,
+                st->snap_restored_bytes, st->snap_changed, st->snap_skipped,
+                st->snap_truncated ? " (snapshot was cut short)" : "");
+
+    if (cache->lazy)
+        fprintf(out, "STATS: lazy PUTs deferred %lu bytes, %lu loaded on "
+                "first GET, %lu bytes of reads saved\n", st->lazy_deferred,
+                st->lazy_loaded, st->lazy_deferred - st->lazy_loaded);
+
+    if (cache->pack_min > 0) {
+        double gain = 1;
+        if (st->packed_out > 0)
+            gain = (double)st->packed_in / (double)st->packed_out;
+
+        fprintf(out, "STATS: %lu files compressed, %lu bytes kept in %lu "
+                "(%0.2lfx the room), %lu didn't shrink enough\n", st->packed,
+                st->packed_in, st->packed_out, gain, st->pack_skipped);
+    }
+
+    if (cache->dedup != NULL) {
+        uint64_t logical = 0;
+        uint64_t held = held_bytes(cache, &logical);
+        double mb_s = 0;
+        if (st->dedup_hash_ns > 0)
+            mb_s = st->dedup_hashed_bytes / (st->dedup_hash_ns / 1e9)
+                   / (1024 * 1024);
+        fprintf(out, "STATS: %lu files hashed (%lu bytes, %0.0lf MB/s), %lu "
+                "shared cached data (%lu bytes), %lu hash collisions\n",
+                st->dedup_hashed, st->dedup_hashed_bytes, mb_s,
+                st->dedup_shared, st->dedup_shared_bytes,
+                st->dedup_collisions);
+        fprintf(out, "STATS: %lu bytes of files held in %lu (dedup ratio "
+                "%0.2lfx)\n", logical, held,
+                (held > 0) ? (double)logical / held : 1.0);
+    }
+
+    if (st->l0_hits > 0 || st->l0_fills > 0)
+        fprintf(out, "STATS: %lu GETs answered by per-thread L0s, %lu L0 "
+                "slots filled, %lu found stale\n", st->l0_hits, st->l0_fills,
+                st->l0_stale);
+
+    direct_stats_t direct;
+    if (stats_direct_file_sys(&direct) > 0)
+        fprintf(out, "STATS: %lu reads with O_DIRECT (%lu bytes), %lu fell "
+                "back to the page cache, %lu waited for a bounce buffer\n",
+                direct.reads, direct.bytes, direct.fallbacks,
+                direct.pool_waits);
+
+    if (cache->chunk_len > 0)
+        fprintf(out, "STATS: %lu chunks read (%lu bytes), %lu found cached, "
+                "%lu evicted; %lu bytes of chunks cached\n", st->chunk_loads,
+                st->chunk_load_bytes, st->chunk_hits, st->chunk_evictions,
+                cache->chunk_bytes);
+}
+
+
+/*** STATIC HELPER FUNCTIONS ***/
+
+
+/* pick_victim()
+ * @brief   finds the item that evict_one should evict next
+ * @param   cache: a struct cache_t pointer
+ * @param   expired: set to 1 if the victim is an expired file, otherwise 0
+ * @returns the victim item, or NULL if the cache is empty
+ * @note    eviction policy: the first expired file, if any; otherwise, if
+ *          at most one file has never been retrieved, the least-recently
+ *          retrieved file; otherwise, the oldest never-retrieved file
+ * @note    the rule is gcache_a0's (see gcache.h), shared with the generic
+ *          cache
+ */
+static cache_item_t pick_victim(C_T cache, int *expired)
+{
+    *expired = 0;
+    if (cache == NULL)
+        return NULL;
+
+    gcache_a0_t scan;
+    gcache_a0_start(&scan, cache->now());
+
+    // items don't record when they were put; the policy doesn't need it
+    cache_item_t curr;
+    for (curr = cache->head; curr != NULL; curr = curr->next)
+        if (gcache_a0_visit(&scan, curr, 0, (curr->file).expiration,
+                            (curr->file).last_retrieved))
+            break;
+
+    *expired = scan.expired;
+    return (cache_item_t)gcache_a0_pick(&scan, cache->head);
+}
+
+
+
+/* find_in_cache()
+ * @brief   looks up the cache_item_t pointer with the given file_name, in
+ *          the cache's name index
+ * @param   file_name: name of file;
+ * @param   cache: a struct cache_t pointer
+ * @param   item_add: pointer to store retrieved item in.
+ * @returns 0 if the item was found
+ * @note    if file is not found, cache_item is set to NULL, and
+ *          -1 is returned. 
+ * 
+ * @note    caller can pass item_add as NULL, if just checking membership
+ */ 
+static int find_in_cache(C_T cache, char *file_name, 
+                                  cache_item_t *item_add)
+{
+    if (cache == NULL || file_name == NULL)
+        return -1; 
+
+    return find_hashed(cache, file_name, hash_str(file_name), item_add);
+}
+
+
+/* find_hashed()
+ * @brief   find_in_cache(), for a name whose hash_str() is already known
+ * @param   hash: hash_str(file_name)
+ * @returns 0 if the item was found; -1 if not
+ */
+static int find_hashed(C_T cache, char *file_name, uint64_t hash,
+                       cache_item_t *item_add)
+{
+    if (item_add != NULL)
+        *item_add = NULL;
+
+    // a definite "no" from the filter means we can skip the lookup
+    if (!maybe_hashed_bloom(cache->filter, hash)) {
+        cache->stats.filter_skips++;
+        return -1;
+    }
+
+    cache_item_t curr = cache->index[hash & cache->index_mask];
+    while (curr != NULL) {
+        if (curr->hash == hash && strcmp((curr->file).name, file_name) == 0) {
+            if (item_add != NULL) // if caller is using item_add
+                *item_add = curr;
+            return 0;
+        }
+        curr = curr->chain;
+    }
+
+    // file with file_name was not found.
+    if (cache->filter != NULL) {
+        cache->stats.filter_false_pos++;
+        note_result_bloom(cache->filter, 1);
+        if (degraded_bloom(cache->filter))
+            rebuild_filter(cache);
+    }
+
+    return -1; 
+}
+
+
+/* rebuild_filter()
+ * @brief   replaces the cache's bloom filter with a fresh one, sized for
+ *          the cache's capacity and filled from the cache list
+ * @param   cache: a struct cache_t pointer
+ * @returns none
+ */
+static void rebuild_filter(C_T cache)
+{
+    int expected = cache->cap;
+    if (cache->size > expected)
+        expected = cache->size;
+
+    free_bloom(cache->filter);
+    cache->filter = create_bloom(expected, cache->filter_fp);
+
+    cache_item_t curr = cache->head;
+    while (curr != NULL) {
+        add_bloom(cache->filter, (curr->file).name);
+        curr = curr->next;
+    }
+
+    cache->stats.filter_rebuilds++;
+}
+
+
+/* add_negative()
+ * @brief   appends a negative entry for file_name, dropping the oldest
+ *          entry if the negative list is full
+ * @param   cache: a struct cache_t pointer
+ * @param   file_name: malloc'd name of unreadable file; owned by the entry
+ * @returns none
+ */
+static void add_negative(C_T cache, char *file_name)
+{
+    // a stale entry for this name may still be listed; replace it
+    invalidate_negative_cache(cache, file_name);
+
+    if (cache->neg_size >= cache->neg_cap)
+        remove_negative(cache, NULL);
+
+    neg_item_t item = malloc(sizeof(struct neg_item_t));
+    item->name = file_name;
+    add_watcher(cache->watcher, file_name); // to see it appear
+    item->expiration = gcache_expires(cache->now(), cache->neg_ttl);
+    item->next = NULL;
+
+    if (cache->neg_head == NULL) {
+        cache->neg_head = item;
+    }
+    else {
+        neg_item_t last = cache->neg_head;
+        while (last->next != NULL)
+            last = last->next;
+        last->next = item;
+    }
+
+    cache->neg_size++;
+    cache->stats.neg_inserts++;
+}
+
+
+/* remove_negative()
+ * @brief   unlinks and frees one negative entry
+ * @param   cache: a struct cache_t pointer
+ * @param   prev: entry before the one to remove, or NULL to remove the head
+ * @returns none
+ */
+static void remove_negative(C_T cache, neg_item_t prev)
+{
+    neg_item_t target = (prev == NULL) ? cache->neg_head : prev->next;
+    if (target == NULL)
+        return;
+
+    if (prev == NULL)
+        cache->neg_head = target->next;
+    else
+        prev->next = target->next;
+
+    remove_watcher(cache->watcher, target->name);
+    free(target->name);
+    free(target);
+    cache->neg_size--;
+}
+
+
+/* drop_item()
+ * @brief   frees an item that has just been unlinked from the cache list,
+ *          after removing it from the bloom filter and the watcher
+ * @param   cache: a struct cache_t pointer
+ * @param   item: the unlinked item
+ * @returns none
+ */
+static void drop_item(C_T cache, cache_item_t item)
+{
+    remove_bloom(cache->filter, (item->file).name);
+    remove_watcher(cache->watcher, (item->file).name);
+
+    if ((item->file).ahead == 2)
+        cache->stats.ahead_wasted++;
+
+    set_chunks(cache, &item->file, -1);
+    free_cache_item(item);
+}
+
+
+/* source_gone()
+ * @brief   drops an item whose source file can no longer be read, and
+ *          records it as a negative entry
+ * @param   cache: a struct cache_t pointer, with negative caching on
+ * @param   item: the item to drop
+ * @returns modified struct cache_t pointer, cast to void pointer
+ */
+static void *source_gone(C_T cache, cache_item_t item)
+{
+    char *name = strdup((item->file).name);
+    remove_file_cache(cache, name);
+    add_negative(cache, name);
+    return (void *)cache;
+}
+
+
+/* new_cache_item()
+ * @brief   creates a new cache_item_t pointer that stores a new
+ *          cache_file_t struct (with a malloc'd buffer for the file data)
+ * @param   file_name   name of file to store in item's cache_file_t
+ * @param   max_age     time before item expires in the cache
+ * @param   lazy        if 1, only stat the file; its data is read later
+ * @param   chunk_len   if > 0, a file bigger than this is only stat'd too:
+ *                      it's chunked once linked, and read chunk by chunk
+ * @param   now         the cache's time now, which max_age counts from
+ * @returns a cache_item_t pointer
+ * @note    if the file can't be read (or stat'd), data is NULL and len is -1
+ */ 
+static cache_item_t new_cache_item(char *file_name, int max_age, int lazy,
+                                   int chunk_len, clock_t now)
+{
+    unsigned char *file_buffer = NULL;
+    file_meta_t meta = { 0 };
+    int file_len = -1;
+    int loaded = 1;
+
+    if (!lazy && chunk_len > 0 && stat_file_meta(file_name, &meta) == 0
+            && meta.size > chunk_len)
+        lazy = 1;
+
+    if (!lazy) {
+        file_len = read_file_with_meta(file_name, &file_buffer, &meta);
+    }
+    else if (stat_file_meta(file_name, &meta) == 0) {
+        file_len = (int)meta.size;
+        loaded = 0; // read in on first GET
+    }
+
+    if (file_len == -1 && file_buffer != NULL) {
+        free(file_buffer);
+        file_buffer = NULL;
+    }
+
+    return build_cache_item(file_name, max_age, file_buffer, file_len,
+                            &meta, loaded, now);
+}
+
+
+/* build_cache_item()
+ * @brief   creates a new cache_item_t pointer around a file's data
+ * @param   file_name   name of file; the item takes ownership of it
+ * @param   max_age     time before item expires in the cache
+ * @param   data        malloc'd file data, owned by the item; NULL if the
+ *                      file is unreadable or not yet loaded
+ * @param   len         length of data; -1 if the file is unreadable
+ * @param   meta        source file's metadata when it was read / stat'd
+ * @param   loaded      0 if data is still to be read on the first GET
+ * @param   now         the cache's time now, which max_age counts from
+ * @returns a cache_item_t pointer
+ */
+static cache_item_t build_cache_item(char *file_name, int max_age,
+                                     unsigned char *data, int len,
+                                     file_meta_t *meta, int loaded,
+                                     clock_t now)
+{
+    // this file expires at time = now + max_age (in clock ticks)
+    clock_t exp_time = gcache_expires(now, max_age);
+
+    cache_file_t new_file= { NULL, file_name, len, 
+                              max_age, exp_time, 0 };
+    set_data(NULL, &new_file, data, len);
+    new_file.meta = *meta;
+    new_file.loaded = loaded;
+
+    cache_item_t new_item = malloc(sizeof(struct cache_item_t));
+    new_item->file = new_file;
+    new_item->next = NULL;
+    new_item->prev = NULL;
+    new_item->chain = NULL;
+
+    return new_item;
+}
+
+
+/* link_item()
+ * @brief   appends a new item to the back of the cache list, and adds it
+ *          to the bloom filter and the watcher
+ * @param   cache: a struct cache_t pointer
+ * @param   item: a new, unlinked item
+ * @returns none
+ */
+static void link_item(C_T cache, cache_item_t item)
+{
+    char *file_name = (item->file).name;
+
+    if (cache->chunk_len > 0 && (item->file).http == NULL
+            && (item->file).len > cache->chunk_len)
+        chunk_file(cache, &item->file);
+
+    cache->size = cache->size + 1; // update size of cache
+    add_bloom(cache->filter, file_name);
+    if ((item->file).http == NULL) { // a proxied response has no source
+        add_watcher(cache->watcher, file_name);
+        keep_data(cache, &item->file);
+    }
+
+    if (!(item->file).loaded)
+        cache->stats.lazy_deferred += (item->file).len;
+
+    item->hash = hash_str(file_name);
+    item->chain = cache->index[item->hash & cache->index_mask];
+    cache->index[item->hash & cache->index_mask] = item;
+
+    item->prev = cache->tail;
+    if (cache->head == NULL && cache->tail == NULL) {
+        cache->head = item;
+        cache->tail = item;
+        return;
+    }
+
+    // otherwise, append new cache_file_t to back of cache list
+    (cache->tail)->next = item;
+    cache->tail = item; // back of list points to new item 
+}
+
+
+/* unlink_item()
+ * @brief   removes an item from the cache list and the name index, then
+ *          frees it (see drop_item)
+ * @param   cache: a struct cache_t pointer
+ * @param   item: an item in the cache
+ * @returns none
+ */
+static void unlink_item(C_T cache, cache_item_t item)
+{
+    if (item->prev == NULL)
+        cache->head = item->next;
+    else
+        (item->prev)->next = item->next;
+
+    if (item->next == NULL)
+        cache->tail = item->prev;
+    else
+        (item->next)->prev = item->prev;
+
+    cache_item_t *link = &cache->index[item->hash & cache->index_mask];
+    while (*link != item)
+        link = &(*link)->chain;
+    *link = item->chain;
+
+    cache->size = cache->size - 1; // update num of items in cache
+    atomic_fetch_add(&cache->epoch, 1);
+    drop_item(cache, item);
+}
+
+
+/* set_data()
+ * @brief   points a file at new data, wrapped in a new payload that the
+ *          file holds the only reference to; the old payload loses the
+ *          file's reference, and is freed unless a handle still pins it
+ * @param   cache: the file's cache, whose epoch is bumped; NULL for a file
+ *          that isn't in one yet
+ * @param   file: file to update
+ * @param   data: malloc'd data, owned by the new payload; NULL for none
+ * @param   len: length of data; -1 if the file is unreadable
+ * @returns none
+ */
+static void set_data(C_T cache, cache_file_t *file, unsigned char *data,
+                     int len)
+{
+    if (cache != NULL)
+        atomic_fetch_add(&cache->epoch, 1);
+
+    release_file_cache(file->payload);
+    file->payload = (data != NULL) ? create_payload(data, len) : NULL;
+
+    file->data = data;
+    file->len = len;
+}
+
+
+/* pack_data()
+ * @brief   compresses a file's data, just read (or stored), if compression
+ *          is on, the file is big enough, and it shrinks by the cache's
+ *          ratio; the file then holds a new payload, of the compressed data
+ * @param   cache: a struct cache_t pointer
+ * @param   file: file whose data was just set
+ * @returns none
+ */
+static void pack_data(C_T cache, cache_file_t *file)
+{
+    payload_t *raw = file->payload;
+    if (cache->pack_min == 0 || raw == NULL || raw->packed > 0
+            || file->len < cache->pack_min)
+        return;
+
+    unsigned char *packed = malloc(bound_lz(file->len));
+    int size = pack_lz(file->data, file->len, packed);
+
+    if (size >= file->len || size * cache->pack_ratio > file->len) {
+        free(packed);
+        cache->stats.pack_skipped++;
+        return;
+    }
+
+    file->payload = create_payload(realloc(packed, size), file->len);
+    file->payload->packed = size;
+    file->data = file->payload->data;
+    release_file_cache(raw);
+
+    cache->stats.packed++;
+    cache->stats.packed_in += file->len;
+    cache->stats.packed_out += size;
+}
+
+
+/* raw_data()
+ * @brief   returns a file's data as it is, for writing it to L2 or a
+ *          snapshot, whose records hold uncompressed data
+ * @param   file: a loaded file
+ * @returns file->data, unless it's compressed: then a malloc'd copy,
+ *          decompressed, that the caller frees (NULL if that fails)
+ */
+static unsigned char *raw_data(cache_file_t *file)
+{
+    if (file->payload == NULL || file->payload->packed == 0)
+        return file->data;
+
+    unsigned char *data = malloc(file->len);
+    if (unpack_lz(file->data, file->payload->packed, data, file->len) == -1) {
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+
+/* keep_data()
+ * @brief   settles a file's newly read (or restored) data: with dedup on,
+ *          its data is hashed, and if a cached payload holds the same
+ *          bytes, the file shares it, and its own copy is freed; otherwise
+ *          the data is compressed (see pack_data), and added to the store
+ * @param   cache: a struct cache_t pointer
+ * @param   file: file whose data was just set
+ * @returns none
+ */
+static void keep_data(C_T cache, cache_file_t *file)
+{
+    payload_t *raw = file->payload;
+    if (cache->dedup == NULL || raw == NULL || raw->packed > 0) {
+        pack_data(cache, file);
+        return;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t hash = hash_data(file->data, file->len);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    cache->stats.dedup_hashed++;
+    cache->stats.dedup_hashed_bytes += file->len;
+    cache->stats.dedup_hash_ns += (end.tv_sec - start.tv_sec) * 1000000000L
+                                  + (end.tv_nsec - start.tv_nsec);
+
+    payload_t *match = find_dedup(cache->dedup, hash, file->len);
+    if (match != NULL) {
+        if (same_data(match, file->data, file->len)) {
+            file->payload = match; // takes find_dedup's reference
+            file->data = match->data;
+            release_file_cache(raw);
+
+            cache->stats.dedup_shared++;
+            cache->stats.dedup_shared_bytes += file->len;
+            return;
+        }
+
+        release_file_cache(match);
+        cache->stats.dedup_collisions++;
+    }
+
+    pack_data(cache, file);
+    add_dedup(cache->dedup, file->payload, hash);
+}
+
+
+/* find_dedup()
+ * @brief   looks for a payload in the store with the given hash and length,
+ *          and pins it, unless it's already being freed
+ * @param   store: a dedup store
+ * @param   hash, len: of the data being looked for
+ * @returns a payload, with a reference for the caller; NULL if none
+ */
+static payload_t *find_dedup(dedup_t *store, uint64_t hash, int len)
+{
+    payload_t *found = NULL;
+    dedup_entry_t *entry;
+
+    pthread_mutex_lock(&store->lock);
+    for (entry = store->buckets[hash & store->mask]; entry != NULL;
+            entry = entry->next) {
+        payload_t *payload = entry->payload;
+        if (payload->hash != hash || payload->len != len)
+            continue;
+
+        // a payload whose last reference is gone is about to be forgotten
+        int refs = atomic_load(&payload->refs);
+        while (refs > 0 && !atomic_compare_exchange_weak(&payload->refs,
+                                                         &refs, refs + 1))
+            ;
+        if (refs > 0) {
+            found = payload;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&store->lock);
+
+    return found;
+}
+
+
+/* add_dedup()
+ * @brief   adds a payload to the store under the hash of its data, doubling
+ *          the table once it holds more entries than buckets
+ * @param   store: a dedup store
+ * @param   payload: a cached payload, not yet in a store
+ * @param   hash: hash_data() of its uncompressed data
+ * @returns none
+ */
+static void add_dedup(dedup_t *store, payload_t *payload, uint64_t hash)
+{
+    dedup_entry_t *entry = malloc(sizeof(dedup_entry_t));
+    entry->payload = payload;
+    payload->store = store;
+    payload->hash = hash;
+
+    pthread_mutex_lock(&store->lock);
+    entry->next = store->buckets[hash & store->mask];
+    store->buckets[hash & store->mask] = entry;
+    store->entries++;
+
+    if (store->entries > store->mask + 1) {
+        uint64_t mask = store->mask * 2 + 1;
+        dedup_entry_t **buckets = calloc(mask + 1, sizeof(dedup_entry_t *));
+        uint64_t i;
+
+        for (i = 0; i <= store->mask; i++) {
+            while (store->buckets[i] != NULL) {
+                dedup_entry_t *moved = store->buckets[i];
+                store->buckets[i] = moved->next;
+                moved->next = buckets[moved->payload->hash & mask];
+                buckets[moved->payload->hash & mask] = moved;
+            }
+        }
+        free(store->buckets);
+        store->buckets = buckets;
+        store->mask = mask;
+    }
+    pthread_mutex_unlock(&store->lock);
+}
+
+
+/* forget_dedup()
+ * @brief   removes a payload from its store, as its last reference goes
+ * @param   payload: a payload in a store, with no references left
+ * @returns none
+ */
+static void forget_dedup(payload_t *payload)
+{
+    dedup_t *store = payload->store;
+
+    pthread_mutex_lock(&store->lock);
+    dedup_entry_t **at = &store->buckets[payload->hash & store->mask];
+    while (*at != NULL && (*at)->payload != payload)
+        at = &(*at)->next;
+
+    if (*at != NULL) {
+        dedup_entry_t *entry = *at;
+        *at = entry->next;
+        free(entry);
+        store->entries--;
+    }
+    pthread_mutex_unlock(&store->lock);
+}
+
+
+/* free_dedup()
+ * @brief   frees a store; a payload still in it (pinned by a handle that
+ *          outlives the cache) is cut loose, and freed as any other
+ * @param   store: a dedup store; NULL does nothing
+ * @returns none
+ */
+static void free_dedup(dedup_t *store)
+{
+    if (store == NULL)
+        return;
+
+    uint64_t i;
+    for (i = 0; i <= store->mask; i++) {
+        while (store->buckets[i] != NULL) {
+            dedup_entry_t *entry = store->buckets[i];
+            store->buckets[i] = entry->next;
+            entry->payload->store = NULL;
+            free(entry);
+        }
+    }
+
+    pthread_mutex_destroy(&store->lock);
+    free(store->buckets);
+    free(store);
+}
+
+
+/* same_data()
+ * @brief   compares a payload's data, unpacking it if it's compressed, with
+ *          len bytes of data
+ * @returns 1 if they're equal, else 0
+ */
+static int same_data(payload_t *payload, unsigned char *data, int len)
+{
+    if (payload->len != len)
+        return 0;
+    if (payload->packed == 0)
+        return memcmp(payload->data, data, len) == 0;
+
+    unsigned char *raw = malloc(len > 0 ? len : 1);
+    int same = unpack_lz(payload->data, payload->packed, raw, len) == 0
+               && memcmp(raw, data, len) == 0;
+    free(raw);
+    return same;
+}
+
+
+/* held_bytes()
+ * @brief   sums the data of the cache's files, as dedup sees it
+ * @param   cache: a struct cache_t pointer, with dedup on
+ * @param   logical: set to the bytes of every cached file with data
+ * @returns bytes of data held: each payload's length, counted once however
+ *          many files share it
+ * @note    payloads in the store are all counted, including any that only
+ *          handles still pin
+ */
+static uint64_t held_bytes(C_T cache, uint64_t *logical)
+{
+    uint64_t held = 0;
+    cache_item_t curr;
+
+    *logical = 0;
+    for (curr = cache->head; curr != NULL; curr = curr->next) {
+        payload_t *payload = (curr->file).payload;
+        if (payload == NULL)
+            continue;
+        *logical += payload->len;
+        if (payload->store == NULL)
+            held += payload->len;
+    }
+
+    dedup_t *store = cache->dedup;
+    uint64_t i;
+    pthread_mutex_lock(&store->lock);
+    for (i = 0; i <= store->mask; i++) {
+        dedup_entry_t *entry;
+        for (entry = store->buckets[i]; entry != NULL; entry = entry->next)
+            held += entry->payload->len;
+    }
+    pthread_mutex_unlock(&store->lock);
+
+    return held;
+}
+
+
+/* chunk_file()
+ * @brief   makes a file that's about to be linked a chunked one: it gets a
+ *          chunk table, and any data it came with (e.g. from L2) is split
+ *          into chunks, as far as the budget has room without evicting
+ * @param   cache: a struct cache_t pointer, with chunking on
+ * @param   file: the new item's file; its data, if any, is released
+ * @returns none
+ */
+static void chunk_file(C_T cache, cache_file_t *file)
+{
+    payload_t *whole = unpack_file_cache(file->payload); // takes its ref
+    file->payload = NULL;
+    file->data = NULL;
+
+    set_chunks(cache, file, file->len);
+    file->loaded = 1;
+
+    int i;
+    for (i = 0; whole != NULL && i < file->n_chunks; i++) {
+        int start = i * cache->chunk_len;
+        int len = file->len - start;
+        if (len > cache->chunk_len)
+            len = cache->chunk_len;
+        if (cache->chunk_bytes + len > cache->chunk_budget)
+            break;
+
+        unsigned char *data = malloc(len);
+        memcpy(data, whole->data + start, len);
+        file->chunks[i].payload = create_payload(data, len);
+        add_chunk(cache, &file->chunks[i]);
+    }
+
+    release_file_cache(whole);
+}
+
+
+/* set_chunks()
+ * @brief   drops all of a chunked file's loaded chunks (handles on them
+ *          keep them alive), then gives it a new, empty chunk table for
+ *          len bytes of data, e.g. once its source has changed
+ * @param   cache: a struct cache_t pointer
+ * @param   file: a chunked file, or a file that's about to be
+ * @param   len: the file's new length; -1 leaves it with no table (and
+ *          unreadable)
+ * @returns none
+ */
+static void set_chunks(C_T cache, cache_file_t *file, int len)
+{
+    atomic_fetch_add(&cache->epoch, 1);
+
+    int i;
+    for (i = 0; i < file->n_chunks; i++)
+        if (file->chunks[i].payload != NULL)
+            drop_chunk(cache, &file->chunks[i]);
+
+    free(file->chunks);
+    file->chunks = NULL;
+    file->n_chunks = 0;
+    file->len = len;
+
+    if (len >= 0) {
+        file->n_chunks = (len + cache->chunk_len - 1) / cache->chunk_len;
+        file->chunks = calloc(file->n_chunks > 0 ? file->n_chunks : 1,
+                              sizeof(chunk_t));
+    }
+}
+
+
+/* load_chunk()
+ * @brief   pins chunk i of a chunked file: a loaded chunk becomes the most
+ *          recently used; otherwise it's read from the source (if that
+ *          hasn't changed since the file was cached) and added
+ * @param   cache: a struct cache_t pointer
+ * @param   file: a chunked file
+ * @param   i: index of the chunk
+ * @returns the chunk's payload, with a reference for the caller; NULL if
+ *          the source changed, or couldn't be read
+ */
+static payload_t *load_chunk(C_T cache, cache_file_t *file, int i)
+{
+    chunk_t *chunk = &file->chunks[i];
+
+    if (chunk->payload != NULL) {
+        cache->stats.chunk_hits++;
+
+        payload_t *payload = chunk->payload;
+        atomic_fetch_add(&payload->refs, 1); // survives its drop from the LRU
+        drop_chunk(cache, chunk);
+        chunk->payload = payload;
+        add_chunk(cache, chunk); // takes the pin's reference as the cache's
+        atomic_fetch_add(&payload->refs, 1);
+        return payload;
+    }
+
+    int start = i * cache->chunk_len;
+    int len = file->len - start;
+    if (len > cache->chunk_len)
+        len = cache->chunk_len;
+
+    unsigned char *data = malloc(len > 0 ? len : 1);
+    file_meta_t meta;
+    if (read_file_range(file->name, start, data, len, &meta) != len
+            || meta.size != file->meta.size
+            || meta.mtime != file->meta.mtime
+            || meta.mtime_nsec != file->meta.mtime_nsec
+            || meta.ino != file->meta.ino) {
+        free(data);
+        return NULL;
+    }
+
+    cache->stats.chunk_loads++;
+    cache->stats.chunk_load_bytes += len;
+
+    chunk->payload = create_payload(data, len);
+    add_chunk(cache, chunk);
+    atomic_fetch_add(&chunk->payload->refs, 1);
+    return chunk->payload;
+}
+
+
+/* add_chunk()
+ * @brief   appends a chunk that's just been given its payload to the LRU,
+ *          as the most recently used, then evicts the least recently used
+ *          chunks (other than it) until the chunks fit in the budget
+ * @param   cache: a struct cache_t pointer
+ * @param   chunk: a chunk with a payload, not in the LRU
+ * @returns none
+ */
+static void add_chunk(C_T cache, chunk_t *chunk)
+{
+    chunk->next = NULL;
+    chunk->prev = cache->chunk_tail;
+    if (cache->chunk_tail != NULL)
+        cache->chunk_tail->next = chunk;
+    else
+        cache->chunk_head = chunk;
+    cache->chunk_tail = chunk;
+    cache->chunk_bytes += chunk->payload->len;
+
+    while (cache->chunk_bytes > cache->chunk_budget
+            && cache->chunk_head != chunk) {
+        drop_chunk(cache, cache->chunk_head);
+        cache->stats.chunk_evictions++;
+    }
+}
+
+
+/* drop_chunk()
+ * @brief   unlinks a loaded chunk from the LRU, and drops the cache's
+ *          reference to its payload, leaving the chunk to be read again
+ * @param   cache: a struct cache_t pointer
+ * @param   chunk: a chunk in the LRU
+ * @returns none
+ */
+static void drop_chunk(C_T cache, chunk_t *chunk)
+{
+    if (chunk->prev != NULL)
+        chunk->prev->next = chunk->next;
+    else
+        cache->chunk_head = chunk->next;
+
+    if (chunk->next != NULL)
+        chunk->next->prev = chunk->prev;
+    else
+        cache->chunk_tail = chunk->prev;
+
+    cache->chunk_bytes -= chunk->payload->len;
+    release_file_cache(chunk->payload);
+    chunk->payload = NULL;
+    chunk->prev = NULL;
+    chunk->next = NULL;
+}
+
+
+/* create_view()
+ * @brief   wraps pinned payloads in a view: a payload with no data of its
+ *          own, whose len bytes start skip bytes into parts[0] and run on
+ *          through the rest, in order
+ * @param   parts: malloc'd array of n pinned payloads; the view takes it,
+ *          and their references
+ * @param   off: offset of the view's first byte in its file
+ * @returns the view, with one reference, the caller's
+ */
+static payload_t *create_view(payload_t **parts, int n, int skip, int off,
+                              int len)
+{
+    payload_t *view = create_payload(NULL, len);
+    view->parts = parts;
+    view->n_parts = n;
+    view->skip = skip;
+    view->off = off;
+
+    return view;
+}
+
+
+/* free_cache_item()
+ * @brief   given a malloc'd cache_item_t, frees it and all memory
+ *          associated with its cache_file_t content.
+ * @param   address of cache_item_t, a pointer, to free
+ * @returns none
+ * @note    if item is NULL, does nothing; assumes item was malloc'd
+ */ 
+static void free_cache_item(cache_item_t item)
+{
+        if (item == NULL)
+            return;
+
+        // drop the cache's reference to the file's data; open handles
+        // keep it alive until they're released
+        set_data(NULL, &item->file, NULL, -1);
+
+        // with the cache going away, its chunk LRU doesn't matter
+        int i;
+        for (i = 0; i < (item->file).n_chunks; i++)
+            release_file_cache((item->file).chunks[i].payload);
+        free((item->file).chunks);
+        
+        if ((item->file).name != NULL)
+            free((item->file).name);
+        free((item->file).http);
+
+        free(item);
+        item = NULL;
+}
+
+
+/* apply_fetch()
+ * @brief   applies a fetch's read (or revalidation) to the cache: renews or
+ *          swaps in the data of a cached file, or inserts a new one,
+ *          evicting to make room
+ * @param   cache: a struct cache_t pointer, locked by the caller
+ * @param   job: the finished read; its name is borrowed, its data taken
+ * @param   max_age: MAX-AGE for a file that isn't cached
+ * @param   lazy: 1 if job only stat'd a new file, for a lazy PUT
+ * @returns FETCH_LOADED, FETCH_MISS or FETCH_ERROR
+ * @note    the file may have been evicted (or PUT) while it was read; it's
+ *          then inserted (or updated) like any other
+ */
+static int apply_fetch(C_T cache, refresh_result_t *job, int max_age,
+                       int lazy)
+{
+    cache_item_t item = NULL;
+    find_in_cache(cache, job->name, &item);
+
+    if (job->changed)
+        cache->stats.fetch_loads++;
+
+    if (item == NULL && max_age < 0) { // evicted, and not ours to re-add
+        free(job->data);
+        return FETCH_MISS;
+    }
+
+    if (item == NULL) {
+        if (job->gone && cache->neg_ttl > 0) {
+            add_negative(cache, strdup(job->name));
+            cache->stats.fetch_errors++;
+            return FETCH_ERROR;
+        }
+
+        while (cache->size >= cache->cap && cache->head != NULL)
+            evict_one(cache);
+
+        item = build_cache_item(strdup(job->name), max_age, job->data,
+                                job->len, &job->meta, !lazy || job->gone,
+                                cache->now());
+        link_item(cache, item);
+
+        if (job->gone) {
+            cache->stats.fetch_errors++;
+            return FETCH_ERROR;
+        }
+        return FETCH_LOADED;
+    }
+
+    cache_file_t *file = &item->file;
+    file->expiration = gcache_expires(cache->now(), file->max_age);
+    file->hits = 0;
+
+    if (job->gone) {
+        cache->stats.fetch_errors++;
+        if (cache->neg_ttl > 0) {
+            source_gone(cache, item);
+        }
+        else {
+            set_chunks(cache, file, -1);
+            set_data(cache, file, NULL, -1);
+            file->loaded = 1;
+        }
+        return FETCH_ERROR;
+    }
+
+    if (!job->changed) { // revalidated: the cached data is still good
+        cache->stats.revalidated++;
+        cache->stats.revalidated_bytes += file->len;
+        return FETCH_LOADED;
+    }
+
+    if (file->chunks != NULL) { // changed chunks are re-read as GETs need
+        free(job->data);
+        set_chunks(cache, file, job->len);
+        file->meta = job->meta;
+        cache->stats.reloaded++;
+        return FETCH_LOADED;
+    }
+
+    if (!file->loaded) {
+        cache->stats.lazy_loaded += job->len;
+    }
+    else {
+        cache->stats.reloaded++;
+        cache->stats.reloaded_bytes += job->len;
+    }
+
+    set_data(cache, file, job->data, job->len);
+    keep_data(cache, file);
+    file->meta = job->meta;
+    file->loaded = 1;
+
+    return FETCH_LOADED;
+}
+
+
+/* hash_batch()
+ * @brief   hashes every name in a batch, so that each is hashed once for
+ *          all of the batch's lookups, and prefetches the index buckets of
+ *          the first few
+ * @param   cache: a struct cache_t pointer
+ * @param   file_names, n: the batch
+ * @returns malloc'd array of n hashes
+ */
+static uint64_t *hash_batch(C_T cache, char **file_names, int n)
+{
+    uint64_t *hashes = malloc(n * sizeof(uint64_t));
+    int i;
+
+    for (i = 0; i < n; i++)
+        hashes[i] = hash_str(file_names[i]);
+
+    for (i = 0; i < PREFETCH_AHEAD && i < n; i++)
+        prefetch_batch(cache, hashes, n, i);
+
+    return hashes;
+}
+
+
+/* prefetch_batch()
+ * @brief   asks for key i's index bucket, and the first item chained from
+ *          it, to be pulled into cache ahead of its lookup
+ * @note    does nothing past the end of the batch
+ */
+static void prefetch_batch(C_T cache, uint64_t *hashes, int n, int i)
+{
+    if (i >= n)
+        return;
+
+    cache_item_t *bucket = &cache->index[hashes[i] & cache->index_mask];
+    __builtin_prefetch(bucket);
+    if (*bucket != NULL)
+        __builtin_prefetch(*bucket);
+}
+
+
+/* peek_negative()
+ * @brief   checks for a live negative entry, like is_negative_cache(), but
+ *          without counting a hit or dropping an expired entry
+ * @returns 1 if file_name has a live negative entry; otherwise 0
+ */
+static int peek_negative(C_T cache, char *file_name)
+{
+    neg_item_t curr;
+    for (curr = cache->neg_head; curr != NULL; curr = curr->next)
+        if (strcmp(curr->name, file_name) == 0)
+            return !gcache_expired(curr->expiration, cache->now());
+
+    return 0;
+}
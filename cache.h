@@ -7,35 +7,214 @@
  * 
  */ 
 
+#ifndef CACHE_H
+#define CACHE_H
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdatomic.h>
 
 #include "file_sys.h"
+#include "tinylfu.h"
+#include "bloom.h"
+#include "refresh.h"
+#include "watch.h"
+#include "flight.h"
+#include "spill.h"
+#include "snapshot.h"
+#include "http.h"
+#include "lz.h"
 
 typedef struct cache_t* C_T;
 
 
+// a file's data, shared between the cache and any handles on it; freed
+// when the last of them lets go. a view (see acquire_range_cache) holds no
+// data itself, only the pinned chunks its bytes are in. with dedup on (see
+// enable_dedup_cache), files with the same data share one payload
+typedef struct payload_t {
+    unsigned char *data; // malloc'd buffer containing the file's data, or
+                         // (if packed) the data compressed (see lz.h)
+    int len; // length of the file's data, in bytes
+    int packed; // bytes of compressed data; 0 if data holds it as it is
+    atomic_int refs; // 1 while the cache holds it, plus 1 per open handle
+
+    struct payload_t **parts; // a view's chunks, in order; else NULL
+    int n_parts;
+    int skip; // bytes of parts[0] before the view's first byte
+    int off; // offset in the file of the first byte; 0 for a whole file
+
+    struct dedup_t *store; // dedup store that can find it by content; or
+                           // NULL if it isn't in one
+    uint64_t hash; // if store isn't NULL: hash_data() of its uncompressed data
+} payload_t;
+
+// a byte range of a file, for a GET's RANGE
+typedef struct range_t {
+    int off; // offset of the first byte
+    int len; // number of bytes; -1 for the rest of the file
+} range_t;
+
+
 typedef struct cache_file_t {
-    unsigned char *data; // malloc'd buffer containing len bytes of data
+    unsigned char *data; // malloc'd buffer containing len bytes of data;
+                         // compressed, if payload->packed
     char *name; // name of file in current directory
     int len; // length of file, in bytes
 
     int max_age; // expiration time of file, in seconds
     clock_t expiration; // time at which expiration will occur (ticks)
     clock_t last_retrieved; // time of last GET call on file
+
+    file_meta_t meta; // source file's size / mtime / inode when cached
+    int loaded; // 1 once data holds the file's bytes (0 if PUT lazily)
+
+    int stale; // grace period past expiration (sec) to serve stale data
+    int refreshing; // 1 while a background refresh is in flight
+    int hits; // GETs since data was last read or revalidated
+    int ahead; // refresh-ahead: 0 none, 1 in flight, 2 done but unused
+
+    payload_t *payload; // refcounted owner of data; NULL if data is NULL
+
+    http_meta_t *http; // origin's validators, for a response cached by the
+                       // proxy (see store_http_cache); NULL for a file
+
+    struct chunk_t *chunks; // a chunked file's chunks, each loaded as GETs
+                            // touch it (see enable_chunks_cache); NULL if
+                            // its data is whole
+    int n_chunks;
 } cache_file_t; 
 
 // macro for an empty 'null' value of the cache_file_t type.
 #define NULL_FILE (cache_file_t){NULL, NULL, 0, 0, 0, 0};
 
+
+// running counters for a cache, reported at the end of a sim run
+typedef struct cache_stats_t {
+    uint64_t gets; // GET commands seen
+    uint64_t hits; // GETs that found their file in the cache
+    uint64_t misses; // GETs that didn't
+    uint64_t puts; // PUT commands seen
+    uint64_t evictions; // files evicted to make room
+    uint64_t rejected; // new files turned away by the admission filter
+    uint64_t filter_skips; // lookups answered by the bloom filter alone
+    uint64_t filter_false_pos; // lookups the filter let through in vain
+    uint64_t filter_rebuilds; // times the filter was rebuilt from the list
+    uint64_t neg_inserts; // unreadable files recorded as negative entries
+    uint64_t neg_hits; // requests answered by a negative entry
+    uint64_t lazy_deferred; // bytes of lazy PUTs whose reads were deferred
+    uint64_t lazy_loaded; // of those, bytes read on a first GET
+    uint64_t revalidated; // expired files renewed unchanged, without a read
+    uint64_t revalidated_bytes; // bytes those renewals didn't have to read
+    uint64_t reloaded; // expired files re-read because their source changed
+    uint64_t reloaded_bytes; // bytes read by those reloads
+    uint64_t stale_served; // expired GETs answered from the stale copy
+    uint64_t bg_refreshes; // background refreshes applied
+    uint64_t bg_changed; // of those, refreshes that found new data
+    uint64_t ahead_issued; // refresh-aheads issued for hot files
+    uint64_t ahead_wasted; // refresh-aheads never followed by a GET
+    uint64_t watch_events; // changes to cached sources seen by the watcher
+    uint64_t watch_invalidations; // files dropped because their source changed
+    uint64_t watch_reloads; // files revalidated because their source changed
+    uint64_t fetch_loads; // source reads made by fetches (one per flight)
+    uint64_t fetch_shared; // fetches that waited on another caller's load
+    uint64_t fetch_timeouts; // of those, fetches that gave up waiting
+    uint64_t fetch_errors; // fetches whose source couldn't be read
+    uint64_t l2_hits; // GET misses answered by promoting a file from L2
+    uint64_t l2_put_hits; // new PUTs whose data came from L2, not the source
+    uint64_t snap_restored; // files restored from a snapshot
+    uint64_t snap_restored_bytes; // bytes of data they brought with them
+    uint64_t snap_changed; // snapshot files dropped: their source changed
+    uint64_t snap_skipped; // snapshot files already cached, or with no room
+    uint64_t snap_truncated; // snapshots that ended in a damaged record
+    uint64_t packed; // files kept compressed in memory
+    uint64_t packed_in; // bytes of data they held before compression
+    uint64_t packed_out; // bytes they were compressed to
+    uint64_t pack_skipped; // files big enough, that didn't compress enough
+    uint64_t chunk_loads; // chunks read from their sources
+    uint64_t chunk_load_bytes; // bytes read by those reads
+    uint64_t chunk_hits; // chunks a GET found already cached
+    uint64_t chunk_evictions; // chunks evicted to stay within the budget
+    uint64_t dedup_hashed; // files whose data was hashed for dedup
+    uint64_t dedup_hashed_bytes; // bytes hashed
+    uint64_t dedup_hash_ns; // time spent hashing, in nanoseconds
+    uint64_t dedup_shared; // files that found their data already cached
+    uint64_t dedup_shared_bytes; // bytes those files didn't need to keep
+    uint64_t dedup_collisions; // equal hashes whose data wasn't equal
+    uint64_t l0_hits; // GETs answered by a thread's L0 (see l0.h); also
+                      // counted in gets and hits
+    uint64_t l0_fills; // handles put in L0 slots
+    uint64_t l0_stale; // L0 slots found stale by a GET
+} cache_stats_t;
+
+// outcomes of fetch_file_cache()
+#define FETCH_ERROR -1 // source couldn't be read (by this or another caller)
+#define FETCH_MISS 0 // not cached, and the caller didn't ask to insert it
+#define FETCH_HIT 1 // already fresh: nothing was read
+#define FETCH_LOADED 2 // this caller read (or revalidated) the file
+#define FETCH_SHARED 3 // another caller's read was shared
+#define FETCH_TIMEOUT 4 // gave up waiting for another caller's read
+
+// outcomes of each file in put_many_cache()
+#define PUT_NEGATIVE -1 // skipped: known to be unreadable
+#define PUT_REJECTED 0 // turned away by the admission filter
+#define PUT_STORED 1 // newly stored
+#define PUT_UPDATED 2 // already cached; MAX-AGE updated and renewed
+
 /*** CACHE FILE UTIL FUNCS ***/
 
-// returns file if it exists in the cache; otherwise returns NULL_FILE
+// returns file if it exists in the cache; otherwise returns NULL_FILE.
+// its data is only valid while the cache is unchanged: use a handle
+// (acquire_file_cache) to keep reading it after that
 cache_file_t retrieve_file_struct(C_T cache, char *file_name);
 
+// pins a cached file's data; NULL if it isn't cached or has no data
+payload_t *acquire_file_cache(C_T cache, char *file_name);
+
+// unpins data pinned by acquire_file_cache, freeing it if it's unused
+void release_file_cache(payload_t *handle);
+
+// wraps malloc'd data in a payload, with one reference for the caller
+payload_t *create_payload(unsigned char *data, int len);
+
+// swaps a handle on compressed data for one on a decompressed copy
+payload_t *unpack_file_cache(payload_t *handle);
+
+// keeps files of at least min_len bytes compressed, if they shrink enough
+void *enable_compress_cache(C_T cache, int min_len, double min_ratio);
+
+// shares one payload between cached files with byte-identical data
+void *enable_dedup_cache(C_T cache);
+
+// stores files bigger than chunk_len in chunks, within budget bytes
+void *enable_chunks_cache(C_T cache, int chunk_len, uint64_t budget);
+
+// pins a range of a cached file's data, reading any chunks it touches
+payload_t *acquire_range_cache(C_T cache, char *file_name, range_t range);
+
+// stores an origin's response under its target, sharing body's payload
+int store_http_cache(C_T cache, char *target, payload_t *body, int max_age,
+                     http_meta_t *http);
+
+// renews a cached response the origin said is unchanged (a 304)
+void *renew_http_cache(C_T cache, char *target, int max_age,
+                       http_meta_t *http);
+
+// turns on an on-disk L2 under dir, of budget bytes, for evicted files
+void *enable_spill_cache(C_T cache, char *dir, uint64_t budget);
+
+// moves file_name from L2 back into the cache; returns 1 if it was there
+int promote_spill_cache(C_T cache, char *file_name);
+
+// writes every cached file, and the admission state, to a snapshot at path
+int save_snapshot_cache(C_T cache, char *path);
+
+// restores the files of a snapshot whose sources haven't changed
+int load_snapshot_cache(C_T cache, char *path);
+
 // prints out information for the given file
 void print_file_struct(cache_file_t file);
 
@@ -63,8 +242,111 @@ void *push_back_cache(C_T cache, char *file_name, int max_age);
 // removes a given file in the cache
 void *remove_file_cache(C_T cache, char *file_name);
 
+// renews an expired file: keeps its data if the source is unchanged,
+// otherwise re-reads it in place
+void *revalidate_item_cache(C_T cache, char *file_name);
+
+// sets a file's stale-while-revalidate grace period, in seconds
+void *set_stale_cache(C_T cache, char *file_name, int stale);
+
+// returns 1 if an expired file may be served stale (a refresh is queued)
+int serve_stale_cache(C_T cache, char *file_name);
+
+// turns on refresh-ahead for files read at least min_rate times per sec
+void *enable_refresh_ahead_cache(C_T cache, double fraction, double min_rate);
+
+// refreshes a hot file in the background as it nears expiration
+int refresh_ahead_cache(C_T cache, char *file_name);
+
+// applies any background refreshes that have finished
+void *apply_refreshes_cache(C_T cache);
+
+// turns on inotify-driven invalidation (or reloading) of changed files
+void *enable_watch_cache(C_T cache, int reload);
+
+// applies any changes to cached source files reported by the watcher
+void *apply_watch_cache(C_T cache);
+
+// records a GET on a file, without renewing its freshness
+void *touch_item_cache(C_T cache, char *file_name);
+
+// takes / releases the cache's lock, for running commands from threads
+void lock_cache(C_T cache);
+void unlock_cache(C_T cache);
+
+// loads or revalidates a file, sharing one source read between threads
+int fetch_file_cache(C_T cache, char *file_name, int max_age, int timeout_ms);
+
+// marks a cached file as expired
+void *expire_item_cache(C_T cache, char *file_name);
+
+// looks up (and stamps as retrieved) a batch of files, hashing up front
+int get_many_cache(C_T cache, char **file_names, int n, cache_file_t *files);
+
+// stores a batch of files, reading new ones together outside the lock
+int put_many_cache(C_T cache, char **file_names, int *max_ages, int n,
+                   int *results);
+
 // updates item in cache with updated time information
 void *update_item_cache(C_T cache, char *file_name, cache_file_t new_item);
 
 // prints out the contents of the cache
 void print_cache(C_T cache);
+
+
+/**** CACHE ADMISSION + STATS ****/
+
+// turns on TinyLFU admission, with a sketch of (at least) width counters
+void *enable_admission_cache(C_T cache, int width);
+
+// records an access (GET or PUT) to file_name in the admission sketch
+void record_access_cache(C_T cache, char *file_name);
+
+// returns 1 if file_name should displace the next eviction victim
+int admit_file_cache(C_T cache, char *file_name);
+
+// turns on a counting bloom filter over cache membership, for fast misses
+void *enable_filter_cache(C_T cache, double fp_rate);
+
+// turns on negative caching of unreadable files, with their own ttl and cap
+void *enable_negative_cache(C_T cache, int ttl, int cap);
+
+// returns 1 if file_name is known to be unreadable (a live negative entry)
+int is_negative_cache(C_T cache, char *file_name);
+
+// drops file_name's negative entry, e.g. once the file appears
+void *invalidate_negative_cache(C_T cache, char *file_name);
+
+// turns on lazy PUTs: only stat the file, and read it on its first GET
+void *enable_lazy_cache(C_T cache);
+
+// reads a lazily PUT file's data in, if it hasn't been already
+int load_item_cache(C_T cache, char *file_name);
+
+// returns the cache's running counters
+cache_stats_t *stats_of_cache(C_T cache);
+
+// returns the cache's epoch, which changes whenever a file's data does
+uint64_t epoch_of_cache(C_T cache);
+
+// sends the cache's messages and stats to out; NULL turns messages off
+void *set_log_cache(C_T cache, FILE *out);
+
+// sets the clock the cache's stamps and expirations are on (gcache.h's
+// gcache_clock_cpu by default, or gcache_clock_mono)
+void *set_clock_cache(C_T cache, clock_t (*now)(void));
+
+// returns the time now, by the cache's clock
+clock_t now_cache(C_T cache);
+
+// returns where the cache's messages go; NULL if they're off
+FILE *log_of_cache(C_T cache);
+
+// prints a message to the cache's log, if it has one
+void log_cache(C_T cache, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// prints out the cache's running counters, to its log
+void print_stats_cache(C_T cache);
+
+#endif
@@ -7,8 +7,50 @@
  * 
  */ 
 
+#define _GNU_SOURCE // O_DIRECT
+
+#include <errno.h>
+#include <pthread.h>
+
 #include "file_sys.h"
 
+// O_DIRECT settings, bounce buffer pool and counters, for the process
+static struct {
+    int min_len; // smallest file read with O_DIRECT; 0 if off
+    pthread_mutex_t lock; // guards the pool and counters
+    pthread_cond_t freed; // signalled when a buffer goes back to the pool
+    unsigned char *pool[DIRECT_POOL]; // free buffers
+    int n_free;
+    int n_made; // buffers allocated, at most DIRECT_POOL
+    direct_stats_t stats;
+} direct_io = { 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+
+/*** STATIC HELPER FUNC DECLARATIONS ***/
+
+// opens a file to read, with O_DIRECT if it's on; *direct says if it took
+static int open_direct(char *file_name, int *direct);
+
+// reads size bytes into a new aligned buffer, in O_DIRECT requests
+static int read_direct(int fildes, unsigned char **buffer, off_t size);
+
+// reads len bytes at off through a pool buffer, in O_DIRECT requests
+static int read_range_direct(int fildes, off_t off, unsigned char *buffer,
+                             int len);
+
+// turns O_DIRECT off for an open file
+static void drop_direct(int fildes);
+
+// turns O_DIRECT off for a file whose filesystem rejected it, and counts it
+static void fallback_direct(int fildes);
+
+// takes a bounce buffer from the pool, waiting if they're all in use
+static unsigned char *take_buffer(void);
+
+// puts a bounce buffer back in the pool
+static void give_buffer(unsigned char *buf);
+
+
 /* read_file_into_buf()
  * @brief   reads contents of the given file into a buffer
  * @param   file_name   name of file to read
@@ -17,39 +59,201 @@
  * @note    if file can't be opened, or read fails, returns -1
  */ 
 int read_file_into_buf(char *file_name, unsigned char **buffer)
+{
+    return read_file_with_meta(file_name, buffer, NULL);
+}
+
+
+/* read_file_with_meta()
+ * @brief   reads contents of the given file into a buffer, and records
+ *          the size, mtime and inode it was read at
+ * @param   file_name   name of file to read
+ * @param   buffer      address of buffer to allocate for file data
+ * @param   meta        struct to fill with file's metadata; may be NULL
+ * @returns number of bytes read into buffer (file size)
+ * @note    if file can't be opened, or read fails, returns -1
+ * @note    with O_DIRECT on (see enable_direct_file_sys), a big enough file
+ *          is read straight into an aligned buffer (still freed with
+ *          free()), bypassing the page cache
+ */ 
+int read_file_with_meta(char *file_name, unsigned char **buffer,
+                        file_meta_t *meta)
 {
     struct stat st;
+    int direct = 0;
 
-    int fildes = open(file_name, O_RDONLY);
+    int fildes = open_direct(file_name, &direct);
     if (fildes == -1) {// if open fails (file is not found)
         return -1;
     }
 
-    stat(file_name, &st);
-    if (st.st_size < 0) {
-        printf("couldnt' stat the file\n");
+    if (fstat(fildes, &st) == -1 || st.st_size < 0) {
+        fprintf(stderr, "couldnt' stat the file\n");
+        close(fildes);
         return -1;
     }
-    *buffer = malloc(st.st_size);
-    memset(*buffer, 0, st.st_size);    
 
-    // if we couldn't properly allocate buffer
-    if (buffer == NULL) {
-        close(fildes);
-        return -1;
+    int bytes_read = -1;
+    if (direct && st.st_size >= direct_io.min_len) {
+        bytes_read = read_direct(fildes, buffer, st.st_size);
+        if (bytes_read == -1 && errno == EINVAL) { // not supported after all
+            free(*buffer);
+            *buffer = NULL;
+            fallback_direct(fildes);
+        }
+        else {
+            direct = 2; // read
+        }
     }
 
-    int bytes_read = read(fildes, *buffer, st.st_size);
+    if (direct != 2) {
+        if (direct)
+            drop_direct(fildes); // too small to be worth it
+        *buffer = malloc(st.st_size);
+
+        // if we couldn't properly allocate buffer
+        if (*buffer == NULL && st.st_size > 0) {
+            close(fildes);
+            return -1;
+        }
+
+        bytes_read = read(fildes, *buffer, st.st_size);
+    }
     close(fildes);
 
     if (bytes_read < st.st_size) { // if read does not read entire file
         return -1;
     }
 
+    if (meta != NULL) {
+        meta->size = st.st_size;
+        meta->mtime = st.st_mtim.tv_sec;
+        meta->mtime_nsec = st.st_mtim.tv_nsec;
+        meta->ino = st.st_ino;
+    }
+
     return st.st_size; // length of file, in bytes
 }
 
 
+/* read_file_range()
+ * @brief   reads part of the given file into a buffer, and records the
+ *          size, mtime and inode of the file it was read from
+ * @param   file_name   name of file to read
+ * @param   off         offset of the first byte to read
+ * @param   buffer      buffer of at least len bytes
+ * @param   len         number of bytes to read
+ * @param   meta        struct to fill with file's metadata
+ * @returns number of bytes read, which is less than len only at the end
+ *          of the file
+ * @note    if file can't be opened, or read fails, returns -1
+ * @note    with O_DIRECT on, a range of a big enough file is read in
+ *          aligned requests through a bounce buffer from the pool
+ */
+int read_file_range(char *file_name, off_t off, unsigned char *buffer,
+                    int len, file_meta_t *meta)
+{
+    struct stat st;
+    int direct = 0;
+
+    int fildes = open_direct(file_name, &direct);
+    if (fildes == -1)
+        return -1;
+
+    if (fstat(fildes, &st) == -1) {
+        close(fildes);
+        return -1;
+    }
+
+    int done = -1;
+    if (direct && st.st_size >= direct_io.min_len) {
+        done = read_range_direct(fildes, off, buffer, len);
+        if (done == -1 && errno == EINVAL)
+            fallback_direct(fildes);
+        else
+            direct = 2; // read
+    }
+
+    if (direct != 2) {
+        if (direct)
+            drop_direct(fildes);
+
+        done = 0;
+        while (done < len) {
+            ssize_t n = pread(fildes, buffer + done, len - done, off + done);
+            if (n <= 0)
+                break;
+            done += n;
+        }
+    }
+    close(fildes);
+
+    meta->size = st.st_size;
+    meta->mtime = st.st_mtim.tv_sec;
+    meta->mtime_nsec = st.st_mtim.tv_nsec;
+    meta->ino = st.st_ino;
+
+    return done;
+}
+
+
+/* enable_direct_file_sys()
+ * @brief   has every read of a file of at least min_len bytes (whole, or a
+ *          range) use O_DIRECT, in requests of up to DIRECT_REQ bytes, so
+ *          the data isn't kept in the page cache as well as in the buffer
+ *          it's read into
+ * @param   min_len: smallest file to read with O_DIRECT; 0 turns it off
+ * @returns none
+ * @note    applies to the whole process. on a filesystem that doesn't
+ *          support O_DIRECT, reads fall back to the page cache
+ */
+void enable_direct_file_sys(int min_len)
+{
+    pthread_mutex_lock(&direct_io.lock);
+    direct_io.min_len = (min_len > 0) ? min_len : 0;
+    pthread_mutex_unlock(&direct_io.lock);
+}
+
+
+/* stats_direct_file_sys()
+ * @brief   copies out the counters of O_DIRECT reads
+ * @param   stats: struct to fill in; may be NULL
+ * @returns the threshold set by enable_direct_file_sys(); 0 if it's off
+ */
+int stats_direct_file_sys(direct_stats_t *stats)
+{
+    pthread_mutex_lock(&direct_io.lock);
+    if (stats != NULL)
+        *stats = direct_io.stats;
+    int min_len = direct_io.min_len;
+    pthread_mutex_unlock(&direct_io.lock);
+
+    return min_len;
+}
+
+
+/* stat_file_meta()
+ * @brief   looks up a file's size, mtime and inode, without opening it
+ * @param   file_name   name of file to stat
+ * @param   meta        struct to fill with file's metadata
+ * @returns 0 on success; -1 if the file can't be stat'd
+ */ 
+int stat_file_meta(char *file_name, file_meta_t *meta)
+{
+    struct stat st;
+
+    if (stat(file_name, &st) == -1)
+        return -1;
+
+    meta->size = st.st_size;
+    meta->mtime = st.st_mtim.tv_sec;
+    meta->mtime_nsec = st.st_mtim.tv_nsec;
+    meta->ino = st.st_ino;
+
+    return 0;
+}
+
+
 /* write_buf_into_file()
  * @brief   given a data buffer of size buf_len, write the data into a
  *          new file called "file_name"
@@ -96,4 +300,212 @@ int write_buf_into_file(char *file_name, unsigned char *buffer, uint32_t buf_len
 void delete_file(char *file_name)
 {
     unlink(file_name);
-}
\ No newline at end of file
+}
+
+
+/*** STATIC HELPER FUNCTIONS ***/
+
+
+/* open_direct()
+ * @brief   opens a file read-only, with O_DIRECT if it's on; if the
+ *          filesystem refuses O_DIRECT, opens it without
+ * @param   file_name: file to open
+ * @param   direct: set to 1 if the file was opened with O_DIRECT, else 0
+ * @returns the file descriptor, or -1
+ */
+static int open_direct(char *file_name, int *direct)
+{
+    *direct = (direct_io.min_len > 0);
+    if (!*direct)
+        return open(file_name, O_RDONLY);
+
+    int fildes = open(file_name, O_RDONLY | O_DIRECT);
+    if (fildes == -1 && errno == EINVAL) {
+        *direct = 0;
+        pthread_mutex_lock(&direct_io.lock);
+        direct_io.stats.fallbacks++;
+        pthread_mutex_unlock(&direct_io.lock);
+        fildes = open(file_name, O_RDONLY);
+    }
+
+    return fildes;
+}
+
+
+/* read_direct()
+ * @brief   reads a whole file, opened with O_DIRECT, into a new buffer
+ *          aligned to DIRECT_ALIGN, in requests of up to DIRECT_REQ bytes
+ * @param   fildes: the file
+ * @param   buffer: set to the buffer, of size rounded up to DIRECT_ALIGN;
+ *          the caller frees it, whatever is returned
+ * @param   size: the file's size
+ * @returns bytes read, or -1 with errno set (EINVAL if the filesystem won't
+ *          do O_DIRECT reads after all)
+ */
+static int read_direct(int fildes, unsigned char **buffer, off_t size)
+{
+    size_t cap = (size + DIRECT_ALIGN - 1) & ~(off_t)(DIRECT_ALIGN - 1);
+    if (posix_memalign((void **)buffer, DIRECT_ALIGN,
+                       (cap > 0) ? cap : DIRECT_ALIGN) != 0) {
+        *buffer = NULL;
+        errno = ENOMEM;
+        return -1;
+    }
+
+    off_t done = 0;
+    while (done < size) {
+        size_t want = cap - done;
+        if (want > DIRECT_REQ)
+            want = DIRECT_REQ;
+
+        ssize_t n = pread(fildes, *buffer + done, want, done);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+            return -1;
+        done += n;
+        if ((size_t)n < want) // end of file
+            break;
+    }
+
+    pthread_mutex_lock(&direct_io.lock);
+    direct_io.stats.reads++;
+    direct_io.stats.bytes += done;
+    pthread_mutex_unlock(&direct_io.lock);
+
+    return done;
+}
+
+
+/* read_range_direct()
+ * @brief   reads a range of a file, opened with O_DIRECT: the aligned span
+ *          around it is read into a bounce buffer, a request at a time,
+ *          and the range's bytes copied out
+ * @param   fildes: the file
+ * @param   off, len: the range
+ * @param   buffer: buffer of at least len bytes
+ * @returns bytes read, which is less than len only at the end of the file;
+ *          or -1 with errno set (EINVAL as for read_direct)
+ */
+static int read_range_direct(int fildes, off_t off, unsigned char *buffer,
+                             int len)
+{
+    off_t pos = off & ~(off_t)(DIRECT_ALIGN - 1);
+    off_t end = off + len;
+    off_t span_end = (end + DIRECT_ALIGN - 1) & ~(off_t)(DIRECT_ALIGN - 1);
+    unsigned char *bounce = take_buffer();
+    int done = 0;
+
+    if (bounce == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    int result = 0;
+
+    while (pos < span_end) {
+        size_t want = span_end - pos;
+        if (want > DIRECT_REQ)
+            want = DIRECT_REQ;
+
+        ssize_t n = pread(fildes, bounce, want, pos);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1) {
+            result = -1;
+            break;
+        }
+
+        // copy out the part of [pos, pos + n) that's in the range
+        off_t from = (pos > off) ? pos : off;
+        off_t to = (pos + n < end) ? pos + n : end;
+        if (to > from) {
+            memcpy(buffer + (from - off), bounce + (from - pos), to - from);
+            done += to - from;
+        }
+
+        pos += n;
+        if ((size_t)n < want) // end of file
+            break;
+    }
+
+    int saved = errno;
+    give_buffer(bounce);
+    if (result == -1) {
+        errno = saved;
+        return -1;
+    }
+
+    pthread_mutex_lock(&direct_io.lock);
+    direct_io.stats.reads++;
+    direct_io.stats.bytes += done;
+    pthread_mutex_unlock(&direct_io.lock);
+
+    return done;
+}
+
+
+/* drop_direct()
+ * @brief   turns O_DIRECT off for an open file, to read it buffered
+ */
+static void drop_direct(int fildes)
+{
+    fcntl(fildes, F_SETFL, fcntl(fildes, F_GETFL) & ~O_DIRECT);
+}
+
+
+/* fallback_direct()
+ * @brief   turns O_DIRECT off for a file whose first O_DIRECT read failed,
+ *          and counts the fallback
+ */
+static void fallback_direct(int fildes)
+{
+    drop_direct(fildes);
+
+    pthread_mutex_lock(&direct_io.lock);
+    direct_io.stats.fallbacks++;
+    pthread_mutex_unlock(&direct_io.lock);
+}
+
+
+/* take_buffer()
+ * @brief   takes a free bounce buffer from the pool, allocating one if
+ *          fewer than DIRECT_POOL exist, or else waiting for one
+ * @returns a buffer of DIRECT_REQ bytes, aligned to DIRECT_ALIGN; NULL if
+ *          one couldn't be allocated
+ */
+static unsigned char *take_buffer(void)
+{
+    unsigned char *buf = NULL;
+
+    pthread_mutex_lock(&direct_io.lock);
+    if (direct_io.n_free == 0 && direct_io.n_made == DIRECT_POOL) {
+        direct_io.stats.pool_waits++;
+        while (direct_io.n_free == 0)
+            pthread_cond_wait(&direct_io.freed, &direct_io.lock);
+    }
+
+    if (direct_io.n_free > 0) {
+        buf = direct_io.pool[--direct_io.n_free];
+    }
+    else if (posix_memalign((void **)&buf, DIRECT_ALIGN, DIRECT_REQ) == 0) {
+        direct_io.n_made++;
+    }
+    else {
+        buf = NULL;
+    }
+    pthread_mutex_unlock(&direct_io.lock);
+
+    return buf;
+}
+
+
+/* give_buffer()
+ * @brief   puts a bounce buffer back in the pool, for the next range read
+ */
+static void give_buffer(unsigned char *buf)
+{
+    pthread_mutex_lock(&direct_io.lock);
+    direct_io.pool[direct_io.n_free++] = buf;
+    pthread_cond_signal(&direct_io.freed);
+    pthread_mutex_unlock(&direct_io.lock);
+}
@@ -7,6 +7,9 @@
  * 
  */ 
 
+#ifndef FILE_SYS_H
+#define FILE_SYS_H
+
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -16,12 +19,54 @@
 #include <unistd.h>
 #include <fcntl.h>
 
+// what stat() says about a source file, used to tell if it has changed
+typedef struct file_meta_t {
+    off_t size; // length of file, in bytes
+    time_t mtime; // last modification time (sec)
+    long mtime_nsec; // nanoseconds part of mtime
+    ino_t ino; // inode number
+} file_meta_t;
+
+#define DIRECT_ALIGN 4096 // O_DIRECT buffers, offsets and lengths align to this
+#define DIRECT_REQ (1024 * 1024) // most bytes per O_DIRECT read request
+#define DIRECT_POOL 4 // aligned bounce buffers, of DIRECT_REQ bytes, for
+                      // O_DIRECT range reads
+
+// counters for O_DIRECT reads (see enable_direct_file_sys)
+typedef struct direct_stats_t {
+    uint64_t reads; // files (or ranges) read with O_DIRECT
+    uint64_t bytes; // bytes they read
+    uint64_t fallbacks; // reads that went through the page cache instead,
+                        // as their filesystem doesn't support O_DIRECT
+    uint64_t pool_waits; // range reads that waited for a bounce buffer
+} direct_stats_t;
+
 // reads an entire file into a malloc'd buffer; returns num of bytes read 
 int read_file_into_buf(char *file_name, unsigned char **buffer);
 
+// like read_file_into_buf, but also fills in the file's metadata
+int read_file_with_meta(char *file_name, unsigned char **buffer,
+                        file_meta_t *meta);
+
+// reads len bytes at off into buffer, filling in the file's metadata;
+// returns num of bytes read, or -1
+int read_file_range(char *file_name, off_t off, unsigned char *buffer,
+                    int len, file_meta_t *meta);
+
+// reads files of at least min_len bytes with O_DIRECT; 0 turns it off
+void enable_direct_file_sys(int min_len);
+
+// copies out the O_DIRECT counters; returns the threshold (0 if off)
+int stats_direct_file_sys(direct_stats_t *stats);
+
+// stats a file without opening it; returns 0 on success, -1 on failure
+int stat_file_meta(char *file_name, file_meta_t *meta);
+
 // write buffer data out into file; returns num of bytes written
 int write_buf_into_file(char *file_name, unsigned char *buffer, 
                         uint32_t buf_len);
 
 // removes a file from the given directory (if it exists)
-void delete_file(char *file_name);
\ No newline at end of file
+void delete_file(char *file_name);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,177 @@
+/*
+ * FLIGHT.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ */
+
+#include <time.h>
+#include <errno.h>
+
+#include "flight.h"
+
+/*** IN-FLIGHT LOAD ***/
+typedef struct flight_t {
+    char *key;
+    int landed; // 1 once the leader has called land_flight()
+    int result; // leader's outcome, valid once landed
+    int refs; // leader + waiters still looking at this flight
+    pthread_cond_t done; // broadcast when the flight lands
+    struct flight_t *next;
+} *flight_t;
+
+struct flight_group_t {
+    pthread_mutex_t lock;
+    flight_t flights; // flights whose leader hasn't landed yet
+};
+
+
+/*** STATIC HELPER FUNC DECLARATIONS ***/
+
+// drops one reference to a flight, freeing it after the last one
+static void release_flight(flight_t f);
+
+
+/* create_flight()
+ * @brief   initializes an empty single-flight group
+ * @returns a struct flight_group_t pointer
+ */
+F_T create_flight()
+{
+    F_T group = malloc(sizeof(struct flight_group_t));
+    pthread_mutex_init(&group->lock, NULL);
+    group->flights = NULL;
+    return group;
+}
+
+
+/* free_flight()
+ * @brief   frees a single-flight group
+ * @param   group: a struct flight_group_t pointer
+ * @note    every leader must have landed, and every waiter returned
+ */
+void free_flight(F_T group)
+{
+    if (group == NULL)
+        return;
+
+    pthread_mutex_destroy(&group->lock);
+    free(group);
+}
+
+
+/* join_flight()
+ * @brief   starts a load of key, or joins the one already in progress
+ * @param   group: a struct flight_group_t pointer
+ * @param   key: key to load
+ * @param   timeout_ms: how long to wait for another caller's load; < 0 to
+ *          wait for as long as it takes
+ * @param   result: for FLIGHT_SHARED, set to the leader's result
+ * @returns FLIGHT_LEADER if the caller must load key and then call
+ *          land_flight(); FLIGHT_SHARED if another caller loaded it;
+ *          FLIGHT_TIMEOUT if that load didn't finish in time
+ */
+int join_flight(F_T group, char *key, int timeout_ms, int *result)
+{
+    pthread_mutex_lock(&group->lock);
+
+    flight_t f = group->flights;
+    while (f != NULL && strcmp(f->key, key) != 0)
+        f = f->next;
+
+    if (f == NULL) { // nobody's loading key: caller leads
+        f = malloc(sizeof(struct flight_t));
+        f->key = strdup(key);
+        f->landed = 0;
+        f->result = 0;
+        f->refs = 1;
+        pthread_cond_init(&f->done, NULL);
+        f->next = group->flights;
+        group->flights = f;
+
+        pthread_mutex_unlock(&group->lock);
+        return FLIGHT_LEADER;
+    }
+
+    f->refs++;
+
+    struct timespec deadline;
+    if (timeout_ms >= 0) {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    int err = 0;
+    while (!f->landed && err != ETIMEDOUT) {
+        if (timeout_ms < 0)
+            pthread_cond_wait(&f->done, &group->lock);
+        else
+            err = pthread_cond_timedwait(&f->done, &group->lock, &deadline);
+    }
+
+    int outcome = FLIGHT_TIMEOUT;
+    if (f->landed) {
+        *result = f->result;
+        outcome = FLIGHT_SHARED;
+    }
+
+    release_flight(f);
+    pthread_mutex_unlock(&group->lock);
+
+    return outcome;
+}
+
+
+/* land_flight()
+ * @brief   ends the caller's load of key, and wakes everyone waiting on it
+ * @param   group: a struct flight_group_t pointer
+ * @param   key: key that was loaded
+ * @param   result: outcome to hand to the waiters
+ * @note    must only be called by the flight's leader. callers arriving
+ *          after this start a new flight.
+ */
+void land_flight(F_T group, char *key, int result)
+{
+    pthread_mutex_lock(&group->lock);
+
+    flight_t *link = &group->flights;
+    while (*link != NULL && strcmp((*link)->key, key) != 0)
+        link = &(*link)->next;
+
+    flight_t f = *link;
+    if (f != NULL) {
+        *link = f->next; // unlisted: later callers lead a fresh load
+        f->landed = 1;
+        f->result = result;
+        pthread_cond_broadcast(&f->done);
+        release_flight(f);
+    }
+
+    pthread_mutex_unlock(&group->lock);
+}
+
+
+/*** STATIC HELPER FUNCTIONS ***/
+
+
+/* release_flight()
+ * @brief   drops a reference to an (unlisted or listed) flight; the last
+ *          reference frees it
+ * @note    called with the group's lock held
+ */
+static void release_flight(flight_t f)
+{
+    if (--f->refs > 0)
+        return;
+
+    pthread_cond_destroy(&f->done);
+    free(f->key);
+    free(f);
+}
\ No newline at end of file
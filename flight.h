@@ -0,0 +1,40 @@
+/*
+ * FLIGHT.H
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * Single-flight groups: when several threads need the same key loaded at
+ * once, the first becomes the leader and does the load; the rest wait for
+ * it to finish and share its outcome, instead of loading it again.
+ *
+ */
+
+#ifndef FLIGHT_H
+#define FLIGHT_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+typedef struct flight_group_t *F_T;
+
+// what join_flight() made of the caller
+#define FLIGHT_LEADER 1 // caller must do the load, then call land_flight()
+#define FLIGHT_SHARED 2 // another caller did the load; outcome is in *result
+#define FLIGHT_TIMEOUT 3 // gave up waiting for the leader
+
+// creates an empty single-flight group
+F_T create_flight();
+
+// frees a group; no flights may be in progress
+void free_flight(F_T group);
+
+// joins (or starts) the flight for key, waiting up to timeout_ms for it
+int join_flight(F_T group, char *key, int timeout_ms, int *result);
+
+// ends the caller's flight for key, handing result to every waiter
+void land_flight(F_T group, char *key, int result);
+
+#endif
\ No newline at end of file
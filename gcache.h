@@ -0,0 +1,226 @@
+/*
+ * GCACHE.H
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * What cache.c and shm.c share about time and eviction, header-only so
+ * each call can be inlined: the clocks items are stamped by, the expiry
+ * stamp and check, and the eviction policies.
+ *
+ * A policy is a family of scan functions, policy_t, policy_start(),
+ * policy_visit() and policy_pick(), which a cache calls by name, so the
+ * choice is made at compile time rather than through a pointer. It scans
+ * the entries oldest first, as evict_one() does: start() begins a scan,
+ * visit() sees each entry's stamps (and returns 1 to end the scan early),
+ * and pick() returns the victim. pick_victim() in cache.c and the shared
+ * segment in shm.c evict by gcache_a0; gcache_lru is plain LRU.
+ *
+ */
+
+#ifndef GCACHE_H
+#define GCACHE_H
+
+#if !defined(_POSIX_C_SOURCE) && !defined(_GNU_SOURCE)
+#define _POSIX_C_SOURCE 199309L // clock_gettime(), struct timespec
+#endif
+
+#include <stdlib.h>
+#include <time.h>
+
+#ifndef CLOCK_MONOTONIC
+#error "gcache.h: include it before <time.h>, or define _POSIX_C_SOURCE"
+#endif
+
+
+/*** CLOCKS ***/
+
+
+/* gcache_clock_cpu()
+ * @brief   the process's CPU time, which cache.c stamps its items by unless
+ *          told otherwise (set_clock_cache)
+ */
+static inline clock_t gcache_clock_cpu(void)
+{
+    return clock();
+}
+
+
+/* gcache_clock_mono()
+ * @brief   monotonic wall time, in clock_t ticks; unlike CPU time, it passes
+ *          while the process is idle
+ */
+static inline clock_t gcache_clock_mono(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (clock_t)ts.tv_sec * CLOCKS_PER_SEC
+           + ts.tv_nsec / (1000000000 / CLOCKS_PER_SEC);
+}
+
+
+/*** EXPIRY ***/
+
+
+/* gcache_expires()
+ * @brief   the expiration stamp of an entry put at now, to live max_age
+ *          seconds
+ */
+static inline clock_t gcache_expires(clock_t now, int max_age)
+{
+    return now + (clock_t)max_age * CLOCKS_PER_SEC;
+}
+
+
+/* gcache_expired()
+ * @brief   returns 1 if an entry stamped to expire at expiration has, by now
+ */
+static inline int gcache_expired(clock_t expiration, clock_t now)
+{
+    return expiration <= now;
+}
+
+
+/*** POLICIES ***/
+
+
+// a scan by gcache_a0: the first expired entry ends it
+typedef struct gcache_a0_t {
+    clock_t now;
+    void *victim; // the expired entry, if any
+    int expired; // 1 if victim is an expired entry
+    int num_not_retrieved;
+    void *few_retrieved; // oldest never-retrieved entry
+    void *many_retrieved; // least-recently retrieved entry
+    clock_t least_recent;
+} gcache_a0_t;
+
+
+/* gcache_a0_start()
+ * @brief   begins a scan for the entry evict_one() would evict
+ */
+static inline void gcache_a0_start(gcache_a0_t *s, clock_t now)
+{
+    s->now = now;
+    s->victim = NULL;
+    s->expired = 0;
+    s->num_not_retrieved = 0;
+    s->few_retrieved = NULL;
+    s->many_retrieved = NULL;
+    s->least_recent = now;
+}
+
+
+/* gcache_a0_visit()
+ * @brief   sees the next entry, oldest first
+ * @param   item: the entry
+ * @param   created: when it was put (unused by this policy)
+ * @param   expiration, last_retrieved: its stamps; 0 if never retrieved
+ * @returns 1 if the entry has expired, which ends the scan; otherwise 0
+ */
+static inline int gcache_a0_visit(gcache_a0_t *s, void *item, clock_t created,
+                                  clock_t expiration, clock_t last_retrieved)
+{
+    (void)created;
+
+    if (gcache_expired(expiration, s->now)) {
+        s->victim = item;
+        s->expired = 1;
+        return 1;
+    }
+
+    if (last_retrieved == 0) {
+        s->num_not_retrieved++;
+        if (s->few_retrieved == NULL)
+            s->few_retrieved = item;
+    }
+    else if (last_retrieved < s->least_recent) {
+        s->least_recent = last_retrieved;
+        s->many_retrieved = item;
+    }
+    return 0;
+}
+
+
+/* gcache_a0_pick()
+ * @brief   ends a scan
+ * @param   head: the oldest entry, or NULL if there are none
+ * @returns the victim: the first expired entry, if any; otherwise, if at
+ *          most one entry has never been retrieved, the least-recently
+ *          retrieved one; otherwise, the oldest never-retrieved one
+ */
+static inline void *gcache_a0_pick(gcache_a0_t *s, void *head)
+{
+    if (s->victim != NULL)
+        return s->victim;
+
+    if (s->num_not_retrieved < 2 && s->many_retrieved != NULL)
+        return s->many_retrieved;
+
+    if (s->few_retrieved != NULL)
+        return s->few_retrieved;
+
+    return head; // every retrieval was stamped 'now'; fall back
+}
+
+
+// a scan by gcache_lru: the first expired entry ends it
+typedef struct gcache_lru_t {
+    clock_t now;
+    void *victim;
+    int expired;
+    void *oldest; // least-recently used entry, where a put counts as a use
+    clock_t oldest_use;
+} gcache_lru_t;
+
+
+/* gcache_lru_start()
+ * @brief   begins a scan for the least-recently used entry
+ */
+static inline void gcache_lru_start(gcache_lru_t *s, clock_t now)
+{
+    s->now = now;
+    s->victim = NULL;
+    s->expired = 0;
+    s->oldest = NULL;
+    s->oldest_use = now;
+}
+
+
+/* gcache_lru_visit()
+ * @brief   sees the next entry, oldest first, as gcache_a0_visit()
+ */
+static inline int gcache_lru_visit(gcache_lru_t *s, void *item,
+                                   clock_t created, clock_t expiration,
+                                   clock_t last_retrieved)
+{
+    if (gcache_expired(expiration, s->now)) {
+        s->victim = item;
+        s->expired = 1;
+        return 1;
+    }
+
+    clock_t used = (last_retrieved > created) ? last_retrieved : created;
+    if (s->oldest == NULL || used < s->oldest_use) {
+        s->oldest = item;
+        s->oldest_use = used;
+    }
+    return 0;
+}
+
+
+/* gcache_lru_pick()
+ * @brief   ends a scan
+ * @returns the first expired entry, if any; otherwise the entry put or
+ *          retrieved longest ago (the oldest, on a tie)
+ */
+static inline void *gcache_lru_pick(gcache_lru_t *s, void *head)
+{
+    if (s->victim != NULL)
+        return s->victim;
+    return (s->oldest != NULL) ? s->oldest : head;
+}
+
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * HASH.H
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include <string.h>
+
+/* hash_bytes()
+ * @brief   64-bit FNV-1a over len bytes, finished with a splitmix64 mix so
+ *          that both halves of the result are usable as independent hashes
+ * @param   data, len   bytes to hash
+ * @returns 64-bit hash
+ */
+static inline uint64_t hash_bytes(const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    size_t i;
+    for (i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+/* hash_data()
+ * @brief   64-bit hash for bulk data (e.g. a file's contents), 32 bytes a
+ *          step: four independent lanes of multiply-rotate over 8-byte
+ *          words, folded together with any tail by hash_bytes()
+ * @param   data, len   bytes to hash
+ * @returns 64-bit hash; not hash_bytes()'s value for the same bytes
+ * @note    not cryptographic: equal hashes still need their data compared
+ */
+static inline uint64_t hash_data(const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t lane[4] = { 0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL,
+                         0x165667b19e3779f9ULL, 0x27d4eb2f165667c5ULL };
+    size_t i;
+    int j;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        for (j = 0; j < 4; j++) {
+            uint64_t w;
+            memcpy(&w, p + i + 8 * j, 8);
+            lane[j] = (lane[j] ^ w) * 0x9fb21c651e98df25ULL;
+            lane[j] = (lane[j] << 29) | (lane[j] >> 35);
+        }
+    }
+
+    uint64_t fold[5] = { lane[0], lane[1], lane[2], lane[3], len };
+    return hash_bytes(fold, sizeof(fold)) ^ hash_bytes(p + i, len - i);
+}
+
+/* hash_str()
+ * @brief   hashes a null-terminated string (e.g. a file name)
+ */
+static inline uint64_t hash_str(const char *str)
+{
+    return hash_bytes(str, strlen(str));
+}
+
+/* hash_nth()
+ * @brief   derives the i'th of k hashes from one 64-bit hash, using
+ *          double hashing (h1 + i * h2)
+ */
+static inline uint32_t hash_nth(uint64_t h, int i)
+{
+    uint32_t h1 = (uint32_t)h;
+    uint32_t h2 = (uint32_t)(h >> 32) | 1;
+    return h1 + (uint32_t)i * h2;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,928 @@
+/*
+ * HTTP.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ */
+
+#define _GNU_SOURCE // strptime(), timegm()
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <strings.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "http.h"
+
+#define ORIGIN_TIMEOUT_SEC 10 // longest wait on one read from the origin
+#define CC_MAX 512 // longest Cache-Control kept, over all of its lines
+
+struct origin_t {
+    char *host; // host to connect to, and send as Host:
+    char *port; // TCP port; NULL for a Unix socket
+    char *path; // Unix socket path; NULL for TCP
+    int fd; // keep-alive connection; -1 until needed, or once closed
+
+    char buf[HTTP_HEAD_MAX]; // bytes read from fd, not yet used
+    size_t pos;
+    size_t len;
+};
+
+
+/*** STATIC HELPER FUNC DECLARATIONS ***/
+
+// finds the blank line that ends a head; returns the head's length
+// (blank line included), or 0 if it isn't all there
+static size_t head_length(char *buf, size_t len);
+
+// cuts the next line out of a head, in place; NULL once it's used up
+static char *next_line(char **cursor, char *end);
+
+// splits "Name: value" in place, trimming the value; 0 if it isn't one
+static int split_header(char *line, char **name, char **value);
+
+// returns 1 if a comma-separated header value lists token
+static int has_token(char *value, char *token);
+
+// returns the opaque part of an entity-tag (skipping any W/), and its
+// length; NULL if there's no tag at *cursor, which is moved past it
+static char *next_etag(char **cursor, size_t *len);
+
+// connects to the origin; returns the socket, or -1
+static int connect_origin(O_T origin);
+
+// reads the origin's next response; -2 if it closed before answering
+static int read_response(O_T origin, http_response_t *resp);
+
+// reads more of the origin's bytes into its buffer; returns bytes read,
+// 0 at EOF, or -1
+static ssize_t fill_origin(O_T origin);
+
+// reads len bytes of body, buffered ones first; returns 0, or -1
+static int read_body(O_T origin, unsigned char *body, size_t len);
+
+// reads a chunked body into resp; returns 0, or -1
+static int read_chunked(O_T origin, http_response_t *resp);
+
+// reads one line (a chunk size, or a trailer); NULL on error
+static char *read_line(O_T origin);
+
+// writes len bytes, however many write() calls it takes; 0, or -1
+static int write_all(int fd, char *buf, size_t len);
+
+
+/* parse_http_request()
+ * @brief   parses a request's head (request line and header fields) from
+ *          the front of buf, in place: lines and values are cut out with
+ *          '\0's, and req points at them
+ * @param   buf, len: bytes read from the client
+ * @param   req: filled in
+ * @returns length of the head, blank line (and any empty lines before it)
+ *          included; 0 if the blank line hasn't arrived yet; -1 if the head
+ *          is malformed (a 400)
+ * @note    bare '\n' line endings are accepted, as well as "\r\n"
+ */
+int parse_http_request(char *buf, size_t len, http_request_t *req)
+{
+    // empty lines before the request line are skipped (RFC 7230, 3.5): a
+    // client may send a stray "\r\n" between keep-alive requests
+    size_t skip = 0;
+    while (skip < len && (buf[skip] == '\n' || (buf[skip] == '\r'
+            && skip + 1 < len && buf[skip + 1] == '\n')))
+        skip += (buf[skip] == '\r') ? 2 : 1;
+
+    size_t head_len = head_length(buf + skip, len - skip);
+    if (head_len == 0)
+        return 0;
+
+    char *cursor = buf + skip;
+    char *end = cursor + head_len;
+    char *line = next_line(&cursor, end);
+
+    memset(req, 0, sizeof(*req));
+    if (line == NULL) // no request line
+        return -1;
+
+    // request line: METHOD SP target SP HTTP/1.x
+    char *target = strchr(line, ' ');
+    char *version = (target != NULL) ? strchr(target + 1, ' ') : NULL;
+    if (version == NULL || strncmp(version + 1, "HTTP/1.", 7) != 0)
+        return -1;
+
+    *target++ = '\0';
+    *version++ = '\0';
+    req->method = line;
+    req->keep_alive = (strcmp(version, "HTTP/1.0") != 0);
+
+    if (strncasecmp(target, "http://", 7) == 0
+            || strncasecmp(target, "https://", 8) == 0) {
+        char *path = strchr(strstr(target, "//") + 2, '/');
+        target = (path != NULL) ? path : "/";
+    }
+    if (target[0] != '/' || *req->method == '\0')
+        return -1;
+    req->target = target;
+
+    char *name, *value;
+    while ((line = next_line(&cursor, end)) != NULL) {
+        if (!split_header(line, &name, &value))
+            return -1;
+
+        if (strcasecmp(name, "Connection") == 0) {
+            if (has_token(value, "close"))
+                req->keep_alive = 0;
+            else if (has_token(value, "keep-alive"))
+                req->keep_alive = 1;
+        }
+        else if (strcasecmp(name, "Content-Length") == 0) {
+            req->has_body |= (atol(value) > 0);
+        }
+        else if (strcasecmp(name, "Transfer-Encoding") == 0) {
+            req->has_body = 1;
+        }
+        else if (strcasecmp(name, "Cache-Control") == 0
+                 || strcasecmp(name, "Pragma") == 0) {
+            req->no_cache |= has_token(value, "no-cache");
+        }
+        else if (strcasecmp(name, "If-None-Match") == 0) {
+            req->if_none_match = value;
+        }
+        else if (strcasecmp(name, "If-Modified-Since") == 0) {
+            req->if_modified_since = parse_http_date(value);
+        }
+    }
+
+    return (int)(skip + head_len);
+}
+
+
+/* parse_cache_control()
+ * @brief   reads a response's Cache-Control directives as a shared cache
+ *          must: no-store and private forbid storing, no-cache allows it
+ *          but needs a revalidation on every use, and s-maxage overrides
+ *          max-age
+ * @param   value: the header's value (several lines joined with commas)
+ * @returns the response's lifetime in seconds (0 for no-cache); -1 if it
+ *          mustn't be stored; -2 if it doesn't say
+ */
+int parse_cache_control(char *value)
+{
+    int max_age = -2;
+    int s_maxage = -2;
+    int no_cache = 0;
+    char *p = value;
+
+    while (*p != '\0') {
+        p += strspn(p, " \t,");
+        size_t len = strcspn(p, "=, \t");
+
+        if ((len == 8 && strncasecmp(p, "no-store", 8) == 0)
+                || (len == 7 && strncasecmp(p, "private", 7) == 0))
+            return -1;
+        if (len == 8 && strncasecmp(p, "no-cache", 8) == 0)
+            no_cache = 1;
+
+        int *target = NULL;
+        if (len == 7 && strncasecmp(p, "max-age", 7) == 0)
+            target = &max_age;
+        else if (len == 8 && strncasecmp(p, "s-maxage", 8) == 0)
+            target = &s_maxage;
+
+        p += len;
+        if (*p == '=') {
+            p++;
+            if (target != NULL)
+                *target = atoi(p + (*p == '"'));
+            p += strcspn(p, ",");
+        }
+    }
+
+    if (no_cache)
+        return 0;
+    if (s_maxage >= 0)
+        return s_maxage;
+    return (max_age >= 0) ? max_age : -2;
+}
+
+
+/* parse_http_date()
+ * @brief   parses an HTTP date: an IMF-fixdate, or either of the obsolete
+ *          formats (RFC 850, asctime) a recipient must also accept
+ * @param   value: the date
+ * @returns the date, as seconds since the epoch; 0 if it isn't a date
+ */
+time_t parse_http_date(char *value)
+{
+    static const char *formats[] = {
+        "%a, %d %b %Y %H:%M:%S GMT", "%A, %d-%b-%y %H:%M:%S GMT",
+        "%a %b %e %H:%M:%S %Y"
+    };
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        struct tm tm = { 0 };
+        char *rest = strptime(value, formats[i], &tm);
+        if (rest != NULL && *rest == '\0')
+            return timegm(&tm);
+    }
+
+    return 0;
+}
+
+
+/* format_http_date()
+ * @brief   formats t as an IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+ * @param   t: seconds since the epoch
+ * @param   buf: HTTP_DATE_LEN bytes
+ */
+void format_http_date(time_t t, char *buf)
+{
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    strftime(buf, HTTP_DATE_LEN, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+
+/* http_not_modified()
+ * @brief   evaluates a GET's conditional headers against the current
+ *          copy: If-None-Match (weak comparison) if it was given,
+ *          otherwise If-Modified-Since
+ * @param   req: the request
+ * @param   meta: the copy's validators
+ * @returns 1 if the client's copy is current, and it gets a 304
+ */
+int http_not_modified(http_request_t *req, http_meta_t *meta)
+{
+    if (req->if_none_match != NULL) {
+        if (strcmp(req->if_none_match, "*") == 0)
+            return 1; // any current copy matches
+
+        char *cursor = meta->etag;
+        size_t have_len;
+        char *have = next_etag(&cursor, &have_len);
+        if (have == NULL)
+            return 0;
+
+        cursor = req->if_none_match;
+        size_t want_len;
+        char *want;
+        while ((want = next_etag(&cursor, &want_len)) != NULL)
+            if (want_len == have_len && memcmp(want, have, have_len) == 0)
+                return 1;
+        return 0;
+    }
+
+    return req->if_modified_since != 0 && meta->last_modified != 0
+           && meta->last_modified <= req->if_modified_since;
+}
+
+
+/* http_reason()
+ * @brief   returns the reason phrase for a status code
+ */
+const char *http_reason(int status)
+{
+    switch (status) {
+    case 200: return "OK";
+    case 203: return "Non-Authoritative Information";
+    case 204: return "No Content";
+    case 206: return "Partial Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 410: return "Gone";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 502: return "Bad Gateway";
+    case 503: return "Service Unavailable";
+    case 504: return "Gateway Timeout";
+    default: return "Unknown";
+    }
+}
+
+
+/* create_origin()
+ * @brief   makes a client for an origin server; it connects on its first
+ *          fetch, and keeps the connection open between fetches
+ * @param   spec: "port" (on 127.0.0.1), "host:port", or else the path of
+ *          a Unix socket
+ * @returns a struct origin_t pointer; NULL if spec is NULL
+ * @note    a client isn't thread-safe: each thread fetching needs its own
+ */
+O_T create_origin(char *spec)
+{
+    if (spec == NULL)
+        return NULL;
+
+    O_T origin = calloc(1, sizeof(struct origin_t));
+    origin->fd = -1;
+
+    char *colon = strrchr(spec, ':');
+    if (strspn(spec, "0123456789") == strlen(spec)) {
+        origin->host = strdup("127.0.0.1");
+        origin->port = strdup(spec);
+    }
+    else if (colon != NULL && strchr(spec, '/') == NULL) {
+        origin->host = strndup(spec, colon - spec);
+        origin->port = strdup(colon + 1);
+    }
+    else {
+        origin->path = strdup(spec);
+        origin->host = strdup("localhost");
+    }
+
+    return origin;
+}
+
+
+/* fetch_origin()
+ * @brief   sends GET target to the origin, and reads its whole response
+ * @param   origin: a client from create_origin()
+ * @param   target: the request target (origin-form)
+ * @param   validators: a cached copy's ETag and Last-Modified, sent as
+ *          If-None-Match and If-Modified-Since; NULL for a plain GET
+ * @param   resp: filled in; the caller frees resp->body
+ * @returns 0, or -1 if the origin couldn't be reached or its response was
+ *          malformed, too large, or too slow (ORIGIN_TIMEOUT_SEC per read)
+ * @note    blocks until the response is in. a kept-alive connection that
+ *          the origin has since closed is retried once, on a new one.
+ * @note    resp->max_age is set for a 200 or 304: from Cache-Control, or
+ *          else Expires - Date; a response with neither is kept for 0 sec
+ *          (revalidated on every use) if it has a validator, and not at
+ *          all otherwise, and one with Vary isn't kept either
+ */
+int fetch_origin(O_T origin, char *target, http_meta_t *validators,
+                 http_response_t *resp)
+{
+    if (origin == NULL || target == NULL || resp == NULL)
+        return -1;
+
+    char *req = malloc(strlen(target) + strlen(origin->host)
+                       + 2 * HTTP_TOKEN_MAX + 128);
+    int len = sprintf(req, "GET %s HTTP/1.1\r\nHost: %s\r\n", target,
+                      origin->host);
+
+    if (validators != NULL && validators->etag[0] != '\0')
+        len += sprintf(req + len, "If-None-Match: %s\r\n", validators->etag);
+    if (validators != NULL && validators->last_modified != 0) {
+        char date[HTTP_DATE_LEN];
+        format_http_date(validators->last_modified, date);
+        len += sprintf(req + len, "If-Modified-Since: %s\r\n", date);
+    }
+    len += sprintf(req + len, "\r\n");
+
+    int result = -1;
+    int attempt;
+    for (attempt = 0; attempt < 2; attempt++) {
+        int reused = (origin->fd != -1);
+        if (!reused && (origin->fd = connect_origin(origin)) == -1)
+            break;
+
+        if (write_all(origin->fd, req, len) == 0
+                && (result = read_response(origin, resp)) == 0)
+            break;
+
+        close(origin->fd);
+        origin->fd = -1;
+        origin->pos = origin->len = 0;
+
+        // only a kept-alive connection that closed unused is worth a retry
+        if (!reused || result == -1)
+            break;
+    }
+
+    free(req);
+    return (result == 0) ? 0 : -1;
+}
+
+
+/* free_origin()
+ * @brief   closes an origin client's connection, and frees it
+ * @param   origin: a struct origin_t pointer; NULL does nothing
+ */
+void free_origin(O_T origin)
+{
+    if (origin == NULL)
+        return;
+
+    if (origin->fd != -1)
+        close(origin->fd);
+    free(origin->host);
+    free(origin->port);
+    free(origin->path);
+    free(origin);
+}
+
+
+/*** STATIC HELPER FUNCTIONS ***/
+
+
+/* head_length()
+ * @brief   finds the end of a head: the first empty line, "\r\n" or "\n"
+ * @returns length of the head through that line; 0 if it isn't in buf yet
+ */
+static size_t head_length(char *buf, size_t len)
+{
+    char *p = buf;
+    char *end = buf + len;
+
+    while ((p = memchr(p, '\n', end - p)) != NULL) {
+        p++;
+        if (p < end && *p == '\n')
+            return p + 1 - buf;
+        if (p + 1 < end && p[0] == '\r' && p[1] == '\n')
+            return p + 2 - buf;
+    }
+
+    return 0;
+}
+
+
+/* next_line()
+ * @brief   cuts the next line out of a head, replacing its "\r\n" (or
+ *          "\n") with '\0's
+ * @param   cursor: start of the line; moved to the start of the next one
+ * @param   end: end of the head
+ * @returns the line; NULL at the head's closing empty line (or its end)
+ */
+static char *next_line(char **cursor, char *end)
+{
+    char *line = *cursor;
+    char *nl = memchr(line, '\n', end - line);
+
+    if (nl == NULL)
+        return NULL;
+
+    *nl = '\0';
+    if (nl > line && nl[-1] == '\r')
+        nl[-1] = '\0';
+    *cursor = nl + 1;
+
+    return (*line != '\0') ? line : NULL;
+}
+
+
+/* split_header()
+ * @brief   splits a header field line at its colon, in place
+ * @param   line: "Name: value"
+ * @param   name, value: set to the name, and the value without leading or
+ *          trailing whitespace
+ * @returns 1, or 0 if the line has no colon, or a name with whitespace
+ */
+static int split_header(char *line, char **name, char **value)
+{
+    char *colon = strchr(line, ':');
+    if (colon == NULL || colon == line || strcspn(line, " \t") < (size_t)
+            (colon - line))
+        return 0;
+
+    *colon = '\0';
+    *name = line;
+
+    char *v = colon + 1;
+    v += strspn(v, " \t");
+    char *v_end = v + strlen(v);
+    while (v_end > v && (v_end[-1] == ' ' || v_end[-1] == '\t'))
+        *--v_end = '\0';
+    *value = v;
+
+    return 1;
+}
+
+
+/* has_token()
+ * @brief   looks for token (case-insensitive) in a comma-separated list,
+ *          e.g. "keep-alive, Upgrade"
+ */
+static int has_token(char *value, char *token)
+{
+    size_t token_len = strlen(token);
+    char *p = value;
+
+    while (*p != '\0') {
+        p += strspn(p, " \t,");
+        size_t len = strcspn(p, " \t,=");
+        if (len == token_len && strncasecmp(p, token, len) == 0)
+            return 1;
+        p += strcspn(p, ",");
+    }
+
+    return 0;
+}
+
+
+/* next_etag()
+ * @brief   reads one entity-tag from a list like If-None-Match's
+ * @param   cursor: where to start; moved past the tag
+ * @param   len: set to the length of the tag's opaque part
+ * @returns the opaque part, inside its quotes; NULL if there are no more
+ *          tags (or what's left isn't one)
+ */
+static char *next_etag(char **cursor, size_t *len)
+{
+    char *p = *cursor;
+
+    p += strspn(p, " \t,");
+    if (strncmp(p, "W/", 2) == 0)
+        p += 2;
+    if (*p != '"')
+        return NULL;
+
+    char *close = strchr(p + 1, '"');
+    if (close == NULL)
+        return NULL;
+
+    *len = close - (p + 1);
+    *cursor = close + 1;
+    return p + 1;
+}
+
+
+/* connect_origin()
+ * @brief   opens a blocking connection to the origin, with read and write
+ *          timeouts of ORIGIN_TIMEOUT_SEC
+ * @returns the socket, or -1
+ */
+static int connect_origin(O_T origin)
+{
+    struct timeval timeout = { ORIGIN_TIMEOUT_SEC, 0 };
+    int fd = -1;
+
+    if (origin->path != NULL) {
+        struct sockaddr_un addr = { 0 };
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, origin->path, sizeof(addr.sun_path) - 1);
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd != -1 && connect(fd, (struct sockaddr *)&addr,
+                                sizeof(addr)) == -1) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    else {
+        struct addrinfo hints = { 0 }, *addrs = NULL, *ai;
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+
+        if (getaddrinfo(origin->host, origin->port, &hints, &addrs) != 0)
+            return -1;
+
+        for (ai = addrs; ai != NULL && fd == -1; ai = ai->ai_next) {
+            fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, 0);
+            if (fd != -1 && connect(fd, ai->ai_addr, ai->ai_addrlen) == -1) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(addrs);
+
+        int one = 1;
+        if (fd != -1)
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    if (fd != -1) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    }
+    origin->pos = origin->len = 0;
+    return fd;
+}
+
+
+/* read_response()
+ * @brief   reads the origin's next response, head and body, skipping any
+ *          1xx interim responses; closes the connection afterwards if the
+ *          origin asked to, or the body ran to EOF
+ * @param   origin: an origin client with an open connection
+ * @param   resp: filled in; see fetch_origin()
+ * @returns 0; -1 on an error; -2 if the connection closed before any of
+ *          the response arrived
+ */
+static int read_response(O_T origin, http_response_t *resp)
+{
+    char cc[CC_MAX] = "";
+    time_t date = 0, expires = 0;
+    long long content_length = -1;
+    int chunked = 0, keep_alive = 1, vary = 0;
+    size_t head_len;
+    char *cursor, *end;
+    int got_any = 0;
+
+    memset(resp, 0, sizeof(*resp));
+    resp->max_age = -1;
+
+    while (1) {
+        while ((head_len = head_length(origin->buf + origin->pos,
+                                       origin->len - origin->pos)) == 0) {
+            if (origin->len - origin->pos == HTTP_HEAD_MAX)
+                return -1;
+
+            ssize_t n = fill_origin(origin);
+            if (n <= 0)
+                return (n == 0 && !got_any) ? -2 : -1;
+            got_any = 1;
+        }
+
+        cursor = origin->buf + origin->pos;
+        end = cursor + head_len;
+        char *line = next_line(&cursor, end);
+        origin->pos += head_len;
+
+        if (line == NULL || strncmp(line, "HTTP/1.", 7) != 0
+                || line[8] != ' ')
+            return -1;
+
+        resp->status = atoi(line + 9);
+        keep_alive = (line[7] != '0');
+        if (resp->status < 100 || resp->status > 999)
+            return -1;
+        if (resp->status >= 200)
+            break;
+
+        // a 1xx: its (header-only) head is skipped; the real one follows
+        while (next_line(&cursor, end) != NULL)
+            ;
+    }
+
+    char *line, *name, *value;
+    while ((line = next_line(&cursor, end)) != NULL) {
+        if (!split_header(line, &name, &value))
+            return -1;
+
+        size_t value_len = strlen(value);
+        if (strcasecmp(name, "Content-Length") == 0) {
+            content_length = atoll(value);
+        }
+        else if (strcasecmp(name, "Transfer-Encoding") == 0) {
+            chunked = has_token(value, "chunked");
+        }
+        else if (strcasecmp(name, "Connection") == 0) {
+            if (has_token(value, "close"))
+                keep_alive = 0;
+            else if (has_token(value, "keep-alive"))
+                keep_alive = 1;
+        }
+        else if (strcasecmp(name, "Cache-Control") == 0) {
+            size_t cc_len = strlen(cc);
+            if (cc_len + value_len + 2 < CC_MAX)
+                sprintf(cc + cc_len, "%s%s", (cc_len > 0) ? "," : "", value);
+        }
+        else if (strcasecmp(name, "Vary") == 0) {
+            vary |= (value_len > 0);
+        }
+        else if (strcasecmp(name, "Date") == 0) {
+            date = parse_http_date(value);
+        }
+        else if (strcasecmp(name, "Expires") == 0) {
+            expires = parse_http_date(value);
+        }
+        else if (strcasecmp(name, "ETag") == 0) {
+            if (value_len < HTTP_TOKEN_MAX)
+                strcpy(resp->meta.etag, value);
+        }
+        else if (strcasecmp(name, "Last-Modified") == 0) {
+            resp->meta.last_modified = parse_http_date(value);
+        }
+        else if (strcasecmp(name, "Content-Type") == 0) {
+            if (value_len < HTTP_TOKEN_MAX)
+                strcpy(resp->meta.type, value);
+        }
+    }
+
+    // how long a 200 (or the copy a 304 renews) may be kept
+    if ((resp->status == 200 || resp->status == 304) && !vary) {
+        resp->max_age = parse_cache_control(cc);
+        if (resp->max_age == -2 && expires != 0 && date != 0)
+            resp->max_age = (expires > date) ? (int)(expires - date) : 0;
+        if (resp->max_age == -2)
+            resp->max_age = (resp->meta.etag[0] != '\0'
+                             || resp->meta.last_modified != 0) ? 0 : -1;
+    }
+
+    int result = 0;
+    if (resp->status == 204 || resp->status == 304) {
+        // no body
+    }
+    else if (chunked) {
+        result = read_chunked(origin, resp);
+    }
+    else if (content_length >= 0) {
+        if (content_length > HTTP_BODY_MAX)
+            return -1;
+        resp->len = (int)content_length;
+        resp->body = malloc(resp->len + 1);
+        result = read_body(origin, resp->body, resp->len);
+    }
+    else { // the body runs until the origin closes
+        size_t cap = 64 * 1024;
+        resp->body = malloc(cap);
+        while (1) {
+            if ((size_t)resp->len == cap) {
+                if (cap >= HTTP_BODY_MAX) {
+                    result = -1;
+                    break;
+                }
+                cap *= 2;
+                resp->body = realloc(resp->body, cap);
+            }
+
+            size_t take = origin->len - origin->pos;
+            if (take == 0) {
+                ssize_t n = fill_origin(origin);
+                if (n <= 0) {
+                    result = (n == 0) ? 0 : -1;
+                    break;
+                }
+                take = n;
+            }
+            if (take > cap - resp->len)
+                take = cap - resp->len;
+            memcpy(resp->body + resp->len, origin->buf + origin->pos, take);
+            origin->pos += take;
+            resp->len += take;
+        }
+        keep_alive = 0;
+    }
+
+    if (result == -1) {
+        free(resp->body);
+        resp->body = NULL;
+        return -1;
+    }
+
+    if (!keep_alive) {
+        close(origin->fd);
+        origin->fd = -1;
+        origin->pos = origin->len = 0;
+    }
+    return 0;
+}
+
+
+/* fill_origin()
+ * @brief   reads whatever the origin has sent into the buffer, after the
+ *          bytes not yet used (moved to the front first)
+ * @returns bytes read; 0 at EOF (or if the buffer is full); -1 on an error
+ *          or a timeout
+ */
+static ssize_t fill_origin(O_T origin)
+{
+    if (origin->pos > 0) {
+        memmove(origin->buf, origin->buf + origin->pos,
+                origin->len - origin->pos);
+        origin->len -= origin->pos;
+        origin->pos = 0;
+    }
+    if (origin->len == HTTP_HEAD_MAX)
+        return 0;
+
+    while (1) {
+        ssize_t n = read(origin->fd, origin->buf + origin->len,
+                         HTTP_HEAD_MAX - origin->len);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n > 0)
+            origin->len += n;
+        return n;
+    }
+}
+
+
+/* read_body()
+ * @brief   reads len bytes of body: first whatever's buffered, then the
+ *          rest straight from the socket into body, with no extra copy
+ * @returns 0, or -1 if the origin closed (or failed) early
+ */
+static int read_body(O_T origin, unsigned char *body, size_t len)
+{
+    size_t take = origin->len - origin->pos;
+    if (take > len)
+        take = len;
+    memcpy(body, origin->buf + origin->pos, take);
+    origin->pos += take;
+
+    size_t got = take;
+    while (got < len) {
+        ssize_t n = read(origin->fd, body + got, len - got);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        got += n;
+    }
+
+    return 0;
+}
+
+
+/* read_chunked()
+ * @brief   reads a chunked body: each chunk's hex size line and data, then
+ *          the last (empty) chunk and any trailer lines, which are ignored
+ * @returns 0, or -1 on a malformed or too-large body (including a size
+ *          line with anything but chunk extensions after the size)
+ */
+static int read_chunked(O_T origin, http_response_t *resp)
+{
+    size_t cap = 64 * 1024;
+    resp->body = malloc(cap);
+    resp->len = 0;
+
+    while (1) {
+        char *line = read_line(origin);
+        if (line == NULL)
+            return -1;
+
+        // a size is hex digits, then maybe extensions (";name=value"),
+        // which are ignored; strtoul() alone would take "-1" or " 1", and
+        // let anything follow
+        char *hex_end;
+        unsigned long size = strtoul(line, &hex_end, 16);
+        while (*hex_end == ' ' || *hex_end == '\t')
+            hex_end++;
+        if (!isxdigit((unsigned char)*line)
+                || (*hex_end != '\0' && *hex_end != ';'))
+            return -1;
+        // checked before any sum, which a size near 2^64 would wrap
+        if (size > (unsigned long)(HTTP_BODY_MAX - resp->len))
+            return -1;
+        if (size == 0)
+            break;
+
+        if (resp->len + size + 1 > cap) {
+            while (resp->len + size + 1 > cap)
+                cap *= 2;
+            resp->body = realloc(resp->body, cap);
+        }
+        if (read_body(origin, resp->body + resp->len, size) == -1)
+            return -1;
+        resp->len += size;
+
+        line = read_line(origin); // the "\r\n" after the chunk's data
+        if (line == NULL || *line != '\0')
+            return -1;
+    }
+
+    char *line; // trailers, up to an empty line
+    while ((line = read_line(origin)) != NULL && *line != '\0')
+        ;
+    return (line != NULL) ? 0 : -1;
+}
+
+
+/* read_line()
+ * @brief   reads one line from the origin, through its buffer
+ * @returns the line, without its "\r\n" (valid until the next read); NULL
+ *          if the origin closed or failed first, or the line is too long
+ */
+static char *read_line(O_T origin)
+{
+    char *nl;
+
+    while ((nl = memchr(origin->buf + origin->pos, '\n',
+                        origin->len - origin->pos)) == NULL)
+        if (fill_origin(origin) <= 0)
+            return NULL;
+
+    char *line = origin->buf + origin->pos;
+    *nl = '\0';
+    if (nl > line && nl[-1] == '\r')
+        nl[-1] = '\0';
+    origin->pos = nl + 1 - origin->buf;
+
+    return line;
+}
+
+
+/* write_all()
+ * @brief   writes len bytes, however many write() calls it takes
+ * @returns 0, or -1 on an error (or timeout)
+ */
+static int write_all(int fd, char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
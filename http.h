@@ -0,0 +1,89 @@
+/*
+ * HTTP.H
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * HTTP/1.1 for the cache server's proxy mode (see server.h): parsing the
+ * requests clients send, and fetching from the origin server over a
+ * keep-alive connection. Only what a caching proxy for GET and HEAD needs
+ * is handled: requests with bodies are refused, and responses may be
+ * sized by Content-Length, chunked, or delimited by the origin closing.
+ *
+ */
+
+#ifndef HTTP_H
+#define HTTP_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct origin_t *O_T;
+
+#define HTTP_HEAD_MAX (16 * 1024) // longest request or response head
+#define HTTP_BODY_MAX (256 * 1024 * 1024) // largest body fetched
+#define HTTP_TOKEN_MAX 128 // longest ETag or Content-Type kept (with '\0')
+#define HTTP_DATE_LEN 30 // an IMF-fixdate, with its '\0'
+
+// an origin's validators and type for a response (and the file cached
+// from it); a header that's missing, or too long to keep, is left empty
+typedef struct http_meta_t {
+    char etag[HTTP_TOKEN_MAX]; // ETag, quotes (and any W/) included; or ""
+    time_t last_modified; // Last-Modified; 0 if none
+    char type[HTTP_TOKEN_MAX]; // Content-Type; or ""
+} http_meta_t;
+
+// a client's request head; strings point into the parsed buffer
+typedef struct http_request_t {
+    char *method;
+    char *target; // origin-form ("/path?query"); an absolute-form URL is
+                  // cut down to this
+    int keep_alive; // 0 if the connection closes after the answer
+    int has_body; // 1 if Content-Length (> 0) or Transfer-Encoding is set
+    int no_cache; // 1 if the client asked for revalidation (no-cache)
+    char *if_none_match; // If-None-Match's list; NULL if not given
+    time_t if_modified_since; // If-Modified-Since; 0 if not given
+} http_request_t;
+
+// an origin's response
+typedef struct http_response_t {
+    int status;
+    unsigned char *body; // malloc'd; NULL if the response has none
+    int len; // length of body
+    int max_age; // how long (sec) it may be cached; -1 if it mustn't be
+    http_meta_t meta;
+} http_response_t;
+
+// parses a request head; returns its length, 0 if incomplete, -1 if bad
+int parse_http_request(char *buf, size_t len, http_request_t *req);
+
+// returns the lifetime (sec) a Cache-Control value gives a shared cache;
+// -1 if it mustn't store the response, -2 if no lifetime is given
+int parse_cache_control(char *value);
+
+// parses an HTTP date; returns 0 if it isn't one
+time_t parse_http_date(char *value);
+
+// writes t as an IMF-fixdate into buf (HTTP_DATE_LEN bytes)
+void format_http_date(time_t t, char *buf);
+
+// returns 1 if the request's validators say its copy is current (a 304)
+int http_not_modified(http_request_t *req, http_meta_t *meta);
+
+// returns the reason phrase for a status code
+const char *http_reason(int status);
+
+// makes a client for the origin at "[host:]port" or a Unix socket path
+O_T create_origin(char *spec);
+
+// fetches target from the origin, conditionally if validators are given
+int fetch_origin(O_T origin, char *target, http_meta_t *validators,
+                 http_response_t *resp);
+
+// closes an origin's connection, and frees it
+void free_origin(O_T origin);
+
+#endif
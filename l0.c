@@ -0,0 +1,178 @@
+/*
+ * L0.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ */
+
+#include "l0.h"
+#include "hash.h"
+#include "gcache.h"
+
+// one slot: a file's data, as of an epoch
+typedef struct l0_slot_t {
+    char *name; // malloc'd; NULL if the slot is empty
+    uint64_t hash; // hash_str() of name
+    payload_t *handle; // pinned: plain data, as unpack_file_cache() gives
+    uint64_t epoch; // the shared cache's epoch when the slot was filled
+    clock_t expiration; // the file's, when the slot was filled
+    int uses; // hits left before a GET is sent on to the cache
+} l0_slot_t;
+
+struct l0_t {
+    l0_slot_t *slots;
+    uint64_t mask; // slots - 1, a power of two minus one
+    l0_stats_t stats;
+};
+
+
+/*** STATIC HELPER FUNC DECLARATIONS ***/
+
+// empties a slot, releasing its handle
+static void clear_slot(l0_slot_t *slot);
+
+
+/* create_l0()
+ * @brief   initializes an empty L0
+ * @param   slots: minimum number of slots; rounded up to a power of 2
+ * @returns a struct l0_t pointer, or NULL if slots is invalid
+ */
+L0_T create_l0(int slots)
+{
+    if (slots < 1)
+        return NULL;
+
+    uint64_t n = 1;
+    while (n < (uint64_t)slots)
+        n <<= 1;
+
+    L0_T l0 = calloc(1, sizeof(struct l0_t));
+    l0->slots = calloc(n, sizeof(l0_slot_t));
+    l0->mask = n - 1;
+    return l0;
+}
+
+
+/* free_l0()
+ * @brief   frees an L0, and releases the handles its slots pin
+ * @param   l0: a struct l0_t pointer
+ */
+void free_l0(L0_T l0)
+{
+    if (l0 == NULL)
+        return;
+
+    uint64_t i;
+    for (i = 0; i <= l0->mask; i++)
+        clear_slot(&l0->slots[i]);
+
+    free(l0->slots);
+    free(l0);
+}
+
+
+/* get_l0()
+ * @brief   looks name up in its slot
+ * @param   l0: a struct l0_t pointer
+ * @param   name: name of file
+ * @param   epoch: the shared cache's epoch, read before this batch's
+ *          lookups
+ * @param   now: the time, by the shared cache's clock (now_cache)
+ * @returns a new handle on the file's plain data, to be dropped with
+ *          release_file_cache(); NULL if the slot doesn't hold the file,
+ *          holds it stale (which empties the slot), or has answered
+ *          L0_USES GETs of it since it was filled
+ */
+payload_t *get_l0(L0_T l0, char *name, uint64_t epoch, clock_t now)
+{
+    uint64_t h = hash_str(name);
+    l0_slot_t *slot = &l0->slots[h & l0->mask];
+
+    if (slot->name == NULL || slot->hash != h
+            || strcmp(slot->name, name) != 0) {
+        l0->stats.misses++;
+        return NULL;
+    }
+
+    if (slot->epoch != epoch || gcache_expired(slot->expiration, now)) {
+        clear_slot(slot);
+        l0->stats.stale++;
+        return NULL;
+    }
+
+    // every L0_USES'th GET goes on to the cache, which refills the slot;
+    // until then (e.g. later in the same batch) the slot still answers
+    if (slot->uses-- == 0) {
+        slot->uses = L0_USES;
+        l0->stats.misses++;
+        return NULL;
+    }
+
+    l0->stats.hits++;
+    atomic_fetch_add(&slot->handle->refs, 1);
+    return slot->handle;
+}
+
+
+/* put_l0()
+ * @brief   fills name's slot, replacing whatever it held
+ * @param   l0: a struct l0_t pointer
+ * @param   name: name of file
+ * @param   handle: a handle on the file's plain data (not compressed, and
+ *          not a view); the slot takes a reference of its own
+ * @param   epoch: the shared cache's epoch, read before the lookup that
+ *          returned handle
+ * @param   expiration: the file's expiration, as of that lookup
+ */
+void put_l0(L0_T l0, char *name, payload_t *handle, uint64_t epoch,
+            clock_t expiration)
+{
+    if (handle == NULL || handle->packed != 0 || handle->parts != NULL)
+        return;
+
+    uint64_t h = hash_str(name);
+    l0_slot_t *slot = &l0->slots[h & l0->mask];
+    clear_slot(slot);
+
+    atomic_fetch_add(&handle->refs, 1);
+    slot->name = strdup(name);
+    slot->hash = h;
+    slot->handle = handle;
+    slot->epoch = epoch;
+    slot->expiration = expiration;
+    slot->uses = L0_USES;
+    l0->stats.fills++;
+}
+
+
+/* take_stats_l0()
+ * @brief   returns an L0's counters since it was created, or since they
+ *          were last taken, and zeroes them
+ * @param   l0: a struct l0_t pointer
+ */
+l0_stats_t take_stats_l0(L0_T l0)
+{
+    l0_stats_t stats = l0->stats;
+    memset(&l0->stats, 0, sizeof(l0_stats_t));
+    return stats;
+}
+
+
+/*** STATIC HELPER FUNCTIONS ***/
+
+
+/* clear_slot()
+ * @brief   empties a slot, dropping its reference to its handle
+ */
+static void clear_slot(l0_slot_t *slot)
+{
+    if (slot->name == NULL)
+        return;
+
+    release_file_cache(slot->handle);
+    free(slot->name);
+    slot->name = NULL;
+    slot->handle = NULL;
+}
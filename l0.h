@@ -0,0 +1,62 @@
+/*
+ * L0.H
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * A tiny per-thread front cache for hot keys: a few dozen direct-mapped
+ * slots, each holding a pinned handle on a file's (plain) data, consulted
+ * before the shared cache and its lock. It's only ever touched by the
+ * thread that owns it, so a hit writes nothing another thread reads.
+ *
+ * A slot is filled with the shared cache's epoch (see epoch_of_cache),
+ * which the cache bumps whenever a file's data changes or a file leaves;
+ * once they differ, the slot is stale, and the next lookup goes back to the
+ * shared cache. A slot is also stale once its file has expired. Every
+ * L0_USES'th GET a slot could answer is sent on to the shared cache anyway
+ * (and refills the slot), so that it still sees some of a hot file's GETs,
+ * for its recency, admission counts and refresh-ahead.
+ *
+ */
+
+#ifndef L0_H
+#define L0_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "cache.h"
+
+#define L0_USES 64 // hits a slot answers between GETs sent to the cache
+
+typedef struct l0_t *L0_T;
+
+// an L0's counters
+typedef struct l0_stats_t {
+    uint64_t hits; // lookups answered by a slot
+    uint64_t misses; // lookups whose slot held another file, or none, or
+                     // that were sent on to the cache after L0_USES hits
+    uint64_t stale; // lookups whose slot was stale (epoch, or expiry)
+    uint64_t fills; // handles put in a slot
+} l0_stats_t;
+
+// creates an L0 of (at least) slots slots
+L0_T create_l0(int slots);
+
+// frees an L0, releasing the handles its slots pin
+void free_l0(L0_T l0);
+
+// returns a new handle on name's data if a slot holds it, fresh; else NULL
+payload_t *get_l0(L0_T l0, char *name, uint64_t epoch, clock_t now);
+
+// puts a handle on name's data in its slot, taking a reference of its own
+void put_l0(L0_T l0, char *name, payload_t *handle, uint64_t epoch,
+            clock_t expiration);
+
+// returns the L0's counters, and zeroes them
+l0_stats_t take_stats_l0(L0_T l0);
+
+#endif
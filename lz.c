@@ -0,0 +1,373 @@
+/*
+ * LZ.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ */
+
+#include "lz.h"
+
+#define LZ_MIN_MATCH 4 // shortest match worth a sequence
+#define LZ_HASH_BITS 13 // size of the match finder's table (8K entries)
+#define LZ_LAST_LITERALS 5 // matches end at least this far before a block's
+                           // end, so it always ends in literals
+#define LZ_MATCH_LIMIT 12 // ...and start at least this far before it
+#define LZ_SKIP_SHIFT 6 // after 2^this misses in a row, search faster
+
+
+/*** STATIC HELPER FUNC DECLARATIONS ***/
+
+// packs one block of up to LZ_BLOCK bytes; returns the packed size
+static int pack_block(unsigned char *src, int len, unsigned char *dst);
+
+// unpacks one packed block into exactly len bytes; returns 0, or -1 if bad
+static int unpack_block(unsigned char *src, int packed, unsigned char *dst,
+                        int len);
+
+// appends a sequence: literals, then (if match_len > 0) a match
+static unsigned char *put_sequence(unsigned char *op, unsigned char *lit,
+                                   int lit_len, int offset, int match_len);
+
+// appends the rest of a length that didn't fit in its token's 4 bits
+static unsigned char *put_length(unsigned char *op, int len);
+
+// reads the rest of a length; returns -1 if src runs out first
+static int get_length(unsigned char **ip, unsigned char *end);
+
+// reads the size word at the start of a block
+static uint32_t get_header(unsigned char *src);
+
+
+/* bound_lz()
+ * @brief   returns the most bytes that pack_lz() can write for len bytes,
+ *          for sizing its buffer
+ */
+int bound_lz(int len)
+{
+    int blocks = len / LZ_BLOCK + 1;
+    return len + blocks * (int)(sizeof(uint32_t) + LZ_BLOCK / 255 + 16);
+}
+
+
+/* pack_lz()
+ * @brief   packs data block by block; a block that doesn't shrink is
+ *          stored as it was
+ * @param   src, len: the data
+ * @param   dst: buffer of at least bound_lz(len) bytes
+ * @returns the number of bytes written to dst
+ */
+int pack_lz(unsigned char *src, int len, unsigned char *dst)
+{
+    unsigned char *op = dst;
+    int pos;
+
+    for (pos = 0; pos < len; pos += LZ_BLOCK) {
+        int raw = (len - pos < LZ_BLOCK) ? len - pos : LZ_BLOCK;
+        uint32_t size = pack_block(src + pos, raw, op + sizeof(uint32_t));
+
+        if ((int)size >= raw) {
+            memcpy(op + sizeof(uint32_t), src + pos, raw);
+            size = raw | LZ_STORED;
+        }
+
+        memcpy(op, &size, sizeof(uint32_t));
+        op += sizeof(uint32_t) + (size & ~LZ_STORED);
+    }
+
+    return op - dst;
+}
+
+
+/* unpack_lz()
+ * @brief   unpacks everything pack_lz() packed, in one go
+ * @param   src, packed: the packed data, and its size
+ * @param   dst: buffer for the len bytes of unpacked data
+ * @returns 0, or -1 if src is damaged (or doesn't unpack to len bytes)
+ */
+int unpack_lz(unsigned char *src, int packed, unsigned char *dst, int len)
+{
+    unsigned char *end = src + packed;
+    int pos;
+
+    for (pos = 0; pos < len; pos += LZ_BLOCK) {
+        int raw = (len - pos < LZ_BLOCK) ? len - pos : LZ_BLOCK;
+        if (end - src < (int)sizeof(uint32_t))
+            return -1;
+
+        uint32_t size = get_header(src);
+        uint32_t body = size & ~LZ_STORED;
+        src += sizeof(uint32_t);
+        if (body > (uint32_t)(end - src))
+            return -1;
+
+        if (size & LZ_STORED) {
+            if ((int)body != raw)
+                return -1;
+            memcpy(dst + pos, src, raw);
+        }
+        else if (unpack_block(src, body, dst + pos, raw) == -1) {
+            return -1;
+        }
+        src += body;
+    }
+
+    return (src == end) ? 0 : -1;
+}
+
+
+/* stream_lz()
+ * @brief   unpacks data a block at a time, handing each block to write as
+ *          it's done; a stored block is handed over without being copied
+ * @param   src, packed: the packed data, and its size
+ * @param   len: the size it unpacks to
+ * @param   write, arg: called with arg and each block, in order
+ * @returns 0, or -1 if src is damaged or write returned -1
+ * @note    needs only one block's worth (LZ_BLOCK) of memory, whatever len
+ */
+int stream_lz(unsigned char *src, int packed, int len, lz_write_fn write,
+              void *arg)
+{
+    unsigned char *end = src + packed;
+    unsigned char *block = NULL;
+    int result = 0;
+    int pos;
+
+    for (pos = 0; pos < len && result == 0; pos += LZ_BLOCK) {
+        int raw = (len - pos < LZ_BLOCK) ? len - pos : LZ_BLOCK;
+        if (end - src < (int)sizeof(uint32_t)) {
+            result = -1;
+            break;
+        }
+
+        uint32_t size = get_header(src);
+        uint32_t body = size & ~LZ_STORED;
+        src += sizeof(uint32_t);
+        if (body > (uint32_t)(end - src)) {
+            result = -1;
+            break;
+        }
+
+        if (size & LZ_STORED) {
+            result = ((int)body == raw) ? write(arg, src, raw) : -1;
+        }
+        else {
+            if (block == NULL)
+                block = malloc(LZ_BLOCK);
+            result = unpack_block(src, body, block, raw);
+            if (result == 0)
+                result = write(arg, block, raw);
+        }
+        src += body;
+    }
+
+    free(block);
+    if (result == 0 && src != end)
+        result = -1;
+    return result;
+}
+
+
+/*** STATIC HELPER FUNCTIONS ***/
+
+
+/* pack_block()
+ * @brief   greedy LZ77 over one block: a hash of each position's next 4
+ *          bytes finds the last position that started with them; the
+ *          longest match there becomes a sequence
+ * @returns the packed size, which may be more than len
+ * @note    positions (and offsets) fit in 16 bits, as a block does
+ */
+static int pack_block(unsigned char *src, int len, unsigned char *dst)
+{
+    uint16_t table[1 << LZ_HASH_BITS] = { 0 };
+    unsigned char *op = dst;
+    int anchor = 0; // start of the literals not yet written
+    int pos = 0;
+    int misses = 0;
+
+    while (pos < len - LZ_MATCH_LIMIT) {
+        uint32_t seq;
+        memcpy(&seq, src + pos, sizeof(seq));
+        uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        int ref = table[h];
+        table[h] = pos;
+
+        uint32_t prev;
+        memcpy(&prev, src + ref, sizeof(prev));
+        if (ref >= pos || prev != seq) {
+            pos += 1 + (misses++ >> LZ_SKIP_SHIFT);
+            continue;
+        }
+
+        // extend back over literals that match too, then forward
+        while (pos > anchor && ref > 0 && src[pos - 1] == src[ref - 1]) {
+            pos--;
+            ref--;
+        }
+
+        int max = len - LZ_LAST_LITERALS - pos;
+        int match = LZ_MIN_MATCH;
+        while (match + 8 <= max) {
+            uint64_t a, b;
+            memcpy(&a, src + pos + match, 8);
+            memcpy(&b, src + ref + match, 8);
+            if (a != b) {
+                match += __builtin_ctzll(a ^ b) >> 3; // little-endian
+                break;
+            }
+            match += 8;
+        }
+        if (match + 8 > max)
+            while (match < max && src[pos + match] == src[ref + match])
+                match++;
+
+        op = put_sequence(op, src + anchor, pos - anchor, pos - ref, match);
+        pos += match;
+        anchor = pos;
+        misses = 0;
+    }
+
+    op = put_sequence(op, src + anchor, len - anchor, 0, 0);
+    return op - dst;
+}
+
+
+/* put_sequence()
+ * @brief   appends a token, the literals, and the match (if any)
+ * @returns the end of what was written
+ */
+static unsigned char *put_sequence(unsigned char *op, unsigned char *lit,
+                                   int lit_len, int offset, int match_len)
+{
+    unsigned char *token = op++;
+    int extra = match_len - LZ_MIN_MATCH;
+
+    *token = ((lit_len < 15) ? lit_len : 15) << 4;
+    if (lit_len >= 15)
+        op = put_length(op, lit_len - 15);
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+
+    if (match_len == 0)
+        return op;
+
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    *token |= (extra < 15) ? extra : 15;
+    if (extra >= 15)
+        op = put_length(op, extra - 15);
+
+    return op;
+}
+
+
+/* put_length()
+ * @brief   appends len as bytes of 255, then one of less
+ */
+static unsigned char *put_length(unsigned char *op, int len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = len;
+    return op;
+}
+
+
+/* get_length()
+ * @brief   reads a length written by put_length()
+ * @returns the length, or -1 if it runs past end
+ */
+static int get_length(unsigned char **ip, unsigned char *end)
+{
+    int len = 0;
+    unsigned char byte;
+
+    do {
+        if (*ip == end)
+            return -1;
+        byte = *(*ip)++;
+        len += byte;
+    } while (byte == 255);
+
+    return len;
+}
+
+
+/* unpack_block()
+ * @brief   replays one block's sequences into dst, checking every length
+ *          and offset against the buffers' bounds
+ * @returns 0, or -1 if the block is damaged
+ */
+static int unpack_block(unsigned char *src, int packed, unsigned char *dst,
+                        int len)
+{
+    unsigned char *ip = src, *end = src + packed;
+    unsigned char *op = dst, *out_end = dst + len;
+
+    while (ip < end) {
+        int token = *ip++;
+        int lit_len = token >> 4;
+        if (lit_len == 15) {
+            int more = get_length(&ip, end);
+            if (more == -1)
+                return -1;
+            lit_len += more;
+        }
+
+        if (lit_len > end - ip || lit_len > out_end - op)
+            return -1;
+        memcpy(op, ip, lit_len);
+        ip += lit_len;
+        op += lit_len;
+
+        if (ip == end) // the last sequence: literals only
+            break;
+
+        if (end - ip < 2)
+            return -1;
+        int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        int match_len = (token & 15) + LZ_MIN_MATCH;
+        if ((token & 15) == 15) {
+            int more = get_length(&ip, end);
+            if (more == -1)
+                return -1;
+            match_len += more;
+        }
+
+        if (offset == 0 || offset > op - dst || match_len > out_end - op)
+            return -1;
+
+        // a match may overlap its own output: copy a period at a time
+        if (offset == 1) {
+            memset(op, op[-1], match_len);
+            op += match_len;
+        }
+        else {
+            while (match_len > 0) {
+                int n = (match_len < offset) ? match_len : offset;
+                memcpy(op, op - offset, n);
+                op += n;
+                match_len -= n;
+            }
+        }
+    }
+
+    return (op == out_end) ? 0 : -1;
+}
+
+
+/* get_header()
+ * @brief   reads a block's size word, which may not be aligned
+ */
+static uint32_t get_header(unsigned char *src)
+{
+    uint32_t size;
+    memcpy(&size, src, sizeof(size));
+    return size;
+}
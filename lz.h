@@ -0,0 +1,50 @@
+/*
+ * LZ.H
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * A small LZ77 codec, for keeping large cached files compressed in memory.
+ * Data is packed in independent blocks of up to LZ_BLOCK bytes, so it can
+ * be unpacked a block at a time, into a buffer of that size, rather than
+ * all at once. Each block is
+ *
+ *      uint32_t size, then size bytes
+ *
+ * (native byte order) where size's top bit (LZ_STORED) marks a block kept
+ * as it was, because it didn't shrink. A packed block is a run of LZ4-style
+ * sequences: a token byte (literal count in its high 4 bits, match length
+ * - 4 in its low 4; 15 means more follows, in bytes of up to 255), the
+ * literals, then a 2-byte little-endian offset back to the match; the last
+ * sequence has literals only.
+ *
+ */
+
+#ifndef LZ_H
+#define LZ_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LZ_BLOCK (64 * 1024) // bytes of data per block
+#define LZ_STORED 0x80000000u // block size flag: kept as it was
+
+// called with each block of data as it's unpacked; returns 0, or -1 to stop
+typedef int (*lz_write_fn)(void *arg, unsigned char *data, int len);
+
+// returns the most bytes that packing len bytes can take
+int bound_lz(int len);
+
+// packs len bytes of src into dst (of bound_lz(len) bytes); returns its size
+int pack_lz(unsigned char *src, int len, unsigned char *dst);
+
+// unpacks all len bytes of data packed into src; returns 0, or -1 if bad
+int unpack_lz(unsigned char *src, int packed, unsigned char *dst, int len);
+
+// unpacks src a block at a time, passing each to write; returns 0 or -1
+int stream_lz(unsigned char *src, int packed, int len, lz_write_fn write,
+              void *arg);
+
+#endif
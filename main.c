@@ -5,17 +5,159 @@
  * @author Skylar Gilfeather
  * @date CS112, Fall 2022
  * 
+ * usage: ./a.out <command file> <cache size> [options]
+ *        ./a.out --serve <cache size> [options]
+ *      -a      admit new files through a TinyLFU frequency filter
+ *      -s      print hit / miss counters after the run
+ *      -b fp   skip lookups of uncached files with a bloom filter, sized
+ *              for a false-positive rate of fp (e.g. 0.01)
+ *      -n ttl  remember unreadable files for ttl seconds (negative caching)
+ *      -N cap  max number of negative entries (default 64)
+ *      -l      lazy PUTs: stat files on PUT, read them on their first GET
+ *      -R frac refresh hot files in the background once they've used up
+ *              frac of their max_age (e.g. 0.8)
+ *      -H rate GETs per second that make a file hot for -R (default 1)
+ *      -W mode watch cached files with inotify; when one changes, either
+ *              "invalidate" (drop it) or "reload" (revalidate it)
+ *      -p      pipelined replay: parse, run and write outputs on separate
+ *              threads (same results as the serial replay)
+ *      -P n    partitioned replay on n threads, with files split between
+ *              them by name; each owns a sub-cache with a share of the
+ *              capacity in proportion to its files. evictions only see a
+ *              partition's own files, so hit ratios only approximate the
+ *              serial replay's: there is no exact partitioned mode
+ *      -r pct  with -P and -s, the serial replay's hit ratio (%) for the
+ *              same run, to report how far the partitions' is from it
+ *      -o sink where GET outputs go: "files" (default; one <name>_output file
+ *              per GET), "stream:<path>" (length-prefixed records appended
+ *              to one file), "null" (dropped), "pipe" (records to stdout)
+ *              or "pipe:<command>" (records piped into command)
+ *      -L dir  spill evicted files to an on-disk L2 under dir, and check it
+ *              on a miss before giving up (GET) or reading the source (PUT)
+ *      -M mb   L2 budget, in MB (default 64)
+ *      -S path warm the cache from the snapshot at path, if there is one,
+ *              and save a snapshot there at the end of the run (or on
+ *              SIGUSR1); with -P, each partition has its own,
+ *              "<path>.<n>", saved only at the end
+ *      -z kb   keep files of at least kb KB compressed in memory (LZ),
+ *              unpacking them as their GET outputs are written
+ *      -Z ratio    ...only those that shrink by at least ratio (default 1.5)
+ *      -C kb   store files bigger than kb KB in chunks of kb KB, read only
+ *              as GETs touch them; a GET may ask for just a range of bytes,
+ *              "GET: <name>\RANGE: <off>-<len>"
+ *      -K mb   most MB of chunks kept in memory (default 64)
+ *      -D      dedup: files with byte-identical data share one copy of it
+ *      -d kb   read files of at least kb KB with O_DIRECT, bypassing the
+ *              page cache (falls back to it where O_DIRECT isn't supported)
+ * 
+ * server options (with --serve; see server.h for the protocol):
+ *      -T [host:]port  listen on TCP
+ *      -U path listen on a Unix socket
+ *      -E n    run n event loops (TCP: one SO_REUSEPORT socket each)
+ *      -F n    give each loop an L0 of n slots (e.g. 32): a front cache of
+ *              hot files, checked before the shared cache and its lock
+ *      -G name attach to the shared-memory cache called name (e.g. /a0),
+ *              creating it if it's not there, and serve from it instead of
+ *              a private cache; every server attached to it shares it.
+ *              it outlives the server, until removed (/dev/shm/<name>)
+ *      -g mb   MB of file data in the shared-memory cache, if it's created
+ *              (default 64)
+ *      -O origin   speak HTTP/1.1 instead, as a caching reverse proxy for
+ *              the origin at [host:]port (or a Unix socket path)
+ *      -v      log the per-command messages to stdout (off by default)
+ * 
  */ 
 
 #include "sim_cache.h"
+#include "server.h"
 
 int main(int argc, char **argv)
 {
     (void) argc;
+    sim_opts_t opts = { 0 };
+    opts.neg_cap = 64;
+    opts.ahead_rate = 1;
+    opts.spill_mb = 64;
+    opts.compress_ratio = 1.5;
+    opts.chunk_mb = 64;
+    opts.shm_mb = 64;
+    int result = 0;
 
-    if (argc == 3) {
-        int result = run_cache_sim(argv[1], atoi(argv[2]));
+    int i;
+    for (i = 3; i < argc; i++) {
+        if (strcmp(argv[i], "-a") == 0)
+            opts.admission = 1;
+        else if (strcmp(argv[i], "-s") == 0)
+            opts.stats = 1;
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            opts.filter_fp = atof(argv[++i]);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            opts.neg_ttl = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-N") == 0 && i + 1 < argc)
+            opts.neg_cap = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-l") == 0)
+            opts.lazy = 1;
+        else if (strcmp(argv[i], "-R") == 0 && i + 1 < argc)
+            opts.ahead_fraction = atof(argv[++i]);
+        else if (strcmp(argv[i], "-H") == 0 && i + 1 < argc)
+            opts.ahead_rate = atof(argv[++i]);
+        else if (strcmp(argv[i], "-p") == 0)
+            opts.pipeline = 1;
+        else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc)
+            opts.workers = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            opts.compare_serial = 1;
+            opts.serial_ratio = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            opts.output = argv[++i];
+        else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc)
+            opts.spill_dir = argv[++i];
+        else if (strcmp(argv[i], "-M") == 0 && i + 1 < argc)
+            opts.spill_mb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc)
+            opts.snapshot = argv[++i];
+        else if (strcmp(argv[i], "-z") == 0 && i + 1 < argc)
+            opts.compress_kb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-Z") == 0 && i + 1 < argc)
+            opts.compress_ratio = atof(argv[++i]);
+        else if (strcmp(argv[i], "-D") == 0)
+            opts.dedup = 1;
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+            opts.direct_kb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-C") == 0 && i + 1 < argc)
+            opts.chunk_kb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-K") == 0 && i + 1 < argc)
+            opts.chunk_mb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc)
+            opts.tcp = argv[++i];
+        else if (strcmp(argv[i], "-U") == 0 && i + 1 < argc)
+            opts.unix_path = argv[++i];
+        else if (strcmp(argv[i], "-E") == 0 && i + 1 < argc)
+            opts.loops = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-F") == 0 && i + 1 < argc)
+            opts.l0_slots = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-G") == 0 && i + 1 < argc)
+            opts.shm_name = argv[++i];
+        else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc)
+            opts.shm_mb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-O") == 0 && i + 1 < argc)
+            opts.origin = argv[++i];
+        else if (strcmp(argv[i], "-v") == 0)
+            opts.verbose = 1;
+        else if (strcmp(argv[i], "-W") == 0 && i + 1 < argc)
+            opts.watch = (strcmp(argv[++i], "reload") == 0) ? WATCH_RELOAD
+                                                             : WATCH_INVALIDATE;
+        else
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+    }
+
+    if (argc >= 3 && strcmp(argv[1], "--serve") == 0) {
+        result = run_cache_server(atoi(argv[2]), &opts);
+    }
+    else if (argc >= 3) {
+        result = run_cache_sim(argv[1], atoi(argv[2]), &opts);
     }
     
-    return 0;
-}
\ No newline at end of file
+    return result;
+}
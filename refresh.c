@@ -0,0 +1,250 @@
+/*
+ * REFRESH.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ */
+
+#include "refresh.h"
+
+/*** REFRESH QUEUE NODE ***/
+typedef struct refresh_node_t {
+    refresh_result_t job; // name + known meta going in; result coming out
+    struct refresh_node_t *next;
+} *refresh_node_t;
+
+struct refresher_t {
+    pthread_t worker;
+    pthread_mutex_t lock; // guards both queues and stopping
+    pthread_cond_t wake; // signalled when a job is queued, or on stop
+
+    refresh_node_t todo_head, todo_tail; // submitted, not yet started
+    refresh_node_t done_head, done_tail; // finished, not yet polled
+    int stopping;
+};
+
+
+/*** STATIC HELPER FUNC DECLARATIONS ***/
+
+// worker loop: takes jobs off the todo queue until stopped
+static void *refresh_worker(void *arg);
+
+// appends node to the queue with the given head and tail
+static void enqueue(refresh_node_t *head, refresh_node_t *tail,
+                    refresh_node_t node);
+
+// pops the head of a queue; NULL if empty
+static refresh_node_t dequeue(refresh_node_t *head, refresh_node_t *tail);
+
+
+/* create_refresher()
+ * @brief   initializes a refresher and starts its worker thread
+ * @returns a struct refresher_t pointer, or NULL if the thread won't start
+ */
+R_T create_refresher()
+{
+    R_T r = malloc(sizeof(struct refresher_t));
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->wake, NULL);
+    r->todo_head = r->todo_tail = NULL;
+    r->done_head = r->done_tail = NULL;
+    r->stopping = 0;
+
+    if (pthread_create(&r->worker, NULL, refresh_worker, r) != 0) {
+        pthread_mutex_destroy(&r->lock);
+        pthread_cond_destroy(&r->wake);
+        free(r);
+        return NULL;
+    }
+
+    return r;
+}
+
+
+/* free_refresher()
+ * @brief   stops the worker thread, and frees the refresher along with any
+ *          queued jobs and unclaimed results
+ * @param   refresher: a struct refresher_t pointer
+ * @note    a refresh already in progress is finished before this returns
+ */
+void free_refresher(R_T refresher)
+{
+    if (refresher == NULL)
+        return;
+
+    pthread_mutex_lock(&refresher->lock);
+    refresher->stopping = 1;
+    pthread_cond_signal(&refresher->wake);
+    pthread_mutex_unlock(&refresher->lock);
+
+    pthread_join(refresher->worker, NULL);
+
+    refresh_node_t node;
+    while ((node = dequeue(&refresher->todo_head, &refresher->todo_tail))) {
+        free(node->job.name);
+        free(node);
+    }
+    while ((node = dequeue(&refresher->done_head, &refresher->done_tail))) {
+        free(node->job.name);
+        free(node->job.data);
+        free(node);
+    }
+
+    pthread_mutex_destroy(&refresher->lock);
+    pthread_cond_destroy(&refresher->wake);
+    free(refresher);
+}
+
+
+/* submit_refresher()
+ * @brief   queues a file to be refreshed in the background
+ * @param   refresher: a struct refresher_t pointer
+ * @param   file_name: name of file to refresh; copied
+ * @param   known: metadata the file was cached with, to compare against
+ * @returns 0 if queued, -1 if refresher is invalid
+ */
+int submit_refresher(R_T refresher, char *file_name, file_meta_t *known)
+{
+    if (refresher == NULL || file_name == NULL)
+        return -1;
+
+    refresh_node_t node = calloc(1, sizeof(struct refresh_node_t));
+    node->job.name = strdup(file_name);
+    node->job.meta = *known;
+
+    pthread_mutex_lock(&refresher->lock);
+    enqueue(&refresher->todo_head, &refresher->todo_tail, node);
+    pthread_cond_signal(&refresher->wake);
+    pthread_mutex_unlock(&refresher->lock);
+
+    return 0;
+}
+
+
+/* poll_refresher()
+ * @brief   takes one finished refresh off the refresher, without blocking
+ * @param   refresher: a struct refresher_t pointer
+ * @param   result: filled in with the finished refresh
+ * @returns 1 if a result was taken (caller owns its name and data);
+ *          0 if none are ready
+ */
+int poll_refresher(R_T refresher, refresh_result_t *result)
+{
+    if (refresher == NULL)
+        return 0;
+
+    pthread_mutex_lock(&refresher->lock);
+    refresh_node_t node = dequeue(&refresher->done_head, &refresher->done_tail);
+    pthread_mutex_unlock(&refresher->lock);
+
+    if (node == NULL)
+        return 0;
+
+    *result = node->job;
+    free(node);
+    return 1;
+}
+
+
+/* run_refresh()
+ * @brief   runs a refresh in the caller's thread: stats job's file, and if
+ *          it differs from the known metadata, reads its new data in
+ * @param   job: job to run; name and meta are inputs, the rest outputs
+ */
+void run_refresh(refresh_result_t *job)
+{
+    file_meta_t meta;
+
+    job->changed = 0;
+    job->gone = 0;
+    job->data = NULL;
+    job->len = -1;
+
+    if (stat_file_meta(job->name, &meta) == -1) {
+        job->gone = 1;
+        return;
+    }
+
+    if (meta.size == job->meta.size && meta.mtime == job->meta.mtime
+            && meta.mtime_nsec == job->meta.mtime_nsec
+            && meta.ino == job->meta.ino)
+        return; // unchanged: nothing to read
+
+    job->len = read_file_with_meta(job->name, &job->data, &job->meta);
+    if (job->len == -1) {
+        free(job->data);
+        job->data = NULL;
+        job->gone = 1;
+        return;
+    }
+
+    job->changed = 1;
+}
+
+
+/*** STATIC HELPER FUNCTIONS ***/
+
+
+/* refresh_worker()
+ * @brief   worker thread body: runs queued refreshes one at a time, and
+ *          hands each one back on the done queue
+ * @param   arg: the struct refresher_t pointer that owns this thread
+ */
+static void *refresh_worker(void *arg)
+{
+    R_T r = (R_T)arg;
+
+    pthread_mutex_lock(&r->lock);
+    while (1) {
+        while (r->todo_head == NULL && !r->stopping)
+            pthread_cond_wait(&r->wake, &r->lock);
+
+        if (r->stopping)
+            break;
+
+        refresh_node_t node = dequeue(&r->todo_head, &r->todo_tail);
+        pthread_mutex_unlock(&r->lock);
+
+        run_refresh(&node->job); // file I/O happens outside the lock
+
+        pthread_mutex_lock(&r->lock);
+        enqueue(&r->done_head, &r->done_tail, node);
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    return NULL;
+}
+
+
+/* enqueue()
+ * @brief   appends node to the back of a queue
+ */
+static void enqueue(refresh_node_t *head, refresh_node_t *tail,
+                    refresh_node_t node)
+{
+    node->next = NULL;
+    if (*tail == NULL)
+        *head = node;
+    else
+        (*tail)->next = node;
+    *tail = node;
+}
+
+
+/* dequeue()
+ * @brief   pops the front of a queue
+ * @returns the popped node, or NULL if the queue is empty
+ */
+static refresh_node_t dequeue(refresh_node_t *head, refresh_node_t *tail)
+{
+    refresh_node_t node = *head;
+    if (node == NULL)
+        return NULL;
+
+    *head = node->next;
+    if (*head == NULL)
+        *tail = NULL;
+    return node;
+}
\ No newline at end of file
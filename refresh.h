@@ -0,0 +1,52 @@
+/*
+ * REFRESH.H
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * Background refresher: a worker thread that revalidates (and, if needed,
+ * re-reads) source files off the request path. The cache submits names,
+ * and later polls for finished refreshes to apply them; the worker never
+ * touches the cache itself.
+ *
+ */
+
+#ifndef REFRESH_H
+#define REFRESH_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "file_sys.h"
+
+typedef struct refresher_t *R_T;
+
+// outcome of one background refresh
+typedef struct refresh_result_t {
+    char *name; // malloc'd name of refreshed file; owned by the receiver
+    int changed; // 1 if the source changed and data was re-read
+    int gone; // 1 if the source couldn't be stat'd or read
+    unsigned char *data; // malloc'd new data, if changed; else NULL
+    int len; // length of new data, if changed
+    file_meta_t meta; // source metadata at refresh time
+} refresh_result_t;
+
+// starts a refresher with its own worker thread
+R_T create_refresher();
+
+// stops the worker and frees the refresher, and any unclaimed results
+void free_refresher(R_T refresher);
+
+// queues file_name for a refresh, given the metadata it was cached with
+int submit_refresher(R_T refresher, char *file_name, file_meta_t *known);
+
+// pops one finished refresh, if any; returns 1 if result was filled in
+int poll_refresher(R_T refresher, refresh_result_t *result);
+
+// runs one refresh synchronously, in the caller's thread
+void run_refresh(refresh_result_t *job);
+
+#endif
\ No newline at end of file
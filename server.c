@@ -0,0 +1,1138 @@
+/*
+ * SERVER.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ */
+
+#define _GNU_SOURCE // accept4()
+
+#include <errno.h>
+#include <netdb.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "server.h"
+#include "shm.h"
+#include "gcache.h"
+
+#define SERVER_BATCH 32 // most consecutive GETs (or PUTs) run as one batch
+#define SERVER_EVENTS 64 // events taken per epoll_wait()
+#define SERVER_IOV 64 // answers gathered per writev()
+#define CONN_OUT_MAX 256 // answers queued on a connection before it pauses
+#define CONN_IN_MIN (16 * 1024) // initial read buffer; grows for long lines
+#define CONN_LINE_MAX (64 * 1024) // longest request line
+#define HTTP_ANSWER_HEAD (512 + 2 * HTTP_TOKEN_MAX) // longest response head
+
+// what an epoll event's data.ptr points at; each struct starts with its tag
+#define TAG_LISTEN 0
+#define TAG_CONN 1
+#define TAG_WAKE 2
+
+/*** ANSWER ***/
+// one answer queued on a connection: a head, and maybe data
+typedef struct answer_t {
+    int head_len;
+    payload_t *handle; // data that follows head, pinned; NULL if none
+    size_t sent; // bytes of head, then data, written so far
+    struct answer_t *next;
+    char head[]; // "OK <len>\n", a one-word answer, or an HTTP head
+} answer_t;
+
+/*** CONNECTION ***/
+typedef struct conn_t {
+    int tag; // TAG_CONN
+    int fd;
+
+    char *in; // bytes read, not yet parsed
+    size_t in_len;
+    size_t in_cap;
+
+    answer_t *out_head; // answers not yet fully written, oldest first
+    answer_t *out_tail;
+    int out_count;
+
+    int can_read; // 0 once read() says EAGAIN, until EPOLLIN
+    int can_write; // 0 once writev() says EAGAIN, until EPOLLOUT
+    int eof; // the peer has closed its side
+    int dead; // a write failed, or a line was too long: close now
+
+    struct conn_t *prev; // the loop's other connections
+    struct conn_t *next;
+} conn_t;
+
+/*** LISTENING SOCKET, OR WAKE-UP EVENTFD ***/
+typedef struct listener_t {
+    int tag; // TAG_LISTEN or TAG_WAKE
+    int fd;
+} listener_t;
+
+/*** SERVER ***/
+typedef struct server_t {
+    C_T cache;
+    SHM_T shm; // shared-memory cache the line protocol uses; NULL if off
+    sim_opts_t *opts;
+    listener_t stop; // eventfd, readable (and never read) once stopping
+    listener_t snap; // eventfd, readable when a snapshot is wanted
+    listener_t unix_l; // shared by every loop; fd -1 if none
+
+    atomic_uint_fast64_t accepted; // connections accepted
+    atomic_uint_fast64_t requests; // requests answered
+    atomic_uint_fast64_t bytes_out; // bytes of data sent
+    atomic_uint_fast64_t fetches; // HTTP: requests forwarded to the origin
+    atomic_uint_fast64_t not_modified; // HTTP: 304s sent to clients
+} server_t;
+
+/*** EVENT LOOP ***/
+typedef struct server_loop_t {
+    server_t *srv;
+    int id;
+    int epfd;
+    listener_t tcp; // this loop's TCP socket; fd -1 if none
+    conn_t *conns; // open connections
+
+    L0_T l0; // this loop's front cache of hot files; NULL if off
+    O_T origin; // HTTP: this loop's client for the origin; NULL if off
+    char date[HTTP_DATE_LEN]; // HTTP: Date header, redone once a second
+    time_t date_at;
+} server_loop_t;
+
+// the running server, for stop_cache_server() and signal handlers
+static _Atomic(server_t *) running = NULL;
+
+
+/*** STATIC HELPER FUNC DECLARATIONS ***/
+
+// opens a non-blocking TCP socket listening on "[host:]port"; -1 on error
+static int open_tcp(char *spec, int reuseport);
+
+// opens a non-blocking Unix socket listening on path; -1 on error
+static int open_unix(char *path);
+
+// event loop thread body
+static void *loop_main(void *arg);
+
+// accepts every pending connection on a listening socket
+static void accept_all(server_loop_t *loop, int fd);
+
+// reads, runs and answers whatever a connection allows, until it blocks
+static void service_conn(server_loop_t *loop, conn_t *conn);
+
+// reads one chunk; returns bytes read, or 0 at EAGAIN / EOF
+static ssize_t read_conn(conn_t *conn);
+
+// runs the complete requests in a connection's buffer; returns how many
+static int handle_requests(server_loop_t *loop, conn_t *conn);
+
+// runs a batch of GETs, or of PUTs, and queues their answers
+static void run_requests(server_loop_t *loop, conn_t *conn,
+                         sim_cmd_t *batch, int n);
+
+// HTTP: runs the complete requests in a connection's buffer
+static int handle_http(server_loop_t *loop, conn_t *conn);
+
+// HTTP: answers a GET or HEAD from the cache, or else from the origin
+static void proxy_request(server_loop_t *loop, conn_t *conn,
+                          http_request_t *req);
+
+// HTTP: queues a response; body may be NULL, and its pin is taken over
+static void queue_http(server_loop_t *loop, conn_t *conn,
+                       http_request_t *req, int status, http_meta_t *meta,
+                       payload_t *body, int max_age, int age,
+                       const char *via);
+
+// queues an answer; handle (pinned data to follow head) may be NULL
+static void queue_answer(conn_t *conn, char *head, payload_t *handle);
+
+// writes queued answers until they're all sent, or the socket is full
+static void flush_conn(server_loop_t *loop, conn_t *conn);
+
+// closes a connection, releasing the data its answers pin
+static void close_conn(server_loop_t *loop, conn_t *conn);
+
+// SIGINT / SIGTERM / SIGUSR1 handlers
+static void on_stop_signal(int sig);
+static void on_snapshot_signal(int sig);
+
+
+/* run_cache_server()
+ * @brief   serves a cache over TCP and / or Unix sockets, on one or more
+ *          edge-triggered epoll loops, until SIGINT or SIGTERM (or
+ *          stop_cache_server)
+ * @param   cache_size  capacity of the cache
+ * @param   opts    options for the cache, as for a sim run, plus tcp,
+ *                  unix_path, loops and verbose
+ * @returns 0 once stopped; 1 if nothing could be listened on
+ * @note    with several loops, each has its own TCP socket bound with
+ *          SO_REUSEPORT, so the kernel spreads connections between them; a
+ *          Unix socket is shared, and woken one loop at a time
+ *          (EPOLLEXCLUSIVE). every loop shares the one cache and its lock.
+ * @note    the cache logs no per-command messages unless opts->verbose is
+ *          set (then they go to stdout); the server's own go to stderr
+ * @note    with opts->snapshot, the cache is warmed from the snapshot, and
+ *          a snapshot is saved on SIGUSR1 and on the way out
+ * @note    with opts->origin, clients speak HTTP/1.1 instead, and the cache
+ *          holds the origin's responses (see proxy_request)
+ * @note    with opts->l0_slots, each loop answers GETs of whole files from
+ *          its own L0 of that many slots where it can, without the cache's
+ *          lock (see lookup_l0_cmd)
+ * @note    with opts->shm_name (and no origin), the line protocol's GETs and
+ *          PUTs go to that shared-memory cache instead (see shm.h), which
+ *          other servers on the host may share; it's left in place when the
+ *          server stops
+ */
+int run_cache_server(int cache_size, sim_opts_t *opts)
+{
+    if (cache_size < 1 || opts == NULL
+            || (opts->tcp == NULL && opts->unix_path == NULL)) {
+        fprintf(stderr, "server needs a cache size, and -T or -U\n");
+        return 1;
+    }
+
+    int loops = (opts->loops > 0) ? opts->loops : 1;
+    server_t srv = { 0 };
+    server_loop_t *loop = calloc(loops, sizeof(server_loop_t));
+    int i;
+
+    srv.opts = opts;
+    srv.unix_l = (listener_t){ TAG_LISTEN, -1 };
+    if (opts->unix_path != NULL)
+        srv.unix_l.fd = open_unix(opts->unix_path);
+
+    for (i = 0; i < loops; i++) {
+        loop[i].srv = &srv;
+        loop[i].id = i;
+        loop[i].tcp = (listener_t){ TAG_LISTEN, -1 };
+        if (opts->tcp != NULL)
+            loop[i].tcp.fd = open_tcp(opts->tcp, loops > 1);
+    }
+
+    if ((opts->unix_path != NULL && srv.unix_l.fd == -1)
+            || (opts->tcp != NULL && loop[0].tcp.fd == -1)) {
+        fprintf(stderr, "server can't listen on %s\n",
+                (srv.unix_l.fd == -1 && opts->unix_path != NULL)
+                ? opts->unix_path : opts->tcp);
+        for (i = 0; i < loops; i++)
+            if (loop[i].tcp.fd != -1)
+                close(loop[i].tcp.fd);
+        if (srv.unix_l.fd != -1)
+            close(srv.unix_l.fd);
+        free(loop);
+        return 1;
+    }
+
+    srv.cache = configure_cache(create_cache(cache_size), cache_size, opts);
+    // the sim's per-command messages would drown out everything else, so
+    // unless asked for, they aren't even formatted
+    set_log_cache(srv.cache, opts->verbose ? stdout : NULL);
+    // HTTP max-ages and Ages are wall time, which passes while we're idle
+    if (opts->origin != NULL)
+        set_clock_cache(srv.cache, gcache_clock_mono);
+    if (opts->shm_name != NULL && opts->origin == NULL) {
+        srv.shm = open_shm(opts->shm_name, cache_size, opts->shm_mb);
+        if (srv.shm == NULL)
+            fprintf(stderr, "server can't open shared memory %s; using a "
+                    "private cache\n", opts->shm_name);
+    }
+    if (opts->snapshot != NULL)
+        restore_snapshot(srv.cache, opts->snapshot);
+
+    srv.stop = (listener_t){ TAG_WAKE, eventfd(0, EFD_NONBLOCK) };
+    srv.snap = (listener_t){ TAG_WAKE, eventfd(0, EFD_NONBLOCK) };
+    running = &srv;
+
+    struct sigaction act = { 0 }, old_int, old_term, old_usr1, old_pipe;
+    act.sa_handler = on_stop_signal;
+    sigaction(SIGINT, &act, &old_int);
+    sigaction(SIGTERM, &act, &old_term);
+    act.sa_handler = on_snapshot_signal;
+    sigaction(SIGUSR1, &act, &old_usr1);
+    act.sa_handler = SIG_IGN; // a client that hangs up fails our writes
+    sigaction(SIGPIPE, &act, &old_pipe);
+
+    fprintf(stderr, "SERVER: listening on%s%s%s%s, %d loop%s%s%s\n",
+            opts->tcp ? " tcp " : "", opts->tcp ? opts->tcp : "",
+            opts->unix_path ? " unix " : "",
+            opts->unix_path ? opts->unix_path : "", loops,
+            (loops > 1) ? "s" : "", opts->origin ? ", HTTP proxy for " : "",
+            opts->origin ? opts->origin : "");
+
+    pthread_t *threads = malloc(loops * sizeof(pthread_t));
+    for (i = 0; i < loops; i++)
+        pthread_create(&threads[i], NULL, loop_main, &loop[i]);
+    for (i = 0; i < loops; i++)
+        pthread_join(threads[i], NULL);
+
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    sigaction(SIGUSR1, &old_usr1, NULL);
+    sigaction(SIGPIPE, &old_pipe, NULL);
+    running = NULL;
+
+    if (opts->snapshot != NULL)
+        take_snapshot(srv.cache, opts->snapshot);
+
+    if (opts->stats) {
+        printf("SERVER: %lu connections, %lu requests, %lu bytes of data "
+               "sent\n", (uint64_t)srv.accepted, (uint64_t)srv.requests,
+               (uint64_t)srv.bytes_out);
+        if (opts->origin != NULL)
+            printf("SERVER: %lu origin fetches, %lu 304s sent\n",
+                   (uint64_t)srv.fetches, (uint64_t)srv.not_modified);
+        if (srv.shm != NULL)
+            print_stats_shm(srv.shm);
+        else
+            print_stats_cache(srv.cache);
+    }
+
+    for (i = 0; i < loops; i++)
+        if (loop[i].tcp.fd != -1)
+            close(loop[i].tcp.fd);
+    if (srv.unix_l.fd != -1) {
+        close(srv.unix_l.fd);
+        unlink(opts->unix_path);
+    }
+    close(srv.stop.fd);
+    close(srv.snap.fd);
+    free(threads);
+    free(loop);
+    free_cache(srv.cache);
+    close_shm(srv.shm);
+
+    return 0;
+}
+
+
+/* stop_cache_server()
+ * @brief   asks a running server's loops to close their connections and
+ *          return; run_cache_server() then cleans up and returns
+ * @note    safe to call from a signal handler, or another thread
+ */
+void stop_cache_server(void)
+{
+    server_t *srv = running;
+    uint64_t one = 1;
+
+    if (srv != NULL && write(srv->stop.fd, &one, sizeof(one)) == -1)
+        return; // the counter is already non-zero: it's stopping anyway
+}
+
+
+/*** STATIC HELPER FUNCTIONS ***/
+
+
+/* loop_main()
+ * @brief   event loop thread: waits on its sockets (edge-triggered, for
+ *          connections) and services whatever is ready, until stopped
+ * @param   arg: the loop's server_loop_t
+ */
+static void *loop_main(void *arg)
+{
+    server_loop_t *loop = (server_loop_t *)arg;
+    server_t *srv = loop->srv;
+    struct epoll_event ev, events[SERVER_EVENTS];
+    int i;
+
+    loop->epfd = epoll_create1(0);
+    loop->origin = create_origin(srv->opts->origin);
+    loop->l0 = create_l0(srv->opts->l0_slots);
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = &srv->stop;
+    epoll_ctl(loop->epfd, EPOLL_CTL_ADD, srv->stop.fd, &ev);
+
+    if (loop->id == 0) { // one loop takes the snapshots
+        ev.data.ptr = &srv->snap;
+        epoll_ctl(loop->epfd, EPOLL_CTL_ADD, srv->snap.fd, &ev);
+    }
+    if (loop->tcp.fd != -1) {
+        ev.data.ptr = &loop->tcp;
+        epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->tcp.fd, &ev);
+    }
+    if (srv->unix_l.fd != -1) {
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE; // wake one loop per accept
+        ev.data.ptr = &srv->unix_l;
+        epoll_ctl(loop->epfd, EPOLL_CTL_ADD, srv->unix_l.fd, &ev);
+    }
+
+    int stopping = 0;
+    while (!stopping) {
+        int n = epoll_wait(loop->epfd, events, SERVER_EVENTS, -1);
+        if (n == -1 && errno != EINTR)
+            break;
+
+        for (i = 0; i < n; i++) {
+            int tag = *(int *)events[i].data.ptr;
+
+            if (tag == TAG_WAKE) {
+                listener_t *wake = (listener_t *)events[i].data.ptr;
+                uint64_t count;
+                if (wake == &srv->stop) {
+                    stopping = 1;
+                }
+                else if (read(wake->fd, &count, sizeof(count)) > 0
+                         && srv->opts->snapshot != NULL) {
+                    take_snapshot(srv->cache, srv->opts->snapshot);
+                }
+            }
+            else if (tag == TAG_LISTEN) {
+                accept_all(loop, ((listener_t *)events[i].data.ptr)->fd);
+            }
+            else {
+                conn_t *conn = (conn_t *)events[i].data.ptr;
+                uint32_t got = events[i].events;
+                if (got & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                    conn->can_read = 1;
+                if (got & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+                    conn->can_write = 1;
+                service_conn(loop, conn);
+            }
+        }
+    }
+
+    while (loop->conns != NULL)
+        close_conn(loop, loop->conns);
+    close(loop->epfd);
+    free_origin(loop->origin);
+
+    // the L0's hits were never counted by the cache
+    if (loop->l0 != NULL) {
+        l0_stats_t l0_stats = take_stats_l0(loop->l0);
+        lock_cache(srv->cache);
+        cache_stats_t *stats = stats_of_cache(srv->cache);
+        stats->gets += l0_stats.hits;
+        stats->hits += l0_stats.hits;
+        stats->l0_hits += l0_stats.hits;
+        stats->l0_fills += l0_stats.fills;
+        stats->l0_stale += l0_stats.stale;
+        unlock_cache(srv->cache);
+        free_l0(loop->l0);
+    }
+
+    return NULL;
+}
+
+
+/* accept_all()
+ * @brief   accepts connections until there are none left waiting, and
+ *          adds each to the loop, edge-triggered for reads and writes
+ * @param   loop: the accepting loop
+ * @param   fd: a listening socket
+ */
+static void accept_all(server_loop_t *loop, int fd)
+{
+    while (1) {
+        int cfd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (cfd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            return; // EAGAIN: none left (or out of fds: try again later)
+        }
+
+        int one = 1; // answers go out as soon as they're written
+        setsockopt(cfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        conn_t *conn = calloc(1, sizeof(conn_t));
+        conn->tag = TAG_CONN;
+        conn->fd = cfd;
+        conn->in_cap = CONN_IN_MIN;
+        conn->in = malloc(conn->in_cap);
+        conn->can_read = 1;
+        conn->can_write = 1;
+
+        conn->next = loop->conns;
+        if (loop->conns != NULL)
+            loop->conns->prev = conn;
+        loop->conns = conn;
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn;
+        epoll_ctl(loop->epfd, EPOLL_CTL_ADD, cfd, &ev);
+        atomic_fetch_add(&loop->srv->accepted, 1);
+
+        service_conn(loop, conn); // requests may have come with it
+    }
+}
+
+
+/* service_conn()
+ * @brief   makes all the progress a connection allows: writes queued
+ *          answers, runs complete requests, and reads more, until it's
+ *          blocked on the socket (or paused with CONN_OUT_MAX answers
+ *          queued, until they're written)
+ * @param   loop: the connection's loop
+ * @param   conn: the connection
+ * @note    edge-triggered: the loop is only told again once the socket
+ *          changes, so this must run until read() or writev() says EAGAIN
+ */
+static void service_conn(server_loop_t *loop, conn_t *conn)
+{
+    int progress = 1;
+
+    while (progress && !conn->dead) {
+        flush_conn(loop, conn);
+        progress = handle_requests(loop, conn);
+
+        if (conn->out_count < CONN_OUT_MAX && conn->can_read && !conn->eof
+                && !conn->dead)
+            progress |= (read_conn(conn) > 0);
+    }
+
+    // a closed peer still gets the answers to what it sent
+    if (conn->dead || (conn->eof && conn->out_head == NULL))
+        close_conn(loop, conn);
+}
+
+
+/* read_conn()
+ * @brief   reads one chunk from a connection into its buffer, growing the
+ *          buffer for a long line
+ * @param   conn: the connection
+ * @returns bytes read; 0 at EAGAIN (can_read is cleared) or EOF (eof set)
+ */
+static ssize_t read_conn(conn_t *conn)
+{
+    if (conn->in_cap - conn->in_len < CONN_IN_MIN / 4) {
+        if (conn->in_cap >= CONN_LINE_MAX) { // no newline in sight
+            conn->dead = 1;
+            return 0;
+        }
+        conn->in_cap *= 2;
+        conn->in = realloc(conn->in, conn->in_cap);
+    }
+
+    while (1) {
+        ssize_t n = read(conn->fd, conn->in + conn->in_len,
+                         conn->in_cap - conn->in_len);
+        if (n > 0) {
+            conn->in_len += n;
+            return n;
+        }
+        if (n == 0) {
+            conn->eof = 1;
+        }
+        else if (errno == EINTR) {
+            continue;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            conn->can_read = 0;
+        }
+        else {
+            conn->eof = 1;
+        }
+        return 0;
+    }
+}
+
+
+/* handle_requests()
+ * @brief   parses each complete line in a connection's buffer, and runs
+ *          them in batches of consecutive GETs or PUTs, as a sim run does,
+ *          so one lock acquisition covers many requests
+ * @param   loop: the connection's loop
+ * @param   conn: the connection
+ * @returns number of lines handled; stops early once CONN_OUT_MAX answers
+ *          are queued
+ */
+static int handle_requests(server_loop_t *loop, conn_t *conn)
+{
+    sim_cmd_t batch[SERVER_BATCH];
+    size_t pos = 0;
+    int handled = 0;
+    int n = 0;
+
+    if (loop->origin != NULL)
+        return handle_http(loop, conn);
+
+    while (conn->out_count + n < CONN_OUT_MAX) {
+        char *line = conn->in + pos;
+        char *end = memchr(line, '\n', conn->in_len - pos);
+        if (end == NULL)
+            break;
+
+        pos = end - conn->in + 1;
+        *end = '\0';
+        if (end > line && end[-1] == '\r')
+            end[-1] = '\0';
+        handled++;
+
+        sim_cmd_t cmd = { NULL, -1, 0 };
+        parse_command(line, strlen(line), &cmd);
+
+        // a GET after PUTs (or vice versa), or a bad line, ends the batch
+        if (n > 0 && (cmd.file_name == NULL || n == SERVER_BATCH
+                || (batch[0].max_age == -1) != (cmd.max_age == -1))) {
+            run_requests(loop, conn, batch, n);
+            n = 0;
+        }
+
+        if (cmd.file_name == NULL)
+            queue_answer(conn, "ERROR\n", NULL);
+        else
+            batch[n++] = cmd;
+    }
+    run_requests(loop, conn, batch, n);
+
+    // keep the unparsed rest, at the front of the buffer
+    memmove(conn->in, conn->in + pos, conn->in_len - pos);
+    conn->in_len -= pos;
+
+    atomic_fetch_add(&loop->srv->requests, handled);
+    return handled;
+}
+
+
+/* run_requests()
+ * @brief   runs a batch of GETs (with lookup_many_cmd) or of PUTs (with
+ *          put_many_cmd), and queues an answer for each, in order
+ * @param   loop: the connection's loop
+ * @param   conn: the connection
+ * @param   batch, n: the parsed requests; their file names are freed
+ */
+static void run_requests(server_loop_t *loop, conn_t *conn,
+                         sim_cmd_t *batch, int n)
+{
+    C_T cache = loop->srv->cache;
+    SHM_T shm = loop->srv->shm;
+    int i;
+
+    if (n == 0)
+        return;
+
+    if (batch[0].max_age != -1) { // PUTs
+        int results[SERVER_BATCH];
+        if (shm != NULL) {
+            for (i = 0; i < n; i++) {
+                results[i] = put_shm(shm, batch[i].file_name,
+                                     batch[i].max_age);
+                free(batch[i].file_name);
+            }
+        }
+        else
+            put_many_cmd(cache, batch, n, results);
+
+        for (i = 0; i < n; i++) {
+            if (results[i] == PUT_STORED || results[i] == PUT_UPDATED)
+                queue_answer(conn, "STORED\n", NULL);
+            else if (results[i] == PUT_REJECTED)
+                queue_answer(conn, "REJECTED\n", NULL);
+            else
+                queue_answer(conn, "UNREADABLE\n", NULL);
+        }
+        return;
+    }
+
+    char *names[SERVER_BATCH];
+    range_t ranges[SERVER_BATCH];
+    payload_t *handles[SERVER_BATCH];
+    for (i = 0; i < n; i++) {
+        names[i] = batch[i].file_name;
+        ranges[i] = batch[i].range;
+    }
+
+    if (shm != NULL)
+        for (i = 0; i < n; i++)
+            handles[i] = get_shm(shm, names[i], ranges[i]);
+    else if (loop->l0 != NULL)
+        lookup_l0_cmd(cache, loop->l0, names, ranges, n, handles);
+    else
+        lookup_many_cmd(cache, names, ranges, n, handles);
+
+    for (i = 0; i < n; i++) {
+        // writev() needs the data as it is, and in one piece: not as the
+        // cache may keep it (compressed, or in chunks)
+        handles[i] = unpack_file_cache(handles[i]);
+        if (handles[i] != NULL) {
+            char head[24];
+            sprintf(head, "OK %d\n", handles[i]->len);
+            queue_answer(conn, head, handles[i]); // released once sent
+            atomic_fetch_add(&loop->srv->bytes_out, handles[i]->len);
+        }
+        else {
+            queue_answer(conn, "MISS\n", NULL);
+        }
+        free(names[i]);
+    }
+}
+
+
+/* handle_http()
+ * @brief   HTTP's handle_requests(): parses each complete request head in a
+ *          connection's buffer, and answers it, in order
+ * @param   loop: the connection's loop
+ * @param   conn: the connection
+ * @returns number of requests handled; stops early once CONN_OUT_MAX
+ *          answers are queued, or the connection is to close
+ * @note    GET and HEAD are answered (see proxy_request); other methods get
+ *          a 405. a malformed or too-long head (400, 431), or a request with
+ *          a body (501: bodies aren't read, so the next request can't be
+ *          found), closes the connection once its answer is sent, as does
+ *          a request without keep-alive.
+ */
+static int handle_http(server_loop_t *loop, conn_t *conn)
+{
+    size_t pos = 0;
+    int handled = 0;
+
+    while (conn->out_count < CONN_OUT_MAX && !conn->eof) {
+        http_request_t req;
+        int len = parse_http_request(conn->in + pos, conn->in_len - pos,
+                                     &req);
+        if (len == 0 && conn->in_len - pos < HTTP_HEAD_MAX)
+            break;
+        handled++;
+
+        if (len <= 0) {
+            memset(&req, 0, sizeof(req)); // without keep-alive
+            queue_http(loop, conn, &req, (len == 0) ? 431 : 400, NULL, NULL,
+                       -1, -1, NULL);
+            pos = conn->in_len;
+        }
+        else if (req.has_body) {
+            pos = conn->in_len;
+            req.keep_alive = 0;
+            queue_http(loop, conn, &req, 501, NULL, NULL, -1, -1, NULL);
+        }
+        else {
+            pos += len;
+            if (strcmp(req.method, "GET") == 0
+                    || strcmp(req.method, "HEAD") == 0)
+                proxy_request(loop, conn, &req);
+            else
+                queue_http(loop, conn, &req, 405, NULL, NULL, -1, -1, NULL);
+        }
+
+        if (!req.keep_alive)
+            conn->eof = 1; // no more reading; close once answered
+    }
+
+    // keep the unparsed rest, at the front of the buffer
+    memmove(conn->in, conn->in + pos, conn->in_len - pos);
+    conn->in_len -= pos;
+
+    atomic_fetch_add(&loop->srv->requests, handled);
+    return handled;
+}
+
+
+/* proxy_request()
+ * @brief   answers a GET or HEAD as a caching proxy: a fresh cached copy is
+ *          sent straight from its pinned payload (X-Cache: HIT); an expired
+ *          one is revalidated with a conditional GET to the origin, and on
+ *          a 304 renewed and sent (REVALIDATED); anything else is fetched,
+ *          sent, and stored if its Cache-Control allows (MISS)
+ * @param   loop: the connection's loop, with its origin client
+ * @param   conn: the connection
+ * @param   req: the request; if its own validators match the copy being
+ *          sent, it's answered with a 304 and no body
+ * @note    the cache is keyed by request target, and locked only around
+ *          its lookups and updates; the origin fetch blocks this loop (and
+ *          only this loop) until the response is in
+ * @note    responses are counted as the sim counts GETs: a miss is any
+ *          request that needed the origin, revalidations included
+ * @note    freshness and Age are on the cache's clock, which in proxy mode
+ *          is the monotonic one (see run_cache_server)
+ */
+static void proxy_request(server_loop_t *loop, conn_t *conn,
+                          http_request_t *req)
+{
+    server_t *srv = loop->srv;
+    C_T cache = srv->cache;
+    cache_stats_t *stats = stats_of_cache(cache);
+    char *target = req->target;
+    http_meta_t meta = { "", 0, "" };
+    payload_t *body = NULL;
+    int status = 200;
+    int max_age = 0;
+    int age = -1; // no Age: header unless served from the cache
+    const char *via = "HIT";
+
+    lock_cache(cache);
+    stats->gets++;
+    record_access_cache(cache, target);
+
+    cache_file_t file = retrieve_file_struct(cache, target);
+    int cached = (file.http != NULL && file.payload != NULL);
+    if (cached) {
+        clock_t now = now_cache(cache);
+        meta = *file.http;
+        max_age = file.max_age;
+
+        if (!gcache_expired(file.expiration, now) && !req->no_cache) {
+            body = acquire_file_cache(cache, target);
+            touch_item_cache(cache, target);
+            age = (now - (file.expiration - (clock_t)max_age
+                          * CLOCKS_PER_SEC)) / CLOCKS_PER_SEC;
+        }
+    }
+    if (body != NULL)
+        stats->hits++;
+    else
+        stats->misses++;
+    unlock_cache(cache);
+
+    while (body == NULL) {
+        http_response_t resp;
+        atomic_fetch_add(&srv->fetches, 1);
+
+        if (fetch_origin(loop->origin, target, cached ? &meta : NULL,
+                         &resp) == -1) {
+            queue_http(loop, conn, req, 502, NULL, NULL, -1, -1, NULL);
+            return;
+        }
+
+        if (resp.status == 304 && cached) { // still current: renew it
+            lock_cache(cache);
+            renew_http_cache(cache, target,
+                             (resp.max_age >= 0) ? resp.max_age : max_age,
+                             &resp.meta);
+            body = acquire_file_cache(cache, target);
+            file = retrieve_file_struct(cache, target);
+            if (body != NULL)
+                meta = *file.http;
+            unlock_cache(cache);
+
+            cached = 0; // if it was evicted meanwhile, fetch it whole
+            max_age = file.max_age;
+            age = 0;
+            via = "REVALIDATED";
+            continue;
+        }
+
+        // a new (or changed) response: sent from its own payload, which
+        // the cache shares if it keeps it
+        body = create_payload((resp.body != NULL) ? resp.body : malloc(1),
+                              resp.len);
+        status = resp.status;
+        meta = resp.meta;
+        max_age = resp.max_age;
+        age = -1;
+        via = "MISS";
+
+        if (status == 200 && max_age >= 0) {
+            lock_cache(cache);
+            store_http_cache(cache, target, body, max_age, &meta);
+            if (cached) {
+                stats->reloaded++;
+                stats->reloaded_bytes += body->len;
+            }
+            unlock_cache(cache);
+        }
+    }
+
+    if (status == 200 && http_not_modified(req, &meta)) {
+        status = 304;
+        atomic_fetch_add(&srv->not_modified, 1);
+    }
+
+    queue_http(loop, conn, req, status, &meta, body, max_age, age, via);
+}
+
+
+/* queue_http()
+ * @brief   queues an HTTP response: its head is built here, and its body
+ *          is sent from body's payload, which is never copied
+ * @param   loop: the connection's loop (for its cached Date)
+ * @param   conn: the connection
+ * @param   req: the request being answered: a HEAD gets no body, and
+ *          Connection: close is sent if it didn't ask for keep-alive
+ * @param   status: the status code; a 304 gets no body
+ * @param   meta: the body's type and validators; NULL if there's none
+ * @param   body: pinned body; the queue takes over the pin (or releases it,
+ *          if no body is sent). NULL for an empty body
+ * @param   max_age: the Cache-Control max-age to send; -1 for no-store
+ * @param   age: the Age to send (sec); -1 for none
+ * @param   via: the X-Cache value (HIT, MISS, REVALIDATED); NULL for none
+ */
+static void queue_http(server_loop_t *loop, conn_t *conn,
+                       http_request_t *req, int status, http_meta_t *meta,
+                       payload_t *body, int max_age, int age,
+                       const char *via)
+{
+    char head[HTTP_ANSWER_HEAD];
+    int len;
+
+    time_t now = time(NULL);
+    if (now != loop->date_at) {
+        format_http_date(now, loop->date);
+        loop->date_at = now;
+    }
+
+    len = sprintf(head, "HTTP/1.1 %d %s\r\nDate: %s\r\n", status,
+                  http_reason(status), loop->date);
+
+    if (status != 304)
+        len += sprintf(head + len, "Content-Length: %d\r\n",
+                       (body != NULL) ? body->len : 0);
+    if (meta != NULL && meta->type[0] != '\0' && status != 304)
+        len += sprintf(head + len, "Content-Type: %s\r\n", meta->type);
+    if (meta != NULL && meta->etag[0] != '\0')
+        len += sprintf(head + len, "ETag: %s\r\n", meta->etag);
+    if (meta != NULL && meta->last_modified != 0) {
+        char date[HTTP_DATE_LEN];
+        format_http_date(meta->last_modified, date);
+        len += sprintf(head + len, "Last-Modified: %s\r\n", date);
+    }
+
+    if (max_age >= 0)
+        len += sprintf(head + len, "Cache-Control: max-age=%d\r\n", max_age);
+    else
+        len += sprintf(head + len, "Cache-Control: no-store\r\n");
+    if (age >= 0)
+        len += sprintf(head + len, "Age: %d\r\n", age);
+    if (via != NULL)
+        len += sprintf(head + len, "X-Cache: %s\r\n", via);
+    if (status == 405)
+        len += sprintf(head + len, "Allow: GET, HEAD\r\n");
+    if (!req->keep_alive)
+        len += sprintf(head + len, "Connection: close\r\n");
+    sprintf(head + len, "\r\n");
+
+    int head_only = (req->method != NULL && strcmp(req->method, "HEAD") == 0);
+    if (body != NULL && (status == 304 || head_only)) {
+        release_file_cache(body);
+        body = NULL;
+    }
+    if (body != NULL)
+        atomic_fetch_add(&loop->srv->bytes_out, body->len);
+
+    queue_answer(conn, head, body); // released once sent
+}
+
+
+/* queue_answer()
+ * @brief   adds an answer to the end of a connection's queue
+ * @param   conn: the connection
+ * @param   head: the answer's text; copied
+ * @param   handle: pinned data to send after head; the queue takes over the
+ *          pin. NULL if there's none
+ */
+static void queue_answer(conn_t *conn, char *head, payload_t *handle)
+{
+    size_t head_len = strlen(head);
+    answer_t *answer = malloc(sizeof(answer_t) + head_len);
+    answer->head_len = head_len;
+    memcpy(answer->head, head, answer->head_len);
+    answer->handle = handle;
+    answer->sent = 0;
+    answer->next = NULL;
+
+    if (conn->out_tail == NULL)
+        conn->out_head = answer;
+    else
+        conn->out_tail->next = answer;
+    conn->out_tail = answer;
+    conn->out_count++;
+}
+
+
+/* flush_conn()
+ * @brief   writes a connection's queued answers, SERVER_IOV at a time with
+ *          writev(); data goes straight from the cache's pinned payloads
+ * @param   loop: the connection's loop
+ * @param   conn: the connection
+ * @note    stops when the queue is empty, or the socket is full (clearing
+ *          can_write); a failed write marks the connection dead
+ */
+static void flush_conn(server_loop_t *loop, conn_t *conn)
+{
+    (void)loop;
+
+    while (conn->out_head != NULL && conn->can_write && !conn->dead) {
+        struct iovec iov[2 * SERVER_IOV];
+        int cnt = 0;
+        answer_t *a;
+
+        for (a = conn->out_head; a != NULL && cnt < 2 * SERVER_IOV;
+                a = a->next) {
+            size_t sent = a->sent;
+            if (sent < (size_t)a->head_len) {
+                iov[cnt].iov_base = a->head + sent;
+                iov[cnt++].iov_len = a->head_len - sent;
+                sent = 0;
+            }
+            else {
+                sent -= a->head_len;
+            }
+
+            if (a->handle != NULL && sent < (size_t)a->handle->len) {
+                iov[cnt].iov_base = a->handle->data + sent;
+                iov[cnt++].iov_len = a->handle->len - sent;
+            }
+        }
+
+        ssize_t n = writev(conn->fd, iov, cnt);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                conn->can_write = 0;
+            else
+                conn->dead = 1;
+            return;
+        }
+
+        // retire every answer that's now fully written
+        while (conn->out_head != NULL) {
+            a = conn->out_head;
+            size_t total = a->head_len + (a->handle ? a->handle->len : 0);
+            size_t take = total - a->sent;
+            if ((size_t)n < take) {
+                a->sent += n;
+                break;
+            }
+
+            n -= take;
+            conn->out_head = a->next;
+            if (conn->out_head == NULL)
+                conn->out_tail = NULL;
+            conn->out_count--;
+            release_file_cache(a->handle);
+            free(a);
+        }
+    }
+}
+
+
+/* close_conn()
+ * @brief   closes a connection and frees it, releasing the data pinned by
+ *          any answers it didn't get to send
+ * @param   loop: the connection's loop
+ * @param   conn: the connection
+ */
+static void close_conn(server_loop_t *loop, conn_t *conn)
+{
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+
+    while (conn->out_head != NULL) {
+        answer_t *a = conn->out_head;
+        conn->out_head = a->next;
+        release_file_cache(a->handle);
+        free(a);
+    }
+
+    if (conn->prev != NULL)
+        conn->prev->next = conn->next;
+    else
+        loop->conns = conn->next;
+    if (conn->next != NULL)
+        conn->next->prev = conn->prev;
+
+    free(conn->in);
+    free(conn);
+}
+
+
+/* open_tcp()
+ * @brief   opens a TCP socket listening on spec
+ * @param   spec: "port" (every address) or "host:port"
+ * @param   reuseport: 1 to set SO_REUSEPORT, so that several sockets (one
+ *          per loop) can share the port
+ * @returns the non-blocking socket, or -1
+ */
+static int open_tcp(char *spec, int reuseport)
+{
+    char *host = NULL;
+    char *port = spec;
+    char *colon = strrchr(spec, ':');
+
+    if (colon != NULL) {
+        host = strndup(spec, colon - spec);
+        port = colon + 1;
+    }
+
+    struct addrinfo hints = { 0 }, *addrs = NULL;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    int fd = -1;
+    if (getaddrinfo(host, port, &hints, &addrs) == 0) {
+        struct addrinfo *ai;
+        for (ai = addrs; ai != NULL && fd == -1; ai = ai->ai_next) {
+            fd = socket(ai->ai_family,
+                        ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (fd == -1)
+                continue;
+
+            int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (reuseport)
+                setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+            if (bind(fd, ai->ai_addr, ai->ai_addrlen) == -1
+                    || listen(fd, SOMAXCONN) == -1) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(addrs);
+    }
+
+    free(host);
+    return fd;
+}
+
+
+/* open_unix()
+ * @brief   opens a Unix socket listening on path, replacing any stale
+ *          socket file left there
+ * @param   path: the socket's path
+ * @returns the non-blocking socket, or -1
+ */
+static int open_unix(char *path)
+{
+    struct sockaddr_un addr = { 0 };
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        return -1;
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+            || listen(fd, SOMAXCONN) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+/* on_stop_signal()
+ * @brief   SIGINT / SIGTERM handler: stops the server
+ */
+static void on_stop_signal(int sig)
+{
+    (void)sig;
+    stop_cache_server();
+}
+
+
+/* on_snapshot_signal()
+ * @brief   SIGUSR1 handler: has the first loop write a snapshot
+ */
+static void on_snapshot_signal(int sig)
+{
+    (void)sig;
+    server_t *srv = running;
+    uint64_t one = 1;
+
+    if (srv != NULL && write(srv->snap.fd, &one, sizeof(one)) == -1)
+        return; // already pending
+}
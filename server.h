@@ -0,0 +1,52 @@
+/*
+ * SERVER.H
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * Cache server: one cache, shared over TCP and Unix sockets. A request is
+ * one line, just as in a command file:
+ *
+ *      PUT: <name>\MAX-AGE: <sec>[\STALE: <sec>]
+ *      GET: <name>[\RANGE: <off>-[<len>]]
+ *
+ * and each is answered, in order, with one of
+ *
+ *      OK <len>\n, then len bytes of data  (a GET that hit; for a range,
+ *                                          just the range's bytes)
+ *      MISS\n                              (a GET that missed)
+ *      STORED\n or REJECTED\n              (a PUT)
+ *      UNREADABLE\n                       (a PUT of a file with a negative
+ *                                          entry; see -n)
+ *      ERROR\n                             (not a command)
+ *
+ * Clients may pipeline: send any number of requests without waiting for
+ * their answers. Names are read relative to the server's directory.
+ *
+ * With a shared-memory cache (-G; see shm.h), the line protocol's GETs and
+ * PUTs go to it instead of a private cache, so every server on the host
+ * attached to it shares one copy of each file.
+ *
+ * With an origin (-O), the server is an HTTP/1.1 caching reverse proxy
+ * instead: GET and HEAD requests, on keep-alive connections that may also
+ * pipeline, are answered from the cache when it has a fresh copy, and
+ * otherwise forwarded to the origin. Responses are kept for as long as
+ * their Cache-Control (or Expires) allows, keyed by request target, and
+ * revalidated with If-None-Match / If-Modified-Since once they expire.
+ * Conditional requests from clients are answered with 304s.
+ *
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "sim_cache.h"
+
+// serves a cache of cache_size files until stopped (SIGINT / SIGTERM)
+int run_cache_server(int cache_size, sim_opts_t *opts);
+
+// stops a running server, as SIGINT would
+void stop_cache_server(void);
+
+#endif
@@ -0,0 +1,882 @@
+/*
+ * SHM.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ */
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm.h"
+#include "hash.h"
+#include "gcache.h"
+#include "file_sys.h"
+
+#define SHM_MAGIC 0x41307368 // "A0sh"
+#define SHM_VERSION 1
+#define SHM_ALIGN 64 // each region of the segment starts on a cache line
+#define SHM_WAIT_MS 1000 // how long to wait for a segment's creator
+
+// entry states
+#define ENTRY_FREE 0
+#define ENTRY_PUTTING 1 // taken by a PUT that hasn't finished copying in
+#define ENTRY_LIVE 2 // complete, and in the index; never changes but for
+                     // last_retrieved, until it's dropped
+
+// one cached file; every link is an index plus one, 0 for none
+typedef struct shm_entry_t {
+    char name[SHM_NAME_LEN];
+    uint64_t hash; // hash_str() of name
+    uint64_t seq; // when it was put, in PUTs: orders the entries oldest first
+    int len; // length of the file's data, in bytes
+    int max_age; // MAX-AGE it was put with (sec)
+    clock_t created; // stamps, on the monotonic clock (gcache_clock_mono)
+    clock_t expiration;
+    clock_t last_retrieved; // 0 if never retrieved
+    uint32_t first; // first block of its data; 0 if len is 0
+    uint32_t chain; // next entry in its bucket, or on the free list
+    uint32_t older; // neighbours, oldest first
+    uint32_t newer;
+    uint32_t state; // ENTRY_FREE, ENTRY_PUTTING or ENTRY_LIVE
+} shm_entry_t;
+
+// the start of the segment; the regions after it are found by offset
+typedef struct shm_head_t {
+    atomic_uint magic; // SHM_MAGIC, once the creator has set the rest up
+    uint32_t version;
+    uint64_t size; // bytes in the segment
+    pthread_mutex_t lock; // process-shared and robust
+
+    uint32_t cap; // entries
+    uint32_t n_buckets; // a power of two
+    uint32_t n_blocks;
+    uint64_t entries_at; // offsets of the regions, from the segment's start
+    uint64_t buckets_at;
+    uint64_t links_at;
+    uint64_t blocks_at;
+
+    uint32_t oldest; // the live entries, oldest first
+    uint32_t newest;
+    uint32_t free_entries; // stack of free entries, through chain
+    uint32_t free_blocks; // stack of free blocks, through links
+    uint32_t n_live;
+    uint32_t n_free_blocks;
+    uint64_t next_seq;
+
+    shm_stats_t stats;
+} shm_head_t;
+
+// one process's view of a segment
+struct shm_t {
+    shm_head_t *head; // where this process mapped it
+    size_t size;
+    shm_entry_t *entries;
+    uint32_t *buckets; // first entry in each bucket
+    uint32_t *links; // links[b]: the block after block b in its file's chain
+    unsigned char *blocks;
+};
+
+#define ENTRY(shm, ref) (&(shm)->entries[(ref) - 1])
+#define BLOCK(shm, ref) ((shm)->blocks + (size_t)((ref) - 1) * SHM_BLOCK_LEN)
+
+
+/*** STATIC HELPER FUNC DECLARATIONS ***/
+
+// returns n rounded up to a multiple of SHM_ALIGN
+static uint64_t align_up(uint64_t n);
+
+// fills in the geometry of a segment of cap entries and n_blocks blocks;
+// returns its size in bytes
+static uint64_t lay_out(shm_head_t *head, uint32_t cap, uint32_t n_blocks);
+
+// points a process's view at the regions of the segment it mapped
+static void find_regions(SHM_T shm);
+
+// sizes, maps and sets up a segment we just created; NULL on error
+static shm_head_t *create_segment(int fd, int cap, int mb, size_t *size);
+
+// waits for a segment's creator to finish, then maps it; NULL on error, with
+// *abandoned set if its creator never finished
+static shm_head_t *attach_segment(int fd, size_t *size, int *abandoned);
+
+// unlinks name if it's still the segment open as fd; returns 1 if it was
+static int unlink_abandoned(char *name, int fd);
+
+// returns the live entry called file_name, or 0
+static uint32_t find_entry(SHM_T shm, char *file_name, uint64_t hash);
+
+// unlinks a live entry, and frees it and its blocks
+static void drop_entry(SHM_T shm, uint32_t ref);
+
+// evicts the entry evict_one() would; returns 0 if there were none
+static int evict_entry(SHM_T shm);
+
+// copies data into the segment as file_name, replacing any entry of that
+// name; returns a PUT_ value
+static int store_entry(SHM_T shm, char *file_name, unsigned char *data,
+                       int len, int max_age);
+
+// returns a malloc'd copy of len bytes of an entry's data, from off
+static unsigned char *copy_out(SHM_T shm, shm_entry_t *entry, int off,
+                               int len);
+
+// rebuilds everything but the live entries, after a holder of the lock died
+static void recover_segment(SHM_T shm);
+
+
+/* open_shm()
+ * @brief   attaches to the shared-memory segment called name, creating it
+ *          if there isn't one yet
+ * @param   name: segment name, as for shm_open() ("/a0", say)
+ * @param   cap: files the segment can hold, if it's created
+ * @param   mb: MB of file data it can hold, if it's created
+ * @returns a struct shm_t pointer, or NULL on error
+ * @note    an existing segment keeps the size its creator gave it
+ * @note    an attacher waits (up to SHM_WAIT_MS) for a creator that is
+ *          still setting the segment up. if it never finishes (it died
+ *          first), the segment is unlinked and created afresh, once
+ */
+SHM_T open_shm(char *name, int cap, int mb)
+{
+    if (name == NULL || cap < 1 || mb < 1)
+        return NULL;
+
+    shm_head_t *head = NULL;
+    size_t size = 0;
+    int retried = 0;
+
+    while (head == NULL) {
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd != -1) {
+            head = create_segment(fd, cap, mb, &size);
+            close(fd);
+            if (head == NULL) {
+                shm_unlink(name);
+                return NULL;
+            }
+        }
+        else if (errno == EEXIST) {
+            fd = shm_open(name, O_RDWR, 0600);
+            if (fd == -1)
+                return NULL;
+
+            int abandoned = 0;
+            head = attach_segment(fd, &size, &abandoned);
+            if (head == NULL && abandoned && !retried) {
+                // its creator died first: start over, unless another
+                // process already has
+                if (unlink_abandoned(name, fd))
+                    fprintf(stderr, "shm: %s was never set up; recreating "
+                            "it\n", name);
+                retried = 1;
+            }
+            else if (head == NULL) {
+                close(fd);
+                fprintf(stderr, "shm: %s isn't a cache segment\n", name);
+                return NULL;
+            }
+            close(fd);
+        }
+        else {
+            return NULL;
+        }
+    }
+
+    SHM_T shm = calloc(1, sizeof(struct shm_t));
+    shm->head = head;
+    shm->size = size;
+    find_regions(shm);
+
+    if (atomic_load(&head->magic) != SHM_MAGIC) { // we created it
+        recover_segment(shm); // with no live entries: everything is free
+        atomic_store(&head->magic, SHM_MAGIC);
+    }
+
+    lock_shm(shm);
+    head->stats.attaches++;
+    unlock_shm(shm);
+    return shm;
+}
+
+
+/* close_shm()
+ * @brief   unmaps a segment and frees the process's view of it
+ * @param   shm: a struct shm_t pointer
+ * @note    the segment, and what's cached in it, stays for other processes
+ *          (and later ones) until unlink_shm()
+ */
+void close_shm(SHM_T shm)
+{
+    if (shm == NULL)
+        return;
+
+    munmap(shm->head, shm->size);
+    free(shm);
+}
+
+
+/* unlink_shm()
+ * @brief   removes a segment's name; it's freed once the last process
+ *          attached to it closes it
+ * @param   name: segment name, as given to open_shm()
+ * @returns 0, or -1 if there was no such segment
+ */
+int unlink_shm(char *name)
+{
+    return shm_unlink(name);
+}
+
+
+/* put_shm()
+ * @brief   reads a file and puts its data in the segment, evicting as it
+ *          must to make room
+ * @param   shm: a struct shm_t pointer
+ * @param   file_name: name of file
+ * @param   max_age: its MAX-AGE (sec)
+ * @returns PUT_STORED; PUT_UPDATED if it was already there (its data is
+ *          re-read, and its stamps renewed); PUT_REJECTED if it can't be
+ *          kept (bigger than the whole segment, or the name is too long);
+ *          PUT_NEGATIVE if it can't be read
+ * @note    the file is read before the lock is taken
+ */
+int put_shm(SHM_T shm, char *file_name, int max_age)
+{
+    unsigned char *data = NULL;
+    int len = read_file_with_meta(file_name, &data, NULL);
+
+    lock_shm(shm);
+    shm->head->stats.puts++;
+    int result = PUT_NEGATIVE;
+    if (len >= 0)
+        result = store_entry(shm, file_name, data, len, max_age);
+    if (result == PUT_REJECTED)
+        shm->head->stats.rejected++;
+    unlock_shm(shm);
+
+    free(data);
+    return result;
+}
+
+
+/* get_shm()
+ * @brief   looks a file up in the segment, and copies out the bytes asked
+ *          for
+ * @param   shm: a struct shm_t pointer
+ * @param   file_name: name of file
+ * @param   range: bytes to get, as for acquire_range_cache()
+ * @returns a new handle on a private copy of the bytes, to be dropped with
+ *          release_file_cache(); NULL if the file isn't in the segment
+ * @note    an expired file is re-read from its source first (outside the
+ *          lock), and dropped if it can't be
+ */
+payload_t *get_shm(SHM_T shm, char *file_name, range_t range)
+{
+    uint64_t hash = hash_str(file_name);
+    clock_t now = gcache_clock_mono();
+
+    lock_shm(shm);
+    shm->head->stats.gets++;
+    uint32_t ref = find_entry(shm, file_name, hash);
+
+    if (ref != 0 && gcache_expired(ENTRY(shm, ref)->expiration, now)) {
+        int max_age = ENTRY(shm, ref)->max_age;
+        unlock_shm(shm);
+
+        unsigned char *data = NULL;
+        int len = read_file_with_meta(file_name, &data, NULL);
+
+        lock_shm(shm);
+        ref = find_entry(shm, file_name, hash);
+        if (ref != 0 && gcache_expired(ENTRY(shm, ref)->expiration, now)) {
+            if (len < 0 || store_entry(shm, file_name, data, len, max_age)
+                    == PUT_REJECTED)
+                drop_entry(shm, ref);
+            shm->head->stats.reloads++;
+            ref = find_entry(shm, file_name, hash);
+        }
+        free(data);
+    }
+
+    if (ref == 0) {
+        shm->head->stats.misses++;
+        unlock_shm(shm);
+        return NULL;
+    }
+
+    shm_entry_t *entry = ENTRY(shm, ref);
+    entry->last_retrieved = now;
+
+    int off = (range.off < entry->len) ? range.off : entry->len;
+    int len = entry->len - off;
+    if (range.len >= 0 && range.len < len)
+        len = range.len;
+
+    unsigned char *copy = copy_out(shm, entry, off, len);
+    shm->head->stats.hits++;
+    unlock_shm(shm);
+
+    return create_payload(copy, len);
+}
+
+
+/* lock_shm()
+ * @brief   takes the segment's lock
+ * @param   shm: a struct shm_t pointer
+ * @note    if the last holder died with it, the segment may be half-way
+ *          through a change: it's repaired (see recover_segment) before
+ *          this returns
+ */
+void lock_shm(SHM_T shm)
+{
+    if (pthread_mutex_lock(&shm->head->lock) == EOWNERDEAD) {
+        recover_segment(shm);
+        shm->head->stats.recoveries++;
+        pthread_mutex_consistent(&shm->head->lock);
+    }
+}
+
+
+/* unlock_shm()
+ * @brief   releases the segment's lock
+ * @param   shm: a struct shm_t pointer
+ */
+void unlock_shm(SHM_T shm)
+{
+    pthread_mutex_unlock(&shm->head->lock);
+}
+
+
+/* size_of_shm()
+ * @brief   returns the number of files in the segment
+ * @param   shm: a struct shm_t pointer
+ */
+int size_of_shm(SHM_T shm)
+{
+    lock_shm(shm);
+    int n = shm->head->n_live;
+    unlock_shm(shm);
+    return n;
+}
+
+
+/* stats_of_shm()
+ * @brief   returns a copy of the segment's counters, which count every
+ *          attached process's GETs and PUTs
+ * @param   shm: a struct shm_t pointer
+ */
+shm_stats_t stats_of_shm(SHM_T shm)
+{
+    lock_shm(shm);
+    shm_stats_t stats = shm->head->stats;
+    unlock_shm(shm);
+    return stats;
+}
+
+
+/* print_stats_shm()
+ * @brief   prints the segment's counters, and how full it is
+ * @param   shm: a struct shm_t pointer
+ */
+void print_stats_shm(SHM_T shm)
+{
+    if (shm == NULL)
+        return;
+
+    lock_shm(shm);
+    shm_stats_t st = shm->head->stats;
+    uint32_t n_live = shm->head->n_live;
+    uint32_t used = shm->head->n_blocks - shm->head->n_free_blocks;
+    uint32_t n_blocks = shm->head->n_blocks;
+    unlock_shm(shm);
+
+    double ratio = 0;
+    if (st.gets > 0)
+        ratio = 100.0 * (double)st.hits / (double)st.gets;
+
+    printf("SHM: %lu GETs, %lu hits, %lu misses (hit ratio %0.2lf%%)\n",
+           st.gets, st.hits, st.misses, ratio);
+    printf("SHM: %lu PUTs, %lu evictions, %lu rejected, %lu reloaded\n",
+           st.puts, st.evictions, st.rejected, st.reloads);
+    printf("SHM: %u files, %u of %u blocks used, %lu attaches, %lu "
+           "recoveries\n", n_live, used, n_blocks, st.attaches,
+           st.recoveries);
+}
+
+
+/*** STATIC HELPER FUNCTIONS ***/
+
+
+/* align_up()
+ * @brief   rounds n up to a multiple of SHM_ALIGN
+ */
+static uint64_t align_up(uint64_t n)
+{
+    return (n + SHM_ALIGN - 1) / SHM_ALIGN * SHM_ALIGN;
+}
+
+
+/* lay_out()
+ * @brief   fills in a segment's geometry: where each region starts, and
+ *          how big it all is
+ * @param   head: the header to fill in
+ * @param   cap: entries
+ * @param   n_blocks: data blocks
+ * @returns the segment's size, in bytes
+ * @note    called on a local header first, to size the segment, then on
+ *          the new mapping
+ */
+static uint64_t lay_out(shm_head_t *head, uint32_t cap, uint32_t n_blocks)
+{
+    uint32_t n_buckets = 1;
+    while (n_buckets < 2 * cap)
+        n_buckets <<= 1;
+
+    head->version = SHM_VERSION;
+    head->cap = cap;
+    head->n_buckets = n_buckets;
+    head->n_blocks = n_blocks;
+    head->entries_at = align_up(sizeof(shm_head_t));
+    head->buckets_at = align_up(head->entries_at
+                                + (uint64_t)cap * sizeof(shm_entry_t));
+    head->links_at = align_up(head->buckets_at
+                              + (uint64_t)n_buckets * sizeof(uint32_t));
+    head->blocks_at = align_up(head->links_at
+                               + (uint64_t)n_blocks * sizeof(uint32_t));
+    head->size = head->blocks_at + (uint64_t)n_blocks * SHM_BLOCK_LEN;
+    head->next_seq = 1;
+    return head->size;
+}
+
+
+/* find_regions()
+ * @brief   points a process's view at the regions after the header
+ */
+static void find_regions(SHM_T shm)
+{
+    char *base = (char *)shm->head;
+    shm->entries = (shm_entry_t *)(base + shm->head->entries_at);
+    shm->buckets = (uint32_t *)(base + shm->head->buckets_at);
+    shm->links = (uint32_t *)(base + shm->head->links_at);
+    shm->blocks = (unsigned char *)(base + shm->head->blocks_at);
+}
+
+
+/* create_segment()
+ * @brief   sizes a segment we just created, maps it and lays it out, with
+ *          its lock, for cap files and mb MB of data
+ * @param   fd: the new (empty) segment, open for reading and writing
+ * @param   size: filled in with the segment's size
+ * @returns the mapping; NULL on error
+ * @note    its magic is left 0 for open_shm() to set, once it's ready
+ */
+static shm_head_t *create_segment(int fd, int cap, int mb, size_t *size)
+{
+    shm_head_t plan = { 0 };
+    uint32_t n_blocks = (uint32_t)((uint64_t)mb * 1024 * 1024
+                                   / SHM_BLOCK_LEN);
+    *size = lay_out(&plan, cap, n_blocks);
+
+    if (ftruncate(fd, *size) == -1)
+        return NULL;
+    shm_head_t *head = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                            fd, 0);
+    if (head == MAP_FAILED)
+        return NULL;
+
+    lay_out(head, cap, n_blocks); // the rest of the mapping is zeroed
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&head->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return head;
+}
+
+
+/* attach_segment()
+ * @brief   maps an existing segment, once its creator has set it up
+ * @param   fd: the segment, open for reading and writing
+ * @param   size: filled in with the segment's size
+ * @param   abandoned: set to 1 if the segment still wasn't set up (too small
+ *          for a header, or with magic 0) after SHM_WAIT_MS
+ * @returns the mapping; NULL if it isn't ready within SHM_WAIT_MS, or isn't
+ *          a segment of this version
+ */
+static shm_head_t *attach_segment(int fd, size_t *size, int *abandoned)
+{
+    struct timespec ms = { 0, 1000000 };
+    uint32_t magic = 0;
+    int waited;
+
+    for (waited = 0; waited <= SHM_WAIT_MS; waited++) {
+        struct stat st;
+        if (fstat(fd, &st) == -1)
+            return NULL;
+
+        if ((size_t)st.st_size >= sizeof(shm_head_t)) {
+            shm_head_t *head = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED, fd, 0);
+            if (head == MAP_FAILED)
+                return NULL;
+
+            magic = atomic_load(&head->magic);
+            if (magic == SHM_MAGIC) {
+                if (head->version == SHM_VERSION
+                        && head->size == (uint64_t)st.st_size) {
+                    *size = st.st_size;
+                    return head;
+                }
+                munmap(head, st.st_size);
+                return NULL;
+            }
+            munmap(head, st.st_size);
+        }
+        nanosleep(&ms, NULL);
+    }
+
+    *abandoned = (magic == 0);
+    return NULL;
+}
+
+
+/* unlink_abandoned()
+ * @brief   unlinks the segment called name, if the name still refers to the
+ *          one open as fd; another process may have already replaced it
+ * @returns 1 if it was unlinked by us; otherwise 0
+ */
+static int unlink_abandoned(char *name, int fd)
+{
+    struct stat ours, now;
+    int now_fd = shm_open(name, O_RDWR, 0600);
+    if (now_fd == -1)
+        return 0;
+
+    int same = fstat(fd, &ours) == 0 && fstat(now_fd, &now) == 0
+               && ours.st_dev == now.st_dev && ours.st_ino == now.st_ino;
+    close(now_fd);
+    return same && shm_unlink(name) == 0;
+}
+
+
+/* find_entry()
+ * @brief   looks file_name up in the index
+ * @param   hash: hash_str(file_name)
+ * @returns the live entry's index plus one; 0 if there's none
+ */
+static uint32_t find_entry(SHM_T shm, char *file_name, uint64_t hash)
+{
+    uint32_t ref = shm->buckets[hash & (shm->head->n_buckets - 1)];
+
+    while (ref != 0) {
+        shm_entry_t *entry = ENTRY(shm, ref);
+        if (entry->hash == hash && strcmp(entry->name, file_name) == 0)
+            return ref;
+        ref = entry->chain;
+    }
+    return 0;
+}
+
+
+/* drop_entry()
+ * @brief   takes a live entry out of its bucket and the oldest-first
+ *          order, and puts it and its blocks back on the free lists
+ * @note    the entry is marked free first: if this process dies part-way,
+ *          recovery finishes the job
+ */
+static void drop_entry(SHM_T shm, uint32_t ref)
+{
+    shm_head_t *head = shm->head;
+    shm_entry_t *entry = ENTRY(shm, ref);
+    entry->state = ENTRY_FREE;
+
+    uint32_t *link = &shm->buckets[entry->hash & (head->n_buckets - 1)];
+    while (*link != ref)
+        link = &ENTRY(shm, *link)->chain;
+    *link = entry->chain;
+
+    if (entry->older != 0)
+        ENTRY(shm, entry->older)->newer = entry->newer;
+    else
+        head->oldest = entry->newer;
+    if (entry->newer != 0)
+        ENTRY(shm, entry->newer)->older = entry->older;
+    else
+        head->newest = entry->older;
+
+    uint32_t block = entry->first;
+    while (block != 0) {
+        uint32_t next = shm->links[block - 1];
+        shm->links[block - 1] = head->free_blocks;
+        head->free_blocks = block;
+        head->n_free_blocks++;
+        block = next;
+    }
+
+    entry->first = 0;
+    entry->chain = head->free_entries;
+    head->free_entries = ref;
+    head->n_live--;
+}
+
+
+/* evict_entry()
+ * @brief   drops the entry evict_one() would pick: the first expired one,
+ *          oldest first; otherwise the least-recently retrieved or oldest
+ *          never-retrieved one (see gcache_a0)
+ * @returns 1 if an entry was evicted; 0 if there were none
+ * @note    unlike evict_one(), the source file is left alone: other
+ *          processes may still PUT it
+ */
+static int evict_entry(SHM_T shm)
+{
+    shm_head_t *head = shm->head;
+    gcache_a0_t scan;
+    gcache_a0_start(&scan, gcache_clock_mono());
+
+    uint32_t ref;
+    for (ref = head->oldest; ref != 0; ref = ENTRY(shm, ref)->newer) {
+        shm_entry_t *entry = ENTRY(shm, ref);
+        if (gcache_a0_visit(&scan, entry, entry->created, entry->expiration,
+                            entry->last_retrieved))
+            break;
+    }
+
+    shm_entry_t *victim = gcache_a0_pick(&scan, (head->oldest != 0)
+                                         ? ENTRY(shm, head->oldest) : NULL);
+    if (victim == NULL)
+        return 0;
+
+    drop_entry(shm, (uint32_t)(victim - shm->entries) + 1);
+    head->stats.evictions++;
+    return 1;
+}
+
+
+/* store_entry()
+ * @brief   copies a file's data into free blocks, evicting until there are
+ *          enough, and makes it the newest entry
+ * @param   shm: a struct shm_t pointer, locked
+ * @param   file_name: name of file
+ * @param   data: len bytes of its data
+ * @param   max_age: its MAX-AGE (sec)
+ * @returns PUT_STORED; PUT_UPDATED if it replaced an entry of the same name;
+ *          PUT_REJECTED if it can't fit, or its name is too long
+ * @note    the entry is marked live only once its data is all in place, so
+ *          a PUT cut short by a crash is dropped by recovery
+ */
+static int store_entry(SHM_T shm, char *file_name, unsigned char *data,
+                       int len, int max_age)
+{
+    shm_head_t *head = shm->head;
+    uint32_t need = (len + SHM_BLOCK_LEN - 1) / SHM_BLOCK_LEN;
+
+    if (strlen(file_name) >= SHM_NAME_LEN || need > head->n_blocks)
+        return PUT_REJECTED;
+
+    uint64_t hash = hash_str(file_name);
+    int result = PUT_STORED;
+    uint32_t old = find_entry(shm, file_name, hash);
+    if (old != 0) {
+        drop_entry(shm, old);
+        result = PUT_UPDATED;
+    }
+
+    while ((head->free_entries == 0 || head->n_free_blocks < need)
+            && evict_entry(shm))
+        ;
+
+    uint32_t ref = head->free_entries;
+    shm_entry_t *entry = ENTRY(shm, ref);
+    head->free_entries = entry->chain;
+    entry->state = ENTRY_PUTTING;
+
+    clock_t now = gcache_clock_mono();
+    strcpy(entry->name, file_name);
+    entry->hash = hash;
+    entry->len = len;
+    entry->max_age = max_age;
+    entry->created = now;
+    entry->expiration = gcache_expires(now, max_age);
+    entry->last_retrieved = 0;
+
+    uint32_t *link = &entry->first;
+    uint32_t i;
+    for (i = 0; i < need; i++) {
+        uint32_t block = head->free_blocks;
+        head->free_blocks = shm->links[block - 1];
+        head->n_free_blocks--;
+
+        int n = len - (int)i * SHM_BLOCK_LEN;
+        memcpy(BLOCK(shm, block), data + (size_t)i * SHM_BLOCK_LEN,
+               (n < SHM_BLOCK_LEN) ? n : SHM_BLOCK_LEN);
+        *link = block;
+        link = &shm->links[block - 1];
+    }
+    *link = 0;
+
+    entry->seq = head->next_seq++;
+    uint32_t *bucket = &shm->buckets[hash & (head->n_buckets - 1)];
+    entry->chain = *bucket;
+    *bucket = ref;
+
+    entry->older = head->newest;
+    entry->newer = 0;
+    if (head->newest != 0)
+        ENTRY(shm, head->newest)->newer = ref;
+    else
+        head->oldest = ref;
+    head->newest = ref;
+    head->n_live++;
+
+    entry->state = ENTRY_LIVE;
+    return result;
+}
+
+
+/* copy_out()
+ * @brief   copies len bytes of an entry's data, from off, out of its blocks
+ * @returns a malloc'd buffer (of at least 1 byte, so an empty one isn't NULL)
+ */
+static unsigned char *copy_out(SHM_T shm, shm_entry_t *entry, int off,
+                               int len)
+{
+    unsigned char *copy = malloc((len > 0) ? len : 1);
+    uint32_t block = entry->first;
+    int skip;
+
+    for (skip = off / SHM_BLOCK_LEN; skip > 0; skip--)
+        block = shm->links[block - 1];
+
+    int at = off % SHM_BLOCK_LEN, done = 0;
+    while (done < len) {
+        int n = SHM_BLOCK_LEN - at;
+        if (n > len - done)
+            n = len - done;
+        memcpy(copy + done, BLOCK(shm, block) + at, n);
+        done += n;
+        at = 0;
+        block = shm->links[block - 1];
+    }
+    return copy;
+}
+
+
+// a live entry, for sorting them oldest first
+typedef struct shm_order_t {
+    uint64_t seq;
+    uint32_t ref;
+} shm_order_t;
+
+
+/* by_seq()
+ * @brief   qsort() comparator: oldest entry first
+ */
+static int by_seq(const void *a, const void *b)
+{
+    uint64_t x = ((const shm_order_t *)a)->seq;
+    uint64_t y = ((const shm_order_t *)b)->seq;
+    return (x > y) - (x < y);
+}
+
+
+/* recover_segment()
+ * @brief   rebuilds the index, the oldest-first order and both free lists
+ *          from the live entries, which a crash can't leave half-done
+ * @param   shm: a struct shm_t pointer, locked
+ * @note    entries being put are freed, as are live ones whose block chains
+ *          don't add up (out of range, the wrong length, or sharing a block
+ *          with another entry); every block no live entry holds is freed
+ * @note    also sets up a new segment, which has no live entries
+ */
+static void recover_segment(SHM_T shm)
+{
+    shm_head_t *head = shm->head;
+    shm_order_t *live = malloc(head->cap * sizeof(shm_order_t) + 1);
+    uint32_t *owner = calloc(head->n_blocks + 1, sizeof(uint32_t));
+    uint32_t n_live = 0, ref, block, i;
+
+    for (ref = 1; ref <= head->cap; ref++) {
+        shm_entry_t *entry = ENTRY(shm, ref);
+        if (entry->state != ENTRY_LIVE)
+            continue;
+
+        uint32_t need = (entry->len + SHM_BLOCK_LEN - 1) / SHM_BLOCK_LEN;
+        int ok = (entry->len >= 0 && need <= head->n_blocks);
+        for (block = entry->first, i = 0; ok && block != 0; i++) {
+            ok = (block <= head->n_blocks && i < need
+                  && owner[block - 1] == 0);
+            if (ok) {
+                owner[block - 1] = ref;
+                block = shm->links[block - 1];
+            }
+        }
+
+        if (ok && i == need) {
+            live[n_live++] = (shm_order_t){ entry->seq, ref };
+            continue;
+        }
+
+        entry->state = ENTRY_FREE; // give back whatever it claimed
+        for (block = entry->first; block != 0 && block <= head->n_blocks
+                && owner[block - 1] == ref; block = shm->links[block - 1])
+            owner[block - 1] = 0;
+    }
+
+    qsort(live, n_live, sizeof(shm_order_t), by_seq);
+
+    memset(shm->buckets, 0, head->n_buckets * sizeof(uint32_t));
+    head->oldest = head->newest = 0;
+    for (i = 0; i < n_live; i++) {
+        ref = live[i].ref;
+        shm_entry_t *entry = ENTRY(shm, ref);
+        uint32_t *bucket = &shm->buckets[entry->hash & (head->n_buckets - 1)];
+        entry->chain = *bucket;
+        *bucket = ref;
+
+        entry->older = head->newest;
+        entry->newer = 0;
+        if (head->newest != 0)
+            ENTRY(shm, head->newest)->newer = ref;
+        else
+            head->oldest = ref;
+        head->newest = ref;
+    }
+    head->n_live = n_live;
+    if (n_live > 0 && head->next_seq <= live[n_live - 1].seq)
+        head->next_seq = live[n_live - 1].seq + 1;
+
+    // free lists, lowest index on top
+    head->free_entries = 0;
+    for (ref = head->cap; ref >= 1; ref--) {
+        shm_entry_t *entry = ENTRY(shm, ref);
+        if (entry->state == ENTRY_LIVE)
+            continue;
+        entry->state = ENTRY_FREE;
+        entry->chain = head->free_entries;
+        head->free_entries = ref;
+    }
+
+    head->free_blocks = 0;
+    head->n_free_blocks = 0;
+    for (block = head->n_blocks; block >= 1; block--) {
+        if (owner[block - 1] != 0)
+            continue;
+        shm->links[block - 1] = head->free_blocks;
+        head->free_blocks = block;
+        head->n_free_blocks++;
+    }
+
+    free(owner);
+    free(live);
+}
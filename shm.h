@@ -0,0 +1,86 @@
+/*
+ * SHM.H
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * Shared-memory cache: one cache of files in a POSIX shared-memory segment
+ * (shm_open + mmap), which any local process can attach to by name and
+ * serve GETs (and PUTs) from, instead of each building a private cache.
+ *
+ * The segment holds everything: a header, a table of entries (name,
+ * length, stamps), a hash index over them, and the files' data, in fixed
+ * SHM_BLOCK_LEN blocks chained together. Each process maps it at its own
+ * address, so links are indices (plus one; 0 is none), never pointers.
+ *
+ * One process-shared, robust mutex guards the segment. If a process dies
+ * holding it, the next to lock it repairs the segment before going on: an
+ * entry is only ever marked live once its data is in place, so the index,
+ * the oldest-first order and the free lists are rebuilt from the live
+ * entries, and anything half-put is dropped.
+ *
+ * Eviction is evict_one()'s rule (gcache_a0, see gcache.h), on the
+ * monotonic clock, which every process on the host shares. A GET of an
+ * expired file re-reads its source, as the cache's GET does.
+ *
+ */
+
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "cache.h"
+
+#define SHM_BLOCK_LEN 4096 // bytes of data per block
+#define SHM_NAME_LEN 256 // longest file name, with its '\0'
+
+typedef struct shm_t *SHM_T;
+
+// a segment's counters, shared by every process attached to it
+typedef struct shm_stats_t {
+    uint64_t gets; // GETs
+    uint64_t hits; // GETs answered
+    uint64_t misses; // GETs of files not in the segment (or unreadable)
+    uint64_t puts; // PUTs
+    uint64_t rejected; // PUTs of files too big (or names too long) to keep
+    uint64_t evictions; // files evicted to make room
+    uint64_t reloads; // expired files re-read on a GET
+    uint64_t attaches; // opens of the segment, including its creation
+    uint64_t recoveries; // repairs after a process died holding the lock
+} shm_stats_t;
+
+// attaches to the segment called name, or creates it for cap files and
+// mb MB of data if there isn't one; NULL on error
+SHM_T open_shm(char *name, int cap, int mb);
+
+// detaches from a segment; it lives on until unlinked
+void close_shm(SHM_T shm);
+
+// removes the segment called name; processes attached to it keep it
+int unlink_shm(char *name);
+
+// reads file_name and puts its data in the segment; returns a PUT_ value
+int put_shm(SHM_T shm, char *file_name, int max_age);
+
+// returns a copy of range of file_name's data; NULL if it isn't there
+payload_t *get_shm(SHM_T shm, char *file_name, range_t range);
+
+// locks / unlocks the segment, repairing it first if its holder died
+void lock_shm(SHM_T shm);
+void unlock_shm(SHM_T shm);
+
+// returns the number of files in the segment
+int size_of_shm(SHM_T shm);
+
+// returns a copy of the segment's counters
+shm_stats_t stats_of_shm(SHM_T shm);
+
+// prints the segment's counters
+void print_stats_shm(SHM_T shm);
+
+#endif
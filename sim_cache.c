@@ -7,7 +7,59 @@
  * 
  */ 
 
+#include <ctype.h>
+#include <signal.h>
+
 #include "sim_cache.h"
+#include "hash.h"
+#include "gcache.h"
+
+// how long a command waits on another thread's read of the same file (ms)
+#define FETCH_WAIT_MS 5000
+
+// most consecutive GETs (or PUTs) from a command file run as one batch
+#define SIM_BATCH 32
+
+// slots in each of the pipelined mode's queues
+#define PIPE_DEPTH 1024
+
+/*** PIPELINED REPLAY ***/
+// an output file for the writer stage to write
+typedef struct write_job_t {
+    char *file_name; // malloc'd name of the file that was retrieved
+    payload_t *handle; // its data, pinned until it's written
+} write_job_t;
+
+// state shared by the executor and writer stages
+typedef struct sim_pipe_t {
+    Q_T cmds; // parser -> executor: sim_cmd_t; file_name NULL ends it
+    Q_T writes; // executor -> writer: write_job_t; file_name NULL ends it
+    unsigned char *cmd_file; // command file, for the parser to tokenize
+    S_T sink; // where the writer sends outputs
+    size_t pushed; // write jobs handed to the writer (executor only)
+    atomic_size_t written; // write jobs the writer has finished
+    int outputs_cached; // 1 once an "_output" file has been PUT
+} sim_pipe_t;
+
+/*** PARTITIONED REPLAY ***/
+// a trace split by file name across worker threads
+typedef struct sim_parts_t {
+    sim_cmd_t *cmds; // every valid command, in file order
+    int *owner; // worker that runs each command
+    int n_cmds;
+    int workers;
+    C_T *caches; // each worker's sub-cache
+    S_T sink; // where every worker sends outputs
+} sim_parts_t;
+
+// one worker's view of a partitioned replay
+typedef struct sim_worker_t {
+    sim_parts_t *parts;
+    int id;
+} sim_worker_t;
+
+// set by SIGUSR1: a snapshot is written once the current batch is done
+static volatile sig_atomic_t snapshot_wanted = 0;
 
 /*** HELPER FUNCS ***/
 
@@ -16,10 +68,53 @@ static inline int find_char(char *string, int str_len, char c);
 
 static inline char *get_substr(char *string, int a, int b);
 
-static inline char *generate_output_name(char *string);
-
 static void wait_cmd(int time_to_wait);
 
+// parses a GET's "\RANGE: <off>-<len>" field; returns 0, or -1 if bad
+static int parse_range(char *field, range_t *range);
+
+// runs a batch of GETs for lookup_many_cmd; expirations (if not NULL) is
+// set to each file's expiration
+static void lookup_batch(C_T cache, char **file_names, range_t *ranges,
+                         int n, payload_t **handles, clock_t *expirations);
+
+// runs a batch of consecutive GETs, or of consecutive PUTs; with a pipe,
+// GET outputs are handed to its writer stage
+static void run_batch(C_T cache, sim_cmd_t *batch, int n, S_T sink,
+                      sim_pipe_t *pipe);
+
+// runs the command file through parser, executor and writer stages
+static void run_pipelined(C_T cache, unsigned char *cmd_file, S_T sink,
+                          char *snapshot);
+
+// sends a GET's pinned data to the sink, unpacking it if it's compressed,
+// or gathering it if it's a view
+static int write_handle(S_T sink, char *file_name, payload_t *handle);
+
+// pipeline stage bodies
+static void *parse_stage(void *arg);
+static void *write_stage(void *arg);
+
+// runs the command file on worker threads with sub-caches, split by name
+static void run_partitioned(unsigned char *cmd_file, int cache_size,
+                            int workers, S_T sink, sim_opts_t *opts);
+
+// splits cache_size between partitions, by how many files each one owns
+static void split_capacity(sim_parts_t *parts, int cache_size, int *sizes);
+
+// partitioned worker body: runs its files' commands on its own sub-cache
+static void *part_worker(void *arg);
+
+// prints hit / miss counters summed over every sub-cache, and how far
+// their hit ratio is from a serial replay's, if it's known
+static void print_parts_stats(C_T *caches, int n, sim_opts_t *opts);
+
+// SIGUSR1 handler: asks for a snapshot
+static void want_snapshot(int sig);
+
+// returns "<path>.<i>", the snapshot of partition i (malloc'd)
+static char *part_snapshot_path(char *path, int i);
+
 /* init_cache_sim()
  * @brief   given an input file of commands, run caching sim with commands
  * @param   cmd_file_name   name of command file to read from
@@ -38,62 +133,705 @@ C_T init_cache_sim(char *cmd_file_name, int cache_size,
     int result = read_file_into_buf(cmd_file_name, buffer);
     if (result == -1) // if file couldn't be read properly, return
         return NULL;
+
+    // null-terminate the commands, so they can be strtok'd safely
+    *buffer = realloc(*buffer, result + 1);
+    (*buffer)[result] = '\0';
      
     C_T our_cache = create_cache(cache_size); // malloc'd
     return our_cache;
 }
 
 
+/* run_pipelined()
+ * @brief   replays a command file in three stages, each on its own thread:
+ *          a parser that tokenizes and parses lines, an executor (this
+ *          thread) that runs them on the cache in batches, and a writer that
+ *          writes GET output files. stages are joined by bounded SPSC
+ *          queues, so each one runs ahead while the next is busy.
+ * @param   cache   C_T cache instance to work with
+ * @param   cmd_file    null-terminated command file; tokenized in place
+ * @param   sink    where outputs go; NULL for output files
+ * @param   snapshot    path to write a snapshot to on SIGUSR1; or NULL
+ * @returns none
+ * @note    commands run in file order, batched exactly as they are serially,
+ *          and outputs are written in the order their GETs ran
+ */
+static void run_pipelined(C_T cache, unsigned char *cmd_file, S_T sink,
+                          char *snapshot)
+{
+    sim_pipe_t pipe;
+    pipe.cmds = create_spsc(PIPE_DEPTH, sizeof(sim_cmd_t));
+    pipe.writes = create_spsc(PIPE_DEPTH, sizeof(write_job_t));
+    pipe.cmd_file = cmd_file;
+    pipe.sink = sink;
+    pipe.pushed = 0;
+    atomic_init(&pipe.written, 0);
+    pipe.outputs_cached = 0;
+
+    pthread_t parser, writer;
+    pthread_create(&parser, NULL, parse_stage, &pipe);
+    pthread_create(&writer, NULL, write_stage, &pipe);
+
+    sim_cmd_t batch[SIM_BATCH];
+    sim_cmd_t cmd;
+    int batched = 0;
+
+    while (1) {
+        pop_spsc(pipe.cmds, &cmd);
+        if (cmd.file_name == NULL)
+            break;
+
+        // a GET after PUTs (or vice versa) ends the batch
+        if (batched == SIM_BATCH || (batched > 0
+                && (batch[0].max_age == -1) != (cmd.max_age == -1))) {
+            run_batch(cache, batch, batched, sink, &pipe);
+            batched = 0;
+
+            if (snapshot_wanted && snapshot != NULL) {
+                snapshot_wanted = 0;
+                take_snapshot(cache, snapshot);
+            }
+        }
+        batch[batched++] = cmd;
+    }
+    run_batch(cache, batch, batched, sink, &pipe);
+
+    write_job_t done = { NULL, NULL };
+    push_spsc(pipe.writes, &done);
+
+    pthread_join(parser, NULL);
+    pthread_join(writer, NULL);
+    free_spsc(pipe.cmds);
+    free_spsc(pipe.writes);
+}
+
+
+/* parse_stage()
+ * @brief   parser thread: parses each line of the command file, and queues
+ *          every valid command for the executor, then an empty one
+ * @param   arg: the sim_pipe_t of the run
+ */
+static void *parse_stage(void *arg)
+{
+    sim_pipe_t *pipe = (sim_pipe_t *)arg;
+    char *save = NULL;
+    char *line = strtok_r((char *)pipe->cmd_file, "\n", &save);
+
+    while (line != NULL) {
+        sim_cmd_t cmd = { NULL, -1, 0 };
+        parse_command(line, strlen(line), &cmd);
+        if (cmd.file_name != NULL)
+            push_spsc(pipe->cmds, &cmd);
+
+        line = strtok_r(NULL, "\n", &save);
+    }
+
+    sim_cmd_t done = { NULL, -1, 0 };
+    push_spsc(pipe->cmds, &done);
+    return NULL;
+}
+
+
+/* write_stage()
+ * @brief   writer thread: writes each queued GET's output file from its
+ *          pinned data, then releases the data
+ * @param   arg: the sim_pipe_t of the run
+ */
+static void *write_stage(void *arg)
+{
+    sim_pipe_t *pipe = (sim_pipe_t *)arg;
+    write_job_t job;
+
+    while (1) {
+        pop_spsc(pipe->writes, &job);
+        if (job.file_name == NULL)
+            break;
+
+        write_handle(pipe->sink, job.file_name, job.handle);
+
+        release_file_cache(job.handle);
+        free(job.file_name);
+        atomic_fetch_add(&pipe->written, 1);
+    }
+
+    return NULL;
+}
+
+
+/* run_batch()
+ * @brief   runs a batch of consecutive commands of one kind (all GETs, or
+ *          all PUTs) from the command file
+ * @param   cache   C_T cache instance to work with
+ * @param   batch   the parsed commands; their file names are freed
+ * @param   n   number of commands
+ * @param   sink    where GET outputs go; NULL for output files
+ * @param   pipe    NULL to run the batch serially; otherwise, GET outputs
+ *                  are queued for the pipe's writer stage
+ * @returns none
+ * @note    a pipelined PUT of a file the writer may still be writing (an
+ *          "_output" file) first waits for the writer to catch up, so that
+ *          every file is read and deleted in the same order as serially
+ */
+static void run_batch(C_T cache, sim_cmd_t *batch, int n, S_T sink,
+                      sim_pipe_t *pipe)
+{
+    int i;
+
+    if (n == 0)
+        return;
+
+    if (batch[0].max_age != -1) { // PUTs
+        for (i = 0; pipe != NULL && i < n; i++)
+            if (strstr(batch[i].file_name, "_output") != NULL)
+                pipe->outputs_cached = 1;
+
+        // once outputs may be cached, evictions may delete them too
+        while (pipe != NULL && pipe->outputs_cached
+                && atomic_load(&pipe->written) < pipe->pushed)
+            sched_yield();
+
+        put_many_cmd(cache, batch, n, NULL);
+        return;
+    }
+
+    char *names[SIM_BATCH];
+    range_t ranges[SIM_BATCH];
+    for (i = 0; i < n; i++) {
+        names[i] = batch[i].file_name;
+        ranges[i] = batch[i].range;
+    }
+
+    if (pipe == NULL) {
+        get_many_cmd(cache, names, ranges, n, sink);
+        for (i = 0; i < n; i++)
+            free(names[i]);
+        return;
+    }
+
+    payload_t *handles[SIM_BATCH];
+    lookup_many_cmd(cache, names, ranges, n, handles);
+
+    for (i = 0; i < n; i++) {
+        if (handles[i] == NULL) {
+            free(names[i]);
+            continue;
+        }
+
+        write_job_t job = { names[i], handles[i] }; // writer frees both
+        push_spsc(pipe->writes, &job);
+        pipe->pushed++;
+    }
+}
+
+
 /* run_cache_sim()
  * @brief   run caching sim with given input file and generated cache
  * @param   cmd_file_name   name of command file to read from
  * @param   cache_size      size of cache, specified at runtime
+ * @param   opts            options for the run; NULL for defaults
  * @returns 0 if run successfully, 1 if an error is encountered
  * @note    
  */ 
-int run_cache_sim(char *cmd_file_name, int cache_size)
+int run_cache_sim(char *cmd_file_name, int cache_size, sim_opts_t *opts)
 {
     unsigned char *cmd_file = NULL;
     char *line = NULL;
-    char *file_name = NULL;
-    int max_age = -1;
+    sim_cmd_t cmd = { NULL, -1, 0 };
+    sim_opts_t defaults = { 0 };
+
+    if (opts == NULL)
+        opts = &defaults;
+
+    // GET outputs go to output files, unless another sink was asked for
+    S_T sink = NULL;
+    if (opts->output != NULL && (sink = open_sink(opts->output)) == NULL) {
+        fprintf(stderr, "can't open output sink %s\n", opts->output);
+        return 1;
+    }
+
+    // a partitioned run splits the capacity across workers (each with at
+    // least 1 file), and makes their sub-caches itself
+    int parts = 1;
+    if (opts->workers > 1)
+        parts = (opts->workers < cache_size) ? opts->workers : cache_size;
 
     C_T cache = init_cache_sim(cmd_file_name, cache_size, &cmd_file);
+    if (cache == NULL) {
+        close_sink(sink);
+        return 1;
+    }
+
+    if (parts > 1) {
+        free_cache(cache);
+        cache = NULL;
+    }
+    else {
+        cache = configure_cache(cache, cache_size, opts);
+    }
+
+    if (opts->snapshot != NULL) {
+        signal(SIGUSR1, want_snapshot);
+        if (parts == 1)
+            restore_snapshot(cache, opts->snapshot);
+    }
+
+    if (parts > 1) {
+        run_partitioned(cmd_file, cache_size, parts, sink, opts);
+        line = NULL; // cmd_file has been parsed and run
+    }
+    else if (opts->pipeline) {
+        run_pipelined(cache, cmd_file, sink, opts->snapshot);
+        line = NULL; // the parser stage has tokenized cmd_file
+    }
+    else {
+        line = strtok((char *)cmd_file, "\n");
+    }
+
+    // consecutive GETs (or PUTs) are queued up, and run as one batch
+    sim_cmd_t batch[SIM_BATCH];
+    int batched = 0;
 
-    line = strtok((char *)cmd_file, "\n");
     while (line != NULL) {
-        max_age = extract_command(line, strlen(line), &file_name);
-        // if (file_name == NULL && max_age != -1) {
-        //     // printf("WAIT: %i\n", max_age);
-        //     wait_cmd(max_age);
+        parse_command(line, strlen(line), &cmd);
+        // if (cmd.file_name == NULL && cmd.max_age != -1) {
+        //     // printf("WAIT: %i\n", cmd.max_age);
+        //     wait_cmd(cmd.max_age);
         // }
         // else 
-        if (file_name != NULL && max_age != -1) {
-            // PUT 
-            // printf("PUT: %s, %i\n", file_name, max_age);
-            put_cmd(cache, file_name, max_age);
-        }
-        else if (file_name != NULL) {
-            // printf("GET: %s\n", file_name);
-            get_cmd(cache, file_name);
+        if (cmd.file_name != NULL) {
+            // a GET after PUTs (or vice versa) ends the batch
+            if (batched == SIM_BATCH || (batched > 0
+                    && (batch[0].max_age == -1) != (cmd.max_age == -1))) {
+                run_batch(cache, batch, batched, sink, NULL);
+                batched = 0;
+
+                if (snapshot_wanted && opts->snapshot != NULL) {
+                    snapshot_wanted = 0;
+                    take_snapshot(cache, opts->snapshot);
+                }
+            }
+            batch[batched++] = cmd;
         }
 
         // print_cache(cache);
         line = strtok(NULL, "\n"); // get the next line
          // reset to default values; cache item keeps track of file_name
-        max_age = -1;
-        file_name = NULL;
+        cmd.max_age = -1;
+        cmd.file_name = NULL;
     }
+    run_batch(cache, batch, batched, sink, NULL);
 
-    if (file_name != NULL) {
-        free(file_name);
-    }
+    if (opts->snapshot != NULL && parts == 1)
+        take_snapshot(cache, opts->snapshot);
+
+    if (opts->stats && parts == 1)
+        print_stats_cache(cache);
+
+    flush_sink(sink);
+    if (opts->stats)
+        print_stats_sink(sink);
+    close_sink(sink);
 
     free_cache(cache);
+    free(cmd_file);
 
     return 0;
 }
 
+
+/* configure_cache()
+ * @brief   turns on the features a run's options ask for
+ * @param   cache   new C_T cache instance
+ * @param   cache_size  its capacity
+ * @param   opts    options for the run
+ * @returns the configured cache
+ */
+C_T configure_cache(C_T cache, int cache_size, sim_opts_t *opts)
+{
+    // a "pipe" sink writes its records to stdout: messages go to stderr
+    if (opts->output != NULL && strcmp(opts->output, "pipe") == 0)
+        cache = (C_T)set_log_cache(cache, stderr);
+    if (opts->admission)
+        cache = (C_T)enable_admission_cache(cache, cache_size * 16);
+    if (opts->filter_fp > 0)
+        cache = (C_T)enable_filter_cache(cache, opts->filter_fp);
+    if (opts->neg_ttl > 0)
+        cache = (C_T)enable_negative_cache(cache, opts->neg_ttl, opts->neg_cap);
+    if (opts->lazy)
+        cache = (C_T)enable_lazy_cache(cache);
+    if (opts->watch)
+        cache = (C_T)enable_watch_cache(cache, opts->watch == WATCH_RELOAD);
+    if (opts->ahead_fraction > 0)
+        cache = (C_T)enable_refresh_ahead_cache(cache, opts->ahead_fraction,
+                                                opts->ahead_rate);
+    if (opts->spill_dir != NULL)
+        cache = (C_T)enable_spill_cache(cache, opts->spill_dir,
+                                        (uint64_t)opts->spill_mb << 20);
+    if (opts->compress_kb > 0)
+        cache = (C_T)enable_compress_cache(cache, opts->compress_kb * 1024,
+                                           opts->compress_ratio);
+    if (opts->dedup)
+        cache = (C_T)enable_dedup_cache(cache);
+    if (opts->direct_kb > 0) // for the whole process, not just this cache
+        enable_direct_file_sys(opts->direct_kb * 1024);
+    if (opts->chunk_kb > 0)
+        cache = (C_T)enable_chunks_cache(cache, opts->chunk_kb * 1024,
+                                         (uint64_t)opts->chunk_mb << 20);
+    return cache;
+}
+
+
+/* run_partitioned()
+ * @brief   replays a command file on worker threads, with every command on
+ *          a file run by the worker its name hashes to; each worker owns a
+ *          sub-cache with its share of cache_size (see split_capacity), and
+ *          never waits on the others
+ * @param   cmd_file    null-terminated command file; tokenized in place
+ * @param   cache_size  capacity of the whole run
+ * @param   workers number of workers; at most cache_size
+ * @param   sink    where outputs go; NULL for output files
+ * @param   opts    options for the run
+ * @returns none
+ * @note    approximate: commands on one file keep their order, but each
+ *          eviction only sees its worker's files, so hit ratios drift from
+ *          a serial run's whenever a partition's files don't fit its
+ *          share. there's no exact mode that reconciles the partitions'
+ *          evictions; with opts->compare_serial, STATS reports the drift
+ */
+static void run_partitioned(unsigned char *cmd_file, int cache_size,
+                            int workers, S_T sink, sim_opts_t *opts)
+{
+    sim_parts_t parts;
+    int cap = 1024;
+    int i;
+
+    parts.cmds = malloc(cap * sizeof(sim_cmd_t));
+    parts.n_cmds = 0;
+
+    char *save = NULL;
+    char *line = strtok_r((char *)cmd_file, "\n", &save);
+    while (line != NULL) {
+        sim_cmd_t cmd = { NULL, -1, 0 };
+        parse_command(line, strlen(line), &cmd);
+        if (cmd.file_name != NULL) {
+            if (parts.n_cmds == cap) {
+                cap *= 2;
+                parts.cmds = realloc(parts.cmds, cap * sizeof(sim_cmd_t));
+            }
+            parts.cmds[parts.n_cmds++] = cmd;
+        }
+        line = strtok_r(NULL, "\n", &save);
+    }
+
+    parts.workers = workers;
+    parts.sink = sink;
+    parts.owner = malloc(parts.n_cmds * sizeof(int));
+    for (i = 0; i < parts.n_cmds; i++) {
+        char *name = parts.cmds[i].file_name;
+        parts.owner[i] = hash_bytes(name, strlen(name)) % workers;
+    }
+
+    int *sizes = malloc(workers * sizeof(int));
+    split_capacity(&parts, cache_size, sizes);
+    parts.caches = malloc(workers * sizeof(C_T));
+    for (i = 0; i < workers; i++)
+        parts.caches[i] = configure_cache(create_cache(sizes[i]), sizes[i],
+                                          opts);
+    free(sizes);
+
+    // each partition has its own snapshot, as it has its own files
+    char **snapshots = NULL;
+    if (opts->snapshot != NULL) {
+        snapshots = malloc(workers * sizeof(char *));
+        for (i = 0; i < workers; i++) {
+            snapshots[i] = part_snapshot_path(opts->snapshot, i);
+            restore_snapshot(parts.caches[i], snapshots[i]);
+        }
+    }
+
+    pthread_t *threads = malloc(workers * sizeof(pthread_t));
+    sim_worker_t *args = malloc(workers * sizeof(sim_worker_t));
+    for (i = 0; i < workers; i++) {
+        args[i].parts = &parts;
+        args[i].id = i;
+        pthread_create(&threads[i], NULL, part_worker, &args[i]);
+    }
+    for (i = 0; i < workers; i++)
+        pthread_join(threads[i], NULL);
+
+    for (i = 0; snapshots != NULL && i < workers; i++) {
+        take_snapshot(parts.caches[i], snapshots[i]);
+        free(snapshots[i]);
+    }
+    free(snapshots);
+
+    if (opts->stats)
+        print_parts_stats(parts.caches, workers, opts);
+
+    for (i = 0; i < workers; i++)
+        free_cache(parts.caches[i]);
+
+    free(args);
+    free(threads);
+    free(parts.caches);
+    free(parts.owner);
+    free(parts.cmds);
+}
+
+
+/* split_capacity()
+ * @brief   splits cache_size between the partitions in proportion to the
+ *          distinct files each owns, rather than evenly, since names hash
+ *          unevenly; each gets at least 1, and together exactly cache_size
+ * @param   parts   the partitioned trace, with owner filled in
+ * @param   cache_size  capacity of the whole run; at least parts->workers
+ * @param   sizes   array of parts->workers, set to each one's capacity
+ * @returns none
+ * @note    every partition's 1 slot comes out of cache_size first, so the
+ *          run never has more room than the serial one it approximates; the
+ *          rest is split by files, and what rounding leaves goes, one at a
+ *          time, to whichever has the most files per slot
+ */
+static void split_capacity(sim_parts_t *parts, int cache_size, int *sizes)
+{
+    int workers = parts->workers;
+    int *files = calloc(workers, sizeof(int));
+    int total = 0, given = 0, i;
+
+    // distinct names, by hash (a set of hash | 1; 0 is an empty slot)
+    uint64_t slots = 1;
+    while (slots < 2 * (uint64_t)parts->n_cmds)
+        slots <<= 1;
+    uint64_t *seen = calloc(slots, sizeof(uint64_t));
+    for (i = 0; i < parts->n_cmds; i++) {
+        char *name = parts->cmds[i].file_name;
+        uint64_t h = hash_bytes(name, strlen(name)) | 1;
+        uint64_t j = h & (slots - 1);
+        while (seen[j] != 0 && seen[j] != h)
+            j = (j + 1) & (slots - 1);
+        if (seen[j] == 0) {
+            seen[j] = h;
+            files[parts->owner[i]]++;
+            total++;
+        }
+    }
+    free(seen);
+
+    int spare = cache_size - workers; // after each one's first slot
+    for (i = 0; i < workers; i++) {
+        sizes[i] = 1 + ((total > 0) ? (int)((int64_t)spare * files[i] / total)
+                                    : spare / workers);
+        given += sizes[i];
+    }
+
+    while (given < cache_size) {
+        int best = 0;
+        for (i = 1; i < workers; i++) {
+            int64_t mine = (int64_t)files[i] * sizes[best];
+            int64_t theirs = (int64_t)files[best] * sizes[i];
+            if (mine > theirs || (mine == theirs && sizes[i] < sizes[best]))
+                best = i;
+        }
+        sizes[best]++;
+        given++;
+    }
+
+    free(files);
+}
+
+
+/* part_worker()
+ * @brief   worker thread: runs its own commands on its own sub-cache, in
+ *          file order, batched as a serial run batches them
+ * @param   arg: the worker's sim_worker_t
+ */
+static void *part_worker(void *arg)
+{
+    sim_worker_t *worker = (sim_worker_t *)arg;
+    sim_parts_t *parts = worker->parts;
+    C_T cache = parts->caches[worker->id];
+
+    sim_cmd_t batch[SIM_BATCH];
+    int batched = 0;
+    int i;
+
+    for (i = 0; i < parts->n_cmds; i++) {
+        if (parts->owner[i] != worker->id)
+            continue;
+
+        sim_cmd_t cmd = parts->cmds[i];
+        if (batched == SIM_BATCH || (batched > 0
+                && (batch[0].max_age == -1) != (cmd.max_age == -1))) {
+            run_batch(cache, batch, batched, parts->sink, NULL);
+            batched = 0;
+        }
+        batch[batched++] = cmd;
+    }
+    run_batch(cache, batch, batched, parts->sink, NULL);
+
+    return NULL;
+}
+
+
+/* print_parts_stats()
+ * @brief   prints the hit / miss counters of an approximate partitioned run,
+ *          summed over its sub-caches
+ * @param   caches  each worker's sub-cache
+ * @param   n   number of sub-caches
+ * @param   opts    options for the run; with compare_serial, also prints
+ *          how far the hit ratio is from serial_ratio
+ * @returns none
+ */
+static void print_parts_stats(C_T *caches, int n, sim_opts_t *opts)
+{
+    cache_stats_t total = { 0 };
+    int i;
+
+    for (i = 0; i < n; i++) {
+        cache_stats_t *st = stats_of_cache(caches[i]);
+        total.gets += st->gets;
+        total.hits += st->hits;
+        total.misses += st->misses;
+        total.puts += st->puts;
+        total.evictions += st->evictions;
+        total.rejected += st->rejected;
+    }
+
+    double ratio = 0;
+    if (total.gets > 0)
+        ratio = 100.0 * (double)total.hits / (double)total.gets;
+
+    // to the partitions' log, as print_stats_cache() would
+    FILE *out = stdout;
+    if (n > 0 && caches[0] != NULL && log_of_cache(caches[0]) != NULL)
+        out = log_of_cache(caches[0]);
+
+    fprintf(out, "STATS: %lu GETs, %lu hits, %lu misses (hit ratio "
+            "%0.2lf%%) over %d partitions\n", total.gets, total.hits,
+            total.misses, ratio, n);
+    fprintf(out, "STATS: %lu PUTs, %lu evictions, %lu rejected by "
+            "admission\n", total.puts, total.evictions, total.rejected);
+    if (opts->compare_serial)
+        fprintf(out, "STATS: hit ratio %+0.2lf points from the serial "
+                "replay's %0.2lf%%\n", ratio - opts->serial_ratio,
+                opts->serial_ratio);
+}
+
+/* restore_snapshot()
+ * @brief   warms a new cache from the snapshot at path, and reports how
+ *          many files it brought back, and how long that took
+ * @param   cache   C_T cache instance, configured but not yet used
+ * @param   path    snapshot to read; a missing one just leaves it cold
+ * @returns none
+ */
+void restore_snapshot(C_T cache, char *path)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int restored = load_snapshot_cache(cache, path);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double ms = (end.tv_sec - start.tv_sec) * 1e3
+                + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+    if (restored == -1)
+        log_cache(cache, "SNAPSHOT: no snapshot at %s; starting cold\n", path);
+    else
+        log_cache(cache, "SNAPSHOT: restored %d files from %s in %0.2lf ms\n",
+                  restored, path, ms);
+}
+
+
+/* take_snapshot()
+ * @brief   writes a snapshot of a cache to path, holding the cache's lock
+ * @param   cache   C_T cache instance
+ * @param   path    file to write (through "<path>.tmp")
+ * @returns none
+ */
+void take_snapshot(C_T cache, char *path)
+{
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    lock_cache(cache);
+    int saved = save_snapshot_cache(cache, path);
+    unlock_cache(cache);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    double ms = (end.tv_sec - start.tv_sec) * 1e3
+                + (end.tv_nsec - start.tv_nsec) / 1e6;
+
+    if (saved == -1)
+        fprintf(stderr, "can't write snapshot %s\n", path);
+    else
+        log_cache(cache, "SNAPSHOT: saved %d files to %s in %0.2lf ms\n",
+                  saved, path, ms);
+}
+
+
+/* write_handle()
+ * @brief   sends the data a GET pinned to the sink: as it is, or, if the
+ *          cache keeps it compressed, unpacked on its way into the sink; a
+ *          view (of a range, or of a chunked file) goes out as its parts,
+ *          without being copied
+ * @param   sink    where outputs go; NULL for output files
+ * @param   file_name   name of the file retrieved
+ * @param   handle  its pinned data
+ * @returns 0, or -1 if the output couldn't be written
+ */
+static int write_handle(S_T sink, char *file_name, payload_t *handle)
+{
+    if (handle->parts != NULL) {
+        struct iovec *iov = malloc((handle->n_parts + 1)
+                                   * sizeof(struct iovec));
+        int skip = handle->skip, left = handle->len, i;
+
+        for (i = 0; i < handle->n_parts; i++) {
+            int take = handle->parts[i]->len - skip;
+            if (take > left)
+                take = left;
+            iov[i].iov_base = handle->parts[i]->data + skip;
+            iov[i].iov_len = take;
+            left -= take;
+            skip = 0;
+        }
+
+        int result = writev_sink(sink, file_name, handle->off, iov,
+                                 handle->n_parts);
+        free(iov);
+        return result;
+    }
+
+    if (handle->packed > 0)
+        return write_packed_sink(sink, file_name, handle->data,
+                                 handle->packed, handle->len);
+
+    return write_sink(sink, file_name, handle->data, handle->len);
+}
+
+
+/* want_snapshot()
+ * @brief   SIGUSR1 handler: flags that a snapshot should be written
+ */
+static void want_snapshot(int sig)
+{
+    (void)sig;
+    snapshot_wanted = 1;
+}
+
+
+/* part_snapshot_path()
+ * @brief   names partition i's snapshot, "<path>.<i>"
+ * @returns the name; malloc'd
+ */
+static char *part_snapshot_path(char *path, int i)
+{
+    char *name = malloc(strlen(path) + 16);
+    sprintf(name, "%s.%d", path, i);
+    return name;
+}
+
+
 /* wait_cmd()
  *
  *
@@ -117,29 +855,63 @@ static void wait_cmd(int time_to_wait) {
  * 
  * @note    eviction policy: if all files have been accessed before, evict the
  *          least-recently accessed file; otherwise, evict the oldest file
+ * @param   stale       grace period (sec) past max_age during which GETs
+ *                      are served the old data while it refreshes; 0 if none
+ * @note    if admission is on, and the cache is full, a new file is only
+ *          stored if it's been requested more often than the file it would
+ *          evict; a rejected file_name is freed.
+ * @note    safe to call from several threads at once: the new file is read
+ *          outside the cache's lock, and concurrent PUTs of the same file
+ *          share that one read (see fetch_file_cache)
  */
-void put_cmd(C_T cache, char *file_name, int max_age)
+void put_cmd(C_T cache, char *file_name, int max_age, int stale)
 {
+    lock_cache(cache);
+
     int size = size_of_cache(cache);
     int cap = cap_of_cache(cache);
 
+    stats_of_cache(cache)->puts++;
+    record_access_cache(cache, file_name);
+    cache = (C_T)apply_refreshes_cache(cache);
+    cache = (C_T)apply_watch_cache(cache);
+
+    // known-unreadable files are answered from memory, without an open()
+    if (is_negative_cache(cache, file_name)) {
+        log_cache(cache, "%s is unreadable (negative entry)\n", file_name);
+        free(file_name);
+        unlock_cache(cache);
+        return;
+    }
+
     // check if it already exists in cache
     cache_file_t our_file = retrieve_file_struct(cache, file_name);
 
     // if file doesn't exist (NAME IS NULL), add it to the cache!
     if (our_file.name == NULL) {
-        if (size >= cap) {
-            cache = (C_T)evict_one(cache);
+        if (size >= cap && !admit_file_cache(cache, file_name)) {
+            free(file_name);
+            unlock_cache(cache);
+            return;
         }
-        // must create unique, new name string for new item!
 
-        cache = (C_T)push_back_cache(cache, file_name, max_age);
+        // read it in (evicting to make room) outside the lock
+        unlock_cache(cache);
+        fetch_file_cache(cache, file_name, max_age, FETCH_WAIT_MS);
+        lock_cache(cache);
     } else {
         // else, update content for an existing file
         cache_file_t new_file = retrieve_file_struct(cache, file_name);
         new_file.max_age = max_age; // update max age if changed
         cache = (C_T)update_item_cache(cache, file_name, new_file);
     }
+
+    // (re)sets the file's grace period; a no-op if it wasn't cached
+    cache = (C_T)set_stale_cache(cache, file_name, stale);
+
+    if (our_file.name == NULL)
+        free(file_name); // the cache stored its own copy
+    unlock_cache(cache);
 }
 
 
@@ -150,36 +922,300 @@ void put_cmd(C_T cache, char *file_name, int max_age)
  * @param   file_name   name of file to get
  * @returns none
  * 
- * @note    if file exists, but age has timed out, re-”get” file data
- *          from source and update cache content before writing to output
- *          file. if file doesn’t exist in cache, do nothing.
+ * @note    if file exists, but age has timed out, revalidate it against
+ *          its source (see revalidate_item_cache) before writing to output
+ *          file, unless it's within its STALE grace period: then the stale
+ *          data is written, and refreshed in the background. if file doesn’t
+ *          exist in cache, do nothing.
+ * @note    a GET doesn't renew freshness; max_age counts from when the
+ *          data was last read or revalidated.
+ * @note    a batch of one GET: see get_many_cmd
  */
 void get_cmd(C_T cache, char *file_name)
 {
-    cache_file_t our_file = retrieve_file_struct(cache, file_name);
-    printf("asked for %s, got %s\n", file_name, our_file.name);
-    if (our_file.name != NULL) { // if file isn't NULL_FILE
-        clock_t now = clock();
-
-        // if file is expired, "re-get" and update file content 
-        if (our_file.expiration <= now) {
-            cache = (C_T)remove_file_cache(cache, file_name); // frees name
-            cache = (C_T)push_back_cache(cache, file_name, our_file.max_age);
+    get_many_cmd(cache, &file_name, NULL, 1, NULL);
+}
+
+
+/* get_many_cmd()
+ * @brief   executes a run of GETs, as get_cmd would one at a time, but
+ *          with one lock acquisition and one batched lookup for the run,
+ *          and with every output file written together at the end
+ * @param   cache   C_T cache instance to work with
+ * @param   file_names  names of files to get, in order
+ * @param   ranges  each GET's range of bytes; NULL to get whole files
+ * @param   n   number of GETs
+ * @param   sink    where the outputs go; NULL for output files
+ * @returns none
+ * 
+ * @note    safe to call from several threads at once: when many GETs find
+ *          the same file expired, only one of them goes back to its source
+ *          (see fetch_file_cache), and outputs are written from handles on
+ *          the data, outside the cache's lock
+ * @note    a range's output is written at its offset in the output file
+ *          (see writev_sink)
+ */
+void get_many_cmd(C_T cache, char **file_names, range_t *ranges, int n,
+                  S_T sink)
+{
+    payload_t **handles = malloc(n * sizeof(payload_t *));
+    int i;
+
+    lookup_many_cmd(cache, file_names, ranges, n, handles);
+
+    for (i = 0; i < n; i++) {
+        if (handles[i] == NULL)
+            continue;
+
+        write_handle(sink, file_names[i], handles[i]);
+        release_file_cache(handles[i]);
+    }
+
+    free(handles);
+}
+
+
+/* lookup_many_cmd()
+ * @brief   does everything get_many_cmd does for a run of GETs, other than
+ *          writing the output files
+ * @param   cache   C_T cache instance to work with
+ * @param   file_names  names of files to get, in order
+ * @param   ranges  each GET's range of bytes; NULL to get whole files
+ * @param   n   number of GETs
+ * @param   handles array of n handles, each set to the data to write out
+ *          for its GET, or NULL if there's nothing to write
+ * @returns none
+ * @note    a chunked file is never read whole: an expired one is only
+ *          revalidated, and a GET reads just the chunks its range touches
+ *          (see acquire_range_cache)
+ */
+void lookup_many_cmd(C_T cache, char **file_names, range_t *ranges, int n,
+                     payload_t **handles)
+{
+    lookup_batch(cache, file_names, ranges, n, handles, NULL);
+}
+
+
+/* lookup_l0_cmd()
+ * @brief   runs a batch of GETs as lookup_many_cmd does, but answers the
+ *          whole-file GETs that the calling thread's L0 can first, without
+ *          the cache's lock, and puts the data of the others in it
+ * @param   cache   C_T cache instance to work with
+ * @param   l0  the calling thread's L0 (see l0.h)
+ * @param   file_names, ranges, n, handles  as for lookup_many_cmd
+ * @returns none
+ * @note    a whole-file GET's handle is always on plain data, as the L0
+ *          keeps it (see unpack_file_cache); a range's is as the cache
+ *          gives it, and ranges don't use the L0
+ * @note    a GET answered by the L0 isn't counted in the cache's stats, nor
+ *          seen by admission or refresh-ahead; the caller adds its hits to
+ *          the stats (see take_stats_l0), and the L0 sends every L0_USES'th
+ *          GET of a file to the cache
+ */
+void lookup_l0_cmd(C_T cache, L0_T l0, char **file_names, range_t *ranges,
+                   int n, payload_t **handles)
+{
+    // read before the lookups, so a change made during them shows
+    uint64_t epoch = epoch_of_cache(cache);
+    clock_t now = now_cache(cache);
+
+    char **names = malloc(n * sizeof(char *));
+    range_t *miss_ranges = malloc(n * sizeof(range_t));
+    payload_t **found = malloc(n * sizeof(payload_t *));
+    clock_t *expirations = malloc(n * sizeof(clock_t));
+    int *at = malloc(n * sizeof(int));
+    range_t whole = { 0, -1 };
+    int m = 0, i, j;
+
+    for (i = 0; i < n; i++) {
+        range_t range = (ranges != NULL) ? ranges[i] : whole;
+        handles[i] = NULL;
+        if (range.off == 0 && range.len == -1)
+            handles[i] = get_l0(l0, file_names[i], epoch, now);
+
+        if (handles[i] == NULL) {
+            names[m] = file_names[i];
+            miss_ranges[m] = range;
+            at[m++] = i;
         }
-        // else, just update item
-        else { 
-            cache = (C_T)update_item_cache(cache, file_name, our_file);
+    }
+
+    if (m > 0)
+        lookup_batch(cache, names, miss_ranges, m, found, expirations);
+
+    for (j = 0; j < m; j++) {
+        i = at[j];
+        if (miss_ranges[j].off == 0 && miss_ranges[j].len == -1) {
+            found[j] = unpack_file_cache(found[j]);
+            put_l0(l0, file_names[i], found[j], epoch, expirations[j]);
         }
+        handles[i] = found[j];
+    }
+
+    free(at);
+    free(expirations);
+    free(found);
+    free(miss_ranges);
+    free(names);
+}
 
-        char *new_name = generate_output_name(file_name); // malloc'd
-        write_buf_into_file(new_name, our_file.data, our_file.len);
-        free(new_name);
+
+/* lookup_batch()
+ * @brief   lookup_many_cmd's body
+ * @param   expirations: array of n times, each set to its file's expiration
+ *          as of its handle being taken; or NULL
+ */
+static void lookup_batch(C_T cache, char **file_names, range_t *ranges,
+                         int n, payload_t **handles, clock_t *expirations)
+{
+    cache_file_t *files = malloc(n * sizeof(cache_file_t));
+    int i;
+
+    for (i = 0; i < n; i++)
+        handles[i] = NULL;
+
+    lock_cache(cache);
+
+    cache_stats_t *stats = stats_of_cache(cache);
+    stats->gets += n;
+    for (i = 0; i < n; i++)
+        record_access_cache(cache, file_names[i]);
+    cache = (C_T)apply_refreshes_cache(cache);
+    cache = (C_T)apply_watch_cache(cache);
+
+    get_many_cache(cache, file_names, n, files);
+    int relocked = 0; // once the lock's been dropped, files[] may be stale
+
+    for (i = 0; i < n; i++) {
+        char *file_name = file_names[i];
+        cache_file_t our_file = files[i];
+        if (relocked)
+            our_file = retrieve_file_struct(cache, file_name);
+
+        // an L1 miss checks L2 before giving up; promoting may evict
+        if (our_file.name == NULL && promote_spill_cache(cache, file_name)) {
+            relocked = 1;
+            our_file = retrieve_file_struct(cache, file_name);
+        }
+
+        log_cache(cache, "asked for %s, got %s\n", file_name, our_file.name);
+        if (our_file.name == NULL) {
+            stats->misses++;
+            if (is_negative_cache(cache, file_name))
+                log_cache(cache, "%s is unreadable (negative entry)\n",
+                          file_name);
+            else
+                log_cache(cache, "we couldn't find %s in cache\n", file_name);
+            continue; // if file is not in cache, don't do anything!
+        }
+
+        clock_t now = now_cache(cache);
+        stats->hits++;
+
+        // if file is expired, revalidate it against its source: only
+        // re-read the data if the source has changed. inside its STALE
+        // grace period, serve the old data and refresh in the background.
+        // a lazily PUT file is read in on its first GET
+        int expired = (gcache_expired(our_file.expiration, now)
+                       && !serve_stale_cache(cache, file_name));
+
+        if (expired && our_file.chunks != NULL) {
+            revalidate_item_cache(cache, file_name);
+            our_file = retrieve_file_struct(cache, file_name);
+            if (our_file.name == NULL) { // source is gone: negative entry
+                log_cache(cache, "%s is unreadable (negative entry)\n",
+                          file_name);
+                continue;
+            }
+        }
+        else if (expired || !our_file.loaded) {
+            unlock_cache(cache);
+            int fetched = fetch_file_cache(cache, file_name, -1, FETCH_WAIT_MS);
+            lock_cache(cache);
+            relocked = 1;
+            our_file = retrieve_file_struct(cache, file_name);
+
+            if (our_file.name == NULL) { // source is gone: negative entry
+                if (fetched == FETCH_ERROR)
+                    log_cache(cache, "%s is unreadable (negative entry)\n",
+                          file_name);
+                else
+                    log_cache(cache, "%s was evicted while it was read\n",
+                             file_name);
+                continue;
+            }
+
+            if (!our_file.loaded) { // fetch timed out before a first read
+                log_cache(cache, "timed out waiting for %s to be read\n",
+                          file_name);
+                continue;
+            }
+        }
+
+        refresh_ahead_cache(cache, file_name);
+
+        // the handle pins the data, so it's written out after the lock is
+        // dropped, even if another thread evicts or reloads the file
+        range_t whole = { 0, -1 };
+        handles[i] = acquire_range_cache(cache, file_name,
+                                         (ranges != NULL) ? ranges[i] : whole);
+        if (expirations != NULL)
+            expirations[i] = our_file.expiration;
     }
-    else {
-        printf("we couldn't find %s in cache\n", file_name);
+
+    unlock_cache(cache);
+    free(files);
+}
+
+
+/* put_many_cmd()
+ * @brief   executes a run of PUTs, as put_cmd would one at a time, but
+ *          with the run's new files read together (see put_many_cache)
+ * @param   cache   C_T cache instance to work with
+ * @param   cmds    the parsed PUT commands, in order; their file names are
+ *                  freed
+ * @param   n   number of PUTs
+ * @param   outcomes    array of n, set to each PUT's outcome (PUT_STORED,
+ *                      etc.; see put_many_cache); or NULL
+ * @returns none
+ */
+void put_many_cmd(C_T cache, sim_cmd_t *cmds, int n, int *outcomes)
+{
+    char **names = malloc(n * sizeof(char *));
+    int *max_ages = malloc(n * sizeof(int));
+    int *results = (outcomes != NULL) ? outcomes : malloc(n * sizeof(int));
+    int i;
+
+    lock_cache(cache);
+    stats_of_cache(cache)->puts += n;
+    for (i = 0; i < n; i++) {
+        names[i] = cmds[i].file_name;
+        max_ages[i] = cmds[i].max_age;
+        record_access_cache(cache, names[i]);
+    }
+    cache = (C_T)apply_refreshes_cache(cache);
+    cache = (C_T)apply_watch_cache(cache);
+    unlock_cache(cache);
+
+    put_many_cache(cache, names, max_ages, n, results);
+
+    lock_cache(cache);
+    for (i = 0; i < n; i++) {
+        if (results[i] == PUT_NEGATIVE)
+            log_cache(cache, "%s is unreadable (negative entry)\n", names[i]);
+
+        // (re)sets the file's grace period; a no-op if it wasn't cached
+        if (results[i] == PUT_STORED || results[i] == PUT_UPDATED)
+            cache = (C_T)set_stale_cache(cache, names[i], cmds[i].stale);
+
+        free(names[i]); // the cache stored its own copy
     }
+    unlock_cache(cache);
 
-    // if file is not in cache, don't do anything!
+    if (results != outcomes)
+        free(results);
+    free(max_ages);
+    free(names);
 }
 
 
@@ -216,9 +1252,13 @@ int extract_command(char *string, int str_len, char **file_name)
 
     // if command is "GET: "
     if (strncmp("GET: ", string, 5) == 0) { 
-        // copy name from content string into file_name 
-        *file_name = get_substr(string, 5, str_len); // malloc'd!
-        return -1; 
+        // copy name (up to any optional fields) into file_name
+        int slash_ind = find_char(string, str_len, '\\');
+        if (slash_ind == 5)
+            return -1; // no file name, so command is invalid
+        *file_name = get_substr(string, 5, (slash_ind == -1) ? str_len
+                                                             : slash_ind);
+        return -1; // malloc'd!
     } 
     // if command is "PUT: "
     else if (strncmp("PUT: ", string, 5) == 0) {
@@ -253,6 +1293,84 @@ int extract_command(char *string, int str_len, char **file_name)
 }
 
 
+/* parse_command()
+ * @brief   parses a command string, like extract_command(), along with the
+ *          optional fields that may follow a PUT's MAX-AGE, or a GET's name
+ * @param   string  string to parse
+ * @param   str_len length of string to parse
+ * @param   cmd     struct to fill in with the command's content
+ * @returns         max age of file, if applicable, from command
+ * 
+ * @note    optional PUT fields: "\STALE: <sec>", the stale-while-revalidate
+ *          grace period; e.g. "PUT: a.txt\MAX-AGE: 60\STALE: 30"
+ * @note    optional GET fields: "\RANGE: <off>-<len>", the bytes to get,
+ *          from off; a missing len means the rest of the file. e.g.
+ *          "GET: a.txt\RANGE: 4096-1024". a malformed range makes the
+ *          command invalid
+ */ 
+int parse_command(char *string, int str_len, sim_cmd_t *cmd)
+{
+    cmd->stale = 0;
+    cmd->range.off = 0;
+    cmd->range.len = -1;
+    cmd->max_age = extract_command(string, str_len, &cmd->file_name);
+
+    if (cmd->file_name == NULL) {
+        cmd->max_age = -1;
+        return -1;
+    }
+
+    if (cmd->max_age != -1) { // PUT: look for optional fields
+        char *stale = strstr(string, "\\STALE: ");
+        if (stale != NULL)
+            cmd->stale = atoi(stale + 8);
+    }
+    else if (find_char(string, str_len, '\\') != -1) { // GET's fields
+        char *field = get_substr(string, find_char(string, str_len, '\\'),
+                                 str_len);
+        if (parse_range(field, &cmd->range) == -1) {
+            free(cmd->file_name);
+            cmd->file_name = NULL;
+        }
+        free(field);
+    }
+
+    return cmd->max_age;
+}
+
+
+/* parse_range()
+ * @brief   parses a GET's "\RANGE: <off>-<len>" field, or
+ *          "\RANGE: <off>-" for the rest of the file from off
+ * @param   field   the field, from its '\' to the end of the command
+ * @param   range   set to the range, if it's valid
+ * @returns 0, or -1 if field isn't a valid range
+ */
+static int parse_range(char *field, range_t *range)
+{
+    char *end = NULL;
+
+    if (strncmp(field, "\\RANGE: ", 8) != 0 || !isdigit(field[8]))
+        return -1;
+    long off = strtol(field + 8, &end, 10);
+    if (*end != '-' || off > INT32_MAX)
+        return -1;
+
+    long len = -1;
+    if (end[1] != '\0') {
+        if (!isdigit(end[1]))
+            return -1;
+        len = strtol(end + 1, &end, 10);
+        if (*end != '\0' || len > INT32_MAX)
+            return -1;
+    }
+
+    range->off = off;
+    range->len = len;
+    return 0;
+}
+
+
 /* get_substr
  * @brief   Given a C string, return the substring from [a, b)– starting
  *          at a, ending before b. 
@@ -297,42 +1415,3 @@ static inline int find_char(char *string, int str_len, char c)
     }
     return -1;
 }
-
-
-/* generate_output_name()
- * @brief   given a file named <file><optional extention>, return the name
- *          "<file>_output<optional extention>".
- * @param   name to output-ify
- * @returns new output name
- * @note    new output name is malloc'd and must be freed.
- */
-static inline char *generate_output_name(char *string)
-{
-    if (string == NULL)
-        return NULL;
-
-    int str_len = strlen(string);
-    int dot_ind = find_char(string, str_len, '.');
-    char *out = "_output";
-    int len_out = strlen(out);
-
-    // add extra character for null terminator
-    char *new_name = malloc(sizeof(char) * (str_len + len_out + 1));
-
-    if (dot_ind == -1 || dot_ind >= str_len) {
-        strncpy(new_name, string, str_len);
-        strncpy(new_name + str_len, out, len_out);
-        new_name[str_len + len_out] = '\0'; // set null terminator
-    }
-    else {
-        char *ext = get_substr(string, dot_ind, str_len);
-
-        strncpy(new_name, string, dot_ind); // copy over text before dot
-        strncat(new_name, out, strlen(out));
-        strncat(new_name, ext, strlen(ext));
-
-        free(ext);
-    }
-
-    return new_name;
-}
\ No newline at end of file
@@ -7,33 +7,124 @@
  * 
  */ 
 
+#ifndef SIM_CACHE_H
+#define SIM_CACHE_H
+
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 
 #include "cache.h"
 #include "file_sys.h"
+#include "spsc.h"
+#include "sink.h"
+#include "l0.h"
+
+// options for a sim run, set from the command line
+typedef struct sim_opts_t {
+    int admission; // gate new PUTs through a TinyLFU admission filter
+    int stats; // print the cache's hit / miss counters after the run
+    double filter_fp; // bloom filter false-positive target; 0 if off
+    int neg_ttl; // lifetime (sec) of negative entries; 0 if off
+    int neg_cap; // max negative entries, apart from the cache's capacity
+    int lazy; // PUT only stats files; data is read on the first GET
+    double ahead_fraction; // refresh-ahead point, as a fraction of max_age
+    double ahead_rate; // GETs / sec that make a file hot for refresh-ahead
+    int watch; // 0, or WATCH_INVALIDATE / WATCH_RELOAD for inotify watching
+    int pipeline; // replay in parser / executor / writer stages on 3 threads
+    int workers; // > 1: replay on this many threads, split by file name
+    int compare_serial; // with workers: report the hit ratio's distance
+                        // from serial_ratio
+    double serial_ratio; // hit ratio (%) of a serial replay of the same run
+    char *output; // sink spec for GET outputs (see open_sink); NULL: files
+    char *spill_dir; // directory for an on-disk L2 of evicted files; or NULL
+    int spill_mb; // L2 budget, in MB
+    char *snapshot; // snapshot file to warm from and save to; or NULL
+    int compress_kb; // keep files of at least this many KB compressed in
+                     // memory; 0 if off
+    double compress_ratio; // ...if they shrink by at least this factor
+    int chunk_kb; // store files bigger than this many KB in chunks of it,
+                  // read as GETs touch them; 0 if off
+    int chunk_mb; // most MB of chunks kept in memory
+    int dedup; // share one copy of the data of files with the same bytes
+    int direct_kb; // read files of at least this many KB with O_DIRECT,
+                   // bypassing the page cache; 0 if off
+    char *tcp; // server: "[host:]port" to listen on over TCP; or NULL
+    char *unix_path; // server: Unix socket path to listen on; or NULL
+    char *origin; // server: HTTP origin to proxy for ("[host:]port" or a
+                  // Unix socket path); NULL for the line protocol
+    int loops; // server: event loop threads (TCP: one socket each)
+    int l0_slots; // server: slots in each loop's L0 of hot files; 0 if off
+    char *shm_name; // server: shared-memory cache to use (see shm.h); or
+                    // NULL for a private one
+    int shm_mb; // server: MB of data in the shared-memory cache, if it's
+                // created
+    int verbose; // server: log the per-command messages to stdout
+} sim_opts_t;
+
+// values for sim_opts_t.watch
+#define WATCH_INVALIDATE 1 // drop cached files when their sources change
+#define WATCH_RELOAD 2 // revalidate cached files when their sources change
+
+// a parsed command line from the command file
+typedef struct sim_cmd_t {
+    char *file_name; // malloc'd name of file; NULL if command is invalid
+    int max_age; // PUT's MAX-AGE (sec); -1 for GET
+    int stale; // PUT's optional STALE: grace period (sec); 0 if not given
+    range_t range; // GET's optional RANGE: bytes to get; all by default
+} sim_cmd_t;
 
 // checks whether a string is a valid command and gets data from it
 int extract_command(char *string, int str_len, char **file_name);
 
+// like extract_command, but also parses optional fields into cmd
+int parse_command(char *string, int str_len, sim_cmd_t *cmd);
+
 // initiates sim by generating cache structure and opening command file
 C_T init_cache_sim(char *cmd_file_name, int cache_size, 
                    unsigned char **buffer);
 
 // runs caching sim, parsing the command file and running its commands
-int run_cache_sim(char *cmd_file_name, int cache_size);
+int run_cache_sim(char *cmd_file_name, int cache_size, sim_opts_t *opts);
 
 /*** CACHE COMMANDS ***/
 
-void put_cmd(C_T cache, char *file_name, int max_age); // performs PUT command
+// performs PUT command
+void put_cmd(C_T cache, char *file_name, int max_age, int stale);
 
 void get_cmd(C_T cache, char *file_name); // performs GET command
 
+// performs a run of GET commands as one batch, sending outputs to sink;
+// ranges may be NULL, to get whole files
+void get_many_cmd(C_T cache, char **file_names, range_t *ranges, int n,
+                  S_T sink);
+
+// runs a batch of GETs, pinning each hit's data for the caller to send
+void lookup_many_cmd(C_T cache, char **file_names, range_t *ranges, int n,
+                     payload_t **handles);
+
+// as lookup_many_cmd, answering what it can from the calling thread's L0
+void lookup_l0_cmd(C_T cache, L0_T l0, char **file_names, range_t *ranges,
+                   int n, payload_t **handles);
+
+// performs a run of PUT commands as one batch; outcomes may be NULL
+void put_many_cmd(C_T cache, sim_cmd_t *cmds, int n, int *outcomes);
+
 void evict(C_T cache, char *file_name);
 
 
 /*** CACHE HELPER FUNCS ***/
 
 // returns num of PUT files that have been retrieved (GET) at least once
-uint32_t num_retrieved();
\ No newline at end of file
+uint32_t num_retrieved();
+
+// applies the options of a run to a new cache of the given capacity
+C_T configure_cache(C_T cache, int cache_size, sim_opts_t *opts);
+
+// warms a cache from the snapshot at path, if there is one
+void restore_snapshot(C_T cache, char *path);
+
+// writes a snapshot of a cache to path
+void take_snapshot(C_T cache, char *path);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,472 @@
+/*
+ * SINK.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "sink.h"
+#include "file_sys.h"
+#include "lz.h"
+
+#define SINK_BUF (64 * 1024) // records smaller than this are gathered
+#define SINK_IOV 1024 // most iovecs per writev(), as Linux's IOV_MAX
+
+struct sink_t {
+    int kind;
+    int fd; // stream or pipe: where records go
+    FILE *pipe; // pipe to a command, from popen(); else NULL
+    pthread_mutex_t lock; // guards the buffer, fd, and counters
+
+    unsigned char *buf; // records not yet written
+    size_t used;
+
+    uint64_t outputs; // outputs taken
+    uint64_t bytes; // bytes of data in them
+    uint64_t failed; // outputs that couldn't be written
+};
+
+
+/*** STATIC HELPER FUNC DECLARATIONS ***/
+
+// writes every byte of iov[0..cnt), resuming after partial writes
+static int writev_all(int fd, struct iovec *iov, int cnt);
+
+// as flush_sink(), with the sink's lock held
+static int flush_locked(S_T sink);
+
+// stream_lz() callbacks: write a block to the fd at arg, or drop it
+static int write_block(void *arg, unsigned char *data, int len);
+static int drop_block(void *arg, unsigned char *data, int len);
+
+
+/* open_sink()
+ * @brief   opens the sink that spec names
+ * @param   spec: "files", "stream:<path>" (appends to path), "null",
+ *          "pipe" (stdout) or "pipe:<command>" (run with popen())
+ * @returns a struct sink_t pointer, or NULL if spec is unknown or its file
+ *          or command can't be opened
+ */
+S_T open_sink(char *spec)
+{
+    if (spec == NULL)
+        return NULL;
+
+    S_T sink = calloc(1, sizeof(struct sink_t));
+    sink->fd = -1;
+
+    if (strcmp(spec, "files") == 0) {
+        sink->kind = SINK_FILES;
+    }
+    else if (strcmp(spec, "null") == 0) {
+        sink->kind = SINK_NULL;
+    }
+    else if (strncmp(spec, "stream:", 7) == 0 && spec[7] != '\0') {
+        sink->kind = SINK_STREAM;
+        sink->fd = open(spec + 7, O_WRONLY | O_CREAT | O_APPEND,
+                        S_IRUSR | S_IWUSR);
+    }
+    else if (strcmp(spec, "pipe") == 0) {
+        sink->kind = SINK_PIPE;
+        sink->fd = STDOUT_FILENO;
+    }
+    else if (strncmp(spec, "pipe:", 5) == 0 && spec[5] != '\0') {
+        sink->kind = SINK_PIPE;
+        signal(SIGPIPE, SIG_IGN); // a command that exits early fails writes
+        fflush(stdout); // or the command may inherit unflushed messages
+        sink->pipe = popen(spec + 5, "w");
+        if (sink->pipe != NULL)
+            sink->fd = fileno(sink->pipe);
+    }
+    else {
+        free(sink);
+        return NULL;
+    }
+
+    if ((sink->kind == SINK_STREAM || sink->kind == SINK_PIPE)
+            && sink->fd == -1) {
+        free(sink);
+        return NULL;
+    }
+
+    if (sink->kind == SINK_STREAM || sink->kind == SINK_PIPE)
+        sink->buf = malloc(SINK_BUF);
+    pthread_mutex_init(&sink->lock, NULL);
+
+    return sink;
+}
+
+
+/* close_sink()
+ * @brief   writes out any buffered records, closes the sink's file (or
+ *          waits for its command to exit), and frees the sink
+ * @param   sink: a struct sink_t pointer; NULL does nothing
+ * @returns 0, or -1 if buffered records couldn't be written
+ */
+int close_sink(S_T sink)
+{
+    if (sink == NULL)
+        return 0;
+
+    int result = flush_sink(sink);
+
+    if (sink->pipe != NULL)
+        pclose(sink->pipe);
+    else if (sink->kind == SINK_STREAM)
+        close(sink->fd);
+
+    pthread_mutex_destroy(&sink->lock);
+    free(sink->buf);
+    free(sink);
+
+    return result;
+}
+
+
+/* write_sink()
+ * @brief   sends the data of one GET to the sink
+ * @param   sink: a struct sink_t pointer; NULL writes the output file, as
+ *          a "files" sink does
+ * @param   file_name: name of the file that was retrieved
+ * @param   data, len: its data
+ * @returns 0, or -1 if the output couldn't be written
+ * @note    stream and pipe sinks copy small records into their buffer;
+ *          a record that doesn't fit goes out at once, in one writev()
+ *          along with the buffer, without being copied
+ */
+int write_sink(S_T sink, char *file_name, unsigned char *data, int len)
+{
+    if (data == NULL || len < 0)
+        return -1;
+
+    struct iovec iov = { data, len };
+    return writev_sink(sink, file_name, 0, &iov, 1);
+}
+
+
+/* writev_sink()
+ * @brief   sends the data of one GET to the sink, as write_sink() does,
+ *          from pieces in iov[0..cnt) (e.g. the chunks of a range GET)
+ * @param   sink: a struct sink_t pointer; NULL acts as a "files" sink
+ * @param   file_name: name of the file that was retrieved
+ * @param   off: offset of the data in the file. a "files" sink writes it
+ *          at off in the output file, so the ranges of a file build it up;
+ *          a record holds just the data, whatever off is
+ * @param   iov, cnt: the data; iov may be changed
+ * @returns 0, or -1 if the output couldn't be written
+ */
+int writev_sink(S_T sink, char *file_name, off_t off, struct iovec *iov,
+                int cnt)
+{
+    if (file_name == NULL || iov == NULL || cnt < 0 || off < 0)
+        return -1;
+
+    size_t len = 0;
+    int i;
+    for (i = 0; i < cnt; i++)
+        len += iov[i].iov_len;
+
+    int result = 0;
+
+    if (sink == NULL || sink->kind == SINK_FILES) {
+        char *out_name = output_name_sink(file_name); // malloc'd
+        int fd = open(out_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+        free(out_name);
+
+        result = -1;
+        if (fd != -1) {
+            if (lseek(fd, off, SEEK_SET) == off)
+                result = writev_all(fd, iov, cnt);
+            close(fd);
+        }
+
+        if (sink != NULL) {
+            pthread_mutex_lock(&sink->lock);
+            sink->outputs++;
+            sink->bytes += len;
+            sink->failed += (result == -1);
+            pthread_mutex_unlock(&sink->lock);
+        }
+        return result;
+    }
+
+    pthread_mutex_lock(&sink->lock);
+    sink->outputs++;
+    sink->bytes += len;
+
+    if (sink->kind == SINK_NULL) {
+        pthread_mutex_unlock(&sink->lock);
+        return 0;
+    }
+
+    sink_record_t header = { strlen(file_name), len };
+    size_t record = sizeof(header) + header.name_len + len;
+
+    if (record <= SINK_BUF - sink->used) {
+        unsigned char *at = sink->buf + sink->used;
+        memcpy(at, &header, sizeof(header));
+        memcpy(at + sizeof(header), file_name, header.name_len);
+        at += sizeof(header) + header.name_len;
+        for (i = 0; i < cnt; i++) {
+            memcpy(at, iov[i].iov_base, iov[i].iov_len);
+            at += iov[i].iov_len;
+        }
+        sink->used += record;
+    }
+    else {
+        struct iovec *all = malloc((3 + cnt) * sizeof(struct iovec));
+        all[0] = (struct iovec){ sink->buf, sink->used };
+        all[1] = (struct iovec){ &header, sizeof(header) };
+        all[2] = (struct iovec){ file_name, header.name_len };
+        memcpy(all + 3, iov, cnt * sizeof(struct iovec));
+        result = writev_all(sink->fd, all, 3 + cnt);
+        sink->used = 0;
+        free(all);
+    }
+
+    sink->failed += (result == -1);
+    pthread_mutex_unlock(&sink->lock);
+    return result;
+}
+
+
+/* write_packed_sink()
+ * @brief   sends the data of one GET to the sink, as write_sink() does,
+ *          from data the cache keeps compressed: it's unpacked on the way,
+ *          without a copy of the whole file
+ * @param   sink: a struct sink_t pointer; NULL acts as a "files" sink
+ * @param   file_name: name of the file that was retrieved
+ * @param   packed, packed_len: its compressed data (see lz.h)
+ * @param   len: the length of its data
+ * @returns 0, or -1 if the output couldn't be written (or the data was
+ *          damaged)
+ * @note    a record that fits in a stream or pipe sink's buffer is
+ *          unpacked straight into it; otherwise, each block goes out as
+ *          it's unpacked. a null sink unpacks the data too, so that it
+ *          still measures the cost of producing every output
+ */
+int write_packed_sink(S_T sink, char *file_name, unsigned char *packed,
+                      int packed_len, int len)
+{
+    if (file_name == NULL || packed == NULL || len < 0)
+        return -1;
+
+    int result;
+
+    if (sink == NULL || sink->kind == SINK_FILES) {
+        char *out_name = output_name_sink(file_name); // malloc'd
+        int fd = open(out_name, O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+        free(out_name);
+
+        result = -1;
+        if (fd != -1) {
+            result = stream_lz(packed, packed_len, len, write_block, &fd);
+            close(fd);
+        }
+
+        if (sink != NULL) {
+            pthread_mutex_lock(&sink->lock);
+            sink->outputs++;
+            sink->bytes += len;
+            sink->failed += (result == -1);
+            pthread_mutex_unlock(&sink->lock);
+        }
+        return result;
+    }
+
+    if (sink->kind == SINK_NULL) {
+        result = stream_lz(packed, packed_len, len, drop_block, NULL);
+
+        pthread_mutex_lock(&sink->lock);
+        sink->outputs++;
+        sink->bytes += len;
+        sink->failed += (result == -1);
+        pthread_mutex_unlock(&sink->lock);
+        return result;
+    }
+
+    pthread_mutex_lock(&sink->lock);
+    sink->outputs++;
+    sink->bytes += len;
+
+    sink_record_t header = { strlen(file_name), len };
+    size_t record = sizeof(header) + header.name_len + len;
+
+    if (record <= SINK_BUF - sink->used) {
+        unsigned char *at = sink->buf + sink->used;
+        result = unpack_lz(packed, packed_len,
+                           at + sizeof(header) + header.name_len, len);
+        if (result == 0) {
+            memcpy(at, &header, sizeof(header));
+            memcpy(at + sizeof(header), file_name, header.name_len);
+            sink->used += record;
+        }
+    }
+    else {
+        struct iovec iov[3] = {
+            { sink->buf, sink->used },
+            { &header, sizeof(header) },
+            { file_name, header.name_len }
+        };
+        result = writev_all(sink->fd, iov, 3);
+        sink->used = 0;
+        if (result == 0)
+            result = stream_lz(packed, packed_len, len, write_block,
+                               &sink->fd);
+    }
+
+    sink->failed += (result == -1);
+    pthread_mutex_unlock(&sink->lock);
+    return result;
+}
+
+
+/* flush_sink()
+ * @brief   writes out a stream or pipe sink's buffered records
+ * @param   sink: a struct sink_t pointer
+ * @returns 0, or -1 if the write failed (the records are dropped)
+ */
+int flush_sink(S_T sink)
+{
+    if (sink == NULL)
+        return 0;
+
+    pthread_mutex_lock(&sink->lock);
+    int result = flush_locked(sink);
+    pthread_mutex_unlock(&sink->lock);
+
+    return result;
+}
+
+
+/* print_stats_sink()
+ * @brief   prints a sink's counters, in the style of print_stats_cache()
+ * @param   sink: a struct sink_t pointer
+ */
+void print_stats_sink(S_T sink)
+{
+    if (sink == NULL)
+        return;
+
+    static const char *kinds[] = { "files", "stream", "null", "pipe" };
+
+    // a pipe sink to stdout owns it: stats mustn't land in its records
+    FILE *out = (sink->kind == SINK_PIPE && sink->pipe == NULL) ? stderr
+                                                                : stdout;
+
+    pthread_mutex_lock(&sink->lock);
+    fprintf(out, "STATS: %lu outputs (%lu bytes) to %s sink, %lu failed\n",
+            sink->outputs, sink->bytes, kinds[sink->kind], sink->failed);
+    pthread_mutex_unlock(&sink->lock);
+}
+
+
+/* output_name_sink()
+ * @brief   given a file named <file><optional extention>, return the name
+ *          "<file>_output<optional extention>"; the extention starts at
+ *          the first '.'
+ * @param   file_name: name to output-ify
+ * @returns new output name
+ * @note    new output name is malloc'd and must be freed.
+ */
+char *output_name_sink(char *file_name)
+{
+    if (file_name == NULL)
+        return NULL;
+
+    char *out = "_output";
+    size_t str_len = strlen(file_name);
+    size_t len_out = strlen(out);
+    char *dot = strchr(file_name, '.');
+    size_t stem = (dot == NULL) ? str_len : (size_t)(dot - file_name);
+
+    // add extra character for null terminator
+    char *new_name = malloc(str_len + len_out + 1);
+
+    memcpy(new_name, file_name, stem);
+    memcpy(new_name + stem, out, len_out);
+    memcpy(new_name + stem + len_out, file_name + stem, str_len - stem);
+    new_name[str_len + len_out] = '\0';
+
+    return new_name;
+}
+
+
+/*** STATIC HELPER FUNCTIONS ***/
+
+
+/* flush_locked()
+ * @brief   writes out a sink's buffered records; the caller holds its lock
+ */
+static int flush_locked(S_T sink)
+{
+    if (sink->used == 0)
+        return 0;
+
+    struct iovec iov = { sink->buf, sink->used };
+    int result = writev_all(sink->fd, &iov, 1);
+    sink->used = 0;
+
+    return result;
+}
+
+
+/* writev_all()
+ * @brief   writev(), repeated until every byte is written
+ * @returns 0, or -1 if a write fails
+ * @note    iov is advanced in place
+ */
+static int writev_all(int fd, struct iovec *iov, int cnt)
+{
+    while (cnt > 0) {
+        ssize_t n = writev(fd, iov, (cnt < SINK_IOV) ? cnt : SINK_IOV);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        // skip past what was written, including any emptied iovecs
+        while (cnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+
+    return 0;
+}
+
+
+/* write_block()
+ * @brief   stream_lz() callback: writes a block of data to the fd at arg
+ */
+static int write_block(void *arg, unsigned char *data, int len)
+{
+    struct iovec iov = { data, len };
+    return writev_all(*(int *)arg, &iov, 1);
+}
+
+
+/* drop_block()
+ * @brief   stream_lz() callback for a null sink: drops a block of data
+ */
+static int drop_block(void *arg, unsigned char *data, int len)
+{
+    (void)arg;
+    (void)data;
+    (void)len;
+    return 0;
+}
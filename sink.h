@@ -0,0 +1,78 @@
+/*
+ * SINK.H
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * Output sinks: where the data of each GET goes. The default writes (or
+ * overwrites) one "<name>_output<ext>" file per GET. The others send every
+ * output to one place, as records of
+ *
+ *      uint32_t name_len, uint32_t data_len, name bytes, data bytes
+ *
+ * (native byte order, no terminators), or drop them altogether. Records are
+ * gathered in a buffer and written with writev(), and any sink may be
+ * shared by several threads. Data kept compressed by the cache is unpacked
+ * on its way out, a block at a time, or straight into the buffer. The
+ * output of a range GET is written at its offset in the output file, or as
+ * a record of just the range's bytes.
+ *
+ * A "pipe" sink to stdout owns it: the replay's messages and stats go to
+ * stderr instead (see configure_cache), so the records can be parsed.
+ *
+ */
+
+#ifndef SINK_H
+#define SINK_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+typedef struct sink_t *S_T;
+
+// kinds of sinks
+#define SINK_FILES 0 // one <name>_output<ext> file per GET (the default)
+#define SINK_STREAM 1 // records appended to one file
+#define SINK_NULL 2 // outputs are counted, then dropped
+#define SINK_PIPE 3 // records piped into a command, or written to stdout
+
+// header of each record in a stream or pipe sink
+typedef struct sink_record_t {
+    uint32_t name_len; // bytes of name that follow
+    uint32_t data_len; // bytes of data after the name
+} sink_record_t;
+
+// opens a sink from a spec: "files", "stream:<path>", "null", "pipe" (to
+// stdout) or "pipe:<command>"; NULL if the spec or its target is invalid
+S_T open_sink(char *spec);
+
+// flushes and closes a sink; returns 0, or -1 if buffered records were lost
+int close_sink(S_T sink);
+
+// sends one GET's output; a NULL sink acts as a "files" sink
+int write_sink(S_T sink, char *file_name, unsigned char *data, int len);
+
+// as write_sink, from the pieces of data at off in the file (e.g. a range)
+int writev_sink(S_T sink, char *file_name, off_t off, struct iovec *iov,
+                int cnt);
+
+// as write_sink, from compressed data (see lz.h), unpacked as it's written
+int write_packed_sink(S_T sink, char *file_name, unsigned char *packed,
+                      int packed_len, int len);
+
+// writes out any buffered records; returns 0, or -1 on a failed write
+int flush_sink(S_T sink);
+
+// prints how many outputs (and bytes) a sink has taken
+void print_stats_sink(S_T sink);
+
+// returns "<file>_output<ext>" for "<file><ext>"; malloc'd
+char *output_name_sink(char *file_name);
+
+#endif
@@ -0,0 +1,315 @@
+/*
+ * SNAPSHOT.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/mman.h>
+
+#include "snapshot.h"
+#include "hash.h"
+
+#define SNAP_WRITE_BUF (1024 * 1024) // stdio buffer for writing snapshots
+
+struct snapshot_t {
+    // writing
+    FILE *fp; // "<path>.tmp", until it's committed; NULL when reading
+    char *path; // malloc'd final path
+    char *tmp_path; // malloc'd "<path>.tmp"
+    int failed; // 1 once a write has failed
+
+    // reading
+    unsigned char *map; // the mapped snapshot
+    size_t size; // its length
+    size_t pos; // offset of the next record
+    int truncated; // 1 if reading stopped at a bad record
+};
+
+
+/*** STATIC HELPER FUNC DECLARATIONS ***/
+
+// returns the checksum of a record (with check zeroed) and its name
+static uint64_t record_check(snapshot_record_t *rec, char *file_name);
+
+
+/* create_snapshot()
+ * @brief   starts a new snapshot, written to "<path>.tmp" so that a
+ *          snapshot already at path stays whole until this one replaces it
+ * @param   path: where the snapshot goes once committed
+ * @param   policy, len: the admission policy's saved state; NULL and 0 if
+ *          there's none
+ * @returns a struct snapshot_t pointer, or NULL if the file can't be made
+ */
+SNAP_T create_snapshot(char *path, unsigned char *policy, uint32_t len)
+{
+    if (path == NULL)
+        return NULL;
+
+    SNAP_T snap = calloc(1, sizeof(struct snapshot_t));
+    snap->path = strdup(path);
+    snap->tmp_path = malloc(strlen(path) + 5);
+    sprintf(snap->tmp_path, "%s.tmp", path);
+
+    snap->fp = fopen(snap->tmp_path, "w");
+    if (snap->fp == NULL) {
+        free(snap->tmp_path);
+        free(snap->path);
+        free(snap);
+        return NULL;
+    }
+    setvbuf(snap->fp, NULL, _IOFBF, SNAP_WRITE_BUF);
+
+    snapshot_header_t header = { SNAPSHOT_MAGIC, (policy == NULL) ? 0 : len,
+                                 0 };
+    if (fwrite(&header, sizeof(header), 1, snap->fp) != 1
+            || (header.policy_len > 0
+                && fwrite(policy, len, 1, snap->fp) != 1))
+        snap->failed = 1;
+
+    return snap;
+}
+
+
+/* add_snapshot()
+ * @brief   appends a file's record, name and data to a snapshot
+ * @param   snap: a snapshot from create_snapshot()
+ * @param   file_name: name of the file
+ * @param   entry: what the cache knows about it; data is copied out
+ * @returns 0, or -1 if the write failed (the snapshot won't commit)
+ */
+int add_snapshot(SNAP_T snap, char *file_name, snapshot_entry_t *entry)
+{
+    if (snap == NULL || snap->fp == NULL || file_name == NULL
+            || entry == NULL)
+        return -1;
+
+    int len = (entry->data == NULL) ? -1 : entry->len;
+    snapshot_record_t rec = {
+        strlen(file_name) + 1, len, entry->max_age, entry->stale,
+        entry->expires_in, entry->idle, entry->meta.size, entry->meta.mtime,
+        entry->meta.mtime_nsec, entry->meta.ino, 0
+    };
+    rec.check = record_check(&rec, file_name);
+
+    if (fwrite(&rec, sizeof(rec), 1, snap->fp) != 1
+            || fwrite(file_name, rec.name_len, 1, snap->fp) != 1
+            || (len > 0 && fwrite(entry->data, len, 1, snap->fp) != 1))
+        snap->failed = 1;
+
+    return snap->failed ? -1 : 0;
+}
+
+
+/* commit_snapshot()
+ * @brief   finishes a snapshot: flushes and syncs it, then renames it over
+ *          its final path, and frees snap
+ * @param   snap: a snapshot from create_snapshot()
+ * @returns 0, or -1 if any write failed (the partial file is removed, and
+ *          any older snapshot at path is left alone)
+ */
+int commit_snapshot(SNAP_T snap)
+{
+    if (snap == NULL || snap->fp == NULL)
+        return -1;
+
+    if (fflush(snap->fp) != 0 || fsync(fileno(snap->fp)) != 0)
+        snap->failed = 1;
+    if (fclose(snap->fp) != 0)
+        snap->failed = 1;
+    snap->fp = NULL;
+
+    int result = 0;
+    if (snap->failed || rename(snap->tmp_path, snap->path) != 0) {
+        unlink(snap->tmp_path);
+        result = -1;
+    }
+
+    free(snap->tmp_path);
+    free(snap->path);
+    free(snap);
+
+    return result;
+}
+
+
+/* open_snapshot()
+ * @brief   maps a snapshot file for reading
+ * @param   path: the snapshot's path
+ * @returns a struct snapshot_t pointer, or NULL if the file is missing, or
+ *          too short (or wrong) to have a snapshot header
+ */
+SNAP_T open_snapshot(char *path)
+{
+    if (path == NULL)
+        return NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1
+            || (size_t)st.st_size < sizeof(snapshot_header_t)) {
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file open
+    if (map == MAP_FAILED)
+        return NULL;
+
+    snapshot_header_t header;
+    memcpy(&header, map, sizeof(header));
+    if (header.magic != SNAPSHOT_MAGIC
+            || header.policy_len > st.st_size - sizeof(header)) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    // records are read once, front to back
+    madvise(map, st.st_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+    SNAP_T snap = calloc(1, sizeof(struct snapshot_t));
+    snap->map = map;
+    snap->size = st.st_size;
+    snap->pos = sizeof(header) + header.policy_len;
+
+    return snap;
+}
+
+
+/* policy_of_snapshot()
+ * @brief   finds the admission policy's state in a mapped snapshot
+ * @param   snap: a snapshot from open_snapshot()
+ * @param   len: set to the state's length
+ * @returns the state (inside the mapping), or NULL if there's none
+ */
+unsigned char *policy_of_snapshot(SNAP_T snap, uint32_t *len)
+{
+    *len = 0;
+    if (snap == NULL || snap->map == NULL)
+        return NULL;
+
+    memcpy(len, snap->map + offsetof(snapshot_header_t, policy_len),
+           sizeof(uint32_t));
+
+    return (*len > 0) ? snap->map + sizeof(snapshot_header_t) : NULL;
+}
+
+
+/* next_snapshot()
+ * @brief   reads the next file from a mapped snapshot
+ * @param   snap: a snapshot from open_snapshot()
+ * @param   file_name: set to the file's name (inside the mapping)
+ * @param   entry: filled in; its data points inside the mapping, and is
+ *          only valid until close_snapshot()
+ * @returns 1 if a file was read; 0 at the end of the snapshot, or at a
+ *          record that's cut short, or whose checksum doesn't match (see
+ *          truncated_snapshot)
+ * @note    the checksum covers the record and name, not the data: data
+ *          lengths are checked against the file, and the cache checks each
+ *          source's metadata anyway
+ */
+int next_snapshot(SNAP_T snap, char **file_name, snapshot_entry_t *entry)
+{
+    if (snap == NULL || snap->map == NULL || snap->truncated
+            || snap->pos == snap->size)
+        return 0;
+
+    size_t left = snap->size - snap->pos;
+    snapshot_record_t rec;
+
+    if (left < sizeof(rec)) {
+        snap->truncated = 1;
+        return 0;
+    }
+    memcpy(&rec, snap->map + snap->pos, sizeof(rec));
+    left -= sizeof(rec);
+
+    char *name = (char *)snap->map + snap->pos + sizeof(rec);
+    size_t data_len = (rec.data_len > 0) ? (size_t)rec.data_len : 0;
+
+    if (rec.name_len == 0 || rec.name_len > left || rec.data_len < -1
+            || data_len > left - rec.name_len
+            || name[rec.name_len - 1] != '\0') {
+        snap->truncated = 1;
+        return 0;
+    }
+
+    uint64_t check = rec.check;
+    rec.check = 0;
+    if (record_check(&rec, name) != check) {
+        snap->truncated = 1;
+        return 0;
+    }
+
+    *file_name = name;
+    entry->data = (rec.data_len == -1) ? NULL
+                  : (unsigned char *)name + rec.name_len;
+    entry->len = rec.data_len;
+    entry->max_age = rec.max_age;
+    entry->stale = rec.stale;
+    entry->expires_in = rec.expires_in;
+    entry->idle = rec.idle;
+    entry->meta.size = rec.size;
+    entry->meta.mtime = rec.mtime;
+    entry->meta.mtime_nsec = rec.mtime_nsec;
+    entry->meta.ino = rec.ino;
+
+    snap->pos += sizeof(rec) + rec.name_len + data_len;
+    return 1;
+}
+
+
+/* truncated_snapshot()
+ * @brief   tells whether a snapshot ended early
+ * @param   snap: a snapshot from open_snapshot()
+ * @returns 1 if next_snapshot() stopped at a bad record, rather than at the
+ *          end of the file
+ */
+int truncated_snapshot(SNAP_T snap)
+{
+    return (snap != NULL) ? snap->truncated : 0;
+}
+
+
+/* close_snapshot()
+ * @brief   unmaps a snapshot that was read, or abandons (and removes) one
+ *          that was being written, and frees snap
+ * @param   snap: a struct snapshot_t pointer; NULL does nothing
+ */
+void close_snapshot(SNAP_T snap)
+{
+    if (snap == NULL)
+        return;
+
+    if (snap->fp != NULL) {
+        fclose(snap->fp);
+        unlink(snap->tmp_path);
+    }
+    if (snap->map != NULL)
+        munmap(snap->map, snap->size);
+
+    free(snap->tmp_path);
+    free(snap->path);
+    free(snap);
+}
+
+
+/*** STATIC HELPER FUNCTIONS ***/
+
+
+/* record_check()
+ * @brief   checksums a record, whose check field is 0, along with its name
+ */
+static uint64_t record_check(snapshot_record_t *rec, char *file_name)
+{
+    return hash_bytes(rec, sizeof(*rec))
+           ^ (hash_bytes(file_name, rec->name_len) * 0x9e3779b97f4a7c15ULL);
+}
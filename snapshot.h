@@ -0,0 +1,94 @@
+/*
+ * SNAPSHOT.H
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * Cache snapshots: one file holding every cached file's name, metadata and
+ * data, in cache order, plus the admission policy's state. A snapshot is
+ * written to "<path>.tmp" and renamed over path once it's complete, and
+ * read back through mmap(). It's laid out as
+ *
+ *      snapshot_header_t, policy_len bytes of policy state,
+ *      then per file: snapshot_record_t, name (with its '\0'), data
+ *
+ * in native byte order. Each record carries a checksum, so a snapshot that
+ * was cut short (or damaged) is read up to its last whole record.
+ *
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "file_sys.h"
+
+typedef struct snapshot_t *SNAP_T;
+
+#define SNAPSHOT_MAGIC 0x31504e5330414cULL // "LA0SNP1", little-endian
+
+// start of every snapshot file
+typedef struct snapshot_header_t {
+    uint64_t magic; // SNAPSHOT_MAGIC
+    uint32_t policy_len; // bytes of policy state that follow; 0 for none
+    uint32_t pad;
+} snapshot_header_t;
+
+// written ahead of each file's name and data
+typedef struct snapshot_record_t {
+    uint32_t name_len; // bytes of name that follow, including its '\0'
+    int32_t data_len; // bytes of data after the name; -1 if not loaded
+    int32_t max_age; // MAX-AGE the file was cached with (sec)
+    int32_t stale; // its stale-while-revalidate grace period (sec)
+    int64_t expires_in; // ticks it had left to live; <= 0 if expired
+    int64_t idle; // ticks since its last GET; -1 if it had none
+    int64_t size; // source file's metadata when it was read
+    int64_t mtime;
+    int64_t mtime_nsec;
+    uint64_t ino;
+    uint64_t check; // hash of the rest of the record and the name (not
+                    // the data; see next_snapshot())
+} snapshot_record_t;
+
+// a file in a snapshot
+typedef struct snapshot_entry_t {
+    unsigned char *data; // file data; NULL if not loaded. when read back,
+                         // it points into the mapped snapshot
+    int len; // length of data; -1 if not loaded (the source's size is in
+             // meta.size)
+    int max_age;
+    int stale;
+    int64_t expires_in; // ticks left before expiration (see record)
+    int64_t idle; // ticks since the last GET; -1 if never retrieved
+    file_meta_t meta;
+} snapshot_entry_t;
+
+// starts writing a snapshot to "<path>.tmp"; NULL if it can't be created
+SNAP_T create_snapshot(char *path, unsigned char *policy, uint32_t len);
+
+// appends a file to a snapshot being written; returns 0, or -1
+int add_snapshot(SNAP_T snap, char *file_name, snapshot_entry_t *entry);
+
+// syncs a written snapshot and renames it over path; returns 0, or -1
+int commit_snapshot(SNAP_T snap);
+
+// maps a snapshot for reading; NULL if it's missing or isn't a snapshot
+SNAP_T open_snapshot(char *path);
+
+// returns the policy state stored in a mapped snapshot, and its length
+unsigned char *policy_of_snapshot(SNAP_T snap, uint32_t *len);
+
+// reads the next file; returns 1, or 0 at the end (or a damaged record)
+int next_snapshot(SNAP_T snap, char **file_name, snapshot_entry_t *entry);
+
+// returns 1 if reading stopped at a record that was cut short or damaged
+int truncated_snapshot(SNAP_T snap);
+
+// unmaps a snapshot being read, or abandons one being written
+void close_snapshot(SNAP_T snap);
+
+#endif
@@ -0,0 +1,473 @@
+/*
+ * SPILL.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ */
+
+#include <stdio.h>
+#include <sys/uio.h>
+
+#include "spill.h"
+#include "hash.h"
+
+#define SEG_MIN (64 * 1024) // smallest segment file, in bytes
+#define SEG_PER_BUDGET 8 // the budget is split into this many segments
+#define SPILL_BUCKETS 256 // initial index buckets; doubles as it fills
+
+/*** SEGMENT RECORD ***/
+// written ahead of each spilled file: its name, then its data, follow
+typedef struct spill_record_t {
+    uint32_t name_len;
+    uint32_t data_len;
+} spill_record_t;
+
+/*** INDEX ENTRY ***/
+typedef struct spill_item_t {
+    char *name; // malloc'd name of the spilled file
+    uint64_t hash; // hash_bytes() of name
+    uint64_t seg; // number of the segment holding it
+    off_t offset; // offset of its data within the segment
+    spill_entry_t entry; // len, max_age, expiration, meta (data is NULL)
+    struct spill_item_t *chain; // next entry in the same bucket
+} *spill_item_t;
+
+/*** SEGMENT FILE ***/
+typedef struct segment_t {
+    uint64_t num; // segment number; its file is "<num>.seg"
+    int fd;
+    uint64_t bytes; // bytes written to it
+    int live; // records in it not yet taken or dropped
+} segment_t;
+
+struct spill_t {
+    char *dir; // private directory holding the segments
+    uint64_t budget; // max bytes across every segment
+    uint64_t seg_bytes; // size at which a segment is sealed
+    uint64_t total; // bytes across every segment
+
+    segment_t *segs; // oldest first; the last is the one being appended
+    int n_segs;
+    int max_segs;
+    uint64_t next_num; // number of the next new segment
+
+    spill_item_t *index; // hash buckets of entries
+    uint64_t index_mask; // number of buckets - 1
+    uint64_t count; // entries in the index
+
+    spill_stats_t stats;
+};
+
+
+/*** STATIC HELPER FUNC DECLARATIONS ***/
+
+// finds file_name's entry; sets *link to the pointer that points to it
+static spill_item_t find_item(D_T spill, char *file_name,
+                              spill_item_t **link);
+
+// returns the segment numbered num, or NULL if it's been deleted
+static segment_t *find_segment(D_T spill, uint64_t num);
+
+// opens a new, empty segment to append to
+static segment_t *open_segment(D_T spill);
+
+// deletes the segment at position i, dropping (and counting) its entries
+static void remove_segment(D_T spill, int i, int lost);
+
+// unlinks and frees an entry, and marks its record dead
+static void forget_item(D_T spill, spill_item_t *link);
+
+// unlinks and frees an entry, leaving its segment as it is
+static uint64_t free_item(D_T spill, spill_item_t *link);
+
+// doubles the number of index buckets
+static void grow_index(D_T spill);
+
+// returns the path of segment num (malloc'd)
+static char *segment_path(D_T spill, uint64_t num);
+
+
+/* create_spill()
+ * @brief   creates an empty store, in a new directory under dir
+ * @param   dir: directory to keep the store in; created if missing
+ * @param   budget: max bytes of segment files (at least 64 KB is used)
+ * @returns a struct spill_t pointer, or NULL if its directory can't be made
+ */
+D_T create_spill(char *dir, uint64_t budget)
+{
+    if (dir == NULL)
+        return NULL;
+
+    mkdir(dir, S_IRWXU); // fine if it already exists
+
+    char *path = malloc(strlen(dir) + 16);
+    sprintf(path, "%s/l2.XXXXXX", dir);
+    if (mkdtemp(path) == NULL) {
+        free(path);
+        return NULL;
+    }
+
+    D_T spill = calloc(1, sizeof(struct spill_t));
+    spill->dir = path;
+
+    spill->seg_bytes = budget / SEG_PER_BUDGET;
+    if (spill->seg_bytes < SEG_MIN)
+        spill->seg_bytes = SEG_MIN;
+    spill->budget = (budget < spill->seg_bytes) ? spill->seg_bytes : budget;
+
+    // oversized files take a segment each, so leave room for a few more
+    spill->max_segs = spill->budget / spill->seg_bytes + 2;
+    spill->segs = malloc(spill->max_segs * sizeof(segment_t));
+
+    spill->index = calloc(SPILL_BUCKETS, sizeof(spill_item_t));
+    spill->index_mask = SPILL_BUCKETS - 1;
+
+    return spill;
+}
+
+
+/* free_spill()
+ * @brief   deletes every segment and the store's directory, and frees it
+ * @param   spill: a struct spill_t pointer
+ */
+void free_spill(D_T spill)
+{
+    if (spill == NULL)
+        return;
+
+    while (spill->n_segs > 0)
+        remove_segment(spill, 0, 0);
+
+    rmdir(spill->dir);
+    free(spill->dir);
+    free(spill->segs);
+    free(spill->index);
+    free(spill);
+}
+
+
+/* put_spill()
+ * @brief   appends a copy of a file to the store, replacing any copy it
+ *          already holds
+ * @param   spill: a struct spill_t pointer
+ * @param   file_name: name of the file; copied
+ * @param   entry: the file's data and cache state; data is only read
+ * @returns 0 if spilled; -1 if it's bigger than the budget, or the write
+ *          failed
+ * @note    recycles the oldest segments until the file fits the budget
+ */
+int put_spill(D_T spill, char *file_name, spill_entry_t *entry)
+{
+    if (spill == NULL || file_name == NULL || entry->data == NULL)
+        return -1;
+
+    drop_spill(spill, file_name);
+
+    spill_record_t record = { strlen(file_name), entry->len };
+    uint64_t bytes = sizeof(record) + record.name_len + record.data_len;
+
+    if (bytes > spill->budget) {
+        spill->stats.too_big++;
+        return -1;
+    }
+
+    segment_t *seg = NULL;
+    if (spill->n_segs > 0)
+        seg = &spill->segs[spill->n_segs - 1];
+
+    // seal a full segment (an oversized record gets one of its own)
+    if (seg == NULL
+            || (seg->bytes > 0 && seg->bytes + bytes > spill->seg_bytes)) {
+        if (spill->n_segs == spill->max_segs)
+            remove_segment(spill, 0, 1);
+        seg = open_segment(spill);
+        if (seg == NULL)
+            return -1;
+    }
+
+    while (spill->total + bytes > spill->budget && spill->n_segs > 1)
+        remove_segment(spill, 0, 1);
+    seg = &spill->segs[spill->n_segs - 1];
+
+    struct iovec iov[3] = {
+        { &record, sizeof(record) },
+        { file_name, record.name_len },
+        { entry->data, record.data_len }
+    };
+    ssize_t written = pwritev(seg->fd, iov, 3, seg->bytes);
+    if (written != (ssize_t)bytes)
+        return -1;
+
+    spill_item_t item = malloc(sizeof(struct spill_item_t));
+    item->name = strdup(file_name);
+    item->hash = hash_bytes(file_name, record.name_len);
+    item->seg = seg->num;
+    item->offset = seg->bytes + sizeof(record) + record.name_len;
+    item->entry = *entry;
+    item->entry.data = NULL;
+
+    spill_item_t *bucket = &spill->index[item->hash & spill->index_mask];
+    item->chain = *bucket;
+    *bucket = item;
+    spill->count++;
+
+    seg->bytes += bytes;
+    seg->live++;
+    spill->total += bytes;
+    spill->stats.spilled++;
+    spill->stats.spilled_bytes += entry->len;
+
+    if (spill->count > 2 * (spill->index_mask + 1))
+        grow_index(spill);
+
+    return 0;
+}
+
+
+/* take_spill()
+ * @brief   reads a file back out of the store, and forgets it there
+ * @param   spill: a struct spill_t pointer
+ * @param   file_name: name of the file
+ * @param   entry: filled in with the file's cache state, and its data in a
+ *          malloc'd buffer owned by the caller
+ * @returns 1 if the file was found and read; 0 if not (a copy that can't be
+ *          read back is dropped)
+ */
+int take_spill(D_T spill, char *file_name, spill_entry_t *entry)
+{
+    spill_item_t *link = NULL;
+    spill_item_t item = find_item(spill, file_name, &link);
+    if (item == NULL)
+        return 0;
+
+    segment_t *seg = find_segment(spill, item->seg);
+    unsigned char *data = malloc(item->entry.len > 0 ? item->entry.len : 1);
+
+    if (seg == NULL || pread(seg->fd, data, item->entry.len, item->offset)
+            != item->entry.len) {
+        free(data);
+        forget_item(spill, link);
+        return 0;
+    }
+
+    *entry = item->entry;
+    entry->data = data;
+    spill->stats.taken++;
+    spill->stats.taken_bytes += entry->len;
+
+    forget_item(spill, link);
+    return 1;
+}
+
+
+/* drop_spill()
+ * @brief   forgets a file's copy in the store, if there is one
+ * @param   spill: a struct spill_t pointer
+ * @param   file_name: name of the file
+ */
+void drop_spill(D_T spill, char *file_name)
+{
+    spill_item_t *link = NULL;
+    if (find_item(spill, file_name, &link) != NULL)
+        forget_item(spill, link);
+}
+
+
+/* stats_of_spill()
+ * @brief   returns a store's running counters
+ * @param   spill: a struct spill_t pointer
+ * @returns pointer to the counters, or NULL if spill is NULL
+ */
+spill_stats_t *stats_of_spill(D_T spill)
+{
+    return (spill == NULL) ? NULL : &spill->stats;
+}
+
+
+/* bytes_of_spill()
+ * @brief   returns how many bytes the store's segment files take up
+ * @param   spill: a struct spill_t pointer
+ */
+uint64_t bytes_of_spill(D_T spill)
+{
+    return (spill == NULL) ? 0 : spill->total;
+}
+
+
+/*** STATIC HELPER FUNCTIONS ***/
+
+
+/* find_item()
+ * @brief   looks up file_name in the index
+ * @returns its entry, or NULL; *link points at the pointer to it
+ */
+static spill_item_t find_item(D_T spill, char *file_name,
+                              spill_item_t **link)
+{
+    if (spill == NULL || file_name == NULL)
+        return NULL;
+
+    uint64_t hash = hash_bytes(file_name, strlen(file_name));
+    *link = &spill->index[hash & spill->index_mask];
+
+    while (**link != NULL) {
+        if ((**link)->hash == hash && strcmp((**link)->name, file_name) == 0)
+            return **link;
+        *link = &(**link)->chain;
+    }
+
+    return NULL;
+}
+
+
+/* find_segment()
+ * @brief   returns the live segment numbered num, or NULL
+ */
+static segment_t *find_segment(D_T spill, uint64_t num)
+{
+    int i;
+    for (i = 0; i < spill->n_segs; i++)
+        if (spill->segs[i].num == num)
+            return &spill->segs[i];
+    return NULL;
+}
+
+
+/* open_segment()
+ * @brief   creates the next segment file, to append to
+ * @returns the new (last) segment, or NULL if its file can't be created
+ */
+static segment_t *open_segment(D_T spill)
+{
+    char *path = segment_path(spill, spill->next_num);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    free(path);
+
+    if (fd == -1)
+        return NULL;
+
+    segment_t *seg = &spill->segs[spill->n_segs++];
+    seg->num = spill->next_num++;
+    seg->fd = fd;
+    seg->bytes = 0;
+    seg->live = 0;
+    spill->stats.segments++;
+
+    return seg;
+}
+
+
+/* remove_segment()
+ * @brief   closes and deletes the segment at position i, dropping any
+ *          entries still in it
+ * @param   lost: 1 to count its live entries as lost
+ */
+static void remove_segment(D_T spill, int i, int lost)
+{
+    segment_t *seg = &spill->segs[i];
+    uint64_t b;
+
+    // drop the entries still in it; only needed while any are live
+    for (b = 0; seg->live > 0 && b <= spill->index_mask; b++) {
+        spill_item_t *link = &spill->index[b];
+        while (*link != NULL) {
+            if ((*link)->seg == seg->num) {
+                spill->stats.lost += lost;
+                free_item(spill, link);
+                seg->live--;
+            }
+            else {
+                link = &(*link)->chain;
+            }
+        }
+    }
+
+    char *path = segment_path(spill, seg->num);
+    close(seg->fd);
+    unlink(path);
+    free(path);
+
+    spill->total -= seg->bytes;
+    spill->n_segs--;
+    memmove(&spill->segs[i], &spill->segs[i + 1],
+            (spill->n_segs - i) * sizeof(segment_t));
+}
+
+
+/* forget_item()
+ * @brief   unlinks the entry *link points to, frees it, and marks its
+ *          record dead; a sealed segment left with no live records is
+ *          deleted
+ */
+static void forget_item(D_T spill, spill_item_t *link)
+{
+    uint64_t num = free_item(spill, link);
+
+    int i;
+    for (i = 0; i < spill->n_segs; i++) {
+        if (spill->segs[i].num != num)
+            continue;
+
+        spill->segs[i].live--;
+        if (spill->segs[i].live == 0 && i < spill->n_segs - 1)
+            remove_segment(spill, i, 0);
+        break;
+    }
+}
+
+
+/* free_item()
+ * @brief   unlinks the entry *link points to, and frees it
+ * @returns the number of the segment that held it
+ */
+static uint64_t free_item(D_T spill, spill_item_t *link)
+{
+    spill_item_t item = *link;
+    uint64_t num = item->seg;
+
+    *link = item->chain;
+    spill->count--;
+
+    free(item->name);
+    free(item);
+    return num;
+}
+
+
+/* grow_index()
+ * @brief   doubles the index's buckets, and rehashes every entry
+ */
+static void grow_index(D_T spill)
+{
+    uint64_t old_buckets = spill->index_mask + 1;
+    uint64_t mask = 2 * old_buckets - 1;
+    spill_item_t *index = calloc(mask + 1, sizeof(spill_item_t));
+    uint64_t b;
+
+    for (b = 0; b < old_buckets; b++) {
+        spill_item_t item = spill->index[b];
+        while (item != NULL) {
+            spill_item_t next = item->chain;
+            item->chain = index[item->hash & mask];
+            index[item->hash & mask] = item;
+            item = next;
+        }
+    }
+
+    free(spill->index);
+    spill->index = index;
+    spill->index_mask = mask;
+}
+
+
+/* segment_path()
+ * @brief   returns "<dir>/<num>.seg", malloc'd
+ */
+static char *segment_path(D_T spill, uint64_t num)
+{
+    char *path = malloc(strlen(spill->dir) + 32);
+    sprintf(path, "%s/%lu.seg", spill->dir, num);
+    return path;
+}
@@ -0,0 +1,70 @@
+/*
+ * SPILL.H
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * On-disk second tier (L2) for files evicted from the cache. Spilled files
+ * are appended to fixed-size segment files in a private directory, and
+ * found again through an in-memory index. Taking a file back out (or
+ * dropping it) only marks its bytes dead; a segment is deleted once it's
+ * all dead. When the segments outgrow the byte budget, the oldest one is
+ * recycled whole, losing whatever was still live in it.
+ *
+ */
+
+#ifndef SPILL_H
+#define SPILL_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "file_sys.h"
+
+typedef struct spill_t *D_T;
+
+// a spilled file: its data, and what the cache knew about it
+typedef struct spill_entry_t {
+    unsigned char *data; // file data; malloc'd when filled in by take_spill
+    int len; // length of data, in bytes
+    int max_age; // MAX-AGE the file was cached with (sec)
+    clock_t expiration; // when the cached copy expires (ticks)
+    file_meta_t meta; // source file's metadata when it was read
+} spill_entry_t;
+
+// running counters for a spill store
+typedef struct spill_stats_t {
+    uint64_t spilled; // files written to the store
+    uint64_t spilled_bytes; // bytes of data in them
+    uint64_t taken; // files read back out
+    uint64_t taken_bytes; // bytes of data in them
+    uint64_t lost; // live files dropped when their segment was recycled
+    uint64_t too_big; // files that didn't fit the budget at all
+    uint64_t segments; // segment files created
+} spill_stats_t;
+
+// creates a store in a new directory under dir, of at most budget bytes
+D_T create_spill(char *dir, uint64_t budget);
+
+// deletes the store's segments and directory, and frees it
+void free_spill(D_T spill);
+
+// spills a copy of entry's data under file_name; returns 0, or -1
+int put_spill(D_T spill, char *file_name, spill_entry_t *entry);
+
+// takes file_name out of the store; returns 1 if found (entry filled in)
+int take_spill(D_T spill, char *file_name, spill_entry_t *entry);
+
+// forgets file_name, if it's in the store
+void drop_spill(D_T spill, char *file_name);
+
+// returns the store's running counters
+spill_stats_t *stats_of_spill(D_T spill);
+
+// returns bytes currently held in segment files
+uint64_t bytes_of_spill(D_T spill);
+
+#endif
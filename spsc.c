@@ -0,0 +1,125 @@
+/*
+ * SPSC.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ */
+
+#include <sched.h>
+
+#include "spsc.h"
+
+#define SPSC_LINE 64 // keeps the two indices on separate cache lines
+
+struct spsc_t {
+    // written by the producer: number of elements ever pushed
+    _Alignas(SPSC_LINE) atomic_size_t tail;
+    // written by the consumer: number of elements ever popped
+    _Alignas(SPSC_LINE) atomic_size_t head;
+
+    _Alignas(SPSC_LINE) size_t mask; // slots - 1 (a power of 2)
+    size_t elem_size;
+    unsigned char *slots;
+};
+
+
+/* create_spsc()
+ * @brief   initializes an empty queue
+ * @param   cap: minimum number of slots; rounded up to a power of 2
+ * @param   elem_size: bytes per element
+ * @returns a struct spsc_t pointer, or NULL if cap or elem_size is invalid
+ */
+Q_T create_spsc(int cap, size_t elem_size)
+{
+    if (cap <= 0 || elem_size == 0)
+        return NULL;
+
+    size_t slots = 2;
+    while (slots < (size_t)cap)
+        slots <<= 1;
+
+    Q_T q = aligned_alloc(SPSC_LINE, sizeof(struct spsc_t));
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->head, 0);
+    q->mask = slots - 1;
+    q->elem_size = elem_size;
+    q->slots = malloc(slots * elem_size);
+
+    return q;
+}
+
+
+/* free_spsc()
+ * @brief   frees a queue and its slots
+ * @param   queue: a struct spsc_t pointer
+ * @note    elements that point to memory of their own aren't freed
+ */
+void free_spsc(Q_T queue)
+{
+    if (queue == NULL)
+        return;
+
+    free(queue->slots);
+    free(queue);
+}
+
+
+/* push_spsc()
+ * @brief   appends a copy of elem to the queue
+ * @param   queue: a struct spsc_t pointer
+ * @param   elem: elem_size bytes to copy in
+ * @note    only one thread may push to a queue. if the queue is full, waits
+ *          for the consumer to make room.
+ */
+void push_spsc(Q_T queue, void *elem)
+{
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    while (tail - atomic_load_explicit(&queue->head, memory_order_acquire)
+            > queue->mask)
+        sched_yield(); // full
+
+    memcpy(queue->slots + (tail & queue->mask) * queue->elem_size, elem,
+           queue->elem_size);
+
+    // publishes the slot's contents along with the new tail
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+}
+
+
+/* pop_spsc()
+ * @brief   removes the oldest element from the queue
+ * @param   queue: a struct spsc_t pointer
+ * @param   elem: filled in with the element's elem_size bytes
+ * @note    only one thread may pop from a queue. if the queue is empty,
+ *          waits for the producer to push.
+ */
+void pop_spsc(Q_T queue, void *elem)
+{
+    while (!try_pop_spsc(queue, elem))
+        sched_yield(); // empty
+}
+
+
+/* try_pop_spsc()
+ * @brief   removes the oldest element from the queue, if there is one
+ * @param   queue: a struct spsc_t pointer
+ * @param   elem: filled in with the element's elem_size bytes
+ * @returns 1 if an element was popped; 0 if the queue was empty
+ */
+int try_pop_spsc(Q_T queue, void *elem)
+{
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+    if (head == atomic_load_explicit(&queue->tail, memory_order_acquire))
+        return 0;
+
+    memcpy(elem, queue->slots + (head & queue->mask) * queue->elem_size,
+           queue->elem_size);
+
+    // hands the slot back to the producer
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return 1;
+}
@@ -0,0 +1,39 @@
+/*
+ * SPSC.H
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * Bounded single-producer / single-consumer queues: a ring of fixed-size
+ * slots, with the producer and consumer each owning one index. No locks;
+ * a full (or empty) queue makes its producer (or consumer) spin, yielding
+ * the CPU between tries.
+ *
+ */
+
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+typedef struct spsc_t *Q_T;
+
+// creates a queue of (at least) cap slots, each elem_size bytes
+Q_T create_spsc(int cap, size_t elem_size);
+
+// frees a queue; anything still in it is dropped
+void free_spsc(Q_T queue);
+
+// copies elem into the queue, waiting while it's full (producer only)
+void push_spsc(Q_T queue, void *elem);
+
+// copies the oldest element into elem, waiting while empty (consumer only)
+void pop_spsc(Q_T queue, void *elem);
+
+// as pop_spsc, but returns 0 at once if the queue is empty; 1 if popped
+int try_pop_spsc(Q_T queue, void *elem);
+
+#endif
@@ -0,0 +1,375 @@
+/*
+ * STUB_ORIGIN.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "stub_origin.h"
+#include "http.h"
+
+#define STUB_LAST_MODIFIED 1600000000 // objects' Last-Modified, at v0
+
+/*** CONNECTION ***/
+typedef struct stub_conn_t {
+    struct stub_origin_t *stub;
+    int fd;
+    pthread_t thread;
+    struct stub_conn_t *next;
+} stub_conn_t;
+
+struct stub_origin_t {
+    int fd; // listening socket
+    char *path; // Unix socket path, to remove; NULL for TCP
+    pthread_t acceptor;
+
+    int objects;
+    int len; // length of each object
+    int max_age;
+    int delay_us; // wait before each response, as if it took work
+    unsigned char *fill; // len bytes of padding, shared by every response
+    atomic_int *versions; // each object's version; bumped to change it
+
+    pthread_mutex_t lock; // guards conns
+    stub_conn_t *conns;
+
+    atomic_uint_fast64_t served;
+    atomic_uint_fast64_t not_modified;
+};
+
+
+/*** STATIC HELPER FUNC DECLARATIONS ***/
+
+// accepts connections until the listening socket is shut down
+static void *accept_main(void *arg);
+
+// reads requests from one connection, and answers each, until it closes
+static void *conn_main(void *arg);
+
+// answers one request; returns 0, or -1 if the write failed
+static int answer(STUB_T stub, int fd, http_request_t *req);
+
+
+/* start_stub_origin()
+ * @brief   starts a stub origin on its own threads
+ * @param   target: "port" to listen on 127.0.0.1, or a Unix socket path
+ *          (anything with a '/', or not all digits)
+ * @param   objects: number of objects, /obj/0 to /obj/<objects - 1>
+ * @param   len: length of each object, in bytes
+ * @param   max_age: Cache-Control max-age sent for /obj/<i>
+ * @param   delay_us: microseconds to wait before each response
+ * @returns a struct stub_origin_t pointer, or NULL if it can't listen
+ */
+STUB_T start_stub_origin(char *target, int objects, int len, int max_age,
+                         int delay_us)
+{
+    int fd;
+    char *path = NULL;
+
+    if (strspn(target, "0123456789") == strlen(target)) {
+        struct sockaddr_in addr = { 0 };
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(target));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+                || listen(fd, SOMAXCONN) == -1) {
+            close(fd);
+            return NULL;
+        }
+    }
+    else {
+        struct sockaddr_un addr = { 0 };
+        if (strlen(target) >= sizeof(addr.sun_path))
+            return NULL;
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, target);
+        unlink(target);
+
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+                || listen(fd, SOMAXCONN) == -1) {
+            close(fd);
+            return NULL;
+        }
+        path = strdup(target);
+    }
+
+    STUB_T stub = calloc(1, sizeof(struct stub_origin_t));
+    stub->fd = fd;
+    stub->path = path;
+    stub->objects = objects;
+    stub->len = len;
+    stub->max_age = max_age;
+    stub->delay_us = delay_us;
+    stub->fill = malloc(len + 1);
+    memset(stub->fill, 'x', len);
+    stub->versions = calloc(objects, sizeof(atomic_int));
+    pthread_mutex_init(&stub->lock, NULL);
+
+    pthread_create(&stub->acceptor, NULL, accept_main, stub);
+    return stub;
+}
+
+
+/* bump_stub_origin()
+ * @brief   makes a new version of object i: new data, ETag and
+ *          Last-Modified
+ */
+void bump_stub_origin(STUB_T stub, int i)
+{
+    if (stub != NULL && i >= 0 && i < stub->objects)
+        atomic_fetch_add(&stub->versions[i], 1);
+}
+
+
+/* served_stub_origin()
+ * @brief   returns the number of responses sent so far (of any status)
+ * @param   not_modified: set to how many of them were 304s; may be NULL
+ */
+uint64_t served_stub_origin(STUB_T stub, uint64_t *not_modified)
+{
+    if (not_modified != NULL)
+        *not_modified = stub->not_modified;
+    return stub->served;
+}
+
+
+/* stop_stub_origin()
+ * @brief   stops accepting, shuts every connection down, waits for their
+ *          threads, and frees stub
+ */
+void stop_stub_origin(STUB_T stub)
+{
+    if (stub == NULL)
+        return;
+
+    shutdown(stub->fd, SHUT_RDWR); // wakes accept()
+    pthread_join(stub->acceptor, NULL);
+    close(stub->fd);
+    if (stub->path != NULL)
+        unlink(stub->path);
+
+    while (stub->conns != NULL) {
+        stub_conn_t *conn = stub->conns;
+        stub->conns = conn->next;
+
+        shutdown(conn->fd, SHUT_RDWR); // wakes its read()
+        pthread_join(conn->thread, NULL);
+        close(conn->fd);
+        free(conn);
+    }
+
+    pthread_mutex_destroy(&stub->lock);
+    free(stub->versions);
+    free(stub->fill);
+    free(stub->path);
+    free(stub);
+}
+
+
+/*** STATIC HELPER FUNCTIONS ***/
+
+
+/* accept_main()
+ * @brief   acceptor thread: starts a thread for each new connection
+ */
+static void *accept_main(void *arg)
+{
+    STUB_T stub = (STUB_T)arg;
+
+    while (1) {
+        int fd = accept(stub->fd, NULL, NULL);
+        if (fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            return NULL; // shut down
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        stub_conn_t *conn = calloc(1, sizeof(stub_conn_t));
+        conn->stub = stub;
+        conn->fd = fd;
+
+        pthread_mutex_lock(&stub->lock);
+        conn->next = stub->conns;
+        stub->conns = conn;
+        pthread_create(&conn->thread, NULL, conn_main, conn);
+        pthread_mutex_unlock(&stub->lock);
+    }
+}
+
+
+/* conn_main()
+ * @brief   connection thread: answers each request head as it arrives, in
+ *          order, until the client closes (or sends something malformed)
+ * @note    the connection is closed and freed by stop_stub_origin()
+ */
+static void *conn_main(void *arg)
+{
+    stub_conn_t *conn = (stub_conn_t *)arg;
+    char *buf = malloc(HTTP_HEAD_MAX);
+    size_t len = 0;
+
+    while (1) {
+        ssize_t n = read(conn->fd, buf + len, HTTP_HEAD_MAX - len);
+        if (n <= 0)
+            break;
+        len += n;
+
+        size_t pos = 0;
+        http_request_t req;
+        int head_len;
+        while ((head_len = parse_http_request(buf + pos, len - pos,
+                                              &req)) > 0) {
+            pos += head_len;
+            if (answer(conn->stub, conn->fd, &req) == -1)
+                head_len = -1;
+            if (head_len == -1 || !req.keep_alive)
+                break;
+        }
+        if (head_len == -1 || (head_len > 0 && !req.keep_alive)
+                || (head_len == 0 && len - pos == HTTP_HEAD_MAX))
+            break;
+
+        memmove(buf, buf + pos, len - pos);
+        len -= pos;
+    }
+
+    shutdown(conn->fd, SHUT_RDWR);
+    free(buf);
+    return NULL;
+}
+
+
+/* answer()
+ * @brief   writes the response to one request: the object it names (or a
+ *          304, if the client's ETag is current), or a 404
+ * @returns 0, or -1 if the write failed
+ */
+static int answer(STUB_T stub, int fd, http_request_t *req)
+{
+    char head[512];
+    char prefix[32];
+    struct iovec iov[3];
+    int cnt = 0;
+    int status = 404;
+    int i = -1;
+    int head_len;
+
+    char *slash = strchr(req->target + 1, '/');
+    if (slash != NULL) {
+        char *end;
+        long num = strtol(slash + 1, &end, 10);
+        if (end != slash + 1 && *end == '\0' && num >= 0
+                && num < stub->objects)
+            i = (int)num;
+    }
+
+    char *cc = NULL;
+    if (i != -1 && strncmp(req->target, "/obj/", 5) == 0)
+        cc = "max-age";
+    else if (i != -1 && strncmp(req->target, "/nocache/", 9) == 0)
+        cc = "no-cache";
+    else if (i != -1 && strncmp(req->target, "/private/", 9) == 0)
+        cc = "private";
+
+    if (stub->delay_us > 0)
+        usleep(stub->delay_us);
+
+    if (cc == NULL) {
+        head_len = sprintf(head, "HTTP/1.1 404 Not Found\r\n"
+                           "Content-Length: 0\r\n\r\n");
+    }
+    else {
+        int version = stub->versions[i];
+        http_meta_t meta = { "", STUB_LAST_MODIFIED + version, "" };
+        char date[HTTP_DATE_LEN];
+
+        sprintf(meta.etag, "\"%d-%d\"", i, version);
+        format_http_date(meta.last_modified, date);
+        status = http_not_modified(req, &meta) ? 304 : 200;
+
+        head_len = sprintf(head, "HTTP/1.1 %d %s\r\nETag: %s\r\n"
+                           "Last-Modified: %s\r\n", status,
+                           http_reason(status), meta.etag, date);
+        if (strcmp(cc, "max-age") == 0)
+            head_len += sprintf(head + head_len,
+                                "Cache-Control: max-age=%d\r\n",
+                                stub->max_age);
+        else
+            head_len += sprintf(head + head_len, "Cache-Control: %s\r\n",
+                                cc);
+
+        if (status == 200)
+            head_len += sprintf(head + head_len, "Content-Type: "
+                                "application/octet-stream\r\n"
+                                "Content-Length: %d\r\n", stub->len);
+        head_len += sprintf(head + head_len, "\r\n");
+    }
+
+    iov[cnt].iov_base = head;
+    iov[cnt++].iov_len = head_len;
+    if (status == 200) {
+        int prefix_len = snprintf(prefix, sizeof(prefix), "obj %d v%d\n", i,
+                                  stub->versions[i]);
+        if (prefix_len > stub->len)
+            prefix_len = stub->len;
+        iov[cnt].iov_base = prefix;
+        iov[cnt++].iov_len = prefix_len;
+        iov[cnt].iov_base = stub->fill;
+        iov[cnt++].iov_len = stub->len - prefix_len;
+    }
+
+    atomic_fetch_add(&stub->served, 1);
+    if (status == 304)
+        atomic_fetch_add(&stub->not_modified, 1);
+
+    // blocking: writev() only stops short on an error, or a signal
+    size_t left = 0;
+    int j;
+    for (j = 0; j < cnt; j++)
+        left += iov[j].iov_len;
+
+    struct iovec *v = iov;
+    while (left > 0) {
+        ssize_t n = writev(fd, v, cnt);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+
+        left -= n;
+        while (cnt > 0 && (size_t)n >= v->iov_len) {
+            n -= v->iov_len;
+            v++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            v->iov_base = (char *)v->iov_base + n;
+            v->iov_len -= n;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,44 @@
+/*
+ * STUB_ORIGIN.H
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * Stub HTTP origin, for testing and benchmarking the cache server's proxy
+ * mode (see server.h) over loopback. It serves generated objects:
+ *
+ *      /obj/<i>        200: len bytes, starting "obj <i> v<version>\n";
+ *                      Cache-Control: max-age=<max_age>
+ *      /nocache/<i>    the same, with Cache-Control: no-cache
+ *      /private/<i>    the same, with Cache-Control: private
+ *      anything else   404
+ *
+ * each with an ETag and Last-Modified that change when the object is
+ * bumped, and answers a matching If-None-Match with a 304. Every
+ * connection gets its own thread; requests may be pipelined.
+ *
+ */
+
+#ifndef STUB_ORIGIN_H
+#define STUB_ORIGIN_H
+
+#include <stdint.h>
+
+typedef struct stub_origin_t *STUB_T;
+
+// starts serving objects on a port (127.0.0.1) or Unix socket path
+STUB_T start_stub_origin(char *target, int objects, int len, int max_age,
+                         int delay_us);
+
+// changes object i, so its old ETag no longer matches
+void bump_stub_origin(STUB_T stub, int i);
+
+// returns the responses sent so far; not_modified (if not NULL) gets the
+// number of them that were 304s
+uint64_t served_stub_origin(STUB_T stub, uint64_t *not_modified);
+
+// closes every connection, stops serving and frees stub
+void stop_stub_origin(STUB_T stub);
+
+#endif
@@ -9,7 +9,7 @@
 
 #include "test_cache.h"
 
-#define NUM_TESTS 6
+#define NUM_TESTS 33
 
 
 /* run_tests()
@@ -135,6 +135,1427 @@ int test_pop_front_cache()
 }
 
 
+/* test_tinylfu_estimate()
+ * @brief   frequently-accessed keys must out-estimate one-hit wonders
+ */
+int test_tinylfu_estimate()
+{
+    LFU_T lfu = create_tinylfu(64);
+
+    for (int i = 0; i < 10; i++)
+        increment_tinylfu(lfu, "hot.txt");
+    increment_tinylfu(lfu, "cold.txt");
+
+    int hot = estimate_tinylfu(lfu, "hot.txt");
+    int cold = estimate_tinylfu(lfu, "cold.txt");
+    free_tinylfu(lfu);
+
+    if (hot <= cold) {
+        fprintf(stderr, "\tERROR: hot estimated %i, cold %i.\n", hot, cold);
+        return 0;
+    }
+
+    fprintf(stderr, "\tEstimates: hot %i, cold %i.\n", hot, cold);
+    return 1;
+}
+
+
+/* test_bloom_add_remove()
+ * @brief   added keys are always "maybe"; removed keys become "no" again
+ */
+int test_bloom_add_remove()
+{
+    B_T bloom = create_bloom(16, 0.01);
+
+    add_bloom(bloom, "file_a");
+    add_bloom(bloom, "file_b");
+
+    if (!maybe_bloom(bloom, "file_a") || !maybe_bloom(bloom, "file_b")) {
+        fprintf(stderr, "\tERROR: added key reported absent.\n");
+        free_bloom(bloom);
+        return 0;
+    }
+
+    remove_bloom(bloom, "file_a");
+    remove_bloom(bloom, "file_b");
+
+    int result = !maybe_bloom(bloom, "file_a") && !maybe_bloom(bloom, "file_b");
+    if (!result)
+        fprintf(stderr, "\tERROR: removed key still reported present.\n");
+
+    free_bloom(bloom);
+    return result;
+}
+
+
+/* test_negative_cache()
+ * @brief   unreadable files become negative entries, outside the cache
+ *          list, until they're invalidated
+ */
+int test_negative_cache()
+{
+    C_T cache = create_cache(4);
+    cache = (C_T)enable_negative_cache(cache, 60, 4);
+
+    cache = (C_T)push_back_cache(cache, strdup("no_such_file"), 10);
+
+    if (size_of_cache(cache) != 0 || !is_negative_cache(cache, "no_such_file")) {
+        fprintf(stderr, "\tERROR: unreadable file wasn't cached negatively.\n");
+        free_cache(cache);
+        return 0;
+    }
+
+    cache = (C_T)invalidate_negative_cache(cache, "no_such_file");
+    int result = !is_negative_cache(cache, "no_such_file");
+    if (!result)
+        fprintf(stderr, "\tERROR: negative entry survived invalidation.\n");
+
+    free_cache(cache);
+    return result;
+}
+
+
+/* test_lazy_load()
+ * @brief   a lazy PUT only records the file's size; the data is read in
+ *          by the first load
+ */
+int test_lazy_load()
+{
+    C_T cache = create_cache(4);
+    cache = (C_T)enable_lazy_cache(cache);
+    cache = (C_T)push_back_cache(cache, strdup("test10.txt"), 60);
+
+    cache_file_t file = retrieve_file_struct(cache, "test10.txt");
+    if (file.loaded || file.data != NULL || file.len != 160) {
+        fprintf(stderr, "\tERROR: lazy PUT read the file (len %i).\n",
+                file.len);
+        free_cache(cache);
+        return 0;
+    }
+
+    int loaded = load_item_cache(cache, "test10.txt");
+    file = retrieve_file_struct(cache, "test10.txt");
+    int result = loaded && file.loaded && file.data != NULL && file.len == 160;
+    if (!result)
+        fprintf(stderr, "\tERROR: first load didn't read the file.\n");
+
+    free_cache(cache);
+    return result;
+}
+
+
+/* test_revalidate_unchanged()
+ * @brief   revalidating a file whose source hasn't changed keeps its
+ *          buffer, and only renews its expiration
+ */
+int test_revalidate_unchanged()
+{
+    C_T cache = create_cache(4);
+    cache = (C_T)push_back_cache(cache, strdup("test10.txt"), 0);
+
+    cache_file_t before = retrieve_file_struct(cache, "test10.txt");
+    cache = (C_T)revalidate_item_cache(cache, "test10.txt");
+    cache_file_t after = retrieve_file_struct(cache, "test10.txt");
+
+    int result = after.data == before.data
+                 && stats_of_cache(cache)->revalidated == 1
+                 && stats_of_cache(cache)->reloaded == 0;
+    if (!result)
+        fprintf(stderr, "\tERROR: unchanged file was re-read.\n");
+
+    free_cache(cache);
+    return result;
+}
+
+
+/* test_serve_stale()
+ * @brief   a GET of an expired file inside its grace period gets the stale
+ *          copy at once, without re-reading the source; repeated GETs queue
+ *          one background refresh between them, which then replaces the
+ *          data and renews the file
+ */
+int test_serve_stale()
+{
+    char *name = "stale_test.txt";
+    write_buf_into_file(name, (unsigned char *)"stale v1", 8);
+
+    C_T cache = create_cache(4);
+    cache = (C_T)push_back_cache(cache, strdup(name), 0); // already expired
+    cache = (C_T)set_stale_cache(cache, name, 60);
+    clock_t before = retrieve_file_struct(cache, name).expiration;
+
+    write_buf_into_file(name, (unsigned char *)"stale v2, longer", 16);
+
+    // three GETs in the grace period: each may serve the old data
+    int served = serve_stale_cache(cache, name)
+                 + serve_stale_cache(cache, name)
+                 + serve_stale_cache(cache, name);
+    payload_t *handle = acquire_file_cache(cache, name);
+    cache_stats_t *stats = stats_of_cache(cache);
+
+    int result = served == 3 && stats->stale_served == 3 && handle != NULL
+                 && handle->len == 8
+                 && memcmp(handle->data, "stale v1", 8) == 0
+                 && stats->reloaded == 0 && stats->revalidated == 0;
+    if (!result)
+        fprintf(stderr, "\tERROR: the stale copy wasn't served as-is.\n");
+    release_file_cache(handle);
+
+    int waited;
+    for (waited = 0; waited < 2000
+            && stats->bg_refreshes == 0; waited++) {
+        usleep(1000);
+        cache = (C_T)apply_refreshes_cache(cache);
+    }
+    usleep(50000); // long enough for a second refresh, had one been queued
+    cache = (C_T)apply_refreshes_cache(cache);
+
+    cache_file_t file = retrieve_file_struct(cache, name);
+    if (result && (stats->bg_refreshes != 1 || stats->bg_changed != 1
+            || file.len != 16 || file.expiration <= before)) {
+        fprintf(stderr, "\tERROR: expected one refresh to renew the file, "
+                "got %lu.\n", stats->bg_refreshes);
+        result = 0;
+    }
+
+    free_cache(cache);
+    delete_file(name);
+    return result;
+}
+
+
+/* test_refresh_ahead()
+ * @brief   a GET of a hot file past the refresh-ahead point issues a
+ *          background refresh, which renews the file before it can expire
+ *          on a GET; with no GET after it, the refresh counts as wasted once
+ *          the file is evicted
+ */
+int test_refresh_ahead()
+{
+    char *name = "ahead_test.txt";
+    write_buf_into_file(name, (unsigned char *)"ahead", 5);
+
+    C_T cache = create_cache(4);
+    cache = (C_T)enable_refresh_ahead_cache(cache, 0.05, 0);
+    cache = (C_T)push_back_cache(cache, strdup(name), 1);
+    clock_t before = retrieve_file_struct(cache, name).expiration;
+
+    // use up a tenth of the file's (CPU-time) max_age
+    while (clock() < before - CLOCKS_PER_SEC + CLOCKS_PER_SEC / 10)
+        ;
+
+    int issued = refresh_ahead_cache(cache, name);
+    int waited;
+    for (waited = 0; waited < 2000
+            && stats_of_cache(cache)->bg_refreshes == 0; waited++) {
+        usleep(1000);
+        cache = (C_T)apply_refreshes_cache(cache);
+    }
+
+    cache_stats_t *stats = stats_of_cache(cache);
+    clock_t after = retrieve_file_struct(cache, name).expiration;
+    int result = issued == 1 && stats->ahead_issued == 1
+                 && stats->bg_refreshes == 1 && after > before
+                 && stats->revalidated == 0 && stats->reloaded == 0;
+    if (!result)
+        fprintf(stderr, "\tERROR: refresh-ahead didn't renew the file.\n");
+
+    cache = (C_T)evict_one(cache);
+    if (result && (size_of_cache(cache) != 0 || stats->ahead_wasted != 1)) {
+        fprintf(stderr, "\tERROR: an unused refresh-ahead wasn't counted as "
+                "wasted.\n");
+        result = 0;
+    }
+
+    free_cache(cache);
+    delete_file(name);
+    return result;
+}
+
+
+/* test_watch_invalidate()
+ * @brief   rewriting a watched file drops it from the cache on the next
+ *          apply_watch_cache()
+ */
+int test_watch_invalidate()
+{
+    unsigned char data[] = "version 1";
+    write_buf_into_file("watch_test.txt", data, sizeof(data));
+
+    C_T cache = create_cache(4);
+    cache = (C_T)enable_watch_cache(cache, 0);
+    cache = (C_T)push_back_cache(cache, strdup("watch_test.txt"), 600);
+
+    write_buf_into_file("watch_test.txt", data, sizeof(data));
+    cache = (C_T)apply_watch_cache(cache);
+
+    int result = size_of_cache(cache) == 0;
+    if (!result)
+        fprintf(stderr, "\tERROR: changed file is still cached.\n");
+
+    free_cache(cache);
+    delete_file("watch_test.txt");
+    return result;
+}
+
+
+/* count_inotify_watches()
+ * @brief   counts the inotify watches this process holds, from
+ *          /proc/self/fdinfo
+ */
+static int count_inotify_watches()
+{
+    DIR *fds = opendir("/proc/self/fdinfo");
+    if (fds == NULL)
+        return -1;
+
+    int watches = 0;
+    struct dirent *ent;
+    char path[64], line[256];
+    while ((ent = readdir(fds)) != NULL) {
+        snprintf(path, sizeof(path), "/proc/self/fdinfo/%s", ent->d_name);
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL)
+            continue;
+        while (fgets(line, sizeof(line), fp) != NULL)
+            watches += (strncmp(line, "inotify wd:", 11) == 0);
+        fclose(fp);
+    }
+
+    closedir(fds);
+    return watches;
+}
+
+
+/* test_watch_alias()
+ * @brief   a file added by its absolute path, in a directory already
+ *          watched as ".", is still reported under that path; and once
+ *          both files are removed, the directory's watch is dropped
+ */
+int test_watch_alias()
+{
+    char cwd[PATH_MAX], path[PATH_MAX + 32];
+    if (getcwd(cwd, sizeof(cwd)) == NULL)
+        return 0;
+    snprintf(path, sizeof(path), "%s/watch_alias.txt", cwd);
+    write_buf_into_file("watch_alias.txt", (unsigned char *)"v1", 2);
+
+    W_T watcher = create_watcher();
+    int result = watcher != NULL
+                 && add_watcher(watcher, "watch_test.txt") == 0
+                 && add_watcher(watcher, path) == 0;
+
+    write_buf_into_file("watch_alias.txt", (unsigned char *)"v2", 2);
+    char *changed = NULL;
+    int kind;
+    while (result && (kind = poll_watcher(watcher, &changed)) != 0
+            && strcmp(changed, path) != 0)
+        ;
+    if (result && (changed == NULL || strcmp(changed, path) != 0)) {
+        fprintf(stderr, "\tERROR: change to %s was missed.\n", path);
+        result = 0;
+    }
+
+    remove_watcher(watcher, path);
+    remove_watcher(watcher, "watch_test.txt");
+    if (result && count_inotify_watches() != 0) {
+        fprintf(stderr, "\tERROR: an unused directory is still watched.\n");
+        result = 0;
+    }
+
+    free_watcher(watcher);
+    delete_file("watch_alias.txt");
+    return result;
+}
+
+
+/* fetch_worker()
+ * @brief   thread body for test_fetch_coalesce: fetches fetch_test.txt once
+ */
+static void *fetch_worker(void *arg)
+{
+    C_T cache = (C_T)arg;
+    int *outcome = malloc(sizeof(int));
+    *outcome = fetch_file_cache(cache, "fetch_test.txt", -1, -1);
+    return outcome;
+}
+
+
+/* test_fetch_coalesce()
+ * @brief   threads fetching the same changed, expired file at once read its
+ *          source once between them; a missing source is an error
+ */
+int test_fetch_coalesce()
+{
+    unsigned char data[] = "version 1";
+    write_buf_into_file("fetch_test.txt", data, sizeof(data));
+
+    C_T cache = create_cache(4);
+    cache = (C_T)push_back_cache(cache, strdup("fetch_test.txt"), 600);
+
+    unsigned char newer[] = "version 22";
+    write_buf_into_file("fetch_test.txt", newer, sizeof(newer));
+    cache = (C_T)expire_item_cache(cache, "fetch_test.txt");
+
+    pthread_t threads[8];
+    int i, loaded = 0, ok = 1;
+    for (i = 0; i < 8; i++)
+        pthread_create(&threads[i], NULL, fetch_worker, cache);
+
+    for (i = 0; i < 8; i++) {
+        int *outcome = NULL;
+        pthread_join(threads[i], (void **)&outcome);
+        loaded += (*outcome == FETCH_LOADED);
+        ok = ok && (*outcome == FETCH_LOADED || *outcome == FETCH_SHARED
+                    || *outcome == FETCH_HIT);
+        free(outcome);
+    }
+
+    cache_file_t file = retrieve_file_struct(cache, "fetch_test.txt");
+    int result = ok && loaded == 1 && stats_of_cache(cache)->fetch_loads == 1
+                 && file.len == (int)sizeof(newer) && size_of_cache(cache) == 1;
+    if (!result)
+        fprintf(stderr, "\tERROR: %d loads for one changed file.\n", loaded);
+
+    if (fetch_file_cache(cache, "no_such_file.txt", 600, -1) != FETCH_ERROR) {
+        fprintf(stderr, "\tERROR: missing file wasn't an error.\n");
+        result = 0;
+    }
+
+    free_cache(cache);
+    delete_file("fetch_test.txt");
+    return result;
+}
+
+
+/* test_handle_outlives_eviction()
+ * @brief   a handle keeps a file's data readable after the file leaves the
+ *          cache, and the data is freed once the handle is released
+ */
+int test_handle_outlives_eviction()
+{
+    C_T cache = create_cache(4);
+    cache = (C_T)push_back_cache(cache, strdup("test10.txt"), 600);
+
+    payload_t *handle = acquire_file_cache(cache, "test10.txt");
+    cache = (C_T)remove_file_cache(cache, "test10.txt");
+
+    unsigned char *buffer = NULL;
+    int len = read_file_into_buf("test10.txt", &buffer);
+
+    int result = handle != NULL && handle->len == len
+                 && memcmp(handle->data, buffer, len) == 0
+                 && atomic_load(&handle->refs) == 1
+                 && acquire_file_cache(cache, "test10.txt") == NULL;
+    if (!result)
+        fprintf(stderr, "\tERROR: handle's data didn't survive eviction.\n");
+
+    release_file_cache(handle); // last reference: frees the data
+    free(buffer);
+    free_cache(cache);
+    return result;
+}
+
+
+/* test_put_get_many()
+ * @brief   a batch of PUTs stores each new file once, and updates repeats;
+ *          a batch of GETs finds exactly the cached files
+ */
+int test_put_get_many()
+{
+    C_T cache = create_cache(4);
+    char *puts[] = { "test1.txt", "test2.txt", "test1.txt" };
+    int max_ages[] = { 600, 600, 30 };
+    int results[3];
+
+    int stored = put_many_cache(cache, puts, max_ages, 3, results);
+
+    int result = stored == 2 && size_of_cache(cache) == 2
+                 && results[0] == PUT_STORED && results[1] == PUT_STORED
+                 && results[2] == PUT_UPDATED;
+    if (!result)
+        fprintf(stderr, "\tERROR: batched PUTs stored %d files.\n", stored);
+
+    char *gets[] = { "test2.txt", "test3.txt", "test1.txt" };
+    cache_file_t files[3];
+    int found = get_many_cache(cache, gets, 3, files);
+
+    if (found != 2 || files[1].name != NULL || files[2].max_age != 30
+            || files[0].last_retrieved == 0) {
+        fprintf(stderr, "\tERROR: batched GETs found %d files.\n", found);
+        result = 0;
+    }
+
+    free_cache(cache);
+    return result;
+}
+
+
+/* spsc_producer()
+ * @brief   pushes the ints 0..SPSC_TEST_N-1 onto the queue in arg
+ */
+#define SPSC_TEST_N 100000
+static void *spsc_producer(void *arg)
+{
+    Q_T queue = (Q_T)arg;
+    int i;
+    for (i = 0; i < SPSC_TEST_N; i++)
+        push_spsc(queue, &i);
+    return NULL;
+}
+
+
+/* test_spsc_order()
+ * @brief   a small queue, with a producer thread far ahead of its consumer,
+ *          hands every element over once, in order
+ */
+int test_spsc_order()
+{
+    Q_T queue = create_spsc(8, sizeof(int));
+    int empty;
+    int result = !try_pop_spsc(queue, &empty);
+
+    pthread_t producer;
+    pthread_create(&producer, NULL, spsc_producer, queue);
+
+    int i, got;
+    for (i = 0; i < SPSC_TEST_N && result; i++) {
+        pop_spsc(queue, &got);
+        if (got != i) {
+            fprintf(stderr, "\tERROR: popped %d, expected %d.\n", got, i);
+            result = 0;
+        }
+    }
+
+    pthread_join(producer, NULL);
+    free_spsc(queue);
+    return result;
+}
+
+
+/* test_partitioned_replay()
+ * @brief   a trace replayed on 2 partitioned workers runs every GET, and
+ *          writes the files' outputs
+ */
+int test_partitioned_replay()
+{
+    char *trace = "PUT: test1.txt\\MAX-AGE: 600\nPUT: test2.txt\\MAX-AGE: 600\n"
+                  "GET: test1.txt\nGET: test2.txt\nGET: test1.txt\n";
+    write_buf_into_file("part_cmds.txt", (unsigned char *)trace,
+                        strlen(trace));
+    delete_file("test1_output.txt");
+
+    sim_opts_t opts = { 0 };
+    opts.workers = 2;
+
+    unsigned char *in = NULL, *out = NULL;
+    int in_len = read_file_into_buf("test1.txt", &in);
+    int ran = run_cache_sim("part_cmds.txt", 4, &opts);
+    int out_len = read_file_into_buf("test1_output.txt", &out);
+
+    int result = (ran == 0 && out_len == in_len
+                  && memcmp(in, out, in_len) == 0);
+    if (!result)
+        fprintf(stderr, "\tERROR: partitioned replay wrote %d of %d bytes.\n",
+                out_len, in_len);
+
+    free(in);
+    free(out);
+    delete_file("part_cmds.txt");
+    return result;
+}
+
+
+/* test_stream_sink()
+ * @brief   a stream sink appends one length-prefixed record per output, for
+ *          records that are buffered and ones too big to be
+ */
+int test_stream_sink()
+{
+    delete_file("sink_test.bin");
+    S_T sink = open_sink("stream:sink_test.bin");
+    if (sink == NULL || open_sink("bogus") != NULL)
+        return 0;
+
+    int big_len = 200 * 1024;
+    unsigned char *big = malloc(big_len);
+    memset(big, 'x', big_len);
+
+    write_sink(sink, "a.txt", (unsigned char *)"hello", 5);
+    write_sink(sink, "big", big, big_len);
+    write_sink(sink, "a.txt", (unsigned char *)"bye", 3);
+    close_sink(sink);
+
+    unsigned char *buf = NULL;
+    int len = read_file_into_buf("sink_test.bin", &buf);
+    int expected = 3 * sizeof(sink_record_t) + 5 + 5 + 3 + big_len + 5 + 3;
+
+    int result = (len == expected);
+    if (result) {
+        sink_record_t header;
+        memcpy(&header, buf, sizeof(header));
+        result = header.name_len == 5 && header.data_len == 5
+                 && memcmp(buf + sizeof(header), "a.txthello", 10) == 0
+                 && memcmp(buf + len - 8, "a.txtbye", 8) == 0;
+    }
+    if (!result)
+        fprintf(stderr, "\tERROR: stream sink wrote %d of %d bytes.\n", len,
+                expected);
+
+    free(buf);
+    free(big);
+    delete_file("sink_test.bin");
+    return result;
+}
+
+
+/* test_spill_promote()
+ * @brief   a file evicted from a 1-file cache spills to L2, and comes back
+ *          with its data, spilling the file that displaced it in turn
+ */
+int test_spill_promote()
+{
+    unsigned char data_a[] = "spilled file a", data_b[] = "spilled file b";
+    write_buf_into_file("spill_a.txt", data_a, sizeof(data_a));
+    write_buf_into_file("spill_b.txt", data_b, sizeof(data_b));
+
+    C_T cache = create_cache(1);
+    cache = enable_spill_cache(cache, "spill_test_dir", 1 << 20);
+
+    char *names[] = { "spill_a.txt", "spill_b.txt" };
+    int max_ages[] = { 600, 600 };
+    int results[2];
+    put_many_cache(cache, names, max_ages, 2, results); // evicts a
+
+    int result = promote_spill_cache(cache, "spill_a.txt") == 1
+                 && promote_spill_cache(cache, "spill_a.txt") == 0;
+
+    cache_file_t file = retrieve_file_struct(cache, "spill_a.txt");
+    if (!result || file.len != sizeof(data_a)
+            || memcmp(file.data, data_a, sizeof(data_a)) != 0) {
+        fprintf(stderr, "\tERROR: spilled file didn't come back intact.\n");
+        result = 0;
+    }
+
+    if (result && (!promote_spill_cache(cache, "spill_b.txt")
+            || stats_of_cache(cache)->l2_hits != 2)) {
+        fprintf(stderr, "\tERROR: displaced file wasn't spilled.\n");
+        result = 0;
+    }
+
+    free_cache(cache);
+    rmdir("spill_test_dir");
+    delete_file("spill_a.txt");
+    delete_file("spill_b.txt");
+    return result;
+}
+
+
+/* test_snapshot_restore()
+ * @brief   a snapshot brings back unchanged files with their data, drops a
+ *          file whose source changed, and is still read up to a record
+ *          that was cut off
+ */
+int test_snapshot_restore()
+{
+    unsigned char data_a[] = "snapshot file a", data_b[] = "snapshot file b";
+    write_buf_into_file("snap_a.txt", data_a, sizeof(data_a));
+    write_buf_into_file("snap_b.txt", data_b, sizeof(data_b));
+
+    C_T cache = create_cache(4);
+    char *names[] = { "snap_a.txt", "snap_b.txt" };
+    int max_ages[] = { 600, 600 };
+    int results[2];
+    put_many_cache(cache, names, max_ages, 2, results);
+    int result = (save_snapshot_cache(cache, "snap_test.snap") == 2);
+    free_cache(cache);
+
+    write_buf_into_file("snap_b.txt", data_b, 4); // b's source changes
+
+    cache = create_cache(4);
+    result = result && load_snapshot_cache(cache, "snap_test.snap") == 1
+             && stats_of_cache(cache)->snap_changed == 1;
+
+    cache_file_t file = retrieve_file_struct(cache, "snap_a.txt");
+    if (!result || file.len != sizeof(data_a)
+            || memcmp(file.data, data_a, sizeof(data_a)) != 0) {
+        fprintf(stderr, "\tERROR: snapshot didn't restore a intact.\n");
+        result = 0;
+    }
+    free_cache(cache);
+
+    // cut the snapshot off in the middle of b's record
+    truncate("snap_test.snap", sizeof(snapshot_header_t)
+             + 2 * sizeof(snapshot_record_t) + sizeof("snap_a.txt")
+             + sizeof(data_a));
+
+    cache = create_cache(4);
+    if (result && (load_snapshot_cache(cache, "snap_test.snap") != 1
+            || stats_of_cache(cache)->snap_truncated != 1)) {
+        fprintf(stderr, "\tERROR: truncated snapshot wasn't read.\n");
+        result = 0;
+    }
+    free_cache(cache);
+
+    delete_file("snap_test.snap");
+    delete_file("snap_a.txt");
+    delete_file("snap_b.txt");
+    return result;
+}
+
+
+/* test_compress_payload()
+ * @brief   with compression on, a big file that shrinks is kept packed, a
+ *          small one and one that doesn't shrink are kept as they are, and
+ *          GETs unpack packed data into the sink intact: straight into its
+ *          buffer for a small record, a block at a time for a big one
+ */
+int test_compress_payload()
+{
+    int big_len = 200 * 1024, mid_len = 8 * 1024, noise_len = 8 * 1024;
+    unsigned char *big = malloc(big_len), *mid = malloc(mid_len);
+    unsigned char *noise = malloc(noise_len);
+    int i;
+
+    for (i = 0; i < big_len; i++)
+        big[i] = "GET: compressible text\n"[i % 23] + (i / 4096) % 3;
+    for (i = 0; i < mid_len; i++)
+        mid[i] = 'a' + (i % 7);
+    srand(112);
+    for (i = 0; i < noise_len; i++)
+        noise[i] = rand();
+
+    write_buf_into_file("pack_big.txt", big, big_len);
+    write_buf_into_file("pack_mid.txt", mid, mid_len);
+    write_buf_into_file("pack_noise.txt", noise, noise_len);
+    write_buf_into_file("pack_tiny.txt", (unsigned char *)"aaaaaaaa", 8);
+
+    C_T cache = create_cache(8);
+    cache = enable_compress_cache(cache, 1024, 1.5);
+    char *names[] = { "pack_big.txt", "pack_mid.txt", "pack_noise.txt",
+                      "pack_tiny.txt" };
+    int max_ages[] = { 600, 600, 600, 600 };
+    int results[4];
+    put_many_cache(cache, names, max_ages, 4, results);
+
+    cache_stats_t *st = stats_of_cache(cache);
+    payload_t *handle = acquire_file_cache(cache, "pack_big.txt");
+    int result = st->packed == 2 && st->pack_skipped == 1 && handle != NULL
+                 && handle->packed > 0 && handle->packed * 1.5 <= big_len
+                 && retrieve_file_struct(cache, "pack_tiny.txt").len == 8;
+    if (!result)
+        fprintf(stderr, "\tERROR: files weren't packed as expected.\n");
+
+    handle = unpack_file_cache(handle);
+    if (result && (handle == NULL || handle->packed != 0
+            || handle->len != big_len
+            || memcmp(handle->data, big, big_len) != 0)) {
+        fprintf(stderr, "\tERROR: unpacked copy doesn't match.\n");
+        result = 0;
+    }
+    release_file_cache(handle);
+
+    delete_file("pack_test.bin");
+    S_T sink = open_sink("stream:pack_test.bin");
+    get_many_cmd(cache, names, NULL, 2, sink);
+    close_sink(sink);
+
+    unsigned char *buf = NULL;
+    int len = read_file_into_buf("pack_test.bin", &buf);
+    int name_len = strlen("pack_big.txt");
+    int at = sizeof(sink_record_t) + name_len;
+    if (result && (len != 2 * at + big_len + mid_len
+            || memcmp(buf + at, big, big_len) != 0
+            || memcmp(buf + len - mid_len, mid, mid_len) != 0)) {
+        fprintf(stderr, "\tERROR: sink didn't get the unpacked data.\n");
+        result = 0;
+    }
+
+    free(buf);
+    free_cache(cache);
+    free(big);
+    free(mid);
+    free(noise);
+    delete_file("pack_test.bin");
+    for (i = 0; i < 4; i++)
+        delete_file(names[i]);
+    return result;
+}
+
+
+/* test_chunked_range()
+ * @brief   with chunking on, a big file is PUT without being read; a range
+ *          GET reads just the chunks it touches, a repeat finds them
+ *          cached, a whole GET evicts chunks to stay within budget, and
+ *          every GET's bytes are right
+ */
+int test_chunked_range()
+{
+    int big_len = 40000, chunk_len = 4096;
+    unsigned char *big = malloc(big_len);
+    int i;
+
+    for (i = 0; i < big_len; i++)
+        big[i] = i * 31 + i / 7;
+    write_buf_into_file("chunk_big.txt", big, big_len);
+
+    C_T cache = create_cache(4);
+    cache = enable_chunks_cache(cache, chunk_len, 3 * chunk_len);
+    char *names[] = { "chunk_big.txt" };
+    int max_ages[] = { 600 };
+    int results[1];
+    put_many_cache(cache, names, max_ages, 1, results);
+
+    cache_stats_t *st = stats_of_cache(cache);
+    cache_file_t file = retrieve_file_struct(cache, "chunk_big.txt");
+    int result = results[0] == PUT_STORED && file.len == big_len
+                 && file.chunks != NULL && st->chunk_loads == 0;
+    if (!result)
+        fprintf(stderr, "\tERROR: big file wasn't chunked on PUT.\n");
+
+    // bytes 5000..10999 are in chunks 1 and 2
+    range_t range = { 5000, 6000 };
+    payload_t *handle = acquire_range_cache(cache, "chunk_big.txt", range);
+    if (result && (handle == NULL || handle->n_parts != 2
+            || handle->off != 5000 || st->chunk_loads != 2)) {
+        fprintf(stderr, "\tERROR: range didn't load just its chunks.\n");
+        result = 0;
+    }
+    handle = unpack_file_cache(handle);
+    if (result && (handle->len != 6000
+            || memcmp(handle->data, big + 5000, 6000) != 0)) {
+        fprintf(stderr, "\tERROR: range's bytes don't match.\n");
+        result = 0;
+    }
+    release_file_cache(handle);
+
+    // the same range again, through a sink: its chunks are cached
+    delete_file("chunk_test.bin");
+    S_T sink = open_sink("stream:chunk_test.bin");
+    get_many_cmd(cache, names, &range, 1, sink);
+    close_sink(sink);
+
+    unsigned char *buf = NULL;
+    int len = read_file_into_buf("chunk_test.bin", &buf);
+    int at = sizeof(sink_record_t) + strlen(names[0]);
+    if (result && (st->chunk_hits != 2 || st->chunk_loads != 2
+            || len != at + 6000 || memcmp(buf + at, big + 5000, 6000) != 0)) {
+        fprintf(stderr, "\tERROR: repeated range wasn't served cached.\n");
+        result = 0;
+    }
+    free(buf);
+
+    // the whole file: 10 chunks through a budget of 3
+    range_t whole = { 0, -1 };
+    handle = unpack_file_cache(acquire_range_cache(cache, "chunk_big.txt",
+                                                   whole));
+    if (result && (handle == NULL || handle->len != big_len
+            || memcmp(handle->data, big, big_len) != 0
+            || st->chunk_evictions < 7)) {
+        fprintf(stderr, "\tERROR: whole GET of chunks doesn't match.\n");
+        result = 0;
+    }
+    release_file_cache(handle);
+
+    free_cache(cache);
+    free(big);
+    delete_file("chunk_test.bin");
+    delete_file("chunk_big.txt");
+    return result;
+}
+
+
+/* test_dedup_shared()
+ * @brief   with dedup on, files with the same bytes share one payload (kept
+ *          compressed, if it shrinks), a file of the same length with other
+ *          bytes doesn't, and a shared payload outlives the file it was
+ *          first read for
+ */
+int test_dedup_shared()
+{
+    int len = 16 * 1024, i;
+    unsigned char *same = malloc(len), *other = malloc(len);
+
+    for (i = 0; i < len; i++) {
+        same[i] = 'a' + (i % 13);
+        other[i] = 'a' + (i % 11);
+    }
+    write_buf_into_file("dedup_a.txt", same, len);
+    write_buf_into_file("dedup_b.txt", same, len);
+    write_buf_into_file("dedup_c.txt", other, len);
+
+    C_T cache = create_cache(4);
+    cache = enable_compress_cache(cache, 1024, 1.5);
+    cache = enable_dedup_cache(cache);
+    char *names[] = { "dedup_a.txt", "dedup_b.txt", "dedup_c.txt" };
+    int max_ages[] = { 600, 600, 600 };
+    int results[3];
+    put_many_cache(cache, names, max_ages, 3, results);
+
+    cache_stats_t *st = stats_of_cache(cache);
+    payload_t *a = retrieve_file_struct(cache, "dedup_a.txt").payload;
+    payload_t *b = retrieve_file_struct(cache, "dedup_b.txt").payload;
+    payload_t *c = retrieve_file_struct(cache, "dedup_c.txt").payload;
+    int result = a != NULL && a == b && c != a && a->packed > 0
+                 && st->dedup_hashed == 3 && st->dedup_shared == 1
+                 && st->dedup_shared_bytes == (uint64_t)len;
+    if (!result)
+        fprintf(stderr, "\tERROR: identical files didn't share data.\n");
+
+    // b keeps the shared data once a is gone
+    cache = remove_file_cache(cache, "dedup_a.txt");
+    payload_t *handle = unpack_file_cache(acquire_file_cache(cache,
+                                                             "dedup_b.txt"));
+    if (result && (handle == NULL || handle->len != len
+            || memcmp(handle->data, same, len) != 0)) {
+        fprintf(stderr, "\tERROR: shared data didn't outlive a.\n");
+        result = 0;
+    }
+    release_file_cache(handle);
+
+    free_cache(cache);
+    free(same);
+    free(other);
+    for (i = 0; i < 3; i++)
+        delete_file(names[i]);
+    return result;
+}
+
+
+/* test_direct_read()
+ * @brief   with O_DIRECT on, a file bigger than a read request is read
+ *          whole, and in unaligned ranges (one past its end), intact;
+ *          each read either bypassed the page cache or fell back to it
+ */
+int test_direct_read()
+{
+    int len = DIRECT_REQ + DIRECT_REQ / 2 + 123, i;
+    unsigned char *data = malloc(len);
+    for (i = 0; i < len; i++)
+        data[i] = i * 7 + i / 4099;
+    write_buf_into_file("direct_test.bin", data, len);
+
+    direct_stats_t before, after;
+    stats_direct_file_sys(&before);
+    enable_direct_file_sys(64 * 1024);
+
+    unsigned char *whole = NULL;
+    file_meta_t meta;
+    int result = read_file_with_meta("direct_test.bin", &whole, &meta) == len
+                 && meta.size == len && memcmp(whole, data, len) == 0;
+    if (!result)
+        fprintf(stderr, "\tERROR: direct read of a whole file failed.\n");
+    free(whole);
+
+    unsigned char *part = malloc(DIRECT_REQ + 5000);
+    if (result && (read_file_range("direct_test.bin", 5000, part,
+                                   DIRECT_REQ + 5000, &meta)
+                       != DIRECT_REQ + 5000
+                   || memcmp(part, data + 5000, DIRECT_REQ + 5000) != 0
+                   || read_file_range("direct_test.bin", len - 100, part,
+                                      5000, &meta) != 100
+                   || memcmp(part, data + len - 100, 100) != 0)) {
+        fprintf(stderr, "\tERROR: direct read of a range failed.\n");
+        result = 0;
+    }
+    free(part);
+
+    enable_direct_file_sys(0);
+    stats_direct_file_sys(&after);
+    if (result && after.reads + after.fallbacks
+                  != before.reads + before.fallbacks + 3) {
+        fprintf(stderr, "\tERROR: direct reads weren't counted.\n");
+        result = 0;
+    }
+
+    free(data);
+    delete_file("direct_test.bin");
+    return result;
+}
+
+
+// an entry's stamps, as a policy sees them
+typedef struct test_stamps_t {
+    char *name;
+    clock_t created, expiration, last_retrieved; // 0: never retrieved
+} test_stamps_t;
+
+
+/* test_victim()
+ * @brief   scans entries[0..n), oldest first, as a cache would, with
+ *          gcache_lru if lru is 1 or else gcache_a0
+ * @returns the victim's name; *expired is set to 1 if it had expired
+ */
+static char *test_victim(int lru, test_stamps_t *entries, int n,
+                         clock_t now, int *expired)
+{
+    gcache_a0_t a0;
+    gcache_lru_t lru_scan;
+    test_stamps_t *victim;
+    int i;
+
+    if (lru) {
+        gcache_lru_start(&lru_scan, now);
+        for (i = 0; i < n; i++)
+            if (gcache_lru_visit(&lru_scan, &entries[i], entries[i].created,
+                                 entries[i].expiration,
+                                 entries[i].last_retrieved))
+                break;
+        victim = gcache_lru_pick(&lru_scan, entries);
+        *expired = lru_scan.expired;
+    }
+    else {
+        gcache_a0_start(&a0, now);
+        for (i = 0; i < n; i++)
+            if (gcache_a0_visit(&a0, &entries[i], entries[i].created,
+                                entries[i].expiration,
+                                entries[i].last_retrieved))
+                break;
+        victim = gcache_a0_pick(&a0, entries);
+        *expired = a0.expired;
+    }
+    return victim->name;
+}
+
+
+/* test_gcache_policy()
+ * @brief   the shared policies pick the right victim: gcache_a0, as
+ *          evict_one() does, the least-recently retrieved entry once at most
+ *          one was never retrieved, and otherwise the oldest never-retrieved
+ *          one; gcache_lru, the one put or retrieved longest ago. An expired
+ *          entry goes first, under either.
+ */
+int test_gcache_policy()
+{
+    // a, b and c put at 1; b retrieved at 2, c at 3; d put at 4
+    clock_t expires = gcache_expires(1, 10);
+    test_stamps_t entries[4] = { { "a", 1, expires, 0 },
+                                 { "b", 1, expires, 2 },
+                                 { "c", 1, expires, 3 },
+                                 { "d", 4, gcache_expires(4, 10), 0 } };
+    int expired;
+
+    int result = strcmp(test_victim(0, entries, 3, 4, &expired), "b") == 0
+                 && !expired
+                 && strcmp(test_victim(1, entries, 3, 4, &expired), "a") == 0
+                 && !expired;
+    if (!result)
+        fprintf(stderr, "\tERROR: a full cache evicted the wrong entry.\n");
+
+    // with a and d never retrieved, gcache_a0 evicts the older, a
+    if (result && strcmp(test_victim(0, entries, 4, 5, &expired), "a") != 0) {
+        fprintf(stderr, "\tERROR: gcache_a0 kept a never-retrieved entry.\n");
+        result = 0;
+    }
+
+    // a, b and c have expired by 1 + 10 sec; d hasn't
+    if (result && (!gcache_expired(expires, expires)
+                   || gcache_expired(entries[3].expiration, expires)
+                   || strcmp(test_victim(0, entries, 4, expires, &expired),
+                             "a") != 0 || !expired
+                   || strcmp(test_victim(1, entries, 4, expires, &expired),
+                             "a") != 0 || !expired)) {
+        fprintf(stderr, "\tERROR: an expired entry wasn't evicted first.\n");
+        result = 0;
+    }
+
+    // the first expired entry ends the scan, wherever it is
+    entries[2].expiration = 3;
+    if (result && (strcmp(test_victim(1, entries, 4, 5, &expired), "c") != 0
+                   || !expired)) {
+        fprintf(stderr, "\tERROR: an expired entry wasn't evicted first.\n");
+        result = 0;
+    }
+    return result;
+}
+
+
+/* test_l0_epoch()
+ * @brief   a thread's L0 answers a repeated GET without the cache, with
+ *          the same pinned data; once the file changes (and the cache's
+ *          epoch with it), the next GET goes to the cache, for the new data.
+ *          a re-PUT only renews the file, so its L0 slot stays good. ranges
+ *          skip the L0.
+ */
+int test_l0_epoch()
+{
+    char *name = "l0_test.txt";
+    write_buf_into_file(name, (unsigned char *)"first", 5);
+
+    C_T cache = (C_T)create_cache(4);
+    push_back_cache(cache, strdup(name), 600);
+    L0_T l0 = create_l0(8);
+    payload_t *first, *again, *reput, *changed, *part;
+    range_t range = { 1, 3 };
+
+    lookup_l0_cmd(cache, l0, &name, NULL, 1, &first);
+    lookup_l0_cmd(cache, l0, &name, NULL, 1, &again);
+    l0_stats_t warm = take_stats_l0(l0);
+
+    int result = first != NULL && first == again && first->len == 5
+                 && memcmp(first->data, "first", 5) == 0
+                 && warm.hits == 1 && warm.fills == 1;
+    if (!result)
+        fprintf(stderr, "\tERROR: a repeated GET wasn't an L0 hit.\n");
+
+    // PUT it again, with a new max-age, as the sim does
+    uint64_t epoch = epoch_of_cache(cache);
+    lock_cache(cache);
+    cache_file_t renewed = retrieve_file_struct(cache, name);
+    renewed.max_age = 900;
+    update_item_cache(cache, name, renewed);
+    unlock_cache(cache);
+
+    lookup_l0_cmd(cache, l0, &name, NULL, 1, &reput);
+    l0_stats_t kept = take_stats_l0(l0);
+    if (result && (epoch_of_cache(cache) != epoch || reput != first
+                   || kept.hits != 1 || kept.fills != 0)) {
+        fprintf(stderr, "\tERROR: a re-PUT emptied the L0.\n");
+        result = 0;
+    }
+
+    write_buf_into_file(name, (unsigned char *)"second!", 7);
+    lock_cache(cache);
+    expire_item_cache(cache, name);
+    unlock_cache(cache);
+
+    lookup_l0_cmd(cache, l0, &name, NULL, 1, &changed);
+    lookup_l0_cmd(cache, l0, &name, &range, 1, &part);
+    part = unpack_file_cache(part); // a view of the range
+    l0_stats_t after = take_stats_l0(l0);
+
+    if (result && (epoch_of_cache(cache) == epoch || changed == NULL
+                   || changed->len != 7
+                   || memcmp(changed->data, "second!", 7) != 0
+                   || after.stale != 1 || after.hits != 0
+                   || after.fills != 1)) {
+        fprintf(stderr, "\tERROR: a stale L0 slot answered a GET.\n");
+        result = 0;
+    }
+    if (result && (part == NULL || part->len != 3 || part->off != 1
+                   || memcmp(part->data, "eco", 3) != 0)) {
+        fprintf(stderr, "\tERROR: a range GET went wrong.\n");
+        result = 0;
+    }
+
+    release_file_cache(first);
+    release_file_cache(again);
+    release_file_cache(reput);
+    release_file_cache(changed);
+    release_file_cache(part);
+    free_l0(l0);
+    free_cache(cache);
+    delete_file(name);
+    return result;
+}
+
+
+/* test_shm_attach()
+ * @brief   a file put in a shared-memory cache by one process is a hit for
+ *          another that attaches to it, and the other way round; when a
+ *          process dies holding the lock, the next to take it repairs the
+ *          segment, and what was cached survives. a segment whose creator
+ *          died before setting it up is recreated
+ */
+int test_shm_attach()
+{
+    char seg[64];
+    snprintf(seg, sizeof(seg), "/a0_test_%d", (int)getpid());
+    char *ours = "shm_test.txt", *theirs = "shm_test_2.txt";
+    range_t all = { 0, -1 };
+    write_buf_into_file(ours, (unsigned char *)"shared", 6);
+    write_buf_into_file(theirs, (unsigned char *)"from a child", 12);
+
+    SHM_T shm = open_shm(seg, 4, 1);
+    if (shm == NULL) {
+        fprintf(stderr, "\tERROR: couldn't create a segment.\n");
+        delete_file(ours);
+        delete_file(theirs);
+        return 0;
+    }
+    put_shm(shm, ours, 600);
+
+    // a child attaches, GETs our file, and PUTs one of its own
+    int status = -1;
+    pid_t pid = fork();
+    if (pid == 0) {
+        SHM_T child = open_shm(seg, 4, 1);
+        payload_t *got = (child != NULL) ? get_shm(child, ours, all) : NULL;
+        int ok = got != NULL && got->len == 6
+                 && memcmp(got->data, "shared", 6) == 0
+                 && put_shm(child, theirs, 600) == PUT_STORED;
+        _exit(ok ? 0 : 1);
+    }
+    waitpid(pid, &status, 0);
+
+    payload_t *got = get_shm(shm, theirs, (range_t){ 5, 5 });
+    int result = WIFEXITED(status) && WEXITSTATUS(status) == 0
+                 && got != NULL && got->len == 5
+                 && memcmp(got->data, "a chi", 5) == 0
+                 && size_of_shm(shm) == 2;
+    if (!result)
+        fprintf(stderr, "\tERROR: processes didn't share the segment.\n");
+    release_file_cache(got);
+
+    // a child dies with the lock held
+    pid = fork();
+    if (pid == 0) {
+        SHM_T child = open_shm(seg, 4, 1);
+        if (child != NULL)
+            lock_shm(child);
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+
+    got = get_shm(shm, ours, all);
+    shm_stats_t stats = stats_of_shm(shm);
+    if (result && (got == NULL || got->len != 6 || stats.recoveries != 1
+                   || stats.attaches != 3 || size_of_shm(shm) != 2)) {
+        fprintf(stderr, "\tERROR: the segment wasn't recovered.\n");
+        result = 0;
+    }
+    release_file_cache(got);
+
+    // a creator dies after sizing its segment, before setting its magic
+    char dead[64];
+    snprintf(dead, sizeof(dead), "/a0_test_dead_%d", (int)getpid());
+    int fd = shm_open(dead, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd != -1) {
+        if (ftruncate(fd, 1024 * 1024) == -1)
+            fprintf(stderr, "\tERROR: couldn't size a segment.\n");
+        close(fd);
+    }
+
+    SHM_T fresh = open_shm(dead, 4, 1);
+    if (result && (fresh == NULL || put_shm(fresh, ours, 600) != PUT_STORED
+                   || size_of_shm(fresh) != 1)) {
+        fprintf(stderr, "\tERROR: an abandoned segment wasn't recreated.\n");
+        result = 0;
+    }
+    close_shm(fresh);
+    unlink_shm(dead);
+
+    close_shm(shm);
+    unlink_shm(seg);
+    delete_file(ours);
+    delete_file(theirs);
+    return result;
+}
+
+
+/* server_thread()
+ * @brief   runs a cache server on a Unix socket, until it's stopped
+ */
+static void *server_thread(void *arg)
+{
+    sim_opts_t *opts = (sim_opts_t *)arg;
+    run_cache_server(4, opts);
+    return NULL;
+}
+
+
+/* test_server_pipeline()
+ * @brief   pipelined requests sent in one write to a cache server are
+ *          answered in order, with a hit's data streamed after its header
+ */
+int test_server_pipeline()
+{
+    sim_opts_t opts = { 0 };
+    opts.unix_path = "srv_test.sock";
+    pthread_t server;
+    pthread_create(&server, NULL, server_thread, &opts);
+
+    struct sockaddr_un addr = { 0 };
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, opts.unix_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int tries;
+    for (tries = 0; tries < 200; tries++) { // until the server listens
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            break;
+        usleep(10000);
+    }
+
+    unsigned char *data = NULL;
+    int len = read_file_into_buf("test1.txt", &data);
+
+    char *reqs = "PUT: test1.txt\\MAX-AGE: 600\nGET: test1.txt\n"
+                 "GET: nosuch.txt\nnot a command\n";
+    char want[256];
+    int want_len = sprintf(want, "STORED\nOK %d\n", len);
+    memcpy(want + want_len, data, len);
+    want_len += len;
+    want_len += sprintf(want + want_len, "MISS\nERROR\n");
+
+    char got[256];
+    int got_len = 0;
+    ssize_t reqs_len = strlen(reqs);
+    if (tries < 200 && write(fd, reqs, reqs_len) == reqs_len) {
+        shutdown(fd, SHUT_WR);
+        ssize_t n;
+        while (got_len < (int)sizeof(got)
+                && (n = read(fd, got + got_len, sizeof(got) - got_len)) > 0)
+            got_len += n;
+    }
+    close(fd);
+
+    stop_cache_server();
+    pthread_join(server, NULL);
+
+    int result = (got_len == want_len && memcmp(got, want, want_len) == 0);
+    if (!result)
+        fprintf(stderr, "\tERROR: got %d bytes of answers, wanted %d.\n",
+                got_len, want_len);
+
+    free(data);
+    return result;
+}
+
+
+/* http_exchange()
+ * @brief   sends one request to an HTTP server, and reads its response
+ * @param   fd: a connected socket
+ * @param   req: the request
+ * @param   no_body: 1 if the response has no body, whatever it says (HEAD)
+ * @param   head: filled with the response's head, '\0'-terminated (512 B)
+ * @param   body: filled with its body (up to 2 KB)
+ * @returns the body's length, or -1 if the response was cut short
+ */
+static int http_exchange(int fd, char *req, int no_body, char *head,
+                         char *body)
+{
+    int len = 0;
+
+    if (write(fd, req, strlen(req)) != (ssize_t)strlen(req))
+        return -1;
+
+    head[0] = '\0';
+    while (len < 511 && strstr(head, "\r\n\r\n") == NULL) {
+        if (read(fd, head + len, 1) != 1)
+            return -1;
+        head[++len] = '\0';
+    }
+
+    char *cl = strstr(head, "Content-Length: ");
+    int body_len = (cl != NULL && !no_body) ? atoi(cl + 16) : 0;
+    if (body_len > 2048)
+        return -1;
+
+    for (len = 0; len < body_len; ) {
+        ssize_t n = read(fd, body + len, body_len - len);
+        if (n <= 0)
+            return -1;
+        len += n;
+    }
+
+    return body_len;
+}
+
+
+/* test_http_proxy()
+ * @brief   a cache server in proxy mode serves fresh responses from the
+ *          cache, revalidates expired ones with the origin (a 304 renews
+ *          the copy, a 200 replaces it), answers conditional GETs with
+ *          304s, never stores what the origin marks private, and skips
+ *          empty lines before a request
+ */
+int test_http_proxy()
+{
+    STUB_T stub = start_stub_origin("origin_test.sock", 4, 1000, 600, 0);
+    if (stub == NULL)
+        return 0;
+
+    sim_opts_t opts = { 0 };
+    opts.unix_path = "proxy_test.sock";
+    opts.origin = "origin_test.sock";
+    pthread_t server;
+    pthread_create(&server, NULL, server_thread, &opts);
+
+    struct sockaddr_un addr = { 0 };
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, opts.unix_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int tries;
+    for (tries = 0; tries < 200; tries++) { // until the server listens
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            break;
+        usleep(10000);
+    }
+
+    char head[512], body[2048];
+    uint64_t served, not_modified;
+    int result = (tries < 200);
+
+    // a miss, then a hit that never reaches the origin
+    char *get_obj = "GET /obj/1 HTTP/1.1\r\nHost: test\r\n\r\n";
+    result = result && http_exchange(fd, get_obj, 0, head, body) == 1000
+             && strstr(head, "X-Cache: MISS") != NULL
+             && strncmp(body, "obj 1 v0\n", 9) == 0;
+    result = result && http_exchange(fd, get_obj, 0, head, body) == 1000
+             && strstr(head, "X-Cache: HIT") != NULL
+             && served_stub_origin(stub, NULL) == 1;
+
+    // an empty line before a request line is skipped, not a bad request
+    result = result && http_exchange(fd, "\r\nGET /obj/1 HTTP/1.1\r\n"
+                                     "Host: x\r\n\r\n", 0, head,
+                                     body) == 1000
+             && strstr(head, "X-Cache: HIT") != NULL;
+
+    // the client's own copy is current
+    result = result && http_exchange(fd, "GET /obj/1 HTTP/1.1\r\n"
+                                     "If-None-Match: \"1-0\"\r\n\r\n", 0,
+                                     head, body) == 0
+             && strncmp(head, "HTTP/1.1 304", 12) == 0;
+
+    // HEAD gets no body, so the next response follows right after it
+    result = result && http_exchange(fd, "HEAD /obj/1 HTTP/1.1\r\n\r\n", 1,
+                                     head, body) == 0
+             && strstr(head, "Content-Length: 1000") != NULL;
+    result = result && http_exchange(fd, "GET /none HTTP/1.1\r\n\r\n", 0,
+                                     head, body) == 0
+             && strncmp(head, "HTTP/1.1 404", 12) == 0;
+
+    // no-cache: revalidated on every use, until the origin changes it
+    char *get_nocache = "GET /nocache/2 HTTP/1.1\r\n\r\n";
+    result = result && http_exchange(fd, get_nocache, 0, head, body) == 1000
+             && strstr(head, "X-Cache: MISS") != NULL;
+    result = result && http_exchange(fd, get_nocache, 0, head, body) == 1000
+             && strstr(head, "X-Cache: REVALIDATED") != NULL
+             && strncmp(body, "obj 2 v0\n", 9) == 0;
+    served_stub_origin(stub, &not_modified);
+    result = result && not_modified == 1;
+
+    bump_stub_origin(stub, 2);
+    result = result && http_exchange(fd, get_nocache, 0, head, body) == 1000
+             && strstr(head, "X-Cache: MISS") != NULL
+             && strncmp(body, "obj 2 v1\n", 9) == 0;
+
+    // private: fetched every time
+    char *get_private = "GET /private/3 HTTP/1.1\r\n\r\n";
+    served = served_stub_origin(stub, NULL);
+    result = result && http_exchange(fd, get_private, 0, head, body) == 1000
+             && http_exchange(fd, get_private, 0, head, body) == 1000
+             && strstr(head, "X-Cache: MISS") != NULL
+             && served_stub_origin(stub, NULL) == served + 2;
+
+    result = result && http_exchange(fd, "DELETE /obj/1 HTTP/1.1\r\n\r\n", 0,
+                                     head, body) == 0
+             && strncmp(head, "HTTP/1.1 405", 12) == 0;
+
+    if (!result)
+        fprintf(stderr, "\tERROR: last response was:\n%s\n", head);
+
+    close(fd);
+    stop_cache_server();
+    pthread_join(server, NULL);
+    stop_stub_origin(stub);
+
+    return result;
+}
+
+
 /*** FILE UTIL TESTS ***/
 
 
@@ -263,6 +1684,30 @@ int test_extract_command_bads()
 }
 
 
+/* test_parse_command_stale()
+ * @brief   a PUT's optional STALE field is parsed alongside its MAX-AGE
+ */
+int test_parse_command_stale()
+{
+    char *with = "PUT: hello.txt\\MAX-AGE: 60\\STALE: 30";
+    char *without = "PUT: hello.txt\\MAX-AGE: 60";
+    sim_cmd_t cmd;
+
+    parse_command(with, strlen(with), &cmd);
+    int result = cmd.file_name != NULL && strcmp(cmd.file_name, "hello.txt") == 0
+                 && cmd.max_age == 60 && cmd.stale == 30;
+    free(cmd.file_name);
+
+    parse_command(without, strlen(without), &cmd);
+    result = result && cmd.max_age == 60 && cmd.stale == 0;
+    free(cmd.file_name);
+
+    if (!result)
+        fprintf(stderr, "\tERROR: STALE field parsed incorrectly.\n");
+    return result;
+}
+
+
 // uses private member struct, cache_item_t
 // int test_find_in_cache()
 // {
@@ -318,6 +1763,33 @@ int main(int argc, char **argv)
                               // &test_get_substr,
                               &test_read_write_file,
                               &test_extract_command_goods,
+                              &test_tinylfu_estimate,
+                              &test_bloom_add_remove,
+                              &test_negative_cache,
+                              &test_lazy_load,
+                              &test_revalidate_unchanged,
+                              &test_serve_stale,
+                              &test_refresh_ahead,
+                              &test_watch_invalidate,
+                              &test_watch_alias,
+                              &test_fetch_coalesce,
+                              &test_handle_outlives_eviction,
+                              &test_put_get_many,
+                              &test_spsc_order,
+                              &test_partitioned_replay,
+                              &test_stream_sink,
+                              &test_spill_promote,
+                              &test_snapshot_restore,
+                              &test_server_pipeline,
+                              &test_http_proxy,
+                              &test_compress_payload,
+                              &test_chunked_range,
+                              &test_dedup_shared,
+                              &test_direct_read,
+                              &test_gcache_policy,
+                              &test_l0_epoch,
+                              &test_shm_attach,
+                              &test_parse_command_stale,
                               // &test_extract_command_bads
                                     };
 
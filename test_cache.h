@@ -14,10 +14,22 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <limits.h>
+#include <dirent.h>
 
 #include "assert.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
 #include "sim_cache.h"
+#include "server.h"
+#include "stub_origin.h"
 #include "file_sys.h"
+#include "gcache.h"
+#include "shm.h"
 
 /*** TESTING FRAMEWORK **/
 
@@ -38,6 +50,58 @@ int test_find_in_cache();
 
 int test_free_cache_item();
 
+int test_tinylfu_estimate();
+
+int test_bloom_add_remove();
+
+int test_negative_cache();
+
+int test_lazy_load();
+
+int test_revalidate_unchanged();
+
+int test_serve_stale();
+
+int test_refresh_ahead();
+
+int test_watch_invalidate();
+
+int test_watch_alias();
+
+int test_fetch_coalesce();
+
+int test_handle_outlives_eviction();
+
+int test_put_get_many();
+
+int test_spsc_order();
+
+int test_partitioned_replay();
+
+int test_stream_sink();
+
+int test_spill_promote();
+
+int test_snapshot_restore();
+
+int test_server_pipeline();
+
+int test_http_proxy();
+
+int test_compress_payload();
+
+int test_chunked_range();
+
+int test_dedup_shared();
+
+int test_direct_read();
+
+int test_gcache_policy();
+
+int test_l0_epoch();
+
+int test_shm_attach();
+
 /*** FILE UTIL TESTS ***/
 
 int test_read_file_to_buf();
@@ -52,4 +116,6 @@ int test_extract_command_goods();
 
 int test_extract_command_bads();
 
+int test_parse_command_stale();
+
 int test_find_in_cache();
\ No newline at end of file
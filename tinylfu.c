@@ -0,0 +1,252 @@
+/*
+ * TINYLFU.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ */
+
+#include "tinylfu.h"
+#include "hash.h"
+
+#define LFU_DEPTH 4 // rows in the count-min sketch
+#define LFU_MAX_COUNT 15 // counters saturate, like 4-bit counters
+#define LFU_DOOR_HASHES 3 // bits set per key in the doorkeeper
+#define LFU_SAMPLE_FACTOR 10 // age after (factor * width) increments
+
+struct tinylfu_t {
+    uint8_t *counters; // LFU_DEPTH rows of width counters
+    uint64_t *door; // doorkeeper bitset, door_bits bits long
+    uint32_t width; // power of 2
+    uint32_t door_bits; // power of 2
+    uint32_t additions; // increments since the last aging
+    uint32_t sample_size; // additions that trigger an aging
+};
+
+
+/*** STATIC HELPER FUNC DECLARATIONS ***/
+
+// halves every counter and clears the doorkeeper
+static void age_tinylfu(LFU_T lfu);
+
+// returns 1 if all of key's doorkeeper bits are set; sets them if set_bits
+static int door_tinylfu(LFU_T lfu, uint64_t h, int set_bits);
+
+
+/* create_tinylfu()
+ * @brief   initializes a new frequency sketch
+ * @param   width   minimum counters per row; rounded up to a power of 2
+ * @returns a struct tinylfu_t pointer, or NULL if width is invalid
+ */
+LFU_T create_tinylfu(int width)
+{
+    if (width < 1)
+        return NULL;
+
+    uint32_t w = 16;
+    while (w < (uint32_t)width)
+        w <<= 1;
+
+    LFU_T lfu = malloc(sizeof(struct tinylfu_t));
+    lfu->width = w;
+    lfu->door_bits = w * 4;
+    lfu->counters = calloc(LFU_DEPTH * w, sizeof(uint8_t));
+    lfu->door = calloc(lfu->door_bits / 64, sizeof(uint64_t));
+    lfu->additions = 0;
+    lfu->sample_size = LFU_SAMPLE_FACTOR * w;
+
+    return lfu;
+}
+
+
+/* free_tinylfu()
+ * @brief   frees memory associated with a sketch
+ * @param   lfu: a struct tinylfu_t pointer
+ */
+void free_tinylfu(LFU_T lfu)
+{
+    if (lfu == NULL)
+        return;
+
+    free(lfu->counters);
+    free(lfu->door);
+    free(lfu);
+}
+
+
+/* increment_tinylfu()
+ * @brief   records an access to key
+ * @param   lfu: a struct tinylfu_t pointer
+ * @param   key: key that was accessed
+ * @note    a key's first access only sets its doorkeeper bits; later
+ *          accesses bump its sketch counters (conservative update)
+ */
+void increment_tinylfu(LFU_T lfu, char *key)
+{
+    if (lfu == NULL || key == NULL)
+        return;
+
+    uint64_t h = hash_str(key);
+
+    if (door_tinylfu(lfu, h, 1)) {
+        // conservative update: only raise the counters at the minimum
+        int min = LFU_MAX_COUNT;
+        int i;
+        for (i = 0; i < LFU_DEPTH; i++) {
+            uint32_t col = hash_nth(h, i) & (lfu->width - 1);
+            int c = lfu->counters[i * lfu->width + col];
+            if (c < min)
+                min = c;
+        }
+
+        if (min < LFU_MAX_COUNT) {
+            for (i = 0; i < LFU_DEPTH; i++) {
+                uint32_t col = hash_nth(h, i) & (lfu->width - 1);
+                if (lfu->counters[i * lfu->width + col] == min)
+                    lfu->counters[i * lfu->width + col]++;
+            }
+        }
+    }
+
+    lfu->additions++;
+    if (lfu->additions >= lfu->sample_size)
+        age_tinylfu(lfu);
+}
+
+
+/* estimate_tinylfu()
+ * @brief   estimates how often key was accessed in the recent past
+ * @param   lfu: a struct tinylfu_t pointer
+ * @param   key: key to estimate
+ * @returns minimum of key's counters, plus one if the doorkeeper has seen it
+ */
+int estimate_tinylfu(LFU_T lfu, char *key)
+{
+    if (lfu == NULL || key == NULL)
+        return 0;
+
+    uint64_t h = hash_str(key);
+    int min = LFU_MAX_COUNT;
+
+    int i;
+    for (i = 0; i < LFU_DEPTH; i++) {
+        uint32_t col = hash_nth(h, i) & (lfu->width - 1);
+        int c = lfu->counters[i * lfu->width + col];
+        if (c < min)
+            min = c;
+    }
+
+    return min + door_tinylfu(lfu, h, 0);
+}
+
+
+/* size_of_tinylfu()
+ * @brief   returns how many bytes dump_tinylfu() writes for a sketch
+ * @param   lfu: a struct tinylfu_t pointer
+ * @returns size of the sketch's saved state; 0 if lfu is NULL
+ */
+size_t size_of_tinylfu(LFU_T lfu)
+{
+    if (lfu == NULL)
+        return 0;
+
+    return 2 * sizeof(uint32_t) + LFU_DEPTH * lfu->width
+           + (lfu->door_bits / 64) * sizeof(uint64_t);
+}
+
+
+/* dump_tinylfu()
+ * @brief   saves a sketch's state, e.g. into a cache snapshot
+ * @param   lfu: a struct tinylfu_t pointer
+ * @param   buf: at least size_of_tinylfu(lfu) bytes
+ * @note    the state is the width and additions (native byte order), then
+ *          the counters, then the doorkeeper's words
+ */
+void dump_tinylfu(LFU_T lfu, unsigned char *buf)
+{
+    if (lfu == NULL || buf == NULL)
+        return;
+
+    size_t door_len = (lfu->door_bits / 64) * sizeof(uint64_t);
+
+    memcpy(buf, &lfu->width, sizeof(uint32_t));
+    memcpy(buf + sizeof(uint32_t), &lfu->additions, sizeof(uint32_t));
+    buf += 2 * sizeof(uint32_t);
+    memcpy(buf, lfu->counters, LFU_DEPTH * lfu->width);
+    memcpy(buf + LFU_DEPTH * lfu->width, lfu->door, door_len);
+}
+
+
+/* restore_tinylfu()
+ * @brief   replaces a sketch's state with one saved by dump_tinylfu()
+ * @param   lfu: a struct tinylfu_t pointer
+ * @param   buf, len: the saved state
+ * @returns 0, or -1 (leaving lfu as it was) if the state is the wrong
+ *          length, or was saved from a sketch of another width
+ */
+int restore_tinylfu(LFU_T lfu, unsigned char *buf, size_t len)
+{
+    if (lfu == NULL || buf == NULL || len != size_of_tinylfu(lfu))
+        return -1;
+
+    uint32_t width, additions;
+    memcpy(&width, buf, sizeof(uint32_t));
+    memcpy(&additions, buf + sizeof(uint32_t), sizeof(uint32_t));
+    if (width != lfu->width)
+        return -1;
+
+    buf += 2 * sizeof(uint32_t);
+    memcpy(lfu->counters, buf, LFU_DEPTH * lfu->width);
+    memcpy(lfu->door, buf + LFU_DEPTH * lfu->width,
+           (lfu->door_bits / 64) * sizeof(uint64_t));
+    lfu->additions = additions;
+
+    return 0;
+}
+
+
+/*** STATIC HELPER FUNCTIONS ***/
+
+
+/* age_tinylfu()
+ * @brief   halves all counters and resets the doorkeeper, so that the
+ *          sketch reflects recent popularity rather than all-time counts
+ */
+static void age_tinylfu(LFU_T lfu)
+{
+    uint32_t i;
+    for (i = 0; i < LFU_DEPTH * lfu->width; i++)
+        lfu->counters[i] >>= 1;
+
+    memset(lfu->door, 0, (lfu->door_bits / 64) * sizeof(uint64_t));
+    lfu->additions = lfu->additions / 2;
+}
+
+
+/* door_tinylfu()
+ * @brief   checks (and optionally sets) key's bits in the doorkeeper
+ * @param   h           hash of key
+ * @param   set_bits    if nonzero, sets key's bits after checking
+ * @returns 1 if every bit was already set before this call; otherwise 0
+ */
+static int door_tinylfu(LFU_T lfu, uint64_t h, int set_bits)
+{
+    int present = 1;
+
+    int i;
+    for (i = 0; i < LFU_DOOR_HASHES; i++) {
+        // use the other half of the hash than the sketch rows do
+        uint32_t bit = hash_nth((h << 32) | (h >> 32), i)
+                       & (lfu->door_bits - 1);
+        uint64_t mask = 1ULL << (bit % 64);
+
+        if ((lfu->door[bit / 64] & mask) == 0) {
+            present = 0;
+            if (set_bits)
+                lfu->door[bit / 64] |= mask;
+        }
+    }
+
+    return present;
+}
\ No newline at end of file
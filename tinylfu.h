@@ -0,0 +1,45 @@
+/*
+ * TINYLFU.H
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * Frequency estimator for cache admission: a count-min sketch of small
+ * saturating counters, fronted by a "doorkeeper" bloom filter that absorbs
+ * the first access to every key. Counters are halved every sample period,
+ * so old popularity fades out.
+ *
+ */
+
+#ifndef TINYLFU_H
+#define TINYLFU_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct tinylfu_t *LFU_T;
+
+// creates a sketch with (at least) width counters per row
+LFU_T create_tinylfu(int width);
+
+// frees memory associated with a sketch
+void free_tinylfu(LFU_T lfu);
+
+// records one access to key
+void increment_tinylfu(LFU_T lfu, char *key);
+
+// returns estimated number of recent accesses to key
+int estimate_tinylfu(LFU_T lfu, char *key);
+
+// returns bytes needed to save the sketch's state (see dump_tinylfu)
+size_t size_of_tinylfu(LFU_T lfu);
+
+// copies the sketch's state (counters, doorkeeper, width) into buf
+void dump_tinylfu(LFU_T lfu, unsigned char *buf);
+
+// restores state saved by dump_tinylfu; -1 if it's from another width
+int restore_tinylfu(LFU_T lfu, unsigned char *buf, size_t len);
+
+#endif
\ No newline at end of file
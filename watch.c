@@ -0,0 +1,370 @@
+/*
+ * WATCH.C
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/inotify.h>
+
+#include "watch.h"
+#include "hash.h"
+
+#define WATCH_BUCKETS 256 // buckets in the watched-file table
+#define WATCH_BUF_LEN (16 * (sizeof(struct inotify_event) + NAME_MAX + 1))
+
+// events that mean a watched file's contents may have changed, or it's gone
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_MOVED_TO \
+                    | IN_DELETE | IN_MOVED_FROM)
+
+/*** WATCHED DIRECTORY ***/
+// one per inotify watch: a directory reached by several spellings ("." and
+// its absolute path, say) shares one record, under the first spelling seen
+typedef struct watch_dir_t {
+    int wd; // inotify watch descriptor
+    char *dir; // directory path ("." for the current directory)
+    int refs; // watched files in this directory, by any spelling
+    struct watch_dir_t *next;
+} *watch_dir_t;
+
+/*** WATCHED FILE ***/
+// kept in the bucket of its name (not its whole path), so that an event,
+// which gives only a directory's wd and a name, finds every spelling of it
+typedef struct watch_file_t {
+    char *path;
+    char *name; // file name part, within path
+    watch_dir_t dir; // its directory's watch
+    int refs; // times path was added
+    struct watch_file_t *next;
+} *watch_file_t;
+
+struct watcher_t {
+    int fd; // inotify instance
+    watch_dir_t dirs;
+    watch_file_t files[WATCH_BUCKETS];
+
+    char buf[WATCH_BUF_LEN]; // events read, but not yet returned
+    ssize_t buf_len;
+    ssize_t buf_off;
+
+    char **pending; // malloc'd paths the last event matched, not yet
+    int n_pending;  // returned
+    int pending_cap;
+    int pending_kind; // what the event was, for each of them
+
+    char path[PATH_MAX]; // path of the last event returned
+};
+
+
+/*** STATIC HELPER FUNC DECLARATIONS ***/
+
+// splits path into its directory part (written into dir) and returns its
+// file name part
+static char *split_path(char *path, char *dir);
+
+// finds the watched-file record for path; NULL if it isn't watched
+static watch_file_t find_file(W_T watcher, char *path, watch_file_t **link);
+
+// returns the bucket of a file called name
+static uint32_t name_bucket(char *name);
+
+// queues the path of every watched file called name in the directory
+// watched as wd; returns how many were queued
+static int match_event(W_T watcher, int wd, char *name);
+
+
+/* create_watcher()
+ * @brief   initializes a new watcher with its own inotify instance
+ * @returns a struct watcher_t pointer, or NULL if inotify isn't available
+ */
+W_T create_watcher()
+{
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+
+    W_T w = calloc(1, sizeof(struct watcher_t));
+    w->fd = fd;
+    return w;
+}
+
+
+/* free_watcher()
+ * @brief   closes a watcher's inotify instance and frees its records
+ * @param   watcher: a struct watcher_t pointer
+ */
+void free_watcher(W_T watcher)
+{
+    if (watcher == NULL)
+        return;
+
+    close(watcher->fd); // drops every watch with it
+
+    while (watcher->dirs != NULL) {
+        watch_dir_t d = watcher->dirs;
+        watcher->dirs = d->next;
+        free(d->dir);
+        free(d);
+    }
+
+    int i;
+    for (i = 0; i < WATCH_BUCKETS; i++) {
+        while (watcher->files[i] != NULL) {
+            watch_file_t f = watcher->files[i];
+            watcher->files[i] = f->next;
+            free(f->path);
+            free(f);
+        }
+    }
+
+    while (watcher->n_pending > 0)
+        free(watcher->pending[--watcher->n_pending]);
+    free(watcher->pending);
+    free(watcher);
+}
+
+
+/* add_watcher()
+ * @brief   starts reporting changes to path
+ * @param   watcher: a struct watcher_t pointer
+ * @param   path: path of file to watch; copied
+ * @returns 0 on success; -1 if its directory can't be watched
+ * @note    paths may be added more than once; each add needs a remove
+ */
+int add_watcher(W_T watcher, char *path)
+{
+    if (watcher == NULL || path == NULL || strlen(path) >= PATH_MAX)
+        return -1;
+
+    watch_file_t f = find_file(watcher, path, NULL);
+    if (f != NULL) {
+        f->refs++;
+        return 0;
+    }
+
+    char dir[PATH_MAX];
+    char *name = split_path(path, dir);
+
+    watch_dir_t d = watcher->dirs;
+    while (d != NULL && strcmp(d->dir, dir) != 0)
+        d = d->next;
+
+    if (d == NULL) {
+        int wd = inotify_add_watch(watcher->fd, dir, WATCH_MASK);
+        if (wd == -1)
+            return -1;
+
+        // the same directory may be reached by another spelling, in which
+        // case inotify hands back its watch
+        for (d = watcher->dirs; d != NULL && d->wd != wd; d = d->next)
+            ;
+
+        if (d == NULL) {
+            d = malloc(sizeof(struct watch_dir_t));
+            d->wd = wd;
+            d->dir = strdup(dir);
+            d->refs = 0;
+            d->next = watcher->dirs;
+            watcher->dirs = d;
+        }
+    }
+    d->refs++;
+
+    uint32_t b = name_bucket(name);
+    f = malloc(sizeof(struct watch_file_t));
+    f->path = strdup(path);
+    f->name = f->path + (name - path);
+    f->dir = d;
+    f->refs = 1;
+    f->next = watcher->files[b];
+    watcher->files[b] = f;
+
+    return 0;
+}
+
+
+/* remove_watcher()
+ * @brief   stops reporting changes to path, once every add of it has been
+ *          matched by a remove; unwatches its directory when it's unused
+ * @param   watcher: a struct watcher_t pointer
+ * @param   path: path of file to stop watching
+ */
+void remove_watcher(W_T watcher, char *path)
+{
+    if (watcher == NULL || path == NULL)
+        return;
+
+    watch_file_t *link = NULL;
+    watch_file_t f = find_file(watcher, path, &link);
+    if (f == NULL || --f->refs > 0)
+        return;
+
+    watch_dir_t d = f->dir; // by whichever spelling it was added
+    *link = f->next;
+    free(f->path);
+    free(f);
+
+    if (--d->refs > 0)
+        return;
+
+    watch_dir_t *dlink = &watcher->dirs;
+    while (*dlink != d)
+        dlink = &(*dlink)->next;
+    *dlink = d->next;
+
+    inotify_rm_watch(watcher->fd, d->wd);
+    free(d->dir);
+    free(d);
+}
+
+
+/* poll_watcher()
+ * @brief   returns the next change to a watched file, without blocking
+ * @param   watcher: a struct watcher_t pointer
+ * @param   path: set to the changed file's path, owned by the watcher and
+ *          valid until the next poll; NULL for WATCH_OVERFLOW
+ * @returns WATCH_CHANGED, WATCH_GONE or WATCH_OVERFLOW; 0 if there are no
+ *          more events right now
+ * @note    a file added under several spellings is reported once for each
+ *          spelling, an event apiece, in turn
+ */
+int poll_watcher(W_T watcher, char **path)
+{
+    if (watcher == NULL)
+        return 0;
+
+    while (1) {
+        if (watcher->n_pending > 0) {
+            char *next = watcher->pending[--watcher->n_pending];
+            snprintf(watcher->path, PATH_MAX, "%s", next);
+            free(next);
+            *path = watcher->path;
+            return watcher->pending_kind;
+        }
+
+        if (watcher->buf_off >= watcher->buf_len) {
+            watcher->buf_off = 0;
+            watcher->buf_len = read(watcher->fd, watcher->buf, WATCH_BUF_LEN);
+            if (watcher->buf_len <= 0) {
+                watcher->buf_len = 0;
+                return 0; // EAGAIN: nothing pending
+            }
+        }
+
+        struct inotify_event *ev =
+            (struct inotify_event *)(watcher->buf + watcher->buf_off);
+        watcher->buf_off += sizeof(struct inotify_event) + ev->len;
+
+        if (ev->mask & IN_Q_OVERFLOW) {
+            *path = NULL;
+            return WATCH_OVERFLOW;
+        }
+
+        if (ev->len == 0 || (ev->mask & WATCH_MASK) == 0)
+            continue; // events on the directory itself, IN_IGNORED, ...
+
+        // none matched: some other file in a watched directory
+        if (match_event(watcher, ev->wd, ev->name) == 0)
+            continue;
+
+        watcher->pending_kind = (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+                                ? WATCH_GONE : WATCH_CHANGED;
+    }
+}
+
+
+/*** STATIC HELPER FUNCTIONS ***/
+
+
+/* split_path()
+ * @brief   splits "a/b/c.txt" into directory "a/b" and name "c.txt"
+ * @param   path: path to split
+ * @param   dir: buffer of at least PATH_MAX bytes, for the directory
+ * @returns pointer to the name part, within path
+ * @note    a bare name is in directory "."; "/c.txt" is in "/"
+ */
+static char *split_path(char *path, char *dir)
+{
+    char *slash = strrchr(path, '/');
+
+    if (slash == NULL) {
+        strcpy(dir, ".");
+        return path;
+    }
+
+    if (slash == path) {
+        strcpy(dir, "/");
+    }
+    else {
+        memcpy(dir, path, slash - path);
+        dir[slash - path] = '\0';
+    }
+
+    return slash + 1;
+}
+
+
+/* find_file()
+ * @brief   looks up path's watched-file record
+ * @param   link: if non-NULL, set to the pointer that points at the record
+ * @returns the record, or NULL if path isn't watched
+ */
+static watch_file_t find_file(W_T watcher, char *path, watch_file_t **link)
+{
+    char *slash = strrchr(path, '/');
+    uint32_t b = name_bucket((slash != NULL) ? slash + 1 : path);
+    watch_file_t *l = &watcher->files[b];
+
+    while (*l != NULL) {
+        if (strcmp((*l)->path, path) == 0) {
+            if (link != NULL)
+                *link = l;
+            return *l;
+        }
+        l = &(*l)->next;
+    }
+
+    return NULL;
+}
+
+
+/* name_bucket()
+ * @brief   returns the bucket of the watched-file table a file called name
+ *          goes in, whatever directory it's in
+ */
+static uint32_t name_bucket(char *name)
+{
+    return hash_str(name) % WATCH_BUCKETS;
+}
+
+
+/* match_event()
+ * @brief   queues, for poll_watcher() to return, the path of every watched
+ *          file called name in the directory watched as wd, whatever
+ *          spelling of the directory it was added by
+ * @returns number of paths queued
+ */
+static int match_event(W_T watcher, int wd, char *name)
+{
+    watch_file_t f;
+
+    for (f = watcher->files[name_bucket(name)]; f != NULL; f = f->next) {
+        if (f->dir->wd != wd || strcmp(f->name, name) != 0)
+            continue;
+
+        if (watcher->n_pending == watcher->pending_cap) {
+            watcher->pending_cap = (watcher->pending_cap > 0)
+                                   ? 2 * watcher->pending_cap : 4;
+            watcher->pending = realloc(watcher->pending,
+                                       watcher->pending_cap * sizeof(char *));
+        }
+        watcher->pending[watcher->n_pending++] = strdup(f->path);
+    }
+
+    return watcher->n_pending;
+}
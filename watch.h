@@ -0,0 +1,43 @@
+/*
+ * WATCH.H
+ * A0
+ *
+ * @author Skylar Gilfeather
+ * @date CS112, Fall 2022
+ *
+ * inotify watcher for cached source files. Watches are kept per directory
+ * (reference counted by the number of watched files in it), and events are
+ * polled without blocking, then filtered down to the watched files.
+ *
+ */
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef struct watcher_t *W_T;
+
+// kinds of change a watcher reports
+#define WATCH_CHANGED 1 // file was written, created, touched or moved in
+#define WATCH_GONE 2 // file was deleted or moved away
+#define WATCH_OVERFLOW 3 // events were dropped; anything may have changed
+
+// creates a watcher; returns NULL if inotify isn't available
+W_T create_watcher();
+
+// frees a watcher and all of its watches
+void free_watcher(W_T watcher);
+
+// starts watching path (by watching its directory); returns 0 on success
+int add_watcher(W_T watcher, char *path);
+
+// stops watching path
+void remove_watcher(W_T watcher, char *path);
+
+// returns the next event for a watched path, without blocking, or 0
+int poll_watcher(W_T watcher, char **path);
+
+#endif
\ No newline at end of file